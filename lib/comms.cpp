@@ -5,10 +5,30 @@
 #include "encode.h"
 #include "procs.h"
 #include "timing.h"
+#include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 
 namespace Comms{
+  /// Allocation state of a comms page, kept in the first cache line of the page, in front of the
+  /// records. Released records form a stack through their "next" field, of which freeHead holds
+  /// the top. Records that were never handed out are all at the end, starting at record number
+  /// used. Once all capacity records are handed out, the page grows. The creator of the page sets
+  /// magic last, once the records structure behind it is ready.
+  struct Comms::pageControl{
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t freeHead; ///< Change count in the high 32 bits, first free record + 1 (or 0) in the low 32
+    uint64_t used;     ///< Amount of records handed out at least once
+    uint64_t capacity; ///< Amount of records the page has room for
+  };
+
+  static const uint32_t controlMagic = 0x4D43544Cul; // "MCTL"
+
+  /// Bytes in front of the records structure
+  static const size_t controlSize = 64;
+
   Comms::Comms(){
     index = INVALID_RECORD_INDEX;
     currentSize = 0;
@@ -32,20 +52,103 @@ namespace Comms{
   void Comms::addFields(){
     dataAccX.addField("status", RAX_UINT);
     dataAccX.addField("pid", RAX_64UINT);
+    dataAccX.addField("alive", RAX_64UINT);
+    dataAccX.addField("next", RAX_32UINT);
   }
 
   void Comms::nullFields(){
     setPid(getpid());
+    keepAlive();
   }
 
   void Comms::fieldAccess(){
     status = dataAccX.getFieldAccX("status");
     pid = dataAccX.getFieldAccX("pid");
+    alive = dataAccX.getFieldAccX("alive");
+    next = dataAccX.getFieldAccX("next");
+  }
+
+  /// Returns the allocation state of the page, or null if the page is not ready yet.
+  Comms::pageControl *Comms::control() const{
+    if (!dataPage.mapped || dataPage.len < controlSize){return 0;}
+    pageControl *C = (pageControl *)dataPage.mapped;
+    return (C->magic == controlMagic) ? C : 0;
   }
 
+  /// Returns the amount of records in use. For the master, this is the amount of records that were
+  /// ever handed out, so unused parts of the page are never looped over. Records of a page that
+  /// grew are counted once they are mapped, see remapIfGrown.
   size_t Comms::recordCount() const{
     if (!master){return index + 1;}
-    return dataAccX.getRCount();
+    pageControl *C = control();
+    if (!C){return 0;}
+    size_t mappedCount = mappedRecords();
+    return (C->used < mappedCount) ? C->used : mappedCount;
+  }
+
+  /// Returns the amount of records this process has mapped.
+  size_t Comms::mappedRecords() const{
+    if (!dataAccX.getRSize()){return 0;}
+    size_t start = controlSize + dataAccX.getOffset();
+    if (dataPage.len < start){return 0;}
+    size_t mappedCount = (dataPage.len - start) / dataAccX.getRSize();
+    return (mappedCount < dataAccX.getRCount()) ? mappedCount : dataAccX.getRCount();
+  }
+
+  /// Maps the page again, including any records added since it was mapped.
+  /// Returns false if the page is gone.
+  bool Comms::remap(){
+    std::string name = dataPage.name;
+    // Reopening must not unlink the page
+    bool wasMaster = dataPage.master;
+    dataPage.master = false;
+    dataPage.init(name, 0, false, false);
+    dataPage.master = wasMaster;
+    if (!control()){
+      FAIL_MSG("Could not map page %s again", name.c_str());
+      dataPage.close();
+      return false;
+    }
+    dataAccX = Util::RelAccX(dataPage.mapped + controlSize);
+    fieldAccess();
+    return true;
+  }
+
+  /// Maps the records other processes added to the page since it was mapped, if any.
+  /// Called by COMM_LOOP before every pass.
+  void Comms::remapIfGrown(){
+    pageControl *C = control();
+    if (C && C->used > mappedRecords()){remap();}
+  }
+
+  /// Grows the page to twice the given capacity, unless another process already grew it.
+  /// Returns false if the page could not grow.
+  bool Comms::grow(uint64_t capacity){
+#if defined(__CYGWIN__) || defined(_WIN32)
+    return false;
+#else
+    {
+      IPC::semGuard G(&sem);
+      pageControl *C = control();
+      if (C->capacity == capacity){
+        // Record numbers are stored as 32 bits numbers plus one
+        uint64_t newCapacity = capacity * 2;
+        if (newCapacity > 0xFFFFFFFEull){newCapacity = 0xFFFFFFFEull;}
+        if (newCapacity <= capacity){return false;}
+        uint64_t newLen = controlSize + dataAccX.getOffset() + newCapacity * dataAccX.getRSize();
+        if (ftruncate(dataPage.handle, newLen) < 0){
+          FAIL_MSG("Could not grow page %s to %" PRIu64 " bytes: %s", dataPage.name.c_str(), newLen, strerror(errno));
+          return false;
+        }
+        dataAccX.setRCount(newCapacity);
+        dataAccX.setPresent(newCapacity);
+        __sync_synchronize();
+        C->capacity = newCapacity;
+        INFO_MSG("Grew page %s to %" PRIu64 " records", dataPage.name.c_str(), newCapacity);
+      }
+    }
+    return remap();
+#endif
   }
 
   uint8_t Comms::getStatus() const{return status.uint(index);}
@@ -64,6 +167,93 @@ namespace Comms{
     pid.set(_pid, idx);
   }
 
+  /// Marks the own record as in use right now, so the master does not need to check on our pid.
+  void Comms::keepAlive(){
+    if (index == INVALID_RECORD_INDEX){return;}
+    alive.set(Util::bootSecs(), index);
+  }
+
+  /// Returns whether the process owning record idx is still around, master only.
+  /// Only checks the pid if the record was not kept alive in the last COMM_ALIVE_TIMEOUT seconds
+  /// before now, and then counts a running pid as a keepAlive.
+  bool Comms::isAlive(size_t idx, uint64_t now){
+    if (!master){return true;}
+    if (alive.uint(idx) + COMM_ALIVE_TIMEOUT > now){return true;}
+    if (!Util::Procs::isRunning(getPid(idx))){return false;}
+    alive.set(now, idx);
+    return true;
+  }
+
+  /// Sets record idx to COMM_STATUS_INVALID and makes it available again, master only.
+  void Comms::releaseRecord(size_t idx){
+    if (!master){return;}
+    // Only the one who changes the status to invalid may put the record on the free list
+    volatile uint8_t *S = (volatile uint8_t *)status.ptr(idx);
+    uint8_t oldStatus;
+    do{
+      oldStatus = *S;
+      if (oldStatus == COMM_STATUS_INVALID){return;}
+    }while (!__sync_bool_compare_and_swap(S, oldStatus, COMM_STATUS_INVALID));
+    pageControl *C = control();
+    uint64_t head, newHead;
+    do{
+      head = C->freeHead;
+      next.set((uint32_t)head, idx);
+      newHead = (((head >> 32) + 1) << 32) | (idx + 1);
+    }while (!__sync_bool_compare_and_swap(&C->freeHead, head, newHead));
+  }
+
+  /// Takes a record off the free list, or else one that was never handed out yet, growing the
+  /// page if all records are in use. Maps the page again if the record is beyond our mapping.
+  /// The record is marked COMM_STATUS_CLAIMED by this process right away, so the master releases
+  /// it again if this process dies before activating it.
+  /// Returns INVALID_RECORD_INDEX if the page is full and cannot grow.
+  uint64_t Comms::claimRecord(){
+    uint32_t myPid = getpid();
+    while (true){
+      pageControl *C = control();
+      uint64_t head = C->freeHead;
+      while ((uint32_t)head){
+        uint32_t idx = (uint32_t)head - 1;
+        if (idx >= mappedRecords()){
+          if (!remap()){return INVALID_RECORD_INDEX;}
+          C = control();
+        }
+        // If idx was taken and put back in the meantime, the change count makes this fail
+        uint64_t newHead = (((head >> 32) + 1) << 32) | (uint32_t)next.uint(idx);
+        if (__sync_bool_compare_and_swap(&C->freeHead, head, newHead)){
+          markClaimed(idx, myPid);
+          return idx;
+        }
+        head = C->freeHead;
+      }
+      uint64_t capacity = C->capacity;
+      // Map all records first, so nothing but the claim itself happens once we own one
+      if (capacity > mappedRecords()){
+        if (!remap()){return INVALID_RECORD_INDEX;}
+        C = control();
+      }
+      uint64_t used = C->used;
+      while (used < capacity){
+        if (__sync_bool_compare_and_swap(&C->used, used, used + 1)){
+          markClaimed(used, myPid);
+          return used;
+        }
+        used = C->used;
+      }
+      if (!grow(capacity)){return INVALID_RECORD_INDEX;}
+    }
+  }
+
+  /// Marks a record that was just taken as claimed by the given pid, which is written first so the
+  /// master never checks the pid of the previous owner.
+  void Comms::markClaimed(size_t idx, uint32_t owner){
+    pid.set(owner, idx);
+    alive.set(Util::bootSecs(), idx);
+    __sync_synchronize();
+    status.set(COMM_STATUS_CLAIMED, idx);
+  }
+
   void Comms::finishAll(){
     if (!master){return;}
     size_t c = 0;
@@ -101,17 +291,22 @@ namespace Comms{
       dataPage.init(prefix, currentSize, false, false);
       if (dataPage){
         dataPage.master = true;
-        dataAccX = Util::RelAccX(dataPage.mapped);
-        fieldAccess();
+        mapRecords();
       }else{
         dataPage.init(prefix, currentSize, true);
-        dataAccX = Util::RelAccX(dataPage.mapped, false);
+        // The allocation state goes first, so clients know where the records are
+        pageControl *C = (pageControl *)dataPage.mapped;
+        memset((void *)C, 0, sizeof(pageControl));
+        dataAccX = Util::RelAccX(dataPage.mapped + controlSize, false);
         addFields();
-        fieldAccess();
-        size_t reqCount = (currentSize - dataAccX.getOffset()) / dataAccX.getRSize();
+        size_t reqCount = (dataPage.len - controlSize - dataAccX.getOffset()) / dataAccX.getRSize();
+        C->capacity = reqCount;
         dataAccX.setRCount(reqCount);
         dataAccX.setPresent(reqCount);
         dataAccX.setReady();
+        __sync_synchronize();
+        C->magic = controlMagic;
+        fieldAccess();
       }
       return;
     }
@@ -121,26 +316,28 @@ namespace Comms{
       WARN_MSG("Unable to open page %s", prefix.c_str());
       return;
     }
-    dataAccX = Util::RelAccX(dataPage.mapped);
-    fieldAccess();
+    mapRecords();
     if (index == INVALID_RECORD_INDEX || reIssue){
-      size_t reqCount = dataAccX.getRCount();
-      for (index = 0; index < reqCount; ++index){
-        if (getStatus() == COMM_STATUS_INVALID){
-          IPC::semGuard G(&sem);
-          if (getStatus() != COMM_STATUS_INVALID){continue;}
-          nullFields();
-          setStatus(COMM_STATUS_ACTIVE);
-          break;
-        }
-      }
-      if (index >= reqCount){
+      index = claimRecord();
+      if (index == INVALID_RECORD_INDEX){
         FAIL_MSG("Could not register entry on comm page!");
         dataPage.close();
+        return;
       }
+      nullFields();
+      __sync_synchronize();
+      setStatus(COMM_STATUS_ACTIVE);
     }
   }
 
+  /// Points dataAccX and the field accessors at the records of a page that was just opened, once
+  /// its creator made it ready.
+  void Comms::mapRecords(){
+    while (!control()){Util::sleep(50);}
+    dataAccX = Util::RelAccX(dataPage.mapped + controlSize);
+    fieldAccess();
+  }
+
   Statistics::Statistics() : Comms(){sem.open(SEM_STATISTICS, O_CREAT | O_RDWR, ACCESSPERMS, 1);}
 
   void Statistics::unload(){
@@ -1,27 +1,37 @@
 #pragma once
 #include "procs.h"
 #include "shared_memory.h"
+#include "timing.h"
 #include "util.h"
 
 #define COMM_STATUS_SOURCE 0x80
 #define COMM_STATUS_DONOTTRACK 0x40
 #define COMM_STATUS_DISCONNECT 0x20
 #define COMM_STATUS_REQDISCONNECT 0x10
+#define COMM_STATUS_CLAIMED 0x2
 #define COMM_STATUS_ACTIVE 0x1
 #define COMM_STATUS_INVALID 0x0
 
+/// Seconds without a keepAlive after which a record's process is checked for still running
+#define COMM_ALIVE_TIMEOUT 5
 
 #define COMM_LOOP(comm, onActive, onDisconnect) \
   {\
+    uint64_t commNow = Util::bootSecs();\
+    comm.remapIfGrown();\
     for (size_t id = 0; id < comm.recordCount(); id++){\
       if (comm.getStatus(id) == COMM_STATUS_INVALID){continue;}\
-      if (!Util::Procs::isRunning(comm.getPid(id))){\
+      if (comm.getStatus(id) == COMM_STATUS_CLAIMED){\
+        if (!comm.isAlive(id, commNow)){comm.releaseRecord(id);}\
+        continue;\
+      }\
+      if (!comm.isAlive(id, commNow)){\
         comm.setStatus(COMM_STATUS_DISCONNECT | comm.getStatus(id), id);\
       }\
       onActive;\
       if (comm.getStatus(id) & COMM_STATUS_DISCONNECT){\
         onDisconnect;\
-        comm.setStatus(COMM_STATUS_INVALID, id);\
+        comm.releaseRecord(id);\
       }\
     }\
   }
@@ -49,11 +59,23 @@ namespace Comms{
     uint32_t getPid(size_t idx) const;
     void setPid(uint32_t _pid);
     void setPid(uint32_t _pid, size_t idx);
+    void keepAlive();
+    bool isAlive(size_t idx, uint64_t now);
+    void releaseRecord(size_t idx);
+    void remapIfGrown();
     void finishAll();
     void setMaster(bool _master);
     const std::string &pageName() const{return dataPage.name;}
 
   protected:
+    struct pageControl;
+    pageControl *control() const;
+    size_t mappedRecords() const;
+    void mapRecords();
+    bool remap();
+    bool grow(uint64_t capacity);
+    uint64_t claimRecord();
+    void markClaimed(size_t idx, uint32_t owner);
     bool master;
     uint64_t index;
     size_t currentSize;
@@ -62,6 +84,8 @@ namespace Comms{
     Util::RelAccX dataAccX;
     Util::FieldAccX status;
     Util::FieldAccX pid;
+    Util::FieldAccX alive;
+    Util::FieldAccX next;
   };
 
   class Statistics : public Comms{
@@ -28,6 +28,7 @@
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <poll.h>
 #include <pwd.h>
 #include <signal.h>
 #include <string.h>
@@ -38,10 +39,12 @@
 
 bool Util::Config::is_active = false;
 bool Util::Config::is_restarting = false;
+bool Util::Config::is_multi = false;
 static Socket::Server *serv_sock_pointer = 0;
 uint32_t Util::printDebugLevel = DEBUG;
 __thread char Util::streamName[256] = {0};
 __thread char Util::exitReason[256] ={0};
+char Util::shutdownReason[256] ={0};
 
 
 void Util::setStreamName(const std::string & sn){
@@ -303,6 +306,13 @@ bool Util::Config::parseArgs(int &argc, char **&argv){
     }
   }
 
+  // getopt keeps its position in globals; start over in case arguments were parsed before
+#if defined(__FreeBSD__) || defined(__APPLE__) || defined(__MACH__)
+  optreset = 1;
+  optind = 1;
+#else
+  optind = 0;
+#endif
   while ((opt = getopt_long(argc, argv, shortopts.c_str(), longOpts, 0)) != -1){
     switch (opt){
     case 'h':
@@ -441,6 +451,39 @@ struct callbackData{
   int (*cb)(Socket::Connection &);
 };
 
+/// Accepts connections on the server socket until the config is no longer active or the socket
+/// closes, and hands every connection to onConnection along with the callback. New connections are
+/// waited for with poll(), so they are picked up as soon as they arrive. While full (if given)
+/// returns true, waiting connections are left in the listen queue of the socket.
+/// The loop ends early if onConnection returns anything but -1, and then returns that value.
+static int acceptLoop(Socket::Server &server_socket, int (*callback)(Socket::Connection &),
+                      int (*onConnection)(Socket::Server &, Socket::Connection &, int (*)(Socket::Connection &)),
+                      bool (*full)() = 0){
+  Util::Procs::socketList.insert(server_socket.getSocket());
+  server_socket.setBlocking(false);
+  while (Util::Config::is_active && server_socket.connected()){
+    if (full && full()){
+      Util::sleep(10);
+      continue;
+    }
+    struct pollfd pfd;
+    pfd.fd = server_socket.getSocket();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    // Time out once per second so is_active changes are picked up
+    if (poll(&pfd, 1, 1000) < 1){continue;}
+    // Accept everything that is waiting, then go back to polling
+    while (Util::Config::is_active && server_socket.connected() && !(full && full())){
+      Socket::Connection S = server_socket.accept();
+      if (!S.connected()){break;}
+      int r = onConnection(server_socket, S, callback);
+      if (r != -1){return r;}
+    }
+  }
+  Util::Procs::socketList.erase(server_socket.getSocket());
+  return -1;
+}
+
 static void callThreadCallback(void *cDataArg){
   INSANE_MSG("Thread for %p started", cDataArg);
   callbackData *cData = (callbackData *)cDataArg;
@@ -451,52 +494,109 @@ static void callThreadCallback(void *cDataArg){
   INSANE_MSG("Thread for %p ended", cDataArg);
 }
 
+static int threadConnection(Socket::Server &server_socket, Socket::Connection &S, int (*callback)(Socket::Connection &)){
+  callbackData *cData = new callbackData;
+  cData->sock = new Socket::Connection(S);
+  cData->cb = callback;
+  // spawn a new thread for this connection
+  tthread::thread T(callThreadCallback, (void *)cData);
+  // detach it, no need to keep track of it anymore
+  T.detach();
+  HIGH_MSG("Spawned new thread for socket %i", S.getSocket());
+  return -1;
+}
+
 int Util::Config::threadServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &)){
-  Util::Procs::socketList.insert(server_socket.getSocket());
-  while (is_active && server_socket.connected()){
-    Socket::Connection S = server_socket.accept();
-    if (S.connected()){// check if the new connection is valid
-      callbackData *cData = new callbackData;
-      cData->sock = new Socket::Connection(S);
-      cData->cb = callback;
-      // spawn a new thread for this connection
-      tthread::thread T(callThreadCallback, (void *)cData);
-      // detach it, no need to keep track of it anymore
-      T.detach();
-      HIGH_MSG("Spawned new thread for socket %i", S.getSocket());
-    }else{
-      Util::sleep(10); // sleep 10ms
-    }
-  }
-  Util::Procs::socketList.erase(server_socket.getSocket());
+  acceptLoop(server_socket, callback, threadConnection);
   server_socket.close();
   return 0;
 }
 
+static int forkConnection(Socket::Server &server_socket, Socket::Connection &S, int (*callback)(Socket::Connection &)){
+  pid_t myid = fork();
+  if (myid == 0){// if new child, start MAINHANDLER
+    server_socket.drop();
+    return callback(S);
+  }
+  // otherwise, do nothing or output debugging text
+  HIGH_MSG("Forked new process %i for socket %i", (int)myid, S.getSocket());
+  S.drop();
+  return -1;
+}
+
 int Util::Config::forkServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &)){
-  Util::Procs::socketList.insert(server_socket.getSocket());
-  while (is_active && server_socket.connected()){
-    Socket::Connection S = server_socket.accept();
-    if (S.connected()){// check if the new connection is valid
-      pid_t myid = fork();
-      if (myid == 0){// if new child, start MAINHANDLER
-        server_socket.drop();
-        return callback(S);
-      }else{// otherwise, do nothing or output debugging text
-        HIGH_MSG("Forked new process %i for socket %i", (int)myid, S.getSocket());
-        S.drop();
-      }
-    }else{
-      Util::sleep(10); // sleep 10ms
-    }
+  int r = acceptLoop(server_socket, callback, forkConnection);
+  if (r != -1){return r;}
+  if (!is_restarting){server_socket.close();}
+  return 0;
+}
+
+static volatile uint32_t multiConns = 0; ///< Connections multiServer threads are handling right now
+static uint32_t multiMax = 0;            ///< Most connections multiServer handles at once
+static uint32_t multiPeak = 0;           ///< Most connections multiServer handled at once so far
+static uint64_t multiServed = 0;         ///< Connections multiServer handled in total
+
+static void callMultiCallback(void *cDataArg){
+  callbackData *cData = (callbackData *)cDataArg;
+  uint64_t startTime = Util::bootMS();
+  cData->cb(*(cData->sock));
+  cData->sock->close();
+  HIGH_MSG("Connection %p ended after %" PRIu64 "ms, %" PRIu32 " left", cDataArg, Util::bootMS() - startTime,
+           multiConns - 1);
+  delete cData->sock;
+  delete cData;
+  __sync_sub_and_fetch(&multiConns, 1);
+}
+
+/// Returns true if multiServer runs as many connections as it may, logging it when that starts.
+static bool multiFull(){
+  static bool wasFull = false;
+  bool isFull = multiConns >= multiMax;
+  if (isFull && !wasFull){
+    WARN_MSG("Serving the maximum of %" PRIu32 " connections, new connections wait until one ends", multiMax);
   }
-  Util::Procs::socketList.erase(server_socket.getSocket());
+  wasFull = isFull;
+  return isFull;
+}
+
+static int multiConnection(Socket::Server &server_socket, Socket::Connection &S, int (*callback)(Socket::Connection &)){
+  // Children forked to exec other binaries must not inherit the sockets of other connections
+  fcntl(S.getSocket(), F_SETFD, FD_CLOEXEC);
+  callbackData *cData = new callbackData;
+  cData->sock = new Socket::Connection(S);
+  cData->cb = callback;
+  uint32_t curConns = __sync_add_and_fetch(&multiConns, 1);
+  if (curConns > multiPeak){multiPeak = curConns;}
+  ++multiServed;
+  tthread::thread T(callMultiCallback, (void *)cData);
+  T.detach();
+  HIGH_MSG("Started thread for socket %i, now serving %" PRIu32 " connections", S.getSocket(), curConns);
+  return -1;
+}
+
+/// Serves up to maxConns connections at once from a single process, instead of forking for every
+/// connection. Every connection runs its callback in its own thread, keeping all per-connection
+/// state separate while sharing the process, its memory mappings and its page tables. Once
+/// maxConns connections are running, further connections wait in the listen queue until one ends.
+/// On shutdown, waits up to five seconds for running connections to finish.
+int Util::Config::multiServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &), uint32_t maxConns){
+  is_multi = true;
+  multiMax = maxConns ? maxConns : 1;
+  fcntl(server_socket.getSocket(), F_SETFD, FD_CLOEXEC);
+  acceptLoop(server_socket, callback, multiConnection, multiFull);
   if (!is_restarting){server_socket.close();}
+  uint64_t waitStart = Util::bootMS();
+  while (multiConns && Util::bootMS() < waitStart + 5000){Util::sleep(50);}
+  INFO_MSG("Served %" PRIu64 " connections from a single process, peak of %" PRIu32
+           " concurrent, %" PRIu32 " still active on exit",
+           multiServed, multiPeak, (uint32_t)multiConns);
   return 0;
 }
 
-int Util::Config::serveThreadedSocket(int (*callback)(Socket::Connection &)){
-  Socket::Server server_socket;
+/// Opens the listening socket for the serve*Socket functions: the socket passed on stdin, or else
+/// the configured UNIX socket or TCP port. Activates the config and moves the socket to stdin, so
+/// it survives a restart. Returns false if there is no socket to listen on.
+bool Util::Config::openServerSocket(Socket::Server &server_socket){
   if (Socket::checkTrueSocket(0)){
     server_socket = Socket::Server(0);
   }else if (vals.isMember("socket")){
@@ -506,7 +606,7 @@ int Util::Config::serveThreadedSocket(int (*callback)(Socket::Connection &)){
   }
   if (!server_socket.connected()){
     DEVEL_MSG("Failure to open socket");
-    return 1;
+    return false;
   }
   Socket::getSocketName(server_socket.getSocket(), Util::listenInterface, Util::listenPort);
   serv_sock_pointer = &server_socket;
@@ -518,6 +618,12 @@ int Util::Config::serveThreadedSocket(int (*callback)(Socket::Connection &)){
       close(oldSock);
     }
   }
+  return true;
+}
+
+int Util::Config::serveThreadedSocket(int (*callback)(Socket::Connection &)){
+  Socket::Server server_socket;
+  if (!openServerSocket(server_socket)){return 1;}
   int r = threadServer(server_socket, callback);
   serv_sock_pointer = 0;
   return r;
@@ -525,32 +631,20 @@ int Util::Config::serveThreadedSocket(int (*callback)(Socket::Connection &)){
 
 int Util::Config::serveForkedSocket(int (*callback)(Socket::Connection &S)){
   Socket::Server server_socket;
-  if (Socket::checkTrueSocket(0)){
-    server_socket = Socket::Server(0);
-  }else if (vals.isMember("socket")){
-    server_socket = Socket::Server(Util::getTmpFolder() + getString("socket"));
-  }else if (vals.isMember("port") && vals.isMember("interface")){
-    server_socket = Socket::Server(getInteger("port"), getString("interface"), false);
-  }
-  if (!server_socket.connected()){
-    DEVEL_MSG("Failure to open socket");
-    return 1;
-  }
-  Socket::getSocketName(server_socket.getSocket(), Util::listenInterface, Util::listenPort);
-  serv_sock_pointer = &server_socket;
-  activate();
-  if (server_socket.getSocket()){
-    int oldSock = server_socket.getSocket();
-    if (!dup2(oldSock, 0)){
-      server_socket = Socket::Server(0);
-      close(oldSock);
-    }
-  }
+  if (!openServerSocket(server_socket)){return 1;}
   int r = forkServer(server_socket, callback);
   serv_sock_pointer = 0;
   return r;
 }
 
+int Util::Config::serveMultiSocket(int (*callback)(Socket::Connection &S), uint32_t maxConns){
+  Socket::Server server_socket;
+  if (!openServerSocket(server_socket)){return 1;}
+  int r = multiServer(server_socket, callback, maxConns);
+  serv_sock_pointer = 0;
+  return r;
+}
+
 /// Activated the stored config. This will:
 /// - Drop permissions to the stored "username", if any.
 /// - Set is_active to true.
@@ -599,16 +693,18 @@ void Util::Config::signal_handler(int signum, siginfo_t *sigInfo, void *ignore){
     static int ctr = 0;
     if (!is_active && ++ctr > 4){BACKTRACE;}
 #endif
+    // Any thread may receive the signal, so keep the reason where all threads can find it
     switch (sigInfo->si_code){
     case SI_USER:
     case SI_QUEUE:
     case SI_TIMER:
     case SI_ASYNCIO:
     case SI_MESGQ:
-      logExitReason("signal %s (%d) from process %d", strsignal(signum), signum, sigInfo->si_pid);
+      snprintf(shutdownReason, 255, "signal %s (%d) from process %d", strsignal(signum), signum, sigInfo->si_pid);
       break;
-    default: logExitReason("signal %s (%d)", strsignal(signum), signum);
+    default: snprintf(shutdownReason, 255, "signal %s (%d)", strsignal(signum), signum);
     }
+    logExitReason("%s", shutdownReason);
     is_active = false;
   default:
     switch (sigInfo->si_code){
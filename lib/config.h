@@ -17,6 +17,7 @@ namespace Util{
   extern __thread char streamName[256]; ///< Used by debug messages to identify the stream name
   void setStreamName(const std::string & sn);
   extern __thread char exitReason[256];
+  extern char shutdownReason[256]; ///< Why the whole process is stopping, for all of its threads
   void logExitReason(const char *format, ...);
 
   /// Deals with parsing configuration from commandline options.
@@ -24,12 +25,14 @@ namespace Util{
   private:
     JSON::Value vals; ///< Holds all current config values
     int long_count;
+    bool openServerSocket(Socket::Server &server_socket);
     static void signal_handler(int signum, siginfo_t *sigInfo, void *ignore);
 
   public:
     // variables
     static bool is_active;     ///< Set to true by activate(), set to false by the signal handler.
     static bool is_restarting; ///< Set to true when restarting, set to false on boot.
+    static bool is_multi;      ///< Set to true when many connections are served from this process.
     // functions
     Config();
     Config(std::string cmd);
@@ -44,8 +47,10 @@ namespace Util{
     void activate();
     int threadServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &S));
     int forkServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &S));
+    int multiServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &S), uint32_t maxConns);
     int serveThreadedSocket(int (*callback)(Socket::Connection &S));
     int serveForkedSocket(int (*callback)(Socket::Connection &S));
+    int serveMultiSocket(int (*callback)(Socket::Connection &S), uint32_t maxConns);
     int servePlainSocket(int (*callback)(Socket::Connection &S));
     void addOptionsFromCapabilities(const JSON::Value &capabilities);
     void addBasicConnectorOptions(JSON::Value &capabilities);
@@ -174,11 +174,11 @@ static inline void show_stackframe(){}
 #define DEFAULT_PAGE_TIMEOUT 15
 
 /// \TODO These values are hardcoded and that is dangerous and probably a very bad idea. I don't even know if they are currently correct...?! I doubt they are.
-#define META_META_OFFSET 104
+#define META_META_OFFSET 148
 #define META_META_RECORDSIZE 576
 
-#define META_TRACK_OFFSET 148
-#define META_TRACK_RECORDSIZE 1893
+#define META_TRACK_OFFSET 156
+#define META_TRACK_RECORDSIZE 1901
 
 #define TRACK_TRACK_OFFSET 184
 #define TRACK_TRACK_RECORDSIZE 362 + (1 * 1024 * 1024)
@@ -195,10 +195,12 @@ static inline void show_stackframe(){}
 #define TRACK_PAGE_OFFSET 92
 #define TRACK_PAGE_RECORDSIZE 36
 
-#define COMMS_STATISTICS "MstStat"
+// Comms pages start with allocation state in front of the records since version 2, so they are
+// named differently from the version 1 pages that older processes may still have open
+#define COMMS_STATISTICS "MstStat2"
 #define COMMS_STATISTICS_INITSIZE 8 * 1024 * 1024
 
-#define COMMS_USERS "MstUser%s" //%s stream name
+#define COMMS_USERS "MstUsr2%s" //%s stream name
 #define COMMS_USERS_INITSIZE 512 * 1024
 
 #define SEM_STATISTICS "/MstStat"
@@ -223,6 +225,8 @@ static inline void show_stackframe(){}
 #define STRMSTAT_INVALID 255
 
 #define SHM_TRIGGER "MstTRGR%s" //%s trigger name
+#define SHM_TRIGGER_CACHE "MstTRGC"
+#define SHM_TRIGGER_CACHE_SIZE (1024 * 1024) // ~3700 cached blocking trigger responses
 #define SEM_LIVE "/MstLIVE%s"   //%s stream name
 #define SEM_INPUT "/MstInpt%s"  //%s stream name
 #define SEM_TRACKLIST "/MstTRKS%s"  //%s stream name
@@ -240,6 +244,14 @@ static inline void show_stackframe(){}
 
 #define SHM_STREAM_ENCRYPT "MstCRYP%s" //%s stream name
 
+#define SHM_SEGCACHE_INDEX "MstSCIx%s" //%s stream name
+#define SHM_SEGCACHE_INDEX_SIZE (64 * 1024)
+#define SHM_SEGCACHE_ITEM "MstSCIt%s@%016" PRIX64 //%s stream name, %PRIX64 key hash
+#define SHM_SEGCACHE_STATS "MstSCStats"
+#define SEM_SEGCACHE "/MstSCLk%s" //%s stream name
+#define SEM_SEGCACHE_STATS "/MstSCStLk"
+#define SEGCACHE_ENTRIES 1024
+
 #define SIMUL_TRACKS 40
 
 #ifndef UDP_API_HOST
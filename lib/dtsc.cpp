@@ -12,6 +12,11 @@
 #include <cstring>
 #include <fstream>
 #include <iomanip>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace DTSC{
   char Magic_Header[] = "DTSC";
@@ -27,6 +32,26 @@ namespace DTSC{
   /// The mask that will be set by the current process for new tracks
   uint8_t trackValidDefault = TRACK_VALID_ALL;
 
+  /// Returns the codecId for the given codec name, or CODEC_OTHER if it is not listed.
+  codecId internCodec(const char *codec){
+    static const char *names[] ={"H264", "HEVC",  "H263",  "AV1",   "VP8",   "VP9",  "MPEG2",
+                                  "JPEG", "theora", "AAC",  "MP3",   "MP2",   "AC3",  "DTS",
+                                  "opus", "vorbis", "PCM",  "PCMLE", "FLOAT", "ALAW", "ULAW",
+                                  "ADPCM", "Nellymoser", "Speex", "subtitle", "JSON", "ID3", 0};
+    for (size_t i = 0; names[i]; ++i){
+      if (!strcmp(codec, names[i])){return (codecId)(CODEC_H264 + i);}
+    }
+    return CODEC_OTHER;
+  }
+
+  /// Returns VIDEO, AUDIO or META for the given track type, or INVALID for anything else.
+  datatype internType(const char *type){
+    if (!strcmp(type, "video")){return VIDEO;}
+    if (!strcmp(type, "audio")){return AUDIO;}
+    if (!strcmp(type, "meta")){return META;}
+    return INVALID;
+  }
+
   /// Default constructor for packets - sets a null pointer and invalid packet.
   Packet::Packet(){
     data = NULL;
@@ -35,6 +60,7 @@ namespace DTSC{
     master = false;
     version = DTSC_INVALID;
     prevNalSize = 0;
+    fieldsIndexed = false;
   }
 
   /// Copy constructor for packets, copies an existing packet with same noCopy flag as original.
@@ -110,6 +136,7 @@ namespace DTSC{
     bufferLen = 0;
     dataLen = 0;
     version = DTSC_INVALID;
+    fieldsIndexed = false;
   }
 
   /// Internally used resize function for when operating in copy mode and the internal buffer is too
@@ -193,6 +220,7 @@ namespace DTSC{
     // check header type and store packet length
     dataLen = len;
     version = DTSC_INVALID;
+    fieldsIndexed = false;
     if (len < 4){
       FAIL_MSG("ReInit received a packet with size < 4");
       return;
@@ -258,6 +286,7 @@ namespace DTSC{
 
   /// sets the keyframe byte.
   void Packet::setKeyFrame(bool kf){
+    fieldsIndexed = false;
     uint32_t offset = 23;
     while (data[offset] != 'd' && data[offset] != 'k' && data[offset] != 'K'){
       switch (data[offset]){
@@ -280,6 +309,7 @@ namespace DTSC{
     memcpy(data + dataLen - 3, appendData, appendLen);
     memcpy(data + dataLen - 3 + appendLen, "\000\000\356", 3); // end container
     dataLen += appendLen;
+    fieldsIndexed = false;
     Bit::htobl(data + 4, Bit::btohl(data + 4) + appendLen);
     uint32_t offset = getDataStringLenOffset();
     Bit::htobl(data + offset, Bit::btohl(data + offset) + appendLen);
@@ -293,6 +323,7 @@ namespace DTSC{
     memcpy(data + dataLen - 3 + 4, appendData, appendLen);
     memcpy(data + dataLen - 3 + 4 + appendLen, "\000\000\356", 3); // end container
     dataLen += appendLen + 4;
+    fieldsIndexed = false;
     Bit::htobl(data + 4, Bit::btohl(data + 4) + appendLen + 4);
     uint32_t offset = getDataStringLenOffset();
     Bit::htobl(data + offset, Bit::btohl(data + offset) + appendLen + 4);
@@ -313,6 +344,7 @@ namespace DTSC{
     memcpy(data + dataLen - 3, appendData, appendLen);
     memcpy(data + dataLen - 3 + appendLen, "\000\000\356", 3); // end container
     dataLen += appendLen;
+    fieldsIndexed = false;
     Bit::htobl(data + 4, Bit::btohl(data + 4) + appendLen);
     uint32_t offset = getDataStringLenOffset();
     Bit::htobl(data + offset, Bit::btohl(data + offset) + appendLen);
@@ -377,26 +409,73 @@ namespace DTSC{
     return 0; // out of packet! 1 == error
   }
 
+  /// Returns the index in Packet::fieldPos for the given member name, or -1 if it has none.
+  static int packetField(const char *identifier, size_t len){
+    switch (len){
+    case 4:
+      if (!memcmp(identifier, "data", 4)){return 0;}
+      if (!memcmp(identifier, "bpos", 4)){return 3;}
+      return -1;
+    case 6: return memcmp(identifier, "offset", 6) ? -1 : 1;
+    case 8: return memcmp(identifier, "keyframe", 8) ? -1 : 2;
+    case 15: return memcmp(identifier, "disposableframe", 15) ? -1 : 4;
+    default: return -1;
+    }
+  }
+
+  /// Finds the data, offset, keyframe, bpos and disposableframe members of the packet in a single pass over the
+  /// packed object, the same way Scan::getMember would find each of them.
+  void Packet::indexFields() const{
+    fieldsIndexed = true;
+    memset(fieldPos, 0, sizeof(fieldPos));
+    if (!*this || !getDataLen() || !getPayloadLen() || getDataLen() <= getPayloadLen()){return;}
+    char *p = data + (getDataLen() - getPayloadLen());
+    size_t len = getPayloadLen();
+    if (p[0] != DTSC_OBJ && p[0] != DTSC_CON){return;}
+    char *i = p + 1;
+    while (i[0] + i[1] != 0 && i < p + len){// while not encountering 0x0000 (we assume 0x0000EE)
+      if (i + 2 >= p + len){return;}
+      uint16_t keyLen = Bit::btohs(i);
+      i += 2;
+      int f = packetField(i, keyLen);
+      if (f >= 0 && !fieldPos[f]){
+        fieldPos[f] = i + keyLen - data;
+        fieldLen[f] = len - (i - p);
+      }
+      i = skipDTSC(i + keyLen, p + len);
+      if (!i){return;}
+    }
+  }
+
+  /// Returns getScan().getMember(identifier), looking up the most used members in constant time.
+  Scan Packet::getMemberScan(const char *identifier) const{
+    int f = packetField(identifier, strlen(identifier));
+    if (f < 0){return getScan().getMember(identifier);}
+    if (!fieldsIndexed){indexFields();}
+    if (!fieldPos[f]){return Scan();}
+    return Scan(data + fieldPos[f], fieldLen[f]);
+  }
+
   ///\brief Retrieves a single parameter as a string
   ///\param identifier The name of the parameter
   ///\param result A location on which the string will be returned
   ///\param len An integer in which the length of the string will be returned
   void Packet::getString(const char *identifier, char *&result, size_t &len) const{
-    getScan().getMember(identifier).getString(result, len);
+    getMemberScan(identifier).getString(result, len);
   }
 
   ///\brief Retrieves a single parameter as a string
   ///\param identifier The name of the parameter
   ///\param result The string in which to store the result
   void Packet::getString(const char *identifier, std::string &result) const{
-    result = getScan().getMember(identifier).asString();
+    result = getMemberScan(identifier).asString();
   }
 
   ///\brief Retrieves a single parameter as an integer
   ///\param identifier The name of the parameter
   ///\param result The result is stored in this integer
   void Packet::getInt(const char *identifier, uint64_t &result) const{
-    result = getScan().getMember(identifier).asInt();
+    result = getMemberScan(identifier).asInt();
   }
 
   ///\brief Retrieves a single parameter as an integer
@@ -430,7 +509,7 @@ namespace DTSC{
   ///\param identifier The name of the parameter
   ///\result Whether the parameter exists or not
   bool Packet::hasMember(const char *identifier) const{
-    return getScan().getMember(identifier).getType() > 0;
+    return getMemberScan(identifier).getType() > 0;
   }
 
   ///\brief Returns the timestamp of the packet.
@@ -456,6 +535,7 @@ namespace DTSC{
       INFO_MSG("Can't null '%s' for this packet, as it is not master.", memb.c_str());
       return;
     }
+    fieldsIndexed = false;
     getScan().nullMember(memb);
   }
 
@@ -891,6 +971,12 @@ namespace DTSC{
     version = DTSH_VERSION;
     streamMemBuf = 0;
     isMemBuf = false;
+    localValidGen = 0;
+    validCacheGen = 0;
+    validCacheLocal = 0;
+    validCacheMask = 0;
+    validCacheEnd = 0;
+    validCacheCount = 0;
     isMaster = true;
     reInit(_streamName, src);
   }
@@ -902,6 +988,12 @@ namespace DTSC{
     version = DTSH_VERSION;
     streamMemBuf = 0;
     isMemBuf = false;
+    localValidGen = 0;
+    validCacheGen = 0;
+    validCacheLocal = 0;
+    validCacheMask = 0;
+    validCacheEnd = 0;
+    validCacheCount = 0;
     isMaster = master;
     reInit(_streamName, master);
   }
@@ -911,6 +1003,12 @@ namespace DTSC{
     version = DTSH_VERSION;
     streamMemBuf = 0;
     isMemBuf = false;
+    localValidGen = 0;
+    validCacheGen = 0;
+    validCacheLocal = 0;
+    validCacheMask = 0;
+    validCacheEnd = 0;
+    validCacheCount = 0;
     isMaster = true;
     reInit(_streamName, fileName);
   }
@@ -1167,6 +1265,7 @@ namespace DTSC{
       stream.addField("bootmsoffset", RAX_64INT);
       stream.addField("utcoffset", RAX_64INT);
       stream.addField("minfragduration", RAX_64UINT);
+      stream.addField("validgen", RAX_32UINT);
       stream.setRCount(1);
       stream.setReady();
       stream.addRecords(1);
@@ -1185,6 +1284,7 @@ namespace DTSC{
       trackList.addField("ivec", RAX_64UINT);
       trackList.addField("widevine", RAX_256STRING);
       trackList.addField("playready", RAX_STRING, 1024);
+      trackList.addField("notify", RAX_64UINT);
 
       trackList.setRCount(trackCount);
       trackList.setReady();
@@ -1200,6 +1300,7 @@ namespace DTSC{
     streamBootMsOffsetField = stream.getFieldData("bootmsoffset");
     streamUTCOffsetField = stream.getFieldData("utcoffset");
     streamMinimumFragmentDurationField = stream.getFieldData("minfragduration");
+    streamValidGenField = stream.getFieldData("validgen");
 
     trackValidField = trackList.getFieldData("valid");
     trackIdField = trackList.getFieldData("id");
@@ -1214,6 +1315,7 @@ namespace DTSC{
     trackIvecField = trackList.getFieldData("ivec");
     trackWidevineField = trackList.getFieldData("widevine");
     trackPlayreadyField = trackList.getFieldData("playready");
+    trackNotifyField = trackList.getFieldData("notify");
   }
 
   /// Reads the "tracks" field from the "stream" child object, populating the "tracks" variable.
@@ -1271,7 +1373,13 @@ namespace DTSC{
       t.fragmentKeysField = t.fragments.getFieldData("keys");
       t.fragmentFirstKeyField = t.fragments.getFieldData("firstkey");
       t.fragmentSizeField = t.fragments.getFieldData("size");
+
+      t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+      t.pageKeyCountField = t.pages.getFieldData("keycount");
+      t.pageAvailField = t.pages.getFieldData("avail");
+      t.pageFirstTimeField = t.pages.getFieldData("firsttime");
     }
+    ++localValidGen;
   }
 
   /// Reloads shared memory pages that are marked as needing an update, if any
@@ -1294,6 +1402,7 @@ namespace DTSC{
         return true;
       }
       stream = Util::RelAccX(streamPage.mapped, true);
+      streamValidGenField = stream.getFieldData("validgen");
       tM.clear();
       tracks.clear();
       refresh();
@@ -1361,8 +1470,14 @@ namespace DTSC{
         t.fragmentFirstKeyField = t.fragments.getFieldData("firstkey");
         t.fragmentSizeField = t.fragments.getFieldData("size");
 
+        t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+        t.pageKeyCountField = t.pages.getFieldData("keycount");
+        t.pageAvailField = t.pages.getFieldData("avail");
+        t.pageFirstTimeField = t.pages.getFieldData("firsttime");
+
       }
     }
+    if (ret){++localValidGen;}
     return ret;
   }
 
@@ -1844,6 +1959,10 @@ namespace DTSC{
     t.pages.addField("avail", RAX_32UINT);
     t.pages.addField("firsttime", RAX_64UINT);
     t.pages.addField("lastkeytime", RAX_64UINT);
+    t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+    t.pageKeyCountField = t.pages.getFieldData("keycount");
+    t.pageAvailField = t.pages.getFieldData("avail");
+    t.pageFirstTimeField = t.pages.getFieldData("firsttime");
     t.pages.setRCount(pageCount);
     t.pages.setReady();
   }
@@ -1904,6 +2023,60 @@ namespace DTSC{
     return ret;
   }
 
+  /// Returns the data notification word for the given track, or null if not available.
+  /// Futexes need 4-byte alignment, which record offsets do not guarantee, so the aligned word
+  /// inside the 8-byte notify field is used. Since shared pages are always mapped page-aligned,
+  /// every process ends up using the same word.
+  uint32_t *Meta::notifyWord(size_t trackIdx) const{
+    if (!trackNotifyField.size){return 0;}
+    char *ptr = trackList.getPointer(trackNotifyField, trackIdx);
+    if (!ptr){return 0;}
+    return (uint32_t *)(((uintptr_t)ptr + 3) & ~(uintptr_t)3);
+  }
+
+  /// Signals processes blocked in waitForData that new data is available on the given track.
+  /// The lowest bit of the notification word is set by waiting processes, so the (relatively
+  /// expensive) wake call is only made when someone is actually waiting.
+  void Meta::notifyData(size_t trackIdx){
+    uint32_t *word = notifyWord(trackIdx);
+    if (!word){return;}
+    uint32_t prev = __sync_fetch_and_add(word, 2);
+    if (!(prev & 1)){return;}
+    __sync_fetch_and_and(word, ~(uint32_t)1);
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE, 0x7FFFFFFF, NULL, NULL, 0);
+#endif
+  }
+
+  /// Returns the current data notification counter of the given track.
+  /// Read this before checking for new data, then pass it to waitForData.
+  uint32_t Meta::getDataNotify(size_t trackIdx) const{
+    uint32_t *word = notifyWord(trackIdx);
+    if (!word){return 0;}
+    return *(volatile uint32_t *)word & ~(uint32_t)1;
+  }
+
+  /// Blocks until notifyData is called for the given track, or the given amount of millis passed.
+  /// Returns immediately if data was already signalled since lastNotify was retrieved.
+  /// Falls back to sleeping at most 10ms if the notification word is unavailable.
+  /// \returns True if woken up by a notification, false on timeout.
+  bool Meta::waitForData(size_t trackIdx, uint32_t lastNotify, uint64_t millis) const{
+    uint32_t *word = notifyWord(trackIdx);
+#ifdef __linux__
+    if (word){
+      uint32_t cur = __sync_fetch_and_or(word, 1) | 1;
+      if ((cur & ~(uint32_t)1) != lastNotify){return true;}
+      struct timespec T;
+      T.tv_sec = millis / 1000;
+      T.tv_nsec = 1000000 * (millis % 1000);
+      syscall(SYS_futex, word, FUTEX_WAIT, cur, &T, NULL, 0);
+      return getDataNotify(trackIdx) != lastNotify;
+    }
+#endif
+    Util::sleep(millis < 10 ? millis : 10);
+    return word && getDataNotify(trackIdx) != lastNotify;
+  }
+
   void Meta::setChannels(size_t trackIdx, uint16_t channels){
     DTSC::Track &t = tracks.at(trackIdx);
     t.track.setInt(t.trackChannelsField, channels);
@@ -1967,6 +2140,42 @@ namespace DTSC{
     return trackList.getPointer(trackCodecField, trackIdx);
   }
 
+  /// Returns the type of the given track as VIDEO, AUDIO or META, or INVALID for other types.
+  /// Does not copy the type string, so it is cheap enough to call for every packet.
+  datatype Meta::getTypeId(size_t trackIdx) const{
+    return (datatype)getInterned(typeCache, trackTypeField, trackIdx, false);
+  }
+
+  /// Returns the codec of the given track as codecId, or CODEC_OTHER for unlisted codecs.
+  /// Does not copy the codec string, so it is cheap enough to call for every packet.
+  codecId Meta::getCodecId(size_t trackIdx) const{
+    return (codecId)getInterned(codecCache, trackCodecField, trackIdx, true);
+  }
+
+  /// Looks up the interned id of a type or codec string field of the given track.
+  /// The id is cached along with the string it came from, and only looked up again when the string
+  /// in the track list no longer matches. This catches changes by other processes and reuse of the
+  /// track index, at the cost of a short string compare.
+  uint8_t Meta::getInterned(std::vector<internCache> &cache, const Util::RelAccXFieldData &field,
+                            size_t trackIdx, bool codec) const{
+    const char *raw = trackList.getPointer(field, trackIdx);
+    size_t len = field.size < 32 ? field.size : 32;
+    if (trackIdx >= cache.size()){
+      internCache C;
+      C.raw[0] = 0;
+      C.raw[32] = 0;
+      C.id = codec ? (uint8_t)CODEC_OTHER : (uint8_t)INVALID;
+      cache.resize(trackIdx + 1, C);
+    }
+    internCache &C = cache[trackIdx];
+    if (strncmp(C.raw, raw, len) || !len){
+      strncpy(C.raw, raw, len);
+      C.raw[len] = 0;
+      C.id = codec ? (uint8_t)internCodec(C.raw) : (uint8_t)internType(C.raw);
+    }
+    return C.id;
+  }
+
   void Meta::setLang(size_t trackIdx, const std::string &lang){
     DTSC::Track &t = tracks.at(trackIdx);
     t.track.setString(t.trackLangField, lang);
@@ -2054,6 +2263,7 @@ namespace DTSC{
 
   void Meta::setEncryption(size_t trackIdx, const std::string &encryption){
     trackList.setString(trackEncryptionField, encryption, trackIdx);
+    validTracksChanged();
   }
   std::string Meta::getEncryption(size_t trackIdx) const{
     return trackList.getPointer(trackEncryptionField, trackIdx);
@@ -2082,6 +2292,7 @@ namespace DTSC{
 
   void Meta::setSourceTrack(size_t trackIdx, size_t sourceTrack){
     trackList.setInt(trackSourceTidField, sourceTrack, trackIdx);
+    validTracksChanged();
   }
   uint64_t Meta::getSourceTrack(size_t trackIdx) const{
     return trackList.getInt(trackSourceTidField, trackIdx);
@@ -2167,6 +2378,70 @@ namespace DTSC{
     return res;
   }
 
+  /// Marks the set of valid tracks as changed, both for this process and for all other processes
+  /// reading the same metadata.
+  void Meta::validTracksChanged(){
+    ++localValidGen;
+    if (!streamValidGenField.size || !stream.isReady()){return;}
+    char *ptr = stream.getPointer(streamValidGenField);
+    if (ptr){__sync_fetch_and_add((uint32_t *)ptr, 1);}
+  }
+
+  /// Rebuilds the valid track bitmap if anything that getValidTracks() depends on changed since
+  /// the last rebuild. Costs a handful of integer compares when nothing changed.
+  void Meta::checkValidCache() const{
+    // Without a shared generation counter (old metadata layout) we cannot tell: always rebuild.
+    bool haveGen = streamValidGenField.size && stream.isReady();
+    uint32_t sharedGen = haveGen ? stream.getInt(streamValidGenField) : 0;
+    uint64_t endPos = trackList.isReady() ? trackList.getEndPos() : 0;
+    if (haveGen && validCacheLocal == localValidGen && validCacheGen == sharedGen &&
+        validCacheMask == trackValidMask && validCacheEnd == endPos && validCacheLocal &&
+        !validCachePendingReady()){
+      return;
+    }
+    std::set<size_t> valid = getValidTracks();
+    validCache.assign(valid.size() ? (*valid.rbegin()) + 1 : 0, false);
+    for (std::set<size_t>::iterator it = valid.begin(); it != valid.end(); ++it){
+      validCache[*it] = true;
+    }
+    validCacheCount = valid.size();
+    // Tracks the writer has not set ready yet become valid without any of the above changing
+    validCachePending.clear();
+    if (trackList.isReady()){
+      for (size_t i = trackList.getDeleted(); i < endPos; ++i){
+        if (valid.count(i) || !(trackList.getInt(trackValidField, i) & trackValidMask)){continue;}
+        if (!tracks.count(i) || !tracks.at(i).track.isReady()){validCachePending.push_back(i);}
+      }
+    }
+    validCacheLocal = localValidGen;
+    validCacheGen = sharedGen;
+    validCacheMask = trackValidMask;
+    validCacheEnd = endPos;
+  }
+
+  /// Returns true if any of the tracks the valid track bitmap left out for not being ready is ready
+  /// now. Tracks never go back to not being ready.
+  bool Meta::validCachePendingReady() const{
+    for (size_t i = 0; i < validCachePending.size(); ++i){
+      std::map<size_t, Track>::const_iterator it = tracks.find(validCachePending[i]);
+      if (it != tracks.end() && it->second.track.isReady()){return true;}
+    }
+    return false;
+  }
+
+  /// Returns true if getValidTracks() would contain the given track, without building that set.
+  /// Meant for per-packet checks.
+  bool Meta::isValidTrack(size_t trackIdx) const{
+    checkValidCache();
+    return trackIdx < validCache.size() && validCache[trackIdx];
+  }
+
+  /// Returns the size of the set getValidTracks() would return, without building that set.
+  size_t Meta::getValidTrackCount() const{
+    checkValidCache();
+    return validCacheCount;
+  }
+
   std::set<size_t> Meta::getMySourceTracks(size_t pid) const{
     std::set<size_t> res;
     if (!streamPage.mapped){return res;}
@@ -2184,6 +2459,7 @@ namespace DTSC{
   void Meta::validateTrack(size_t trackIdx, uint8_t validType){
     markUpdated(trackIdx);
     trackList.setInt(trackValidField, validType, trackIdx);
+    validTracksChanged();
   }
 
   void Meta::removeEmptyTracks(){
@@ -2211,6 +2487,7 @@ namespace DTSC{
     tracks.erase(trackIdx);
 
     trackList.setInt(trackValidField, 0, trackIdx);
+    validTracksChanged();
   }
 
   /// Removes the first key from the memory structure and caches.
@@ -2581,6 +2858,9 @@ namespace DTSC{
     streamPage.close();
     tM.clear();
     tracks.clear();
+    ++localValidGen;
+    typeCache.clear();
+    codecCache.clear();
     isMaster = true;
     streamName = "";
   }
@@ -3168,43 +3448,85 @@ namespace DTSC{
     return res;
   }
 
+  /// Binary search for the last record in the given pages list with a value for field at or below
+  /// target. The firstkey and firsttime of pages only ever increase, as pages are always added
+  /// after the last one and deleted from the front.
+  /// Returns INVALID_RECORD_INDEX if there is no such record.
+  static uint64_t lastPageAtOrBefore(const Util::RelAccX &pages, const Util::RelAccXFieldData &field, uint64_t target){
+    uint64_t low = pages.getDeleted();
+    uint64_t high = pages.getEndPos();
+    // Searches [low, high) for the first record above target
+    while (low < high){
+      uint64_t mid = low + (high - low) / 2;
+      if (pages.getInt(field, mid) > target){
+        high = mid;
+      }else{
+        low = mid + 1;
+      }
+    }
+    if (low == pages.getDeleted()){return INVALID_RECORD_INDEX;}
+    return low - 1;
+  }
+
+  /// Returns the index in the pages list of the page the given key is on, or would be on if it
+  /// were available: the last page starting at or before the key.
+  /// Returns INVALID_RECORD_INDEX if all pages start after the key.
+  uint64_t Meta::getPageIndexForKey(uint32_t idx, uint64_t keyNum) const{
+    const Track &t = tracks.at(idx);
+    return lastPageAtOrBefore(t.pages, t.pageFirstKeyField, keyNum);
+  }
+
+  /// Returns the index in the pages list of the last page starting at or before the given time.
+  /// Returns INVALID_RECORD_INDEX if all pages start after the given time.
+  uint64_t Meta::getPageIndexForTime(uint32_t idx, uint64_t time) const{
+    const Track &t = tracks.at(idx);
+    return lastPageAtOrBefore(t.pages, t.pageFirstTimeField, time);
+  }
+
+  /// Returns the index in the pages list of the page with the given page number (its first key).
+  /// Returns INVALID_RECORD_INDEX if there is no such page.
+  uint64_t Meta::getPageIndex(uint32_t idx, uint64_t pageNumber) const{
+    const Track &t = tracks.at(idx);
+    uint64_t res = lastPageAtOrBefore(t.pages, t.pageFirstKeyField, pageNumber);
+    if (res == INVALID_RECORD_INDEX || t.pages.getInt(t.pageFirstKeyField, res) != pageNumber){
+      return INVALID_RECORD_INDEX;
+    }
+    return res;
+  }
+
   /// Given the current page, check if the next page is available. Returns true if it is.
   bool Meta::nextPageAvailable(uint32_t idx, size_t currentPage) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
-    for (size_t i = pages.getStartPos(); i + 1 < pages.getEndPos(); ++i){
-      if (pages.getInt("firstkey", i) == currentPage){return pages.getInt("avail", i + 1);}
-    }
-    return false;
+    const Track &t = tracks.at(idx);
+    uint64_t pageIdx = getPageIndex(idx, currentPage);
+    if (pageIdx == INVALID_RECORD_INDEX || pageIdx + 1 >= t.pages.getEndPos()){return false;}
+    return t.pages.getInt(t.pageAvailField, pageIdx + 1);
   }
 
   /// Given a timestamp, returns the page number that timestamp can be found on.
   /// If the timestamp is not available, returns the closest page number that is.
   size_t Meta::getPageNumberForTime(uint32_t idx, uint64_t time) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
-    Util::RelAccXFieldData avail = pages.getFieldData("avail");
-    Util::RelAccXFieldData firsttime = pages.getFieldData("firsttime");
-    uint32_t res = pages.getStartPos();
-    uint64_t endPos = pages.getEndPos();
-    for (uint64_t i = res; i < endPos; ++i){
-      if (pages.getInt(avail, i) == 0){continue;}
-      if (pages.getInt(firsttime, i) > time){break;}
-      res = i;
+    const Track &t = tracks.at(idx);
+    uint64_t res = getPageIndexForTime(idx, time);
+    // Step back to the closest available page
+    while (res != INVALID_RECORD_INDEX && !t.pages.getInt(t.pageAvailField, res)){
+      res = (res > t.pages.getDeleted() ? res - 1 : INVALID_RECORD_INDEX);
     }
-    DONTEVEN_MSG("Page number for time %" PRIu64 " on track %" PRIu32 " can be found on page %zu", time, idx, pages.getInt("firstkey", res));
-    return pages.getInt("firstkey", res);
+    if (res == INVALID_RECORD_INDEX){res = t.pages.getDeleted();}
+    DONTEVEN_MSG("Page number for time %" PRIu64 " on track %" PRIu32 " can be found on page %" PRIu64, time, idx, t.pages.getInt(t.pageFirstKeyField, res));
+    return t.pages.getInt(t.pageFirstKeyField, res);
   }
 
   /// Given a key, returns the page number it can be found on.
   /// If the key is not available, returns the closest page that is.
   size_t Meta::getPageNumberForKey(uint32_t idx, uint64_t keyNum) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
-    size_t res = pages.getStartPos();
-    for (size_t i = pages.getStartPos(); i < pages.getEndPos(); ++i){
-      if (pages.getInt("avail", i) == 0){continue;}
-      if (pages.getInt("firstkey", i) > keyNum){break;}
-      res = i;
-    }
-    return pages.getInt("firstkey", res);
+    const Track &t = tracks.at(idx);
+    uint64_t res = getPageIndexForKey(idx, keyNum);
+    // Step back to the closest available page
+    while (res != INVALID_RECORD_INDEX && !t.pages.getInt(t.pageAvailField, res)){
+      res = (res > t.pages.getDeleted() ? res - 1 : INVALID_RECORD_INDEX);
+    }
+    if (res == INVALID_RECORD_INDEX){res = t.pages.getDeleted();}
+    return t.pages.getInt(t.pageFirstKeyField, res);
   }
 
   /// Returns the key number containing a given time.
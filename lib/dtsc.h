@@ -57,6 +57,41 @@ namespace DTSC{
 
   enum packType{DTSC_INVALID, DTSC_HEAD, DTSC_V1, DTSC_V2, DTCM};
 
+  /// Interned track codecs, see Meta::getCodecId. Codecs not listed here are CODEC_OTHER.
+  enum codecId{
+    CODEC_OTHER,
+    CODEC_H264,
+    CODEC_HEVC,
+    CODEC_H263,
+    CODEC_AV1,
+    CODEC_VP8,
+    CODEC_VP9,
+    CODEC_MPEG2,
+    CODEC_JPEG,
+    CODEC_THEORA,
+    CODEC_AAC,
+    CODEC_MP3,
+    CODEC_MP2,
+    CODEC_AC3,
+    CODEC_DTS,
+    CODEC_OPUS,
+    CODEC_VORBIS,
+    CODEC_PCM,
+    CODEC_PCMLE,
+    CODEC_FLOAT,
+    CODEC_ALAW,
+    CODEC_ULAW,
+    CODEC_ADPCM,
+    CODEC_NELLYMOSER,
+    CODEC_SPEEX,
+    CODEC_SUBTITLE,
+    CODEC_JSON,
+    CODEC_ID3
+  };
+
+  codecId internCodec(const char *codec);
+  datatype internType(const char *type);
+
   /// This class allows scanning through raw binary format DTSC data.
   /// It can be used as an iterator or as a direct accessor.
   class Scan{
@@ -140,6 +175,14 @@ namespace DTSC{
     uint32_t dataLen;
 
     uint64_t prevNalSize;
+
+  private:
+    // Positions of the members most accessors ask for, found in a single pass on first use
+    void indexFields() const;
+    Scan getMemberScan(const char *identifier) const;
+    mutable bool fieldsIndexed;
+    mutable uint32_t fieldPos[5]; ///< Offset of the data, offset, keyframe, bpos and disposableframe values, or 0
+    mutable uint32_t fieldLen[5]; ///< Length of the Scan getMember would return for them
   };
 
   /// A child class of DTSC::Packet, which allows overriding the packet time efficiently.
@@ -266,6 +309,11 @@ namespace DTSC{
     Util::RelAccXFieldData fragmentKeysField;
     Util::RelAccXFieldData fragmentFirstKeyField;
     Util::RelAccXFieldData fragmentSizeField;
+
+    Util::RelAccXFieldData pageFirstKeyField;
+    Util::RelAccXFieldData pageKeyCountField;
+    Util::RelAccXFieldData pageAvailField;
+    Util::RelAccXFieldData pageFirstTimeField;
   };
 
   class Meta{
@@ -332,6 +380,10 @@ namespace DTSC{
     uint64_t getLastUpdated(size_t trackIdx) const;
     uint64_t getLastUpdated() const;
 
+    void notifyData(size_t trackIdx);
+    uint32_t getDataNotify(size_t trackIdx) const;
+    bool waitForData(size_t trackIdx, uint32_t lastNotify, uint64_t millis) const;
+
     void setChannels(size_t trackIdx, uint16_t channels);
     uint16_t getChannels(size_t trackIdx) const;
 
@@ -353,6 +405,9 @@ namespace DTSC{
     void setCodec(size_t trackIdx, const std::string &codec);
     std::string getCodec(size_t trackIdx) const;
 
+    datatype getTypeId(size_t trackIdx) const;
+    codecId getCodecId(size_t trackIdx) const;
+
     void setLang(size_t trackIdx, const std::string &lang);
     std::string getLang(size_t trackIdx) const;
 
@@ -427,6 +482,8 @@ namespace DTSC{
     int64_t getUTCOffset() const;
 
     std::set<size_t> getValidTracks(bool skipEmpty = false) const;
+    bool isValidTrack(size_t trackIdx) const;
+    size_t getValidTrackCount() const;
     std::set<size_t> getMySourceTracks(size_t pid) const;
 
     void validateTrack(size_t trackIdx, uint8_t validType = TRACK_VALID_ALL);
@@ -449,6 +506,9 @@ namespace DTSC{
     bool nextPageAvailable(uint32_t idx, size_t currentPage) const;
     size_t getPageNumberForTime(uint32_t idx, uint64_t time) const;
     size_t getPageNumberForKey(uint32_t idx, uint64_t keynumber) const;
+    uint64_t getPageIndexForKey(uint32_t idx, uint64_t keyNum) const;
+    uint64_t getPageIndexForTime(uint32_t idx, uint64_t time) const;
+    uint64_t getPageIndex(uint32_t idx, uint64_t pageNumber) const;
     size_t getKeyNumForTime(uint32_t idx, uint64_t time) const;
     bool keyTimingsMatch(size_t idx1, size_t idx2) const;
 
@@ -507,6 +567,7 @@ namespace DTSC{
     Util::RelAccXFieldData streamBootMsOffsetField;
     Util::RelAccXFieldData streamUTCOffsetField;
     Util::RelAccXFieldData streamMinimumFragmentDurationField;
+    Util::RelAccXFieldData streamValidGenField;
 
     Util::RelAccXFieldData trackValidField;
     Util::RelAccXFieldData trackIdField;
@@ -521,5 +582,31 @@ namespace DTSC{
     Util::RelAccXFieldData trackIvecField;
     Util::RelAccXFieldData trackWidevineField;
     Util::RelAccXFieldData trackPlayreadyField;
+    Util::RelAccXFieldData trackNotifyField;
+
+    uint32_t *notifyWord(size_t trackIdx) const;
+
+    // Cached bitmap of getValidTracks(), see isValidTrack()
+    void validTracksChanged();
+    void checkValidCache() const;
+    bool validCachePendingReady() const;
+    uint32_t localValidGen; ///< Bumped whenever this process (re)loads, adds or removes tracks
+    mutable uint32_t validCacheLocal;
+    mutable uint32_t validCacheGen;
+    mutable uint8_t validCacheMask;
+    mutable uint64_t validCacheEnd;
+    mutable size_t validCacheCount;
+    mutable std::vector<bool> validCache;
+    mutable std::vector<size_t> validCachePending; ///< Valid tracks left out for not being ready
+
+    // Cached results of getTypeId() and getCodecId(), checked against the track list on every call
+    struct internCache{
+      char raw[33]; ///< Copy of the string the id was interned from
+      uint8_t id;
+    };
+    mutable std::vector<internCache> typeCache;
+    mutable std::vector<internCache> codecCache;
+    uint8_t getInterned(std::vector<internCache> &cache, const Util::RelAccXFieldData &field,
+                        size_t trackIdx, bool codec) const;
   };
 }// namespace DTSC
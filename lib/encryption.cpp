@@ -3,16 +3,211 @@
 #include "encryption.h"
 #include "h264.h"
 
+// Hardware AES backend: AES-NI, plus VAES for wide CTR runs. Selected at runtime based on CPUID,
+// so binaries built with this still run on CPUs without these instructions.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(NOAESNI)
+#define AES_ACCEL 1
+#if __GNUC__ >= 8
+#define AES_ACCEL_VAES 1
+#endif
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#ifdef AES_ACCEL
+namespace{
+  enum accelLevel{ACCEL_NONE = 0, ACCEL_AESNI, ACCEL_VAES};
+
+  accelLevel detectAccel(){
+    unsigned int a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)){return ACCEL_NONE;}
+    if (!(c & bit_AES) || !(d & bit_SSE2)){return ACCEL_NONE;}
+#ifdef AES_ACCEL_VAES
+    // VAES needs AVX2, and the OS must save the YMM registers on context switch
+    if ((c & bit_OSXSAVE) && (c & bit_AVX) && __get_cpuid_max(0, 0) >= 7){
+      unsigned int xLo, xHi;
+      __asm__("xgetbv" : "=a"(xLo), "=d"(xHi) : "c"(0));
+      __cpuid_count(7, 0, a, b, c, d);
+      if ((xLo & 6) == 6 && (b & (1 << 5)) && (c & (1 << 9))){return ACCEL_VAES;}
+    }
+#endif
+    return ACCEL_AESNI;
+  }
+
+  accelLevel getAccel(){
+    static accelLevel level = detectAccel();
+    return level;
+  }
+
+  __attribute__((target("aes,sse2"))) inline __m128i expandStep(__m128i key, __m128i gen){
+    gen = _mm_shuffle_epi32(gen, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, gen);
+  }
+
+#define AESNI_EXPAND(i, rcon)                                                                      \
+  k = expandStep(k, _mm_aeskeygenassist_si128(k, rcon));                                          \
+  _mm_storeu_si128((__m128i *)(rk + 16 * i), k);
+
+  /// Expands a 128-bit key into the 11 round keys used by the AES-NI functions below.
+  __attribute__((target("aes,sse2"))) void aesniExpandKey(const char *key, char *rk){
+    __m128i k = _mm_loadu_si128((const __m128i *)key);
+    _mm_storeu_si128((__m128i *)rk, k);
+    AESNI_EXPAND(1, 0x01);
+    AESNI_EXPAND(2, 0x02);
+    AESNI_EXPAND(3, 0x04);
+    AESNI_EXPAND(4, 0x08);
+    AESNI_EXPAND(5, 0x10);
+    AESNI_EXPAND(6, 0x20);
+    AESNI_EXPAND(7, 0x40);
+    AESNI_EXPAND(8, 0x80);
+    AESNI_EXPAND(9, 0x1b);
+    AESNI_EXPAND(10, 0x36);
+  }
+#undef AESNI_EXPAND
+
+  /// Returns counter block number n, for a 128-bit big-endian counter starting at hi:lo.
+  __attribute__((target("aes,sse2"))) inline __m128i ctrBlock(uint64_t hi, uint64_t lo, uint64_t n){
+    uint64_t nLo = lo + n;
+    if (nLo < lo){++hi;}
+    return _mm_set_epi64x(__builtin_bswap64(nLo), __builtin_bswap64(hi));
+  }
+
+  /// Encrypts/decrypts len bytes in CTR mode, 8 blocks at a time to keep the AES units busy.
+  __attribute__((target("aes,sse2"))) void aesniCTR(const char *rk, uint64_t hi, uint64_t lo,
+                                                      const char *src, char *dest, size_t len){
+    __m128i k[11];
+    for (size_t r = 0; r < 11; ++r){k[r] = _mm_loadu_si128((const __m128i *)(rk + 16 * r));}
+    size_t blocks = len / 16;
+    uint64_t n = 0;
+    for (; n + 8 <= blocks; n += 8){
+      __m128i b[8];
+      for (size_t j = 0; j < 8; ++j){b[j] = _mm_xor_si128(ctrBlock(hi, lo, n + j), k[0]);}
+      for (size_t r = 1; r < 10; ++r){
+        for (size_t j = 0; j < 8; ++j){b[j] = _mm_aesenc_si128(b[j], k[r]);}
+      }
+      for (size_t j = 0; j < 8; ++j){
+        b[j] = _mm_aesenclast_si128(b[j], k[10]);
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + 16 * (n + j)));
+        _mm_storeu_si128((__m128i *)(dest + 16 * (n + j)), _mm_xor_si128(b[j], in));
+      }
+    }
+    for (; n * 16 < len; ++n){
+      __m128i b = _mm_xor_si128(ctrBlock(hi, lo, n), k[0]);
+      for (size_t r = 1; r < 10; ++r){b = _mm_aesenc_si128(b, k[r]);}
+      b = _mm_aesenclast_si128(b, k[10]);
+      if (n < blocks){
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + 16 * n));
+        _mm_storeu_si128((__m128i *)(dest + 16 * n), _mm_xor_si128(b, in));
+      }else{
+        // Partial last block
+        char stream[16];
+        _mm_storeu_si128((__m128i *)stream, b);
+        for (size_t i = 16 * n; i < len; ++i){dest[i] = src[i] ^ stream[i - 16 * n];}
+      }
+    }
+  }
+
+#ifdef AES_ACCEL_VAES
+  /// Like aesniCTR, but two blocks per instruction, 16 blocks at a time.
+  /// Leftover blocks are handed to aesniCTR.
+  __attribute__((target("vaes,avx2,aes"))) void vaesCTR(const char *rk, uint64_t hi, uint64_t lo,
+                                                          const char *src, char *dest, size_t len){
+    __m256i k[11];
+    for (size_t r = 0; r < 11; ++r){
+      k[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(rk + 16 * r)));
+    }
+    size_t blocks = len / 16;
+    uint64_t n = 0;
+    for (; n + 16 <= blocks; n += 16){
+      __m256i b[8];
+      for (size_t j = 0; j < 8; ++j){
+        uint64_t lo0 = lo + n + 2 * j, hi0 = hi + (lo0 < lo);
+        uint64_t lo1 = lo0 + 1, hi1 = hi0 + (lo1 < lo0);
+        b[j] = _mm256_set_epi64x(__builtin_bswap64(lo1), __builtin_bswap64(hi1),
+                                 __builtin_bswap64(lo0), __builtin_bswap64(hi0));
+        b[j] = _mm256_xor_si256(b[j], k[0]);
+      }
+      for (size_t r = 1; r < 10; ++r){
+        for (size_t j = 0; j < 8; ++j){b[j] = _mm256_aesenc_epi128(b[j], k[r]);}
+      }
+      for (size_t j = 0; j < 8; ++j){
+        b[j] = _mm256_aesenclast_epi128(b[j], k[10]);
+        __m256i in = _mm256_loadu_si256((const __m256i *)(src + 16 * (n + 2 * j)));
+        _mm256_storeu_si256((__m256i *)(dest + 16 * (n + 2 * j)), _mm256_xor_si256(b[j], in));
+      }
+    }
+    if (n * 16 < len){
+      uint64_t nLo = lo + n;
+      aesniCTR(rk, hi + (nLo < lo), nLo, src + 16 * n, dest + 16 * n, len - 16 * n);
+    }
+  }
+#endif
+
+  /// Encrypts len bytes (a multiple of 16) in CBC mode, updating ivec like mbedtls does.
+  /// CBC encryption is serial by nature, so there is nothing to interleave here.
+  __attribute__((target("aes,sse2"))) void aesniCBC(const char *rk, char *ivec, const char *src,
+                                                      char *dest, size_t len){
+    __m128i k[11];
+    for (size_t r = 0; r < 11; ++r){k[r] = _mm_loadu_si128((const __m128i *)(rk + 16 * r));}
+    __m128i iv = _mm_loadu_si128((const __m128i *)ivec);
+    for (size_t i = 0; i < len; i += 16){
+      iv = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)), iv);
+      iv = _mm_xor_si128(iv, k[0]);
+      for (size_t r = 1; r < 10; ++r){iv = _mm_aesenc_si128(iv, k[r]);}
+      iv = _mm_aesenclast_si128(iv, k[10]);
+      _mm_storeu_si128((__m128i *)(dest + i), iv);
+    }
+    _mm_storeu_si128((__m128i *)ivec, iv);
+  }
+}// namespace
+#endif
+
 namespace Encryption{
-  AES::AES(){mbedtls_aes_init(&ctx);}
+  AES::AES(){
+    mbedtls_aes_init(&ctx);
+    accelAllowed = true;
+    accelerated = false;
+  }
 
   AES::~AES(){mbedtls_aes_free(&ctx);}
 
   void AES::setEncryptKey(const char *key){
     mbedtls_aes_setkey_enc(&ctx, (const unsigned char *)key, 128);
+    accelerated = false;
+#ifdef AES_ACCEL
+    if (accelAllowed && getAccel() != ACCEL_NONE){
+      aesniExpandKey(key, roundKeys);
+      accelerated = true;
+    }
+#endif
   }
   void AES::setDecryptKey(const char *key){
     mbedtls_aes_setkey_dec(&ctx, (const unsigned char *)key, 128);
+    // The hardware backend only holds an encryption key schedule
+    accelerated = false;
+  }
+
+  /// Allows or disallows use of the hardware AES backend, for keys set after this call.
+  /// Returns true if the backend is allowed and available.
+  bool AES::setAcceleration(bool enabled){
+    accelAllowed = enabled;
+    if (!enabled){accelerated = false;}
+    return enabled && *getAccelerationName();
+  }
+
+  /// Returns the name of the hardware AES backend this CPU supports, or an empty string.
+  const char *AES::getAccelerationName(){
+#ifdef AES_ACCEL
+    switch (getAccel()){
+    case ACCEL_VAES: return "VAES";
+    case ACCEL_AESNI: return "AES-NI";
+    default: break;
+    }
+#endif
+    return "";
   }
 
   DTSC::Packet AES::encryptPacketCTR(const DTSC::Meta &M, const DTSC::Packet &src, uint64_t ivec, size_t newTrack){
@@ -60,6 +255,18 @@ namespace Encryption{
   }
 
   bool AES::encryptBlockCTR(uint64_t ivec, const char *src, char *dest, size_t dataLen){
+#ifdef AES_ACCEL
+    if (accelerated){
+#ifdef AES_ACCEL_VAES
+      if (dataLen >= 256 && getAccel() == ACCEL_VAES){
+        vaesCTR(roundKeys, ivec, 0, src, dest, dataLen);
+        return true;
+      }
+#endif
+      aesniCTR(roundKeys, ivec, 0, src, dest, dataLen);
+      return true;
+    }
+#endif
     size_t ncOff = 0;
     unsigned char streamBlock[] ={0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
@@ -164,6 +371,14 @@ namespace Encryption{
 
   bool AES::encryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen){
     if (dataLen % 16){WARN_MSG("Encrypting a non-multiple of 16 bytes: %zu", dataLen);}
+#ifdef AES_ACCEL
+    if (accelerated){
+      // Same as mbedtls: refuse partial blocks
+      if (dataLen % 16){return false;}
+      aesniCBC(roundKeys, ivec, src, dest, dataLen);
+      return true;
+    }
+#endif
     return mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, dataLen, (unsigned char *)ivec,
                                  (const unsigned char *)src, (unsigned char *)dest) == 0;
   }
@@ -22,7 +22,13 @@ namespace Encryption{
     std::string encryptBlockCBC(char *ivec, const std::string &inp);
     bool encryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen);
 
+    bool setAcceleration(bool enabled);
+    static const char *getAccelerationName();
+
   protected:
     mbedtls_aes_context ctx;
+    bool accelAllowed; ///< False if the hardware backend should not be used, even if available
+    bool accelerated; ///< True if the current key is set up for the hardware backend
+    char roundKeys[176]; ///< Expanded AES-128 encryption key, for the hardware backend
   };
 }// namespace Encryption
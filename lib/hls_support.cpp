@@ -67,7 +67,7 @@ namespace HLS{
   /// returns the main track id provided in master manifest if valid
   /// else returns the current valid main track id
   size_t getTimingTrackId(const DTSC::Meta &M, const std::string &mTrack, const size_t mSelTrack){
-    return (mTrack.size() && (M.getValidTracks().count(atoll(mTrack.c_str()))))
+    return (mTrack.size() && (M.isValidTrack(atoll(mTrack.c_str()))))
                ? atoll(mTrack.c_str())
                : mSelTrack;
   }
@@ -0,0 +1,140 @@
+/// \file http_router.cpp
+/// Holds all code for the HTTP::Router class.
+
+#include "http_router.h"
+
+HTTP::Router::Router(){
+  clear();
+}
+
+/// Removes all handlers and patterns.
+void HTTP::Router::clear(){
+  handlers.clear();
+  patterns.clear();
+  nodes.clear();
+  nodes.resize(1);
+}
+
+/// Adds a handler with the given name, returning its index for use with addMatch and addPrefix.
+/// Handlers added earlier take precedence over handlers added later.
+size_t HTTP::Router::addHandler(const std::string &name){
+  handlers.push_back(name);
+  return handlers.size() - 1;
+}
+
+/// Adds a pattern the whole URL must match.
+void HTTP::Router::addMatch(size_t handler, const std::string &pattern){
+  add(handler, pattern, false);
+}
+
+/// Adds a pattern the URL must start with.
+void HTTP::Router::addPrefix(size_t handler, const std::string &pattern){
+  add(handler, pattern, true);
+}
+
+/// Returns the amount of patterns added.
+size_t HTTP::Router::size() const{
+  return patterns.size();
+}
+
+void HTTP::Router::add(size_t handler, const std::string &p, bool prefix){
+  pattern P;
+  P.handler = handler;
+  P.order = patterns.size();
+  P.prefix = prefix;
+  P.keyLen = p.find('$');
+  P.wildcard = (P.keyLen != std::string::npos);
+  if (P.wildcard){
+    P.suffix = p.substr(P.keyLen + 1);
+  }else{
+    P.keyLen = p.size();
+  }
+  // Walk down the trie along the key, adding nodes where needed
+  size_t n = 0;
+  for (size_t i = 0; i < P.keyLen; ++i){
+    size_t next = 0;
+    for (size_t c = 0; c < nodes[n].children.size(); ++c){
+      if (nodes[n].children[c].first == p[i]){
+        next = nodes[n].children[c].second;
+        break;
+      }
+    }
+    if (!next){
+      next = nodes.size();
+      nodes[n].children.push_back(std::pair<char, size_t>(p[i], next));
+      nodes.resize(next + 1);
+    }
+    n = next;
+  }
+  nodes[n].patterns.push_back(patterns.size());
+  patterns.push_back(P);
+}
+
+/// Checks a pattern whose key is known to be a prefix of url against the rest of the url.
+/// For wildcard patterns, sets the position and length of the stream name in url.
+bool HTTP::Router::matches(const pattern &p, const std::string &url, size_t &nameStart, size_t &nameLen) const{
+  if (!p.wildcard){return p.prefix || url.size() == p.keyLen;}
+  if (url.size() < p.keyLen + 1 + p.suffix.size()){return false;}
+  size_t end;
+  if (p.prefix){
+    // The stream name ends at the first occurrence of the suffix
+    end = url.find(p.suffix, p.keyLen);
+    if (end == std::string::npos){return false;}
+  }else{
+    // The stream name ends where the suffix at the end of the url starts
+    end = url.size() - p.suffix.size();
+    if (url.compare(end, p.suffix.size(), p.suffix)){return false;}
+  }
+  // Stream names never contain a slash
+  if (url.find('/', p.keyLen) < end){return false;}
+  nameStart = p.keyLen;
+  nameLen = end - p.keyLen;
+  return true;
+}
+
+/// Finds the handler for the given url. Returns false if there is none. Otherwise sets handler to
+/// its name, and streamname to the stream name in the url if a matching pattern contains a '$'.
+/// If several patterns of the handler contain a '$' and match, the one added last sets the name.
+bool HTTP::Router::route(const std::string &url, std::string &handler, std::string &streamname) const{
+  size_t best = std::string::npos;   // Handler found so far
+  size_t nameOrder = 0;              // Order of the pattern the stream name comes from
+  size_t nameStart = 0, nameLen = 0; // Stream name, if nameOrder is set
+  bool hasName = false;
+  size_t n = 0;
+  size_t depth = 0;
+  while (true){
+    const std::vector<size_t> &P = nodes[n].patterns;
+    for (std::vector<size_t>::const_iterator it = P.begin(); it != P.end(); ++it){
+      const pattern &p = patterns[*it];
+      if (p.handler > best){continue;}
+      size_t start, len;
+      if (!matches(p, url, start, len)){continue;}
+      if (p.handler < best){
+        best = p.handler;
+        hasName = false;
+      }
+      if (p.wildcard && (!hasName || p.order > nameOrder)){
+        hasName = true;
+        nameOrder = p.order;
+        nameStart = start;
+        nameLen = len;
+      }
+    }
+    if (depth == url.size()){break;}
+    size_t next = 0;
+    const std::vector<std::pair<char, size_t> > &C = nodes[n].children;
+    for (size_t c = 0; c < C.size(); ++c){
+      if (C[c].first == url[depth]){
+        next = C[c].second;
+        break;
+      }
+    }
+    if (!next){break;}
+    n = next;
+    ++depth;
+  }
+  if (best == std::string::npos){return false;}
+  handler = handlers[best];
+  if (hasName){streamname = url.substr(nameStart, nameLen);}
+  return true;
+}
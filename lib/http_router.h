@@ -0,0 +1,46 @@
+/// \file http_router.h
+/// Holds all headers for the HTTP::Router class.
+
+#pragma once
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace HTTP{
+
+  /// Finds the handler for a request URL among url_match and url_prefix patterns, as used in the
+  /// capabilities of HTTP based connectors. A '$' in a pattern stands for the stream name.
+  /// The patterns are stored in a trie on the part before the '$', so a lookup only looks at the
+  /// patterns that share their start with the URL instead of trying every pattern in turn.
+  /// When patterns of several handlers match, the handler that was added first wins.
+  class Router{
+  public:
+    Router();
+    void clear();
+    size_t addHandler(const std::string &name);
+    void addMatch(size_t handler, const std::string &pattern);
+    void addPrefix(size_t handler, const std::string &pattern);
+    size_t size() const;
+    bool route(const std::string &url, std::string &handler, std::string &streamname) const;
+
+  private:
+    struct pattern{
+      size_t handler;     ///< Index in handlers
+      size_t order;       ///< Order the pattern was added in, over all handlers
+      bool prefix;        ///< True for url_prefix patterns, false for url_match patterns
+      bool wildcard;      ///< True if the pattern contains a '$'
+      size_t keyLen;      ///< Length of the part before the '$', which is stored in the trie
+      std::string suffix; ///< Part after the '$'
+    };
+    struct node{
+      std::vector<std::pair<char, size_t> > children; ///< (next character, node index)
+      std::vector<size_t> patterns;                   ///< Patterns whose key ends here
+    };
+    std::vector<std::string> handlers;
+    std::vector<pattern> patterns;
+    std::vector<node> nodes;
+    void add(size_t handler, const std::string &p, bool prefix);
+    bool matches(const pattern &p, const std::string &url, size_t &nameStart, size_t &nameLen) const;
+  };
+
+}// namespace HTTP
@@ -3,6 +3,7 @@
 #include "bitfields.h"
 #include "defines.h"
 #include "json.h"
+#include <algorithm>
 #include <arpa/inet.h> //for htonl
 #include <fstream>
 #include <sstream>
@@ -256,8 +257,9 @@ static std::string UTF16(uint32_t c){
   return ret;
 }
 
-std::string JSON::string_escape(const std::string &val){
-  std::string out = "\"";
+/// Appends the JSON-string-escaped version of val to out
+static void appendEscaped(std::string &out, const std::string &val){
+  out += "\"";
   for (size_t i = 0; i < val.size(); ++i){
     const char &c = val.data()[i];
     switch (c){
@@ -311,6 +313,11 @@ std::string JSON::string_escape(const std::string &val){
     }
   }
   out += "\"";
+}
+
+std::string JSON::string_escape(const std::string &val){
+  std::string out;
+  appendEscaped(out, val);
   return out;
 }
 
@@ -1075,61 +1082,52 @@ std::string &JSON::Value::toNetPacked(){
 /// Converts this JSON::Value to valid JSON notation and returns it.
 /// Makes absolutely no attempts to pretty-print anything. :-)
 std::string JSON::Value::toString() const{
+  std::string out;
+  appendString(out);
+  return out;
+}
+
+/// Appends this JSON::Value in JSON notation to out.
+/// Used by toString, so the whole tree is written into a single string instead of concatenating
+/// the strings of all elements.
+void JSON::Value::appendString(std::string &out) const{
   switch (myType){
   case INTEGER:{
-    std::stringstream st;
-    st << intVal;
-    return st.str();
+    char buf[24];
+    out.append(buf, snprintf(buf, sizeof(buf), "%lld", intVal));
     break;
   }
   case DOUBLE:{
-    std::stringstream st;
-    st.precision(10);
-    st << std::fixed << dblVal;
-    return st.str();
-    break;
-  }
-  case BOOL:{
-    if (intVal != 0){
-      return "true";
-    }else{
-      return "false";
-    }
-    break;
-  }
-  case STRING:{
-    return JSON::string_escape(strVal);
+    char buf[400];
+    int len = snprintf(buf, sizeof(buf), "%.10f", dblVal);
+    out.append(buf, std::min(len, (int)sizeof(buf) - 1));
     break;
   }
+  case BOOL: out += (intVal != 0) ? "true" : "false"; break;
+  case STRING: appendEscaped(out, strVal); break;
   case ARRAY:{
-    std::string tmp = "[";
-    if (arrVal.size() > 0){
-      jsonForEachConst(*this, i){
-        tmp += i->toString();
-        if (i.num() + 1 != arrVal.size()){tmp += ",";}
-      }
+    out += '[';
+    for (std::vector<Value *>::const_iterator it = arrVal.begin(); it != arrVal.end(); ++it){
+      if (it != arrVal.begin()){out += ',';}
+      (*it)->appendString(out);
     }
-    tmp += "]";
-    return tmp;
+    out += ']';
     break;
   }
   case OBJECT:{
-    std::string tmp2 = "{";
-    if (objVal.size() > 0){
-      jsonForEachConst(*this, i){
-        tmp2 += JSON::string_escape(i.key()) + ":";
-        tmp2 += i->toString();
-        if (i.num() + 1 != objVal.size()){tmp2 += ",";}
-      }
+    out += '{';
+    for (std::map<std::string, Value *>::const_iterator it = objVal.begin(); it != objVal.end(); ++it){
+      if (it != objVal.begin()){out += ',';}
+      appendEscaped(out, it->first);
+      out += ':';
+      it->second->appendString(out);
     }
-    tmp2 += "}";
-    return tmp2;
+    out += '}';
     break;
   }
   case EMPTY:
-  default: return "null";
+  default: out += "null";
   }
-  return "null"; // should never get here...
 }
 
 /// Converts this JSON::Value to valid JSON notation and returns it.
@@ -1228,12 +1226,13 @@ JSON::Value & JSON::Value::append(){
 
 /// Prepends the given value to the beginning of this JSON::Value array.
 /// Turns this value into an array if it is not already one.
+/// Moves all existing elements up by one, so this takes time linear in the array size.
 void JSON::Value::prepend(const JSON::Value &rhs){
   if (myType != ARRAY){
     null();
     myType = ARRAY;
   }
-  arrVal.push_front(new JSON::Value(rhs));
+  arrVal.insert(arrVal.begin(), new JSON::Value(rhs));
 }
 
 /// For array and object JSON::Value objects, reduces them
@@ -1241,11 +1240,13 @@ void JSON::Value::prepend(const JSON::Value &rhs){
 /// the first elements and keeping the last ones.
 /// Does nothing for other JSON::Value types, nor does it
 /// do anything if the size is already lower or equal to the
-/// given size.
+/// given size. For arrays, the kept elements are moved to the
+/// front, which takes time linear in the array size.
 void JSON::Value::shrink(unsigned int size){
-  while (arrVal.size() > size){
-    delete arrVal.front();
-    arrVal.pop_front();
+  if (arrVal.size() > size){
+    size_t drop = arrVal.size() - size;
+    for (size_t i = 0; i < drop; ++i){delete arrVal[i];}
+    arrVal.erase(arrVal.begin(), arrVal.begin() + drop);
   }
   while (objVal.size() > size){
     delete objVal.begin()->second;
@@ -1262,7 +1263,7 @@ void JSON::Value::removeMember(const std::string &name){
   }
 }
 
-void JSON::Value::removeMember(const std::deque<Value *>::iterator &it){
+void JSON::Value::removeMember(const std::vector<Value *>::iterator &it){
   delete (*it);
   arrVal.erase(it);
 }
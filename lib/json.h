@@ -31,7 +31,7 @@ namespace JSON{
     std::string strVal;
     double dblVal;
     double dblDivider;
-    std::deque<Value *> arrVal;
+    std::vector<Value *> arrVal;
     std::map<std::string, Value *> objVal;
 
   public:
@@ -90,13 +90,14 @@ namespace JSON{
     void netPrepare();
     std::string &toNetPacked();
     std::string toString() const;
+    void appendString(std::string &out) const;
     std::string toPrettyString(size_t indent = 0) const;
     void append(const Value &rhs);
     Value & append();
     void prepend(const Value &rhs);
     void shrink(uint32_t size);
     void removeMember(const std::string &name);
-    void removeMember(const std::deque<Value *>::iterator &it);
+    void removeMember(const std::vector<Value *>::iterator &it);
     void removeMember(const std::map<std::string, Value *>::iterator &it);
     void removeNullMembers();
     bool isMember(const std::string &name) const;
@@ -137,7 +138,7 @@ namespace JSON{
     ValueType myType;
     Value *r;
     uint32_t i;
-    std::deque<Value *>::iterator aIt;
+    std::vector<Value *>::iterator aIt;
     std::map<std::string, Value *>::iterator oIt;
   };
   class ConstIter{
@@ -153,7 +154,7 @@ namespace JSON{
     ValueType myType;
     const Value *r;
     uint32_t i;
-    std::deque<Value *>::const_iterator aIt;
+    std::vector<Value *>::const_iterator aIt;
     std::map<std::string, Value *>::const_iterator oIt;
   };
 #define jsonForEach(val, i) for (JSON::Iter i(val); i; ++i)
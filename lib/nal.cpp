@@ -10,7 +10,130 @@
 #include "defines.h"
 #include "nal.h"
 
+// SIMD start code scanning: SSE2 and AVX2 on x86, selected at runtime based on CPUID so binaries
+// built with this still run on CPUs without AVX2. Other platforms use the scalar scanner.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(NOSIMD)
+#define NAL_SIMD 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace{
+  /// Returns the offset of the first 00 00 <third> sequence that starts at or after pos and lies
+  /// entirely within the first len bytes of data, or len if there is none. Third must not be zero.
+  size_t findScalar(const char *data, size_t pos, size_t len, char third){
+    const unsigned char *d = (const unsigned char *)data;
+    const unsigned char t = third;
+    while (pos + 2 < len){
+      if (d[pos + 2] == t){
+        if (!d[pos] && !d[pos + 1]){return pos;}
+        // No sequence can start in the next two bytes either, as it would need a zero here
+        pos += 3;
+        continue;
+      }
+      if (d[pos + 2]){
+        pos += 3;
+        continue;
+      }
+      // We COULD skip forward 1 or 2 bytes depending on contents of the second byte
+      // ...but skipping a single byte (removing the 'if') is actually faster (benchmarked).
+      ++pos;
+    }
+    return len;
+  }
+
+#ifdef NAL_SIMD
+  nalu::scanLevel detectLevel(){
+    unsigned int a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(d & bit_SSE2)){return nalu::SCAN_SCALAR;}
+    // AVX2 needs the OS to save the YMM registers on context switch
+    if ((c & bit_OSXSAVE) && (c & bit_AVX) && __get_cpuid_max(0, 0) >= 7){
+      unsigned int xLo, xHi;
+      __asm__("xgetbv" : "=a"(xLo), "=d"(xHi) : "c"(0));
+      __cpuid_count(7, 0, a, b, c, d);
+      if ((xLo & 6) == 6 && (b & (1 << 5))){return nalu::SCAN_AVX2;}
+    }
+    return nalu::SCAN_SSE2;
+  }
+
+  /// findScalar, 16 positions at a time: compares the bytes at offset 0 and 1 against zero and the
+  /// byte at offset 2 against third using unaligned loads, so the lowest set bit is the first match.
+  __attribute__((target("sse2"))) size_t findSSE2(const char *data, size_t pos, size_t len, char third){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i t = _mm_set1_epi8(third);
+    while (pos + 18 <= len){
+      __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + pos + 2)), t);
+      // The third byte rarely matches, so only check for the zeroes when it does
+      if (_mm_movemask_epi8(c)){
+        __m128i z0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + pos)), zero);
+        __m128i z1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + pos + 1)), zero);
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(z0, z1), c));
+        if (mask){return pos + __builtin_ctz(mask);}
+      }
+      pos += 16;
+    }
+    return findScalar(data, pos, len, third);
+  }
+
+  /// findSSE2, 32 positions at a time.
+  __attribute__((target("avx2"))) size_t findAVX2(const char *data, size_t pos, size_t len, char third){
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i t = _mm256_set1_epi8(third);
+    while (pos + 34 <= len){
+      __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + pos + 2)), t);
+      if (_mm256_movemask_epi8(c)){
+        __m256i z0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + pos)), zero);
+        __m256i z1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + pos + 1)), zero);
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(z0, z1), c));
+        if (mask){return pos + __builtin_ctz(mask);}
+      }
+      pos += 32;
+    }
+    return findSSE2(data, pos, len, third);
+  }
+#else
+  nalu::scanLevel detectLevel(){return nalu::SCAN_SCALAR;}
+#endif
+
+  nalu::scanLevel &currentLevel(){
+    static nalu::scanLevel level = detectLevel();
+    return level;
+  }
+
+  size_t findSequence(const char *data, size_t pos, size_t len, char third){
+    switch (currentLevel()){
+#ifdef NAL_SIMD
+    case nalu::SCAN_AVX2: return findAVX2(data, pos, len, third);
+    case nalu::SCAN_SSE2: return findSSE2(data, pos, len, third);
+#endif
+    default: return findScalar(data, pos, len, third);
+    }
+  }
+}// namespace
+
 namespace nalu{
+  /// Returns the instruction set the start code scanning functions currently use.
+  scanLevel getScanLevel(){return currentLevel();}
+
+  /// Makes the start code scanning functions use the given instruction set, or a slower one.
+  /// Returns false and changes nothing if this CPU does not support it. Meant for tests and
+  /// benchmarks; the fastest supported one is used by default.
+  bool setScanLevel(scanLevel level){
+    static scanLevel supported = detectLevel();
+    if (level > supported){return false;}
+    currentLevel() = level;
+    return true;
+  }
+
+  /// Returns the name of the given instruction set, for printing.
+  const char *getScanLevelName(scanLevel level){
+    switch (level){
+    case SCAN_AVX2: return "AVX2";
+    case SCAN_SSE2: return "SSE2";
+    default: return "scalar";
+    }
+  }
+
   std::deque<int> parseNalSizes(DTSC::Packet &pack){
     std::deque<int> result;
     char *data;
@@ -25,26 +148,36 @@ namespace nalu{
     return result;
   }
 
-  std::string removeEmulationPrevention(const std::string &data){
-    std::string result;
-    result.resize(data.size());
+  /// Copies dataSize bytes from data to result, leaving out the emulation prevention bytes (the 03
+  /// in every 00 00 03 sequence after the first two bytes). Result must have room for dataSize
+  /// bytes and may not overlap data. Returns the amount of bytes written to result.
+  size_t removeEmulationPrevention(const char *data, size_t dataSize, char *result){
+    if (dataSize < 3){
+      memcpy(result, data, dataSize);
+      return dataSize;
+    }
     result[0] = data[0];
     result[1] = data[1];
     size_t dataPtr = 2;
-    size_t dataLen = data.size();
     size_t resPtr = 2;
-    while (dataPtr + 2 < dataLen){
-      if (!data[dataPtr] && !data[dataPtr + 1] && data[dataPtr + 2] == 3){// We have found an emulation prevention
-        result[resPtr++] = data[dataPtr++];
-        result[resPtr++] = data[dataPtr++];
-        dataPtr++; // Skip the emulation prevention byte
-      }else{
-        result[resPtr++] = data[dataPtr++];
-      }
+    while (dataPtr + 2 < dataSize){
+      size_t found = findSequence(data, dataPtr, dataSize, 3);
+      if (found == dataSize){break;}
+      // Copy up to and including the two zero bytes, then skip the emulation prevention byte
+      memcpy(result + resPtr, data + dataPtr, found + 2 - dataPtr);
+      resPtr += found + 2 - dataPtr;
+      dataPtr = found + 3;
     }
+    memcpy(result + resPtr, data + dataPtr, dataSize - dataPtr);
+    return resPtr + dataSize - dataPtr;
+  }
 
-    while (dataPtr < dataLen){result[resPtr++] = data[dataPtr++];}
-    return result.substr(0, resPtr);
+  std::string removeEmulationPrevention(const std::string &data){
+    if (data.size() < 3){return data;}
+    std::string result;
+    result.resize(data.size());
+    result.resize(removeEmulationPrevention(data.data(), data.size(), &result[0]));
+    return result;
   }
 
   unsigned long toAnnexB(const char *data, unsigned long dataSize, char *&result){
@@ -73,26 +206,8 @@ namespace nalu{
 
   /// Scan data for Annex B start code. Returns pointer to it when found, null otherwise.
   const char *scanAnnexB(const char *data, uint32_t dataSize){
-    char *offset = (char *)data;
-    const char *maxData = data + dataSize - 2;
-    while (offset < maxData){
-      if (offset[2] > 1){
-        // We have no zero in the third byte, so we need to skip at least 3 bytes forward
-        offset += 3;
-        continue;
-      }
-      if (!offset[2]){
-        // We COULD skip forward 1 or 2 bytes depending on contents of the second byte
-        // offset += (offset[1]?2:1);
-        //... but skipping a single byte (removing the 'if') is actually faster (benchmarked).
-        ++offset;
-        continue;
-      }
-      if (!offset[0] && !offset[1]){return offset;}
-      // We have no zero in the third byte, so we need to skip at least 3 bytes forward
-      offset += 3;
-    }
-    return 0;
+    size_t pos = findSequence(data, 0, dataSize, 1);
+    return (pos == dataSize) ? 0 : data + pos;
   }
 
   unsigned long fromAnnexB(const char *data, unsigned long dataSize, char *&result){
@@ -114,8 +229,7 @@ namespace nalu{
         offset = dataSize;
         continue;
       }
-      const char *end = (const char *)memmem(begin, dataSize - (begin - data), "\000\000\001", 3);
-      if (!end){end = data + dataSize;}
+      const char *end = data + findSequence(data, begin - data, dataSize, 1);
       // Check for 4-byte lead in's. Yes, we access -1 here
       if (end > begin && (end - data) != dataSize && end[-1] == 0x00){end--;}
       unsigned int nalSize = end - begin;
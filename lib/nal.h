@@ -5,6 +5,12 @@
 #include <string>
 
 namespace nalu{
+  /// Instruction sets the start code scanning functions can use, slowest first.
+  enum scanLevel{SCAN_SCALAR = 0, SCAN_SSE2, SCAN_AVX2};
+  scanLevel getScanLevel();
+  bool setScanLevel(scanLevel level);
+  const char *getScanLevelName(scanLevel level);
+
   struct nalData{
     uint8_t nalType;
     size_t nalSize;
@@ -12,6 +18,7 @@ namespace nalu{
 
   std::deque<int> parseNalSizes(DTSC::Packet &pack);
   std::string removeEmulationPrevention(const std::string &data);
+  size_t removeEmulationPrevention(const char *data, size_t dataSize, char *result);
 
   unsigned long toAnnexB(const char *data, unsigned long dataSize, char *&result);
   unsigned long fromAnnexB(const char *data, unsigned long dataSize, char *&result);
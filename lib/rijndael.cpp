@@ -4,6 +4,7 @@
 #include "defines.h"
 #include "rijndael.h"
 
+#include <arpa/inet.h>
 #include <iomanip>
 #include <iostream>
 
@@ -195,6 +195,64 @@ RTMPStream::Chunk::Chunk(){
   data = "";
 }// constructor
 
+RTMPStream::ChunkWriter::ChunkWriter(){
+  contLen = 0;
+  chunkLeft = 0;
+  bytes = 0;
+}
+
+/// Starts a new message, discarding any previous one.
+/// \param header The header of the first chunk, including any extended timestamp.
+/// \param contHeader The header of all following chunks, including any extended timestamp.
+void RTMPStream::ChunkWriter::start(const char *header, size_t headerLen, const char *contHeader, size_t contLen_){
+  pieces.clear();
+  if (headerLen > sizeof(head)){headerLen = sizeof(head);}
+  if (contLen_ > sizeof(cont)){contLen_ = sizeof(cont);}
+  memcpy(head, header, headerLen);
+  memcpy(cont, contHeader, contLen_);
+  contLen = contLen_;
+  struct iovec v;
+  v.iov_base = head;
+  v.iov_len = headerLen;
+  pieces.push_back(v);
+  bytes = headerLen;
+  chunkLeft = RTMPStream::chunk_snd_max;
+}
+
+/// Adds len bytes of payload to the message, starting a new chunk each time the current one is full.
+void RTMPStream::ChunkWriter::append(const char *data, size_t len){
+  while (len){
+    if (!chunkLeft){
+      struct iovec c;
+      c.iov_base = cont;
+      c.iov_len = contLen;
+      pieces.push_back(c);
+      bytes += contLen;
+      chunkLeft = RTMPStream::chunk_snd_max;
+    }
+    struct iovec v;
+    v.iov_base = (void *)data;
+    v.iov_len = std::min(len, chunkLeft);
+    pieces.push_back(v);
+    bytes += v.iov_len;
+    chunkLeft -= v.iov_len;
+    data += v.iov_len;
+    len -= v.iov_len;
+  }
+}
+
+/// Returns the amount of bytes the message takes on the wire.
+size_t RTMPStream::ChunkWriter::size() const{
+  return bytes;
+}
+
+/// Sends the message over conn, and adds it to the sent data counter.
+void RTMPStream::ChunkWriter::send(Socket::Connection &conn){
+  if (!pieces.size()){return;}
+  conn.SendNow(&pieces[0], pieces.size());
+  RTMPStream::snd_cnt += bytes;
+}
+
 /// Packs up a chunk with the given arguments as properties.
 std::string &RTMPStream::SendChunk(unsigned int cs_id, unsigned char msg_type_id,
                                    unsigned int msg_stream_id, std::string data){
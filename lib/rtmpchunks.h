@@ -9,6 +9,7 @@
 #include <string.h>
 #include <string>
 #include <sys/time.h>
+#include <vector>
 
 #ifndef FILLER_DATA
 #define FILLER_DATA                                                                                \
@@ -67,6 +68,26 @@ namespace RTMPStream{
   };
   // RTMPStream::Chunk
 
+  /// Splits a single message into chunks of at most chunk_snd_max bytes for sending, without
+  /// copying its payload. The chunk headers are kept in the ChunkWriter, while the payload is sent
+  /// from where it is, so it must stay valid until send is called.
+  class ChunkWriter{
+  public:
+    ChunkWriter();
+    void start(const char *header, size_t headerLen, const char *contHeader, size_t contLen);
+    void append(const char *data, size_t len);
+    size_t size() const;
+    void send(Socket::Connection &conn);
+
+  private:
+    char head[18];                    ///< Header of the first chunk
+    char cont[8];                     ///< Header of all following chunks
+    size_t contLen;                   ///< Length of cont
+    size_t chunkLeft;                 ///< Payload bytes left in the current chunk
+    size_t bytes;                     ///< Total bytes in pieces
+    std::vector<struct iovec> pieces; ///< Headers and payload slices, in sending order
+  };
+
   extern std::map<unsigned int, Chunk> lastsend;
   extern std::map<unsigned int, Chunk> lastrecv;
 
@@ -473,6 +473,117 @@ namespace RTP{
   void MPEGVideoHeader::setBegin(){data[2] |= 0x10;}
   void MPEGVideoHeader::setEnd(){data[2] |= 0x8;}
 
+  /// Creates an empty ring holding at least the given amount of packets.
+  /// No memory is reserved for packet data until the first packet is stored.
+  PacketRing::PacketRing(size_t slots){
+    mask = 0;
+    slotSize = 0;
+    count = 0;
+    reserve(slots);
+  }
+
+  /// Grows the ring to hold at least the given amount of packets, keeping all stored packets
+  /// that still fit. The capacity is rounded up to a power of two, and never exceeds 65536.
+  void PacketRing::reserve(size_t slots){
+    size_t cap = 1;
+    while (cap < slots && cap < 65536){cap <<= 1;}
+    if (cap > mask + 1 || !lengths.size()){resize(cap, slotSize);}
+  }
+
+  /// Returns the amount of packets this ring can hold.
+  size_t PacketRing::capacity() const{return mask + 1;}
+
+  /// Returns the amount of packets currently stored.
+  size_t PacketRing::size() const{return count;}
+
+  /// Re-creates the slab with the given dimensions, moving over all stored packets.
+  void PacketRing::resize(size_t slots, size_t newSlotSize){
+    std::vector<char> oldSlab;
+    std::vector<uint32_t> oldLengths;
+    std::vector<uint16_t> oldSeqs;
+    oldSlab.swap(slab);
+    oldLengths.swap(lengths);
+    oldSeqs.swap(seqs);
+    size_t oldSlotSize = slotSize;
+    mask = slots - 1;
+    slotSize = newSlotSize;
+    lengths.resize(slots, 0);
+    seqs.resize(slots, 0);
+    if (slotSize){slab.resize(slots * slotSize);}
+    count = 0;
+    for (size_t i = 0; i < oldLengths.size(); ++i){
+      if (oldLengths[i]){store(oldSeqs[i], &oldSlab[i * oldSlotSize], oldLengths[i]);}
+    }
+  }
+
+  /// Returns true if the packet with the given sequence number is stored.
+  bool PacketRing::has(uint16_t seq) const{
+    size_t slot = seq & mask;
+    return lengths[slot] && seqs[slot] == seq;
+  }
+
+  /// Returns the packet with the given sequence number, which must be stored.
+  /// The returned packet points into the ring; it stays valid until the packet is removed or
+  /// overwritten, or the ring is resized.
+  Packet PacketRing::get(uint16_t seq) const{
+    return Packet(getData(seq), getSize(seq));
+  }
+
+  /// Returns a pointer to the data of the packet with the given sequence number, or null.
+  const char *PacketRing::getData(uint16_t seq) const{
+    if (!has(seq)){return 0;}
+    return &slab[(seq & mask) * slotSize];
+  }
+
+  /// Returns the size of the packet with the given sequence number, or zero.
+  size_t PacketRing::getSize(uint16_t seq) const{
+    if (!has(seq)){return 0;}
+    return lengths[seq & mask];
+  }
+
+  /// Stores a copy of the given packet, replacing whatever packet was in its slot.
+  void PacketRing::store(const Packet &pack){store(pack.getSequence(), pack.ptr(), pack.getSize());}
+
+  /// Stores a copy of the given packet data under the given sequence number, replacing whatever
+  /// packet was in its slot.
+  void PacketRing::store(uint16_t seq, const char *data, size_t len){
+    if (!data || !len){return;}
+    if (len > slotSize){
+      // Reserve room for a typical MTU-sized packet at least, to prevent repeated growing
+      size_t newSlotSize = slotSize ? slotSize : 1500;
+      while (newSlotSize < len){newSlotSize *= 2;}
+      resize(mask + 1, newSlotSize);
+    }
+    size_t slot = seq & mask;
+    if (!lengths[slot]){++count;}
+    memcpy(&slab[slot * slotSize], data, len);
+    lengths[slot] = len;
+    seqs[slot] = seq;
+  }
+
+  /// Removes the packet with the given sequence number, if stored.
+  void PacketRing::remove(uint16_t seq){
+    if (!has(seq)){return;}
+    lengths[seq & mask] = 0;
+    --count;
+  }
+
+  /// Returns the stored sequence number that comes first when counting up from the given one,
+  /// taking wraparound into account. Returns the given sequence number if the ring is empty.
+  uint16_t PacketRing::earliest(uint16_t from) const{
+    uint16_t ret = from;
+    uint16_t best = 0xFFFF;
+    for (size_t i = 0; i < lengths.size(); ++i){
+      if (!lengths[i]){continue;}
+      uint16_t dist = seqs[i] - from;
+      if (dist <= best){
+        best = dist;
+        ret = seqs[i];
+      }
+    }
+    return ret;
+  }
+
   Sorter::Sorter(uint64_t trackId, void (*cb)(const uint64_t track, const Packet &p)){
     packTrack = trackId;
     rtpSeq = 0;
@@ -510,13 +621,14 @@ namespace RTP{
       //If we've buffered the first 5 packets, assume we have the first one known
       if (packBuffer.size() >= 5){
         preBuffer = false;
-        rtpSeq = packBuffer.begin()->first;
+        rtpSeq = packBuffer.earliest(rtpSeq);
         rtpWSeq = rtpSeq;
       }
     }else{
       // packet is very early - assume dropped after PACKET_DROP_TIMEOUT packets
       while ((int16_t)(rtpSeq - pSNo) < -(int)PACKET_DROP_TIMEOUT){
         VERYHIGH_MSG("Giving up on track %" PRIu64 " packet %u", packTrack, rtpSeq);
+        packBuffer.remove(rtpSeq);
         ++rtpSeq;
         ++lostTotal;
         ++lostCurrent;
@@ -529,16 +641,16 @@ namespace RTP{
     // packet is somewhat early - ask for packet after PACKET_REORDER_WAIT packets
     while ((int16_t)(rtpWSeq - pSNo) < -(int)PACKET_REORDER_WAIT){
       //Only wanted if we don't already have it
-      if (!packBuffer.count(rtpWSeq)){
+      if (!packBuffer.has(rtpWSeq)){
         wantedSeqs.insert(rtpWSeq);
       }
       ++rtpWSeq;
     }
     // send any buffered packets we may have
     uint16_t prertpSeq = rtpSeq;
-    while (packBuffer.count(rtpSeq)){
-      outPacket(packTrack, packBuffer[rtpSeq]);
-      packBuffer.erase(rtpSeq);
+    while (packBuffer.has(rtpSeq)){
+      outPacket(packTrack, packBuffer.get(rtpSeq));
+      packBuffer.remove(rtpSeq);
       ++rtpSeq;
       ++packTotal;
       ++packCurrent;
@@ -549,7 +661,9 @@ namespace RTP{
     // packet is slightly early - buffer it
     if ((int16_t)(rtpSeq - pSNo) < 0){
       VERYHIGH_MSG("Buffering early packet #%u->%u", rtpSeq, pack.getSequence());
-      packBuffer[pack.getSequence()] = pack;
+      // Everything up to PACKET_DROP_TIMEOUT packets ahead must fit, and that may change at runtime
+      packBuffer.reserve(PACKET_DROP_TIMEOUT + 1);
+      packBuffer.store(pack);
     }
     // packet is late
     if ((int16_t)(rtpSeq - pSNo) > 0){
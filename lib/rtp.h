@@ -79,9 +79,40 @@ namespace RTP{
     Packet(const char *dat, uint64_t len);
     const char *getData();
     char *ptr() const{return data;}
+    uint32_t getSize() const{return maxDataLen;}
     std::string toString() const;
   };
 
+  /// Fixed-size buffer of RTP packets, indexed by sequence number.
+  /// All packet data is kept in a single slab that is allocated on first use, so storing a packet
+  /// does not allocate (unless it is larger than all packets before it) and all lookups are O(1).
+  /// A stored packet is overwritten once a packet is stored whose sequence number maps to the same
+  /// slot, which is the case for sequence numbers that are a multiple of the capacity apart.
+  class PacketRing{
+  public:
+    PacketRing(size_t slots = 64);
+    void reserve(size_t slots);
+    size_t capacity() const;
+    size_t size() const;
+    bool has(uint16_t seq) const;
+    Packet get(uint16_t seq) const;
+    const char *getData(uint16_t seq) const;
+    size_t getSize(uint16_t seq) const;
+    void store(const Packet &pack);
+    void store(uint16_t seq, const char *data, size_t len);
+    void remove(uint16_t seq);
+    uint16_t earliest(uint16_t from) const;
+
+  private:
+    size_t mask;                   ///< Capacity minus one; the capacity is always a power of two
+    size_t slotSize;               ///< Bytes reserved per packet in slab
+    size_t count;                  ///< Amount of stored packets
+    std::vector<char> slab;        ///< Packet data, slotSize bytes per slot
+    std::vector<uint32_t> lengths; ///< Length per slot, zero if empty
+    std::vector<uint16_t> seqs;    ///< Sequence number per slot
+    void resize(size_t slots, size_t newSlotSize);
+  };
+
   /// Sorts RTP packets, outputting them through a callback in correct order.
   /// Also keeps track of statistics, which it expects to be read/reset externally (for now).
   /// Optionally can be inherited from with the outPacket function overridden to not use a callback.
@@ -106,8 +137,7 @@ namespace RTP{
     uint64_t lastBootMS; ///< bootMS time of last Sender Report
   private:
     uint64_t packTrack;
-    std::map<uint16_t, Packet> packBuffer;
-    std::map<uint16_t, Packet> packetHistory;
+    PacketRing packBuffer;
     void (*callback)(const uint64_t track, const Packet &p);
   };
 
@@ -295,14 +295,14 @@ namespace RTP{
   /// The `receivedMediaPackets` is the history of media packets
   /// that you received and keep in a memory. These are used
   /// when XORing when we reconstruct a packet.
-  void PacketFEC::tryToRecoverMissingPacket(std::map<uint16_t, Packet> &receivedMediaPackets,
+  void PacketFEC::tryToRecoverMissingPacket(const PacketRing &receivedMediaPackets,
                                             Packet &reconstructedPacket){
 
     // Mark all the media packets that we protect and which have
     // been received as "received" in our internal list.
     std::set<uint16_t>::iterator protIt = coveredSeqNums.begin();
     while (protIt != coveredSeqNums.end()){
-      if (receivedMediaPackets.count(*protIt) == 1){addReceivedSequenceNumber(*protIt);}
+      if (receivedMediaPackets.has(*protIt)){addReceivedSequenceNumber(*protIt);}
       protIt++;
     }
 
@@ -366,7 +366,7 @@ namespace RTP{
         continue;
       }
 
-      Packet &mediaPacket = receivedMediaPackets[seqNum];
+      const Packet &mediaPacket = receivedMediaPackets.get(seqNum);
       char *mediaData = mediaPacket.ptr();
       uint16_t mediaSize = mediaPacket.getPayloadSize();
       uint8_t *mediaSizePtr = (uint8_t *)&mediaSize;
@@ -400,7 +400,7 @@ namespace RTP{
         ++protIt;
         continue;
       }
-      Packet &mediaPacket = receivedMediaPackets[seqNum];
+      const Packet &mediaPacket = receivedMediaPackets.get(seqNum);
       char *mediaData = mediaPacket.ptr() + mediaPacket.getHsize();
       for (size_t i = 0; i < recoverPayloadSize; ++i){recoverData[12 + i] ^= mediaData[i];}
       ++protIt;
@@ -412,13 +412,11 @@ namespace RTP{
     // @todo check what other header fields we need to fix.
   }
 
+  /// Keeps a history of the last 512 media packets, for recovery through FEC.
+  FECSorter::FECSorter() : packetHistory(512){tmpVideoLossPrevention = 0;}
+
   void FECSorter::addPacket(const Packet &pack){
-    if (tmpVideoLossPrevention & SDP_LOSS_PREVENTION_ULPFEC){
-      packetHistory[pack.getSequence()] = pack;
-      while (packetHistory.begin()->first < pack.getSequence() - 500){
-        packetHistory.erase(packetHistory.begin());
-      }
-    }
+    if (tmpVideoLossPrevention & SDP_LOSS_PREVENTION_ULPFEC){packetHistory.store(pack);}
     Sorter::addPacket(pack);
   }
 
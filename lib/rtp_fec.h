@@ -50,9 +50,9 @@ namespace RTP{
                                                  ///< this as we need to know if enough media packets
                                                  ///< exist that are needed to recover another one.
     void tryToRecoverMissingPacket(
-        std::map<uint16_t, RTP::Packet> &receivedMediaPackets,
-        Packet &reconstructedPacket); ///< Pass in a `std::map` indexed by sequence number of -all-
-                                      ///< the media packets that you keep as history. When this
+        const PacketRing &receivedMediaPackets,
+        Packet &reconstructedPacket); ///< Pass in a `PacketRing` with -all- the media packets
+                                      ///< that you keep as history. When this
                                       ///< `PacketFEC` is capable of recovering a media packet it
                                       ///< will fill the packet passed by reference.
 
@@ -71,6 +71,7 @@ namespace RTP{
 
   class FECSorter : public Sorter{
   public:
+    FECSorter();
     void addPacket(const Packet &pack);
     void addREDPacket(char *dat, unsigned int len, uint8_t codecPayloadType, uint8_t REDPayloadType,
                       uint8_t ULPFECPayloadType);
@@ -79,7 +80,7 @@ namespace RTP{
                                     ///< `handleSignalingCommandRemoteOfferForInput()`.  This
                                     ///< variable should be rmeoved when cleaning up.
   private:
-    std::map<uint16_t, Packet> packetHistory;
+    PacketRing packetHistory;
     std::vector<PacketFEC *> fecPackets;
   };
 
@@ -0,0 +1,283 @@
+/// \file segment_cache.cpp
+/// Shared memory cache of fully muxed media segments.
+
+#include "bitfields.h"
+#include "defines.h"
+#include "segment_cache.h"
+#include "tinythread.h"
+#include <fcntl.h>
+#include <string.h>
+
+#define SEGCACHE_MAGIC 0x4D534331 // "MSC1"
+#define SEGCACHE_HEADER 16 // 4b magic, 4b key length, 8b data length
+#define SEGCACHE_STATS_SIZE 4096
+
+namespace Util{
+
+  static tthread::mutex statsMutex;
+
+  /// Returns a pointer to the server-wide counters, creating the page if it does not exist yet.
+  /// The counters are plain 64-bit integers, updated with atomic adds so any process may write.
+  /// The page is opened and created under SEM_SEGCACHE_STATS, so only one process ever creates it.
+  static uint64_t *statsPage(){
+    static IPC::sharedPage statPage;
+    if (statPage.mapped){return (uint64_t *)statPage.mapped;}
+    tthread::lock_guard<tthread::mutex> guard(statsMutex);
+    if (statPage.mapped){return (uint64_t *)statPage.mapped;}
+    IPC::semaphore lock(SEM_SEGCACHE_STATS, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    if (!lock || !lock.tryWaitOneSecond()){return 0;}
+    statPage.init(SHM_SEGCACHE_STATS, SEGCACHE_STATS_SIZE, false, false);
+    if (!statPage.mapped){
+      statPage.init(SHM_SEGCACHE_STATS, SEGCACHE_STATS_SIZE, true);
+      // Counters should survive this process
+      statPage.master = false;
+    }
+    lock.post();
+    lock.close();
+    return (uint64_t *)statPage.mapped;
+  }
+
+  void SegmentCache::addStat(segmentCacheStat stat, uint64_t amount){
+    uint64_t *stats = statsPage();
+    if (stats){__sync_fetch_and_add(stats + stat, amount);}
+  }
+
+  void SegmentCache::subStat(segmentCacheStat stat, uint64_t amount){
+    uint64_t *stats = statsPage();
+    if (stats){__sync_fetch_and_sub(stats + stat, amount);}
+  }
+
+  /// Copies the server-wide counters into stats, which must hold SEGCACHE_STAT_COUNT values.
+  /// Returns false if no process ever used a segment cache.
+  bool SegmentCache::getStats(uint64_t *stats){
+    IPC::sharedPage statPage(SHM_SEGCACHE_STATS, SEGCACHE_STATS_SIZE, false, false);
+    if (!statPage.mapped){return false;}
+    memcpy(stats, statPage.mapped, SEGCACHE_STAT_COUNT * sizeof(uint64_t));
+    return true;
+  }
+
+  /// FNV-1a hash of the key, used to name the shared memory page of an entry.
+  /// Never returns zero, which marks an unused index slot.
+  uint64_t SegmentCache::keyHash(const std::string &key){
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < key.size(); ++i){
+      hash ^= (uint8_t)key[i];
+      hash *= 0x100000001b3ull;
+    }
+    return hash ? hash : 1;
+  }
+
+  SegmentCache::SegmentCache(){
+    maxSize = 0;
+    itemData = 0;
+    itemSize = 0;
+  }
+
+  SegmentCache::~SegmentCache(){}
+
+  /// Enables the cache for the given stream, using at most maxBytes of shared memory for it.
+  /// A maxBytes of zero leaves the cache disabled.
+  void SegmentCache::init(const std::string &streamName, uint64_t maxBytes){
+    stream = streamName;
+    maxSize = maxBytes;
+    index = Util::RelAccX();
+    if (!maxSize){return;}
+    char semName[NAME_BUFFER_SIZE];
+    snprintf(semName, NAME_BUFFER_SIZE, SEM_SEGCACHE, stream.c_str());
+    IPC::semaphore lock(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    if (!lock || !lock.tryWaitOneSecond()){
+      WARN_MSG("Could not lock segment cache of %s; not caching segments", stream.c_str());
+      return;
+    }
+    openIndex(true);
+    lock.post();
+    lock.close();
+  }
+
+  /// Opens the index page of the cache, optionally creating it. Caller must hold the lock if
+  /// create is true.
+  bool SegmentCache::openIndex(bool create){
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_SEGCACHE_INDEX, stream.c_str());
+    indexPage.init(pageName, SHM_SEGCACHE_INDEX_SIZE, false, false);
+    if (!indexPage.mapped){
+      if (!create){return false;}
+      indexPage.init(pageName, SHM_SEGCACHE_INDEX_SIZE, true);
+      if (!indexPage.mapped){
+        FAIL_MSG("Could not create segment cache index for %s", stream.c_str());
+        return false;
+      }
+      // Removed by wipe() once the stream shuts down, not when this viewer leaves
+      indexPage.master = false;
+    }
+    index = Util::RelAccX(indexPage.mapped, false);
+    if (!index.isReady()){
+      if (!create){return false;}
+      index.addField("hash", RAX_64UINT);
+      index.addField("until", RAX_64UINT);
+      index.addField("size", RAX_64UINT);
+      index.setRCount(SEGCACHE_ENTRIES);
+      index.setReady();
+      index.addRecords(SEGCACHE_ENTRIES);
+    }
+    hashField = index.getFieldData("hash");
+    untilField = index.getFieldData("until");
+    sizeField = index.getFieldData("size");
+    return true;
+  }
+
+  /// Returns true if the cache is enabled and usable.
+  SegmentCache::operator bool() const{return maxSize && index.isReady();}
+
+  /// Looks up the given key. On success data() and size() return the cached segment, which stays
+  /// valid until the next call to get(), even if the entry is evicted in the meanwhile.
+  bool SegmentCache::get(const std::string &key){
+    itemData = 0;
+    itemSize = 0;
+    if (!*this){return false;}
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_SEGCACHE_ITEM, stream.c_str(), keyHash(key));
+    itemPage.init(pageName, 0, false, false);
+    // An entry that is still being written has no magic yet; treat it as a miss
+    if (!itemPage.mapped || itemPage.len < SEGCACHE_HEADER || Bit::btohl(itemPage.mapped) != SEGCACHE_MAGIC){
+      itemPage.close();
+      addStat(SEGCACHE_MISSES, 1);
+      return false;
+    }
+    uint32_t keyLen = Bit::btohl(itemPage.mapped + 4);
+    uint64_t dataLen = Bit::btohll(itemPage.mapped + 8);
+    if (keyLen != key.size() || SEGCACHE_HEADER + keyLen + dataLen > itemPage.len ||
+        memcmp(itemPage.mapped + SEGCACHE_HEADER, key.data(), keyLen)){
+      // Hash collision or damaged entry
+      itemPage.close();
+      addStat(SEGCACHE_MISSES, 1);
+      return false;
+    }
+    itemData = itemPage.mapped + SEGCACHE_HEADER + keyLen;
+    itemSize = dataLen;
+    addStat(SEGCACHE_HITS, 1);
+    addStat(SEGCACHE_BYTES_SAVED, dataLen);
+    return true;
+  }
+
+  /// Returns the data of the entry found by the last successful get().
+  const char *SegmentCache::data() const{return itemData;}
+
+  /// Returns the size of the entry found by the last successful get().
+  uint64_t SegmentCache::size() const{return itemSize;}
+
+  /// Removes the entry in the given index slot. Caller must hold the lock.
+  void SegmentCache::evictEntry(size_t slot){
+    uint64_t hash = index.getInt(hashField, slot);
+    if (!hash){return;}
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_SEGCACHE_ITEM, stream.c_str(), hash);
+    IPC::sharedPage item(pageName, 0, false, false);
+    if (item.mapped){item.master = true;}
+    subStat(SEGCACHE_BYTES_CACHED, index.getInt(sizeField, slot));
+    addStat(SEGCACHE_EVICTIONS, 1);
+    index.setInt(hashField, 0, slot);
+    index.setInt(untilField, 0, slot);
+    index.setInt(sizeField, 0, slot);
+  }
+
+  /// Stores a finished segment under the given key. until is the end time of the segment; all
+  /// entries ending before evictBefore are evicted first (pass the start of the DVR window for
+  /// live streams). After that, the entries ending first are evicted until the new one fits.
+  /// Returns true if the segment was stored, false if it did not fit or was already present.
+  bool SegmentCache::store(const std::string &key, uint64_t until, const std::string &data, uint64_t evictBefore){
+    if (!*this || !data.size()){return false;}
+    uint64_t entrySize = SEGCACHE_HEADER + key.size() + data.size();
+    if (entrySize > maxSize){return false;}
+    uint64_t hash = keyHash(key);
+
+    char semName[NAME_BUFFER_SIZE];
+    snprintf(semName, NAME_BUFFER_SIZE, SEM_SEGCACHE, stream.c_str());
+    IPC::semaphore lock(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    if (!lock || !lock.tryWaitOneSecond()){return false;}
+
+    uint64_t total = 0;
+    size_t freeSlot = SEGCACHE_ENTRIES;
+    for (size_t i = 0; i < SEGCACHE_ENTRIES; ++i){
+      uint64_t slotHash = index.getInt(hashField, i);
+      if (slotHash == hash){
+        // Another viewer beat us to it
+        lock.post();
+        lock.close();
+        return false;
+      }
+      if (slotHash && index.getInt(untilField, i) < evictBefore){evictEntry(i);}
+      if (!index.getInt(hashField, i)){
+        if (freeSlot == SEGCACHE_ENTRIES){freeSlot = i;}
+        continue;
+      }
+      total += index.getInt(sizeField, i);
+    }
+    while (total + entrySize > maxSize || freeSlot == SEGCACHE_ENTRIES){
+      size_t oldest = SEGCACHE_ENTRIES;
+      for (size_t i = 0; i < SEGCACHE_ENTRIES; ++i){
+        if (!index.getInt(hashField, i)){continue;}
+        if (oldest == SEGCACHE_ENTRIES || index.getInt(untilField, i) < index.getInt(untilField, oldest)){
+          oldest = i;
+        }
+      }
+      if (oldest == SEGCACHE_ENTRIES){break;}
+      total -= index.getInt(sizeField, oldest);
+      evictEntry(oldest);
+      if (freeSlot == SEGCACHE_ENTRIES || oldest < freeSlot){freeSlot = oldest;}
+    }
+
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_SEGCACHE_ITEM, stream.c_str(), hash);
+    IPC::sharedPage item(pageName, entrySize, true);
+    if (!item.mapped){
+      lock.post();
+      lock.close();
+      return false;
+    }
+    Bit::htobl(item.mapped + 4, key.size());
+    Bit::htobll(item.mapped + 8, data.size());
+    memcpy(item.mapped + SEGCACHE_HEADER, key.data(), key.size());
+    memcpy(item.mapped + SEGCACHE_HEADER + key.size(), data.data(), data.size());
+    // Readers only trust entries with the magic set, so write it last
+    __sync_synchronize();
+    Bit::htobl(item.mapped, SEGCACHE_MAGIC);
+    item.master = false;
+
+    index.setInt(hashField, hash, freeSlot);
+    index.setInt(untilField, until, freeSlot);
+    index.setInt(sizeField, entrySize, freeSlot);
+    lock.post();
+    lock.close();
+
+    addStat(SEGCACHE_STORES, 1);
+    addStat(SEGCACHE_BYTES_STORED, data.size());
+    addStat(SEGCACHE_BYTES_CACHED, entrySize);
+    return true;
+  }
+
+  /// Removes all cached segments of the given stream, along with the cache itself.
+  /// Called when the stream shuts down.
+  void SegmentCache::wipe(const std::string &streamName){
+    SegmentCache C;
+    C.stream = streamName;
+    char semName[NAME_BUFFER_SIZE];
+    snprintf(semName, NAME_BUFFER_SIZE, SEM_SEGCACHE, streamName.c_str());
+    IPC::semaphore lock(semName, O_RDWR, ACCESSPERMS, 1);
+    if (!lock){return;}
+    lock.tryWaitOneSecond();
+    if (C.openIndex(false)){
+      size_t count = 0;
+      for (size_t i = 0; i < SEGCACHE_ENTRIES; ++i){
+        if (!C.index.getInt(C.hashField, i)){continue;}
+        C.evictEntry(i);
+        ++count;
+      }
+      if (count){INFO_MSG("Removed %zu cached segments of %s", count, streamName.c_str());}
+      C.indexPage.master = true;
+    }
+    lock.post();
+    lock.unlink();
+  }
+
+}// namespace Util
@@ -0,0 +1,59 @@
+/// \file segment_cache.h
+/// Shared memory cache of fully muxed media segments.
+
+#pragma once
+#include "shared_memory.h"
+#include "util.h"
+#include <string>
+
+namespace Util{
+
+  /// Indices of the server-wide counters kept in the SHM_SEGCACHE_STATS page.
+  enum segmentCacheStat{
+    SEGCACHE_HITS = 0,
+    SEGCACHE_MISSES,
+    SEGCACHE_STORES,
+    SEGCACHE_EVICTIONS,
+    SEGCACHE_BYTES_SAVED,
+    SEGCACHE_BYTES_STORED,
+    SEGCACHE_BYTES_CACHED,
+    SEGCACHE_STAT_COUNT
+  };
+
+  /// Shared cache of finished segments for a single stream.
+  /// The first viewer requesting a segment muxes it as usual and stores the result; all later
+  /// viewers of the same segment send the stored bytes as-is. Entries are identified by a key
+  /// string built by the caller, which must contain everything the muxed bytes depend on.
+  /// Every entry has an "until" timestamp, used to evict entries that left the live DVR window.
+  class SegmentCache{
+  public:
+    SegmentCache();
+    ~SegmentCache();
+    void init(const std::string &streamName, uint64_t maxBytes);
+    operator bool() const;
+    bool get(const std::string &key);
+    const char *data() const;
+    uint64_t size() const;
+    bool store(const std::string &key, uint64_t until, const std::string &data, uint64_t evictBefore = 0);
+    static void wipe(const std::string &streamName);
+    static bool getStats(uint64_t *stats);
+
+  private:
+    bool openIndex(bool create);
+    void evictEntry(size_t slot);
+    static uint64_t keyHash(const std::string &key);
+    static void addStat(segmentCacheStat stat, uint64_t amount);
+    static void subStat(segmentCacheStat stat, uint64_t amount);
+    std::string stream;
+    uint64_t maxSize;
+    IPC::sharedPage indexPage;
+    Util::RelAccX index;
+    Util::RelAccXFieldData hashField;
+    Util::RelAccXFieldData untilField;
+    Util::RelAccXFieldData sizeField;
+    IPC::sharedPage itemPage; ///< Page of the entry found by the last successful get()
+    const char *itemData;
+    uint64_t itemSize;
+  };
+
+}// namespace Util
@@ -8,12 +8,15 @@
 #include "json.h"
 #include <cstdlib>
 #include <ifaddrs.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <sstream>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #define BUFFER_BLOCKSIZE 4096 // set buffer blocksize to 4KiB
 
@@ -23,6 +26,18 @@
 #define SOCKETSIZE 51200ul
 #endif
 
+// Batched UDP I/O through recvmmsg/sendmmsg, one system call for up to UDP_BATCH_SIZE datagrams
+#if defined(__linux__) && !defined(NOMMSG)
+#define UDP_MMSG
+#define UDP_BATCH_SIZE 32
+/// Bookkeeping for a single recvmmsg/sendmmsg call
+struct udpBatch{
+  struct mmsghdr hdr[UDP_BATCH_SIZE];
+  struct iovec iov[UDP_BATCH_SIZE];
+  struct sockaddr_storage addr[UDP_BATCH_SIZE];
+};
+#endif
+
 /// Local-scope only helper function that prints address families
 static const char *addrFam(int f){
   switch (f){
@@ -575,6 +590,10 @@ void Socket::Connection::clear(){
   Error = false;
   Blocking = false;
   skipCount = 0;
+  sendBuffer.truncate(0);
+  sendHighWater = 0;
+  sendBatching = false;
+  sendCorked = false;
 #ifdef SSL
   sslConnected = false;
   server_fd = 0;
@@ -605,14 +624,16 @@ void Socket::Connection::addDown(const uint32_t i){
 }
 
 /// Internally used call to make an file descriptor blocking or not.
+/// Only changes the flags if the blocking mode actually changes.
 void setFDBlocking(int FD, bool blocking){
-  int flags = fcntl(FD, F_GETFL, 0);
+  int oldFlags = fcntl(FD, F_GETFL, 0);
+  int flags = oldFlags;
   if (!blocking){
     flags |= O_NONBLOCK;
   }else{
-    flags &= !O_NONBLOCK;
+    flags &= ~O_NONBLOCK;
   }
-  fcntl(FD, F_SETFL, flags);
+  if (flags != oldFlags){fcntl(FD, F_SETFL, flags);}
 }
 
 /// Internally used call to make an file descriptor blocking or not.
@@ -655,6 +676,7 @@ bool Socket::Connection::isBlocking(){
 /// This function calls shutdown, thus making the socket unusable in all other
 /// processes as well. Do not use on shared sockets that are still in use.
 void Socket::Connection::close(){
+  if (sendBuffer.size() && connected()){flushSendBatch();}
   if (sSend != -1){shutdown(sSend, SHUT_RDWR);}
   drop();
 }// Socket::Connection::close
@@ -662,8 +684,9 @@ void Socket::Connection::close(){
 /// Close connection. The internal socket is closed and then set to -1.
 /// If the connection is already closed, nothing happens.
 /// This function does *not* call shutdown, allowing continued use in other
-/// processes.
+/// processes. Data queued while batching sends is discarded.
 void Socket::Connection::drop(){
+  sendBuffer.truncate(0);
 #ifdef SSL
   if (sslConnected){
     DONTEVEN_MSG("SSL close");
@@ -986,14 +1009,189 @@ const Socket::Buffer &Socket::Connection::Received() const{
 
 /// Will not buffer anything but always send right away. Blocks.
 /// Any data that could not be send will block until it can be send or the connection is severed.
+/// Between beginSendBatch and endSendBatch, data is queued instead, and sent once enough of it has
+/// been queued.
 void Socket::Connection::SendNow(const char *data, size_t len){
-  bool bing = isBlocking();
-  if (!bing){setBlocking(true);}
-  unsigned int i = iwrite(data, std::min((long unsigned int)len, SOCKETSIZE));
-  while (i < len && connected()){
-    i += iwrite(data + i, std::min((long unsigned int)(len - i), SOCKETSIZE));
+#ifdef SSL
+  if (sslConnected){
+    bool bing = isBlocking();
+    if (!bing){setBlocking(true);}
+    unsigned int i = iwrite(data, std::min((long unsigned int)len, SOCKETSIZE));
+    while (i < len && connected()){
+      i += iwrite(data + i, std::min((long unsigned int)(len - i), SOCKETSIZE));
+    }
+    if (!bing){setBlocking(false);}
+    return;
+  }
+#endif
+  if (!len || !connected()){return;}
+  if (skipCount){
+    // Skipping is rare: let iwrite handle it, blocking until it is done
+    flushSendBatch(sendBatching);
+    unsigned int i = iwrite(data, len);
+    if (i < len){sendAll(data + i, len - i, 0, 0, sendBatching);}
+    return;
+  }
+  if (sendBatching){
+    if (len < sendHighWater && sendBuffer.append(data, len)){
+      if (sendBuffer.size() >= sendHighWater){flushSendBatch(true);}
+      return;
+    }
+    // Too big to queue: send it along with what was queued, in a single system call
+    size_t queued = sendBuffer.size();
+    sendBuffer.truncate(0);
+    sendAll(sendBuffer, queued, data, len, true);
+    return;
+  }
+  sendAll(data, len);
+}
+
+/// Sends data, followed by extraLen bytes of extra if set, blocking until all of it is sent or
+/// the connection is severed. Does not change the blocking mode of the socket, but waits for it
+/// to become writable when it is nonblocking and the kernel buffer is full.
+/// If more is set, tells the kernel more data follows soon, so it need not send a partial segment.
+void Socket::Connection::sendAll(const char *data, size_t len, const char *extra, size_t extraLen, bool more){
+  struct iovec iov[2];
+  iov[0].iov_base = (void *)data;
+  iov[0].iov_len = len;
+  iov[1].iov_base = (void *)extra;
+  iov[1].iov_len = extraLen;
+  struct iovec *vec = iov;
+  size_t vecLen = (extraLen ? 2 : 1);
+  if (!len){
+    ++vec;
+    --vecLen;
+  }
+  sendAll(vec, vecLen, more);
+}
+
+/// Sends all vecLen pieces in vec the same way, changing vec while doing so.
+void Socket::Connection::sendAll(struct iovec *vec, size_t vecLen, bool more){
+  int flags = 0;
+#ifdef MSG_MORE
+  if (more){flags |= MSG_MORE;}
+#endif
+  // Skip empty pieces, the loop below only does so for pieces that were (partially) sent
+  while (vecLen && !vec->iov_len){
+    ++vec;
+    --vecLen;
+  }
+  while (vecLen && connected()){
+    ssize_t r;
+    int cnt = (vecLen > IOV_MAX ? IOV_MAX : vecLen);
+    if (isTrueSocket){
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = vec;
+      msg.msg_iovlen = cnt;
+      r = sendmsg(sSend, &msg, (cnt < (int)vecLen) ? (flags | MSG_MORE) : flags);
+    }else{
+      r = writev(sSend, vec, cnt);
+    }
+    if (r < 0){
+      if (errno == EINTR){continue;}
+      if (errno == EWOULDBLOCK || errno == EAGAIN){
+        struct pollfd pfd;
+        pfd.fd = sSend;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, 1000);
+        continue;
+      }
+      Error = true;
+      lastErr = strerror(errno);
+      INSANE_MSG("Could not send data! Error: %s", lastErr.c_str());
+      sendBuffer.truncate(0);
+      close();
+      return;
+    }
+    if (r == 0){
+      DONTEVEN_MSG("Socket closed by remote");
+      sendBuffer.truncate(0);
+      close();
+      return;
+    }
+    up += r;
+    sendCorked = more;
+    while (vecLen && (size_t)r >= vec->iov_len){
+      r -= vec->iov_len;
+      ++vec;
+      --vecLen;
+    }
+    if (vecLen){
+      vec->iov_base = (char *)vec->iov_base + r;
+      vec->iov_len -= r;
+    }
   }
-  if (!bing){setBlocking(false);}
+}
+
+/// Sends count pieces of data, as if SendNow was called for each of them in order. Blocks.
+/// Unless they add up to less than a KiB and fit in the current send batch, the pieces are not
+/// copied, but sent along with any queued data in as few system calls as possible.
+/// The pieces themselves are not changed.
+void Socket::Connection::SendNow(const struct iovec *pieces, size_t count){
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i){total += pieces[i].iov_len;}
+  if (!total || !connected()){return;}
+#ifdef SSL
+  if (sslConnected){
+    bool bing = isBlocking();
+    if (!bing){setBlocking(true);}
+    for (size_t i = 0; i < count; ++i){SendNow((const char *)pieces[i].iov_base, pieces[i].iov_len);}
+    if (!bing){setBlocking(false);}
+    return;
+  }
+#endif
+  // Small amounts are cheaper to copy into the send batch than to gather
+  if (skipCount || (sendBatching && total < 1024 && sendBuffer.size() + total < sendHighWater)){
+    for (size_t i = 0; i < count; ++i){SendNow((const char *)pieces[i].iov_base, pieces[i].iov_len);}
+    return;
+  }
+  size_t queued = sendBuffer.size();
+  if (!sendPieces.allocate((count + 1) * sizeof(struct iovec))){
+    for (size_t i = 0; i < count; ++i){SendNow((const char *)pieces[i].iov_base, pieces[i].iov_len);}
+    return;
+  }
+  struct iovec *vec = (struct iovec *)(char *)sendPieces;
+  vec[0].iov_base = (char *)sendBuffer;
+  vec[0].iov_len = queued;
+  memcpy(vec + 1, pieces, count * sizeof(struct iovec));
+  sendBuffer.truncate(0);
+  sendAll(vec, count + 1, sendBatching);
+}
+
+/// Makes all following SendNow calls queue their data instead of sending it directly.
+/// Queued data is sent with as few system calls as possible once highWater bytes are queued, or
+/// when endSendBatch or flushSendBatch is called. Use this around code that sends many small
+/// pieces of data at once, such as the TS packets or RTMP chunks of a single media packet.
+void Socket::Connection::beginSendBatch(size_t highWater){
+  sendHighWater = highWater;
+  sendBatching = (highWater > 1);
+}
+
+/// Sends all data queued since beginSendBatch, and makes SendNow send directly again.
+void Socket::Connection::endSendBatch(){
+  flushSendBatch();
+  sendBatching = false;
+}
+
+/// Sends all queued data, blocking until it is sent or the connection is severed.
+/// If more is set, tells the kernel more data follows soon. If not, makes sure the kernel also
+/// sends what it held back from earlier sends that were told more would follow.
+void Socket::Connection::flushSendBatch(bool more){
+  if (!sendBuffer.size()){
+#ifdef TCP_CORK
+    // Clearing TCP_CORK pushes out pending partial segments, even if the socket was not corked
+    if (!more && sendCorked && isTrueSocket && sSend >= 0){
+      int off = 0;
+      setsockopt(sSend, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+#endif
+    if (!more){sendCorked = false;}
+    return;
+  }
+  size_t queued = sendBuffer.size();
+  sendBuffer.truncate(0);
+  sendAll(sendBuffer, queued, 0, 0, more);
 }
 
 /// Will not buffer anything but always send right away. Blocks.
@@ -1049,6 +1247,8 @@ unsigned int Socket::Connection::iwrite(const void *buffer, int len){
   }
 #endif
   if (!connected() || len < 1){return 0;}
+  // Data queued by SendNow goes out first
+  if (sendBuffer.size()){flushSendBatch(true);}
   if (skipCount){
     // We have bytes to skip writing.
     // Pretend we write them, but don't really.
@@ -1083,6 +1283,7 @@ unsigned int Socket::Connection::iwrite(const void *buffer, int len){
     DONTEVEN_MSG("Socket closed by remote");
     close();
   }
+  if (r > 0){sendCorked = false;}
   up += r;
   return r;
 }// Socket::Connection::iwrite
@@ -1601,6 +1802,11 @@ Socket::UDPConnection::UDPConnection(bool nonblock){
   down = 0;
   destAddr = 0;
   destAddr_size = 0;
+  recvSlot = 0;
+  recvCount = 0;
+  recvPos = 0;
+  sendCount = 0;
+  sendBatching = false;
 #ifdef __CYGWIN__
   data.allocate(SOCKETSIZE);
 #else
@@ -1671,12 +1877,20 @@ Socket::UDPConnection::UDPConnection(const UDPConnection &o){
     destAddr = 0;
     destAddr_size = 0;
   }
+  recvSlot = 0;
+  recvCount = 0;
+  recvPos = 0;
+  sendCount = 0;
+  sendBatching = false;
   data.allocate(2048);
 }
 
 /// Close the UDP socket
 void Socket::UDPConnection::close(){
+  recvCount = 0;
+  recvPos = 0;
   if (sock != -1){
+    flushSendBatch();
     errno = EINTR;
     while (::close(sock) != 0 && errno == EINTR){}
     sock = -1;
@@ -1695,6 +1909,8 @@ Socket::UDPConnection::~UDPConnection(){
 /// Stores the properties of the receiving end of this UDP socket.
 /// This will be the receiving end for all SendNow calls.
 void Socket::UDPConnection::SetDestination(std::string destIp, uint32_t port){
+  // Queued datagrams were meant for the old destination
+  flushSendBatch();
   // UDP sockets can switch between IPv4 and IPv6 on demand.
   // We change IPv4-mapped IPv6 addresses into IPv4 addresses for Windows-sillyness reasons.
   if (destIp.substr(0, 7) == "::ffff:"){destIp = destIp.substr(7);}
@@ -1815,6 +2031,17 @@ void Socket::UDPConnection::SendNow(const char *sdata){
 /// Prints an DLVL_FAIL level debug message if sending failed.
 void Socket::UDPConnection::SendNow(const char *sdata, size_t len){
   if (len < 1){return;}
+#ifdef UDP_MMSG
+  if (sendBatching){
+    if (!sendMeta.allocate(sizeof(udpBatch)) || !sendBuffer.append(sdata, len)){
+      flushSendBatch();
+    }else{
+      ((udpBatch *)(void *)sendMeta)->iov[sendCount++].iov_len = len;
+      if (sendCount == UDP_BATCH_SIZE){flushSendBatch();}
+      return;
+    }
+  }
+#endif
   int r = sendto(sock, sdata, len, 0, (sockaddr *)destAddr, destAddr_size);
   if (r > 0){
     up += r;
@@ -1823,6 +2050,52 @@ void Socket::UDPConnection::SendNow(const char *sdata, size_t len){
   }
 }
 
+/// Makes all following SendNow calls queue their datagram instead of sending it directly.
+/// Queued datagrams are sent with as few system calls as possible once the queue fills up,
+/// the destination changes, or endSendBatch is called. Use this around code that sends a burst
+/// of datagrams at once, such as all RTP packets of a single frame.
+void Socket::UDPConnection::beginSendBatch(){
+  sendBatching = true;
+}
+
+/// Sends all datagrams queued since beginSendBatch, and makes SendNow send directly again.
+void Socket::UDPConnection::endSendBatch(){
+  flushSendBatch();
+  sendBatching = false;
+}
+
+/// Sends all queued datagrams to the current destination.
+/// Prints an DLVL_FAIL level debug message if sending failed.
+void Socket::UDPConnection::flushSendBatch(){
+#ifdef UDP_MMSG
+  if (!sendCount){return;}
+  udpBatch &B = *(udpBatch *)(void *)sendMeta;
+  size_t offset = 0;
+  for (size_t i = 0; i < sendCount; ++i){
+    memset(&B.hdr[i], 0, sizeof(B.hdr[i]));
+    B.iov[i].iov_base = (char *)sendBuffer + offset;
+    offset += B.iov[i].iov_len;
+    B.hdr[i].msg_hdr.msg_iov = &B.iov[i];
+    B.hdr[i].msg_hdr.msg_iovlen = 1;
+    B.hdr[i].msg_hdr.msg_name = destAddr;
+    B.hdr[i].msg_hdr.msg_namelen = destAddr_size;
+  }
+  size_t sent = 0;
+  while (sent < sendCount){
+    int r = sendmmsg(sock, B.hdr + sent, sendCount - sent, 0);
+    if (r < 1){
+      if (r == -1 && errno == EINTR){continue;}
+      FAIL_MSG("Could not send %zu UDP datagrams through %d: %s", sendCount - sent, sock, strerror(errno));
+      break;
+    }
+    for (size_t i = sent; i < sent + r; ++i){up += B.hdr[i].msg_len;}
+    sent += r;
+  }
+  sendCount = 0;
+  sendBuffer.truncate(0);
+#endif
+}
+
 std::string Socket::UDPConnection::getBoundAddress(){
   std::string boundaddr;
   uint32_t boundport;
@@ -2019,24 +2292,84 @@ uint16_t Socket::UDPConnection::bind(int port, std::string iface, const std::str
 /// Attempt to receive a UDP packet.
 /// This will automatically allocate or resize the internal data buffer if needed.
 /// If a packet is received, it will be placed in the "data" member, with it's length in "data_len".
+/// Where supported, up to UDP_BATCH_SIZE packets are read from the kernel at once, and handed out
+/// one by one by the following calls; the sender of each is still written to the destination.
 /// \return True if a packet was received, false otherwise.
 bool Socket::UDPConnection::Receive(){
   if (sock == -1){return false;}
   data.truncate(0);
+#ifdef UDP_MMSG
+  while (recvPos < recvCount || fillRecvBatch()){
+    udpBatch &B = *(udpBatch *)(void *)recvMeta;
+    size_t i = recvPos++;
+    size_t r = B.hdr[i].msg_len;
+    if (!r){continue;}
+    if (destAddr && destAddr_size){
+      socklen_t addrLen = B.hdr[i].msg_hdr.msg_namelen;
+      memcpy(destAddr, &B.addr[i], addrLen < destAddr_size ? addrLen : destAddr_size);
+    }
+    down += r;
+    // Handle UDP packets that are too large: return what fit, the next batch will use larger slots
+    if (r > recvSlot){
+      WARN_MSG("UDP packet of %zu bytes truncated to %zu bytes", r, recvSlot);
+      data.assign((char *)recvBuffer + i * recvSlot, recvSlot);
+      INFO_MSG("Doubling UDP socket buffer from %" PRIu32 " to %" PRIu32, data.rsize(), data.rsize()*2);
+      data.allocate(data.rsize()*2);
+      return true;
+    }
+    data.assign((char *)recvBuffer + i * recvSlot, r);
+    return true;
+  }
+  return false;
+#else
   socklen_t destsize = destAddr_size;
   int r = recvfrom(sock, data, data.rsize(), MSG_TRUNC | MSG_DONTWAIT, (sockaddr *)destAddr, &destsize);
   if (r == -1){
     if (errno != EAGAIN){INFO_MSG("UDP receive: %d (%s)", errno, strerror(errno));}
     return false;
   }
-  data.append(0, r);
   down += r;
-  //Handle UDP packets that are too large
+  //Handle UDP packets that are too large: return what fit
   if (data.rsize() < (unsigned int)r){
+    WARN_MSG("UDP packet of %d bytes truncated to %" PRIu32 " bytes", r, data.rsize());
+    data.append(0, data.rsize());
     INFO_MSG("Doubling UDP socket buffer from %" PRIu32 " to %" PRIu32, data.rsize(), data.rsize()*2);
     data.allocate(data.rsize()*2);
+    return true;
   }
+  data.append(0, r);
   return (r > 0);
+#endif
+}
+
+/// Reads as many waiting datagrams as fit in a single batch, without blocking.
+/// Returns true if at least one datagram was read.
+bool Socket::UDPConnection::fillRecvBatch(){
+  recvCount = 0;
+  recvPos = 0;
+#ifdef UDP_MMSG
+  recvSlot = data.rsize();
+  if (!recvMeta.allocate(sizeof(udpBatch)) || !recvBuffer.allocate(recvSlot * UDP_BATCH_SIZE)){
+    return false;
+  }
+  udpBatch &B = *(udpBatch *)(void *)recvMeta;
+  for (size_t i = 0; i < UDP_BATCH_SIZE; ++i){
+    memset(&B.hdr[i], 0, sizeof(B.hdr[i]));
+    B.iov[i].iov_base = (char *)recvBuffer + i * recvSlot;
+    B.iov[i].iov_len = recvSlot;
+    B.hdr[i].msg_hdr.msg_iov = &B.iov[i];
+    B.hdr[i].msg_hdr.msg_iovlen = 1;
+    B.hdr[i].msg_hdr.msg_name = &B.addr[i];
+    B.hdr[i].msg_hdr.msg_namelen = sizeof(B.addr[i]);
+  }
+  int r = recvmmsg(sock, B.hdr, UDP_BATCH_SIZE, MSG_TRUNC | MSG_DONTWAIT, 0);
+  if (r == -1){
+    if (errno != EAGAIN){INFO_MSG("UDP receive: %d (%s)", errno, strerror(errno));}
+    return false;
+  }
+  recvCount = r;
+#endif
+  return recvCount;
 }
 
 int Socket::UDPConnection::getSock(){
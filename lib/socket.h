@@ -13,6 +13,7 @@
 #include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include "util.h"
@@ -92,6 +93,13 @@ namespace Socket{
     int iread(void *buffer, int len, int flags = 0);  ///< Incremental read call.
     bool iread(Buffer &buffer, int flags = 0); ///< Incremental write call that is compatible with Socket::Buffer.
     void setBoundAddr();
+    Util::ResizeablePointer sendBuffer; ///< Data queued by SendNow while batching sends
+    size_t sendHighWater;               ///< Amount of queued data that triggers a send
+    bool sendBatching;                  ///< True if SendNow queues instead of sending directly
+    bool sendCorked;                    ///< True if the kernel holds sent data back for more to follow
+    Util::ResizeablePointer sendPieces; ///< Pieces for a gathering send, queued data first
+    void sendAll(const char *data, size_t len, const char *extra = 0, size_t extraLen = 0, bool more = false);
+    void sendAll(struct iovec *vec, size_t vecLen, bool more);
 
   protected:
     std::string lastErr; ///< Stores last error, if any.
@@ -149,6 +157,10 @@ namespace Socket{
     void SendNow(const char *data); ///< Will not buffer anything but always send right away. Blocks.
     void SendNow(const char *data,
                  size_t len); ///< Will not buffer anything but always send right away. Blocks.
+    void SendNow(const struct iovec *pieces, size_t count);
+    void beginSendBatch(size_t highWater = 65536);
+    void endSendBatch();
+    void flushSendBatch(bool more = false);
     void skipBytes(uint32_t byteCount);
     uint32_t skipCount;
     // unbuffered i/o methods
@@ -203,6 +215,17 @@ namespace Socket{
     std::string boundAddr, boundMulti;
     int boundPort;
     void checkRecvBuf();
+    Util::ResizeablePointer recvBuffer; ///< Datagrams read by the last batched receive
+    Util::ResizeablePointer recvMeta;   ///< Message headers and addresses for recvBuffer
+    size_t recvSlot;                    ///< Space reserved per datagram in recvBuffer
+    size_t recvCount;                   ///< Amount of datagrams in recvBuffer
+    size_t recvPos;                     ///< Next datagram in recvBuffer to hand out
+    bool fillRecvBatch();
+    Util::ResizeablePointer sendBuffer; ///< Datagrams queued while batching sends
+    Util::ResizeablePointer sendMeta;   ///< Message headers for sendBuffer
+    size_t sendCount;                   ///< Amount of datagrams in sendBuffer
+    bool sendBatching;                  ///< True if SendNow queues instead of sending directly
+    void flushSendBatch();
 
   public:
     Util::ResizeablePointer data;
@@ -223,5 +246,7 @@ namespace Socket{
     void SendNow(const std::string &data);
     void SendNow(const char *data);
     void SendNow(const char *data, size_t len);
+    void beginSendBatch();
+    void endSendBatch();
   };
 }// namespace Socket
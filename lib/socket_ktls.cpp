@@ -0,0 +1,113 @@
+#include "defines.h"
+#include "socket_ktls.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#if defined(__linux__) && defined(MBEDTLS_SSL_EXPORT_KEYS) && defined(WITH_KTLS)
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#if defined(TLS_RX) && defined(TLS_CIPHER_AES_GCM_256)
+#define KTLS
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+/// Installs one direction of a TLS 1.2 AES-GCM session on a socket that has the TLS ULP attached.
+/// The explicit nonce continues from the record sequence number, as mbedtls does.
+template <class T>
+static bool setKernelKey(int sock, int direction, int cipher, const std::string &key,
+                         const std::string &salt, uint64_t seq){
+  T info;
+  memset(&info, 0, sizeof(info));
+  if (key.size() != sizeof(info.key) || salt.size() != sizeof(info.salt)){return false;}
+  info.info.version = TLS_1_2_VERSION;
+  info.info.cipher_type = cipher;
+  memcpy(info.key, key.data(), sizeof(info.key));
+  memcpy(info.salt, salt.data(), sizeof(info.salt));
+  for (size_t i = 0; i < 8; ++i){info.rec_seq[i] = info.iv[i] = (seq >> (56 - 8 * i)) & 0xFF;}
+  return !setsockopt(sock, SOL_TLS, direction, &info, sizeof(info));
+}
+
+/// Installs one direction, picking AES-128-GCM or AES-256-GCM by key size
+static bool setKernelKey(int sock, int direction, const std::string &key, const std::string &salt){
+  if (key.size() == 16){
+    return setKernelKey<tls12_crypto_info_aes_gcm_128>(sock, direction, TLS_CIPHER_AES_GCM_128, key,
+                                                       salt, Socket::KernelTLS::firstSequence);
+  }
+  return setKernelKey<tls12_crypto_info_aes_gcm_256>(sock, direction, TLS_CIPHER_AES_GCM_256, key, salt,
+                                                     Socket::KernelTLS::firstSequence);
+}
+#endif
+#endif
+
+const uint64_t Socket::KernelTLS::firstSequence;
+
+/// Makes mbedtls hand the session keys of handshakes using the given configuration to this object.
+void Socket::KernelTLS::exportKeys(mbedtls_ssl_config *conf){
+#ifdef MBEDTLS_SSL_EXPORT_KEYS
+  mbedtls_ssl_conf_export_keys_ext_cb(conf, onKeys, this);
+#endif
+}
+
+#ifdef MBEDTLS_SSL_EXPORT_KEYS
+/// Called by mbedtls once the session keys are known. Keeps the write keys and implicit IVs of
+/// both sides. The key block holds the MAC keys, the client and server write keys and the client
+/// and server IVs, in that order.
+int Socket::KernelTLS::onKeys(void *p, const unsigned char *ms, const unsigned char *kb, size_t maclen,
+                              size_t keylen, size_t ivlen, const unsigned char clientRandom[32],
+                              const unsigned char serverRandom[32], mbedtls_tls_prf_types prf){
+  KernelTLS *me = (KernelTLS *)p;
+  const char *keys = (const char *)kb + 2 * maclen;
+  me->clientKey.assign(keys, keylen);
+  me->serverKey.assign(keys + keylen, keylen);
+  me->clientIV.assign(keys + 2 * keylen, ivlen);
+  me->serverIV.assign(keys + 2 * keylen + ivlen, ivlen);
+  return 0;
+}
+#endif
+
+/// Returns true if the kernel could take over the given session: it is TLS 1.2 using AES-GCM, the
+/// keys were exported, and mbedtls has no received data buffered that would get lost.
+bool Socket::KernelTLS::usable(mbedtls_ssl_context *ssl) const{
+#ifdef KTLS
+  if (serverIV.size() != 4 || clientIV.size() != 4){return false;}
+  if (strcmp(mbedtls_ssl_get_version(ssl), "TLSv1.2")){return false;}
+  // Other ciphers (such as ARIA or Camellia) use GCM too, only AES-GCM is for the kernel
+  const char *suite = mbedtls_ssl_get_ciphersuite(ssl);
+  if (!strstr(suite, "-AES-128-GCM-") && !strstr(suite, "-AES-256-GCM-")){return false;}
+  // A completed handshake has flushed everything it sent, but may have read ahead
+  return !mbedtls_ssl_check_pending(ssl);
+#else
+  return false;
+#endif
+}
+
+/// Hands encryption and decryption on the (server side) socket to the kernel.
+/// Returns 1 if the kernel took over, 0 if the kernel cannot and the socket was left untouched, so
+/// mbedtls can still be used, or -1 if the kernel took over receiving but not sending, which
+/// leaves the socket unusable.
+int Socket::KernelTLS::enable(int sock) const{
+#ifdef KTLS
+  if (setsockopt(sock, SOL_TCP, TCP_ULP, "tls", sizeof("tls"))){
+    HIGH_MSG("Kernel TLS not available: %s", strerror(errno));
+    return 0;
+  }
+  // Until a direction has keys the socket passes data through as-is, so the receiving side is
+  // set up first: older kernels only support sending, and mbedtls can still be used then.
+  if (!setKernelKey(sock, TLS_RX, clientKey, clientIV)){
+    HIGH_MSG("Kernel TLS receiving not available: %s", strerror(errno));
+    return 0;
+  }
+  if (!setKernelKey(sock, TLS_TX, serverKey, serverIV)){
+    FAIL_MSG("Kernel TLS receives but cannot send: %s", strerror(errno));
+    return -1;
+  }
+  return 1;
+#else
+  return 0;
+#endif
+}
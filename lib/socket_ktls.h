@@ -0,0 +1,37 @@
+#pragma once
+#include <mbedtls/config.h>
+#include <mbedtls/ssl.h>
+#include <stdint.h>
+#include <string>
+
+namespace Socket{
+
+  /// Hands the record layer of a TLS 1.2 AES-GCM session that mbedtls set up to the kernel, so the
+  /// socket carries plaintext from then on and data no longer needs a pass through userspace.
+  /// Call exportKeys on the SSL configuration before the handshake, then enable on the socket
+  /// right after the handshake completed, before any application data went through mbedtls.
+  /// Only uses public mbedtls API: the keys come from the export-keys callback, and the record
+  /// sequence numbers are known because nothing but the Finished messages used the session keys.
+  /// The kernel only takes over in builds with WITH_KTLS; otherwise usable() is always false.
+  class KernelTLS{
+  public:
+    /// Sequence number of the first record after the handshake, in both directions.
+    /// The Finished message of either side was record 0 under the new keys.
+    static const uint64_t firstSequence = 1;
+    void exportKeys(mbedtls_ssl_config *conf);
+    bool usable(mbedtls_ssl_context *ssl) const;
+    int enable(int sock) const;
+    std::string clientKey; ///< Write key of the client side of the session
+    std::string serverKey; ///< Write key of the server side of the session
+    std::string clientIV;  ///< Implicit IV (salt) of the client side of the session
+    std::string serverIV;  ///< Implicit IV (salt) of the server side of the session
+
+  private:
+#ifdef MBEDTLS_SSL_EXPORT_KEYS
+    static int onKeys(void *p, const unsigned char *ms, const unsigned char *kb, size_t maclen,
+                      size_t keylen, size_t ivlen, const unsigned char clientRandom[32],
+                      const unsigned char serverRandom[32], mbedtls_tls_prf_types prf);
+#endif
+  };
+
+}// namespace Socket
@@ -13,14 +13,16 @@
 #include "shared_memory.h"
 #include "socket.h"
 #include "stream.h"
+#include "tinythread.h"
 #include "triggers.h" //LTS
+#include <algorithm>
 #include <semaphore.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-enum Util::trackSortOrder Util::defaultTrackSortOrder = TRKSORT_DEFAULT;
+__thread enum Util::trackSortOrder Util::defaultTrackSortOrder = TRKSORT_DEFAULT;
 
 /// Calls strftime using the current local time, returning empty string on any error.
 static std::string strftime_now(const std::string &format){
@@ -206,6 +208,53 @@ Util::packetSorter::packetSorter(){
   dequeMode = false;
 }
 
+/// Restores the heap property downwards from the given position.
+/// The heap is a min-heap: the packet that should play first is always at index 0.
+void Util::packetSorter::siftDown(size_t pos){
+  size_t count = heapBuffer.size();
+  if (pos >= count){return;}
+  sortedPageInfo moving = heapBuffer[pos];
+  while (true){
+    size_t child = pos * 2 + 1;
+    if (child >= count){break;}
+    if (child + 1 < count && heapBuffer[child + 1] < heapBuffer[child]){++child;}
+    if (!(heapBuffer[child] < moving)){break;}
+    heapBuffer[pos] = heapBuffer[child];
+    pos = child;
+  }
+  heapBuffer[pos] = moving;
+}
+
+/// Restores the heap property upwards from the given position.
+void Util::packetSorter::siftUp(size_t pos){
+  if (pos >= heapBuffer.size()){return;}
+  sortedPageInfo moving = heapBuffer[pos];
+  while (pos){
+    size_t parent = (pos - 1) / 2;
+    if (!(moving < heapBuffer[parent])){break;}
+    heapBuffer[pos] = heapBuffer[parent];
+    pos = parent;
+  }
+  heapBuffer[pos] = moving;
+}
+
+/// Removes entries equal to the first packet, like the set this replaced never held duplicates.
+/// In a min-heap every ancestor of a copy of the first packet equals it as well, so the first
+/// packet has a copy somewhere only if one of its children is a copy. Duplicates thus get dropped
+/// the moment they reach the top, before they could be played twice.
+void Util::packetSorter::dropFirstDuplicates(){
+  while (heapBuffer.size() > 1){
+    size_t dup = 0;
+    for (size_t i = 1; i < 3 && i < heapBuffer.size(); ++i){
+      if (!(heapBuffer[0] < heapBuffer[i])){dup = i;}
+    }
+    if (!dup){return;}
+    heapBuffer[dup] = heapBuffer.back();
+    heapBuffer.pop_back();
+    if (dup < heapBuffer.size()){siftDown(dup);}
+  }
+}
+
 /// Sets sync mode on if true (sync), off if false (async).
 void Util::packetSorter::setSyncMode(bool synced){
   if (dequeMode != !synced){
@@ -217,11 +266,14 @@ void Util::packetSorter::setSyncMode(bool synced){
       }
       dequeBuffer.clear();
     }else{
-      //we've switched away from set
-      for (std::set<Util::sortedPageInfo>::iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
+      //we've switched away from the heap; keep playback order in the deque
+      std::sort(heapBuffer.begin(), heapBuffer.end());
+      for (std::vector<Util::sortedPageInfo>::iterator it = heapBuffer.begin(); it != heapBuffer.end(); ++it){
+        //duplicates are next to each other once sorted; keep only the first
+        if (it != heapBuffer.begin() && !(*(it - 1) < *it)){continue;}
         insert(*it);
       }
-      setBuffer.clear();
+      heapBuffer.clear();
     }
   }
 }
@@ -230,14 +282,16 @@ void Util::packetSorter::setSyncMode(bool synced){
 bool Util::packetSorter::getSyncMode() const{return !dequeMode;}
 
 /// Returns the amount of packets currently in the sorter.
+/// In sync mode, this includes duplicates that have not reached the top yet.
 size_t Util::packetSorter::size() const{
-  if (dequeMode){return dequeBuffer.size();}else{return setBuffer.size();}
+  if (dequeMode){return dequeBuffer.size();}else{return heapBuffer.size();}
 }
 
 /// Clears all packets from the sorter; does not reset mode.
+/// Keeps the allocated capacity, so refilling the sorter afterwards does not allocate.
 void Util::packetSorter::clear(){
   dequeBuffer.clear();
-  setBuffer.clear();
+  heapBuffer.clear();
 }
 
 /// Returns a pointer to the first packet in the sorter.
@@ -245,16 +299,19 @@ const Util::sortedPageInfo * Util::packetSorter::begin() const{
   if (dequeMode){
     return &*dequeBuffer.begin();
   }else{
-    return &*setBuffer.begin();
+    return &*heapBuffer.begin();
   }
 }
 
 /// Inserts a new packet in the sorter.
+/// In sync mode, a duplicate of a packet already in the sorter is dropped once it reaches the top.
 void Util::packetSorter::insert(const sortedPageInfo &pInfo){
   if (dequeMode){
     dequeBuffer.push_back(pInfo);
   }else{
-    setBuffer.insert(pInfo);
+    heapBuffer.push_back(pInfo);
+    siftUp(heapBuffer.size() - 1);
+    dropFirstDuplicates();
   }
 }
 
@@ -268,11 +325,17 @@ void Util::packetSorter::dropTrack(size_t tid){
       }
     }
   }else{
-    for (std::set<Util::sortedPageInfo>::iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
-      if (it->tid == tid){
-        setBuffer.erase(it);
-        return;
+    for (size_t i = 0; i < heapBuffer.size(); ++i){
+      if (heapBuffer[i].tid != tid){continue;}
+      // Move the last entry into the gap, then restore the heap in whichever direction is needed
+      heapBuffer[i] = heapBuffer.back();
+      heapBuffer.pop_back();
+      if (i < heapBuffer.size()){
+        siftUp(i);
+        siftDown(i);
       }
+      dropFirstDuplicates();
+      return;
     }
   }
 }
@@ -285,8 +348,14 @@ void Util::packetSorter::replaceFirst(const sortedPageInfo &pInfo){
     dequeBuffer.pop_front();
     dequeBuffer.push_back(pInfo);
   }else{
-    setBuffer.erase(setBuffer.begin());
-    setBuffer.insert(pInfo);
+    //overwrite the top of the heap and let it sink to its place: one pass, no allocations
+    if (!heapBuffer.size()){
+      insert(pInfo);
+      return;
+    }
+    heapBuffer[0] = pInfo;
+    siftDown(0);
+    dropFirstDuplicates();
   }
 }
 
@@ -305,7 +374,7 @@ bool Util::packetSorter::hasEntry(size_t tid) const{
       if (it->tid == tid){return true;}
     }
   }else{
-    for (std::set<Util::sortedPageInfo>::const_iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
+    for (std::vector<Util::sortedPageInfo>::const_iterator it = heapBuffer.begin(); it != heapBuffer.end(); ++it){
       if (it->tid == tid){return true;}
     }
   }
@@ -320,7 +389,7 @@ void Util::packetSorter::getTrackList(std::set<size_t> &toFill) const{
       toFill.insert(it->tid);
     }
   }else{
-    for (std::set<Util::sortedPageInfo>::const_iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
+    for (std::vector<Util::sortedPageInfo>::const_iterator it = heapBuffer.begin(); it != heapBuffer.end(); ++it){
       toFill.insert(it->tid);
     }
   }
@@ -334,12 +403,25 @@ void Util::packetSorter::getTrackList(std::map<size_t, uint64_t> &toFill) const{
       toFill[it->tid] = it->time;
     }
   }else{
-    for (std::set<Util::sortedPageInfo>::const_iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
+    for (std::vector<Util::sortedPageInfo>::const_iterator it = heapBuffer.begin(); it != heapBuffer.end(); ++it){
       toFill[it->tid] = it->time;
     }
   }
 }
 
+/// Logs that the configuration of the given stream base name could not be found.
+static void noStreamConfigMsg(const std::string &smp){
+  if (!Util::getGlobalConfig("defaultStream")){
+    WARN_MSG("Could not get stream '%s' config!", smp.c_str());
+  }else{
+    INFO_MSG("Could not get stream '%s' config, not emitting WARN message because fallback is "
+             "configured",
+             smp.c_str());
+  }
+}
+
+/// Returns a copy of the configuration of the given stream, or a null value if it is not
+/// configured. Use a StreamConfigReader instead when a few settings or repeated reads are needed.
 JSON::Value Util::getStreamConfig(const std::string &streamname){
   JSON::Value result;
   if (streamname.size() > 100){
@@ -347,32 +429,29 @@ JSON::Value Util::getStreamConfig(const std::string &streamname){
              streamname.size());
     return result;
   }
-  std::string smp = streamname.substr(0, streamname.find_first_of("+ "));
-
-  char tmpBuf[NAME_BUFFER_SIZE];
-  snprintf(tmpBuf, NAME_BUFFER_SIZE, SHM_STREAM_CONF, smp.c_str());
-  Util::DTSCShmReader rStrmConf(tmpBuf);
-  DTSC::Scan stream_cfg = rStrmConf.getScan();
-  if (!stream_cfg){
-    if (!Util::getGlobalConfig("defaultStream")){
-      WARN_MSG("Could not get stream '%s' config!", smp.c_str());
-    }else{
-      INFO_MSG("Could not get stream '%s' config, not emitting WARN message because fallback is "
-               "configured",
-               smp.c_str());
-    }
+  Util::StreamConfigReader rStrmConf;
+  rStrmConf.update(streamname);
+  if (!rStrmConf){
+    noStreamConfigMsg(streamname.substr(0, streamname.find_first_of("+ ")));
     return result;
   }
-  return stream_cfg.asJSON();
+  return rStrmConf.getScan().asJSON();
 }
 
 JSON::Value Util::getGlobalConfig(const std::string &optionName){
-  IPC::sharedPage globCfg(SHM_GLOBAL_CONF);
-  if (!globCfg.mapped){
-    FAIL_MSG("Could not open global configuration options to read setting for '%s'", optionName.c_str());
-    return JSON::Value();
+  // The page is kept open between calls, and opened again once the controller replaces it
+  static tthread::mutex globCfgMutex;
+  static IPC::sharedPage globCfg;
+  static Util::RelAccX cfgData;
+  tthread::lock_guard<tthread::mutex> guard(globCfgMutex);
+  if (!globCfg.mapped || cfgData.isReload()){
+    globCfg.init(SHM_GLOBAL_CONF, 0);
+    if (!globCfg.mapped){
+      FAIL_MSG("Could not open global configuration options to read setting for '%s'", optionName.c_str());
+      return JSON::Value();
+    }
+    cfgData = Util::RelAccX(globCfg.mapped);
   }
-  Util::RelAccX cfgData(globCfg.mapped);
   if (!cfgData.isReady()){
     FAIL_MSG("Global configuration options not ready; cannot read setting for '%s'", optionName.c_str());
     return JSON::Value();
@@ -461,13 +540,16 @@ bool Util::startInput(std::string streamname, std::string filename, bool forkFir
   // Find stream base name
   std::string smp = streamname.substr(0, streamname.find_first_of("+ "));
   // check if base name (everything before + or space) exists
-  const JSON::Value stream_cfg = getStreamConfig(streamname);
+  Util::StreamConfigReader rStrmConf;
+  rStrmConf.update(streamname);
+  DTSC::Scan stream_cfg = rStrmConf.getScan();
   if (!stream_cfg){
+    noStreamConfigMsg(smp);
     HIGH_MSG("Stream %s not configured - attempting to ignore", streamname.c_str());
   }
   /*LTS-START*/
   if (!filename.size()){
-    if (stream_cfg && stream_cfg.isMember("hardlimit_active")){return false;}
+    if (stream_cfg && stream_cfg.hasMember("hardlimit_active")){return false;}
     if (Triggers::shouldTrigger("STREAM_LOAD", smp)){
       if (!Triggers::doTrigger("STREAM_LOAD", streamname, smp)){return false;}
     }
@@ -483,7 +565,7 @@ bool Util::startInput(std::string streamname, std::string filename, bool forkFir
       MEDIUM_MSG("Stream %s not configured, no source manually given, cannot start", streamname.c_str());
       return false;
     }
-    filename = stream_cfg["source"].asStringRef();
+    filename = stream_cfg.getMember("source").asString();
   }
 
   bool hadOriginal = getenv("MIST_ORIGINAL_SOURCE");
@@ -504,14 +586,15 @@ bool Util::startInput(std::string streamname, std::string filename, bool forkFir
         HIGH_MSG("Overriding option '%s' to '%s'", prm.key().c_str(), overrides.at(prm.key()).c_str());
         str_args[opt] = overrides.at(prm.key());
       }else{
-        if (!stream_cfg.isMember(prm.key())){
+        DTSC::Scan val = stream_cfg.getMember(prm.key());
+        if (!val){
           FAIL_MSG("Required parameter %s for stream %s missing", prm.key().c_str(), streamname.c_str());
           return false;
         }
-        if (stream_cfg[prm.key()].isString()){
-          str_args[opt] = stream_cfg[prm.key()].asStringRef();
+        if (val.getType() == DTSC_STR){
+          str_args[opt] = val.asString();
         }else{
-          str_args[opt] = stream_cfg[prm.key()].toString();
+          str_args[opt] = val.asJSON().toString();
         }
       }
     }
@@ -526,11 +609,12 @@ bool Util::startInput(std::string streamname, std::string filename, bool forkFir
         HIGH_MSG("Overriding option '%s' to '%s'", prm.key().c_str(), overrides.at(prm.key()).c_str());
         str_args[opt] = overrides.at(prm.key());
       }else{
-        if (stream_cfg.isMember(prm.key()) && stream_cfg[prm.key()]){
-          if (stream_cfg[prm.key()].isString()){
-            str_args[opt] = stream_cfg[prm.key()].asStringRef();
+        DTSC::Scan val = stream_cfg.getMember(prm.key());
+        if (val && val.asBool()){
+          if (val.getType() == DTSC_STR){
+            str_args[opt] = val.asString();
           }else{
-            str_args[opt] = stream_cfg[prm.key()].toString();
+            str_args[opt] = val.asJSON().toString();
           }
         }
       }
@@ -829,6 +913,62 @@ DTSC::Scan Util::DTSCShmReader::getScan(){
   return DTSC::Scan(rAcc.getPointer("dtsc_data"), rAcc.getSize("dtsc_data"));
 }
 
+Util::StreamConfigReader::StreamConfigReader(){
+  generation = 0;
+}
+
+/// Makes sure the configuration of the given stream (or of its base name, for wildcard streams) is
+/// the current one. Opens the page if this is a different stream than before, if it was not
+/// available before, or if the controller replaced or removed it since; otherwise does nothing.
+/// Returns true if the configuration changed since the previous call. Scans returned before a call
+/// that returns true are no longer valid.
+bool Util::StreamConfigReader::update(const std::string &streamname){
+  char tmpBuf[NAME_BUFFER_SIZE];
+  size_t baseLen = streamname.find_first_of("+ ");
+  if (baseLen == std::string::npos){baseLen = streamname.size();}
+  char baseName[NAME_BUFFER_SIZE];
+  snprintf(baseName, NAME_BUFFER_SIZE, "%.*s", (int)baseLen, streamname.data());
+  snprintf(tmpBuf, NAME_BUFFER_SIZE, SHM_STREAM_CONF, baseName);
+  bool samePage = (pageName == tmpBuf);
+  if (samePage && rPage && !rAcc.isReload()){return false;}
+  bool hadPage = rPage;
+  pageName = tmpBuf;
+  rPage.init(pageName, 0, false, false);
+  if (!rPage){
+    scan = DTSC::Scan();
+    generation = 0;
+    return hadPage || !samePage;
+  }
+  rAcc = Util::RelAccX(rPage.mapped);
+  scan = DTSC::Scan(rAcc.getPointer("dtsc_data"), rAcc.getSize("dtsc_data"));
+  uint64_t newGeneration = rAcc.getInt("generation");
+  // Pages written by controllers without a generation field always count as changed
+  bool changed = (!samePage || !hadPage || !newGeneration || newGeneration != generation);
+  generation = newGeneration;
+  return changed;
+}
+
+/// Returns true if the stream is configured.
+Util::StreamConfigReader::operator bool() const{
+  return scan;
+}
+
+/// Returns the generation of the configuration, which the controller changes every time it
+/// writes a configuration. Zero if the stream is not configured.
+uint64_t Util::StreamConfigReader::getGeneration() const{
+  return generation;
+}
+
+/// Returns the configuration, or an invalid Scan if the stream is not configured.
+DTSC::Scan Util::StreamConfigReader::getScan() const{
+  return scan;
+}
+
+/// Returns a single setting, or an invalid Scan if it or the stream is not configured.
+DTSC::Scan Util::StreamConfigReader::getMember(const std::string &indice) const{
+  return scan.getMember(indice);
+}
+
 /// Takes an existing track list, and selects tracks from it according to the given track type and selector
 std::set<size_t> Util::pickTracks(const DTSC::Meta &M, const std::set<size_t> trackList, const std::string &trackType, const std::string &trackVal){
   std::set<size_t> result;
@@ -1489,6 +1629,17 @@ std::set<size_t> Util::wouldSelect(const DTSC::Meta &M, const std::map<std::stri
   return result;
 }
 
+/// Sets defaultTrackSortOrder from a value of the default_track_sorting output option.
+/// Empty or unknown values leave it unchanged.
+void Util::setDefaultTrackSortOrder(const std::string &order){
+  if (order == "bps_lth"){defaultTrackSortOrder = TRKSORT_BPS_LTH;}
+  if (order == "bps_htl"){defaultTrackSortOrder = TRKSORT_BPS_HTL;}
+  if (order == "id_lth"){defaultTrackSortOrder = TRKSORT_ID_LTH;}
+  if (order == "id_htl"){defaultTrackSortOrder = TRKSORT_ID_HTL;}
+  if (order == "res_lth"){defaultTrackSortOrder = TRKSORT_RES_LTH;}
+  if (order == "res_htl"){defaultTrackSortOrder = TRKSORT_RES_HTL;}
+}
+
 /// Sorts the given set of track IDs by the given sort order, according to the given metadata, and returns it by reference as the given list.
 /// Will clear the list automatically if not empty.
 void Util::sortTracks(std::set<size_t> & validTracks, const DTSC::Meta & M, Util::trackSortOrder sorting, std::list<size_t> & srtTrks){
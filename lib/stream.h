@@ -9,6 +9,7 @@
 #include "util.h"
 #include <string>
 #include <list>
+#include <vector>
 
 const JSON::Value empty;
 
@@ -47,7 +48,8 @@ namespace Util{
     TRKSORT_RES_LTH,
     TRKSORT_RES_HTL
   };
-  extern trackSortOrder defaultTrackSortOrder;
+  extern __thread trackSortOrder defaultTrackSortOrder; ///< Per thread, as threads may serve different outputs
+  void setDefaultTrackSortOrder(const std::string &order);
   void sortTracks(std::set<size_t> & validTracks, const DTSC::Meta & M, trackSortOrder sorting, std::list<size_t> & srtTrks);
 
   /// This struct keeps packet information sorted in playback order
@@ -79,9 +81,12 @@ namespace Util{
       void setSyncMode(bool synced);
       bool getSyncMode() const;
     private:
+      void siftDown(size_t pos);
+      void siftUp(size_t pos);
+      void dropFirstDuplicates();
       bool dequeMode;
       std::deque<sortedPageInfo> dequeBuffer;
-      std::set<sortedPageInfo> setBuffer;
+      std::vector<sortedPageInfo> heapBuffer; ///< Binary min-heap, used in sync mode
   };
 
 
@@ -96,4 +101,24 @@ namespace Util{
     Util::RelAccX rAcc;
   };
 
+  /// Read-only access to the configuration of a stream, as written to shared memory by the
+  /// controller. Keeps the page mapped between calls and only opens it again once the controller
+  /// has replaced or removed it, so checking for changes costs no system calls.
+  class StreamConfigReader{
+  public:
+    StreamConfigReader();
+    bool update(const std::string &streamname);
+    operator bool() const;
+    uint64_t getGeneration() const;
+    DTSC::Scan getScan() const;
+    DTSC::Scan getMember(const std::string &indice) const;
+
+  private:
+    std::string pageName;
+    IPC::sharedPage rPage;
+    Util::RelAccX rAcc;
+    DTSC::Scan scan;
+    uint64_t generation;
+  };
+
 }// namespace Util
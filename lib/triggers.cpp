@@ -15,6 +15,11 @@
 /// Currently, all triggers are handled asynchronously and responses (if any) are completely
 /// ignored. In the future this may change.
 ///
+/// Blocking triggers handled by an URL keep their connection open between executions, so a
+/// process that fires the same trigger repeatedly only connects once. Blocking triggers with a
+/// `cache_ttl` set (in seconds) have their responses cached in shared memory, keyed by trigger
+/// name, handler and payload, so identical requests are answered without running the handler.
+///
 
 #include "bitfields.h"  //for strToBool
 #include "defines.h"    //for FAIL_MSG and INFO_MSG
@@ -22,50 +27,187 @@
 #include "procs.h"      //for StartPiped
 #include "shared_memory.h"
 #include "timing.h"
+#include "tinythread.h"
 #include "triggers.h"
 #include "util.h"
 #include "json.h"
+#include <algorithm>
+#include <map>
+#include <poll.h>
 #include <string.h> //for strncmp
+#include <vector>
 
 namespace Triggers{
 
-  static void submitTriggerStat(const std::string trigger, uint64_t millis, bool ok){
+  /// Time an executable handling a blocking trigger gets before it is killed, in milliseconds
+  static const uint64_t execTimeout = 15000;
+
+  static void submitTriggerStat(const std::string trigger, uint64_t millis, bool ok, bool cached = false){
     JSON::Value j;
     j["trigger_stat"]["name"] = trigger;
     j["trigger_stat"]["ms"] = Util::bootMS() - millis;
     j["trigger_stat"]["ok"] = ok;
+    if (cached){j["trigger_stat"]["cached"] = true;}
     Socket::UDPConnection uSock;
     uSock.SetDestination(UDP_API_HOST, UDP_API_PORT);
     uSock.SendNow(j.toString());
   }
 
+  /// Guards the response cache mapping and the downloader pool, as blocking triggers may fire from
+  /// several threads of the same process at once
+  static tthread::mutex triggerMutex;
+  static IPC::sharedPage cachePage;
+  static Util::RelAccX cacheAccX;
+  static std::map<std::string, std::vector<HTTP::Downloader *> > idleDownloaders;
+
+  /// Returns the shared response cache, opening it if the controller created it.
+  /// Caches created without a sequence field cannot be used safely and are ignored.
+  /// Once opened the cache is never changed again, so the returned pointer stays valid.
+  static Util::RelAccX *getResponseCache(){
+    tthread::lock_guard<tthread::mutex> guard(triggerMutex);
+    if (!cacheAccX.isReady()){
+      if (!cachePage.mapped){cachePage.init(SHM_TRIGGER_CACHE, SHM_TRIGGER_CACHE_SIZE, false, false);}
+      if (!cachePage.mapped){return 0;}
+      cacheAccX = Util::RelAccX(cachePage.mapped, false);
+      if (!cacheAccX.isReady() || !cacheAccX.getRCount() || !cacheAccX.getFieldData("seq").size){
+        cacheAccX = Util::RelAccX();
+        return 0;
+      }
+    }
+    return &cacheAccX;
+  }
+
+  /// FNV-1a hash over trigger name, handler and payload. Never returns zero, which marks an empty
+  /// cache slot.
+  static uint64_t responseKey(const std::string &trigger, const std::string &value, const std::string &payload){
+    uint64_t h = 14695981039346656037ull;
+    const std::string *parts[3] ={&trigger, &value, &payload};
+    for (size_t p = 0; p < 3; ++p){
+      const std::string &str = *parts[p];
+      for (size_t i = 0; i < str.size(); ++i){
+        h ^= (uint8_t)str[i];
+        h *= 1099511628211ull;
+      }
+      h ^= 0xFF; // separator, so "ab"+"c" and "a"+"bc" differ
+      h *= 1099511628211ull;
+    }
+    return h ? h : 1;
+  }
+
+  /// Looks up a cached response for the given key.
+  /// Every slot has a sequence number that is odd while a writer is busy with it. The slot is
+  /// only trusted if the sequence number was even before copying and unchanged after, so neither a
+  /// half-written response nor the hash of one writer next to the response of another is a hit.
+  static bool getCachedResponse(uint64_t key, std::string &response){
+    Util::RelAccX *C = getResponseCache();
+    if (!C){return false;}
+    uint64_t slot = key % C->getRCount();
+    volatile uint64_t *seq = (volatile uint64_t *)C->getPointer("seq", slot);
+    uint64_t startSeq = *seq;
+    __sync_synchronize();
+    if ((startSeq & 1) || C->getInt("hash", slot) != key){return false;}
+    std::string cached = C->getPointer("response", slot);
+    uint64_t expires = C->getInt("expires", slot);
+    __sync_synchronize();
+    if (*seq != startSeq || expires <= Util::bootMS()){return false;}
+    response = cached;
+    return true;
+  }
+
+  /// Stores a response in the cache for ttl seconds. Responses that do not fit are not cached,
+  /// and neither are responses for a slot another process is writing to at the same time.
+  static void setCachedResponse(uint64_t key, const std::string &response, uint32_t ttl){
+    Util::RelAccX *C = getResponseCache();
+    if (!C || response.size() >= C->getFieldData("response").size){return;}
+    uint64_t slot = key % C->getRCount();
+    uint64_t *seq = (uint64_t *)C->getPointer("seq", slot);
+    uint64_t startSeq = *(volatile uint64_t *)seq;
+    // Claim the slot by making the sequence number odd
+    if ((startSeq & 1) || !__sync_bool_compare_and_swap(seq, startSeq, startSeq + 1)){return;}
+    C->setInt("hash", key, slot);
+    C->setString("response", response, slot);
+    C->setInt("expires", Util::bootMS() + ttl * 1000, slot);
+    __sync_synchronize();
+    *(volatile uint64_t *)seq = startSeq + 2;
+  }
+
+  /// Returns the pool key of the endpoint of a trigger handler URL
+  static std::string endpointKey(const HTTP::URL &url){
+    return url.protocol + "://" + url.host + ":" + JSON::Value(url.getPort()).asString();
+  }
+
+  /// Takes a downloader for the handler of a blocking trigger out of the pool for the endpoint, or
+  /// makes a new one if all of them are in use. Nobody else uses it until it is handed back with
+  /// returnDownloader, which keeps the connection open for the next execution. Asynchronous
+  /// triggers do not read the response and thus cannot share a connection.
+  static HTTP::Downloader *takeDownloader(const std::string &endpoint){
+    HTTP::Downloader *DL = 0;
+    {
+      tthread::lock_guard<tthread::mutex> guard(triggerMutex);
+      std::vector<HTTP::Downloader *> &idle = idleDownloaders[endpoint];
+      if (idle.size()){
+        DL = idle.back();
+        idle.pop_back();
+      }
+    }
+    if (!DL){return new HTTP::Downloader();}
+    Socket::Connection &s = DL->getSocket();
+    // Anything (including EOF) arriving on an idle connection means it can no longer be used
+    if (s && s.spool()){s.close();}
+    return DL;
+  }
+
+  /// Hands a downloader taken with takeDownloader back to the pool
+  static void returnDownloader(const std::string &endpoint, HTTP::Downloader *DL){
+    tthread::lock_guard<tthread::mutex> guard(triggerMutex);
+    idleDownloaders[endpoint].push_back(DL);
+  }
+
   ///\brief Handles a trigger by sending a payload to a destination.
   ///\param trigger Trigger event type.
   ///\param value Destination. This can be an (HTTP)URL, or an absolute path to a binary/script
   ///\param payload This data will be sent to the destionation URL/program
   ///\param sync If true, handler is executed blocking and uses the response data.
+  ///\param cacheTTL If non-zero and sync is true, successful responses are cached for this many seconds.
   ///\returns String, false if further processing should be aborted.
   std::string handleTrigger(const std::string &trigger, const std::string &value,
-                            const std::string &payload, int sync, const std::string &defaultResponse){
+                            const std::string &payload, int sync, const std::string &defaultResponse,
+                            uint32_t cacheTTL){
     uint64_t tStartMs = Util::bootMS();
     if (!value.size()){
       WARN_MSG("Trigger requested with empty destination");
       return "true";
     }
+    uint64_t cacheKey = 0;
+    if (sync && cacheTTL){
+      cacheKey = responseKey(trigger, value, payload);
+      std::string cached;
+      if (getCachedResponse(cacheKey, cached)){
+        HIGH_MSG("Using cached response for %s trigger: %s", trigger.c_str(), value.c_str());
+        submitTriggerStat(trigger, tStartMs, true, true);
+        return cached;
+      }
+    }
     INFO_MSG("Executing %s trigger: %s (%s)", trigger.c_str(), value.c_str(), sync ? "blocking" : "asynchronous");
     if (value.substr(0, 7) == "http://" || value.substr(0, 8) == "https://"){// interpret as url
-      HTTP::Downloader DL;
+      HTTP::URL url(value);
+      std::string endpoint = endpointKey(url);
+      HTTP::Downloader asyncDL;
+      HTTP::Downloader &DL = sync ? *takeDownloader(endpoint) : asyncDL;
       DL.setHeader("X-Trigger", trigger);
       DL.setHeader("Content-Type", "text/plain");
-      HTTP::URL url(value);
+      std::string ret = defaultResponse;
       if (DL.post(url, payload, sync) && (!sync || DL.isOk())){
         submitTriggerStat(trigger, tStartMs, true);
-        return DL.data();
+        if (cacheKey){setCachedResponse(cacheKey, DL.const_data(), cacheTTL);}
+        ret = DL.data();
+      }else{
+        FAIL_MSG("Trigger failed to execute (%s), using default response: %s",
+                 DL.getStatusText().c_str(), defaultResponse.c_str());
+        submitTriggerStat(trigger, tStartMs, false);
       }
-      FAIL_MSG("Trigger failed to execute (%s), using default response: %s",
-               DL.getStatusText().c_str(), defaultResponse.c_str());
-      submitTriggerStat(trigger, tStartMs, false);
-      return defaultResponse;
+      if (sync){returnDownloader(endpoint, &DL);}
+      return ret;
     }else{// send payload to stdin of newly forked process
       int fdIn = -1;
       int fdOut = -1;
@@ -90,35 +232,49 @@ namespace Triggers{
       close(fdIn);
 
       if (sync){// if sync!=0 wait for response
-        uint32_t counter = 0;
-        while (Util::Procs::isActive(myProc) && counter < 150){
-          Util::sleep(100);
-          ++counter;
-          if (counter >= 150){
-            if (counter == 150){FAIL_MSG("Trigger taking too long - killing process");}
-            if (counter >= 250){
-              Util::Procs::Stop(myProc);
-            }else{
-              Util::Procs::Murder(myProc);
-            }
-          }
-        }
+        // Read the output as it arrives, until the handler closes it or exits. The exit check only
+        // matters for handlers that leave a child process holding their output open.
         std::string ret;
-        FILE *outFile = fdopen(fdOut, "r");
-        char *fileBuf = 0;
-        size_t fileBufLen = 0;
-        while (!(feof(outFile) || ferror(outFile)) && (getline(&fileBuf, &fileBufLen, outFile) != -1)){
-          ret += fileBuf;
+        char buf[4096];
+        bool timedOut = false;
+        bool exited = false;
+        uint64_t deadline = tStartMs + execTimeout;
+        while (true){
+          uint64_t now = Util::bootMS();
+          if (now >= deadline){
+            timedOut = true;
+            break;
+          }
+          struct pollfd pfd;
+          pfd.fd = fdOut;
+          pfd.events = POLLIN;
+          int r = poll(&pfd, 1, exited ? 0 : std::min(deadline - now, (uint64_t)500));
+          if (r < 0 && errno == EINTR){continue;}
+          if (r < 0){break;}
+          if (!r){
+            if (exited){break;}
+            exited = !Util::Procs::childRunning(myProc);
+            continue;
+          }
+          ssize_t len = read(fdOut, buf, sizeof(buf));
+          if (len < 0 && errno == EINTR){continue;}
+          if (len <= 0){break;}
+          ret.append(buf, len);
         }
-        fclose(outFile);
-        free(fileBuf);
         close(fdOut);
-        if (counter >= 150 && !ret.size()){
+        if (timedOut){
+          FAIL_MSG("Trigger taking too long - killing process");
+          Util::Procs::Murder(myProc);
+        }
+        // Reap it right away if it is done; otherwise the process reaper thread will
+        if (!exited){Util::Procs::childRunning(myProc);}
+        if (timedOut && !ret.size()){
           WARN_MSG("Using default trigger response: %s", defaultResponse.c_str());
           submitTriggerStat(trigger, tStartMs, false);
           return defaultResponse;
         }
         submitTriggerStat(trigger, tStartMs, true);
+        if (cacheKey && !timedOut){setCachedResponse(cacheKey, ret, cacheTTL);}
         return ret;
       }
       close(fdOut);
@@ -215,12 +371,13 @@ namespace Triggers{
       }
       std::string defaultResponse = trigs.getPointer("default", i);
       if (!defaultResponse.size()){defaultResponse = "true";}
+      uint32_t cacheTTL = trigs.getInt("cachettl", i);
 
       if (isHandled){
         VERYHIGH_MSG("%s trigger handled by %s", type.c_str(), uri.c_str());
         if (dryRun){return true;}
         if (sync){
-          response = handleTrigger(type, uri, payload, sync, defaultResponse); // do it.
+          response = handleTrigger(type, uri, payload, sync, defaultResponse, cacheTTL); // do it.
           retVal &= Util::stringToBool(response);
         }else{
           std::string unused_response = handleTrigger(type, uri, payload, sync, defaultResponse); // do it.
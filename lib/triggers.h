@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 #include <string>
 
 namespace Triggers{
@@ -9,7 +10,8 @@ namespace Triggers{
                  const std::string &streamName, bool dryRun, std::string &response,
                  bool paramsCB(const char *, const void *) = 0, const void *extraParam = 0);
   std::string handleTrigger(const std::string &triggerType, const std::string &value,
-                            const std::string &payload, int sync, const std::string &defaultResponse);
+                            const std::string &payload, int sync, const std::string &defaultResponse,
+                            uint32_t cacheTTL = 0);
 
   // All of the below are just shorthands for specific usage of the doTrigger function above:
   bool shouldTrigger(const std::string &triggerType, const std::string &streamName = empty,
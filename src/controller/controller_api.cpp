@@ -504,8 +504,9 @@ void Controller::handleAPICommands(JSON::Value &Request, JSON::Value &Response){
     if (tStat.isMember("name") && tStat.isMember("ms")){
       Controller::triggerLog &tLog = Controller::triggerStats[tStat["name"].asStringRef()];
       tLog.totalCount++;
-      tLog.ms += tStat["ms"].asInt();
+      tLog.addTime(tStat["ms"].asInt());
       if (!tStat.isMember("ok") || !tStat["ok"].asBool()){tLog.failCount++;}
+      if (tStat.isMember("cached") && tStat["cached"].asBool()){tLog.cacheHits++;}
     }
     return;
   }
@@ -10,6 +10,7 @@
 #include <mist/config.h>
 #include <mist/dtsc.h>
 #include <mist/procs.h>
+#include <mist/segment_cache.h>
 #include <mist/shared_memory.h>
 #include <mist/stream.h>
 #include <mist/url.h>
@@ -36,6 +37,8 @@
 #define STAT_CLI_PKTLOST 4096
 #define STAT_CLI_PKTRETRANSMIT 8192
 #define STAT_CLI_ALL 0xFFFF
+// Amount of numeric values fillClients copies per session, whichever fields are requested
+static const size_t CLIENT_ROW_VALS = 9;
 // These are used to store "totals" field requests in a bitfield for speedup.
 #define STAT_TOT_CLIENTS 1
 #define STAT_TOT_BPS_DOWN 2
@@ -52,6 +55,17 @@ std::map<Controller::sessIndex, Controller::statSession> Controller::sessions; /
 std::map<unsigned long, Controller::sessIndex> Controller::connToSession; ///< Map of socket IDs to session info.
 
 std::map<std::string, Controller::triggerLog> Controller::triggerStats; ///< Holds prometheus stats for trigger executions
+/// Upper bounds in milliseconds of the trigger latency buckets
+const uint64_t Controller::triggerLatencyBounds[TRIGGER_LATENCY_BUCKETS - 1] ={
+    5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000};
+
+/// Adds a single execution taking the given amount of milliseconds to the latency buckets
+void Controller::triggerLog::addTime(uint64_t millis){
+  ms += millis;
+  size_t i = 0;
+  while (i < TRIGGER_LATENCY_BUCKETS - 1 && millis > triggerLatencyBounds[i]){++i;}
+  ++latency[i];
+}
 bool Controller::killOnExit = KILL_ON_EXIT;
 tthread::mutex Controller::statsMutex;
 unsigned int Controller::maxConnsPerIP = 0;
@@ -765,29 +779,29 @@ void Controller::statSession::wipeOld(uint64_t cutOff){
   firstSec = 0xFFFFFFFFFFFFFFFFull;
   if (oldConns.size()){
     for (std::deque<statStorage>::iterator it = oldConns.begin(); it != oldConns.end(); ++it){
-      while (it->log.size() && it->log.begin()->first < cutOff){
+      while (it->log.size() && it->log.firstTime() < cutOff){
         if (it->log.size() == 1){
-          wipedDown += it->log.begin()->second.down;
-          wipedUp += it->log.begin()->second.up;
-          wipedPktCount += it->log.begin()->second.pktCount;
-          wipedPktLost += it->log.begin()->second.pktLost;
-          wipedPktRetransmit += it->log.begin()->second.pktRetransmit;
+          wipedDown += it->log.first().down;
+          wipedUp += it->log.first().up;
+          wipedPktCount += it->log.first().pktCount;
+          wipedPktLost += it->log.first().pktLost;
+          wipedPktRetransmit += it->log.first().pktRetransmit;
         }
-        it->log.erase(it->log.begin());
+        it->log.popFront();
       }
       if (it->log.size()){
-        if (firstSec > it->log.begin()->first){firstSec = it->log.begin()->first;}
+        if (firstSec > it->log.firstTime()){firstSec = it->log.firstTime();}
       }
     }
     while (oldConns.size() && !oldConns.begin()->log.size()){oldConns.pop_front();}
   }
   if (curConns.size()){
     for (std::map<uint64_t, statStorage>::iterator it = curConns.begin(); it != curConns.end(); ++it){
-      while (it->second.log.size() > 1 && it->second.log.begin()->first < cutOff){
-        it->second.log.erase(it->second.log.begin());
+      while (it->second.log.size() > 1 && it->second.log.firstTime() < cutOff){
+        it->second.log.popFront();
       }
       if (it->second.log.size()){
-        if (firstSec > it->second.log.begin()->first){firstSec = it->second.log.begin()->first;}
+        if (firstSec > it->second.log.firstTime()){firstSec = it->second.log.firstTime();}
       }
     }
   }
@@ -894,11 +908,11 @@ void Controller::statSession::switchOverTo(statSession &newSess, uint64_t index)
   newSess.curConns[index] = curConns[index];
   // if this connection has data, update firstSec/lastSec if needed
   if (curConns[index].log.size()){
-    if (newSess.firstSec > curConns[index].log.begin()->first){
-      newSess.firstSec = curConns[index].log.begin()->first;
+    if (newSess.firstSec > curConns[index].log.firstTime()){
+      newSess.firstSec = curConns[index].log.firstTime();
     }
-    if (newSess.lastSec < curConns[index].log.rbegin()->first){
-      newSess.lastSec = curConns[index].log.rbegin()->first;
+    if (newSess.lastSec < curConns[index].log.lastTime()){
+      newSess.lastSec = curConns[index].log.lastTime();
     }
   }
   // remove from current session
@@ -910,19 +924,19 @@ void Controller::statSession::switchOverTo(statSession &newSess, uint64_t index)
     if (oldConns.size()){
       for (std::deque<statStorage>::iterator it = oldConns.begin(); it != oldConns.end(); ++it){
         if (it->log.size()){
-          if (firstSec > it->log.begin()->first){firstSec = it->log.begin()->first;}
-          if (lastSec < it->log.rbegin()->first){lastSec = it->log.rbegin()->first;}
+          if (firstSec > it->log.firstTime()){firstSec = it->log.firstTime();}
+          if (lastSec < it->log.lastTime()){lastSec = it->log.lastTime();}
         }
       }
     }
     if (curConns.size()){
       for (std::map<uint64_t, statStorage>::iterator it = curConns.begin(); it != curConns.end(); ++it){
         if (it->second.log.size()){
-          if (firstSec > it->second.log.begin()->first){
-            firstSec = it->second.log.begin()->first;
+          if (firstSec > it->second.log.firstTime()){
+            firstSec = it->second.log.firstTime();
           }
-          if (lastSec < it->second.log.rbegin()->first){
-            lastSec = it->second.log.rbegin()->first;
+          if (lastSec < it->second.log.lastTime()){
+            lastSec = it->second.log.lastTime();
           }
         }
       }
@@ -1052,12 +1066,12 @@ uint64_t Controller::statSession::getDown(){
   uint64_t retVal = wipedDown;
   if (oldConns.size()){
     for (std::deque<statStorage>::iterator it = oldConns.begin(); it != oldConns.end(); ++it){
-      if (it->log.size()){retVal += it->log.rbegin()->second.down;}
+      if (it->log.size()){retVal += it->log.last().down;}
     }
   }
   if (curConns.size()){
     for (std::map<uint64_t, statStorage>::iterator it = curConns.begin(); it != curConns.end(); ++it){
-      if (it->second.log.size()){retVal += it->second.log.rbegin()->second.down;}
+      if (it->second.log.size()){retVal += it->second.log.last().down;}
     }
   }
   return retVal;
@@ -1068,12 +1082,12 @@ uint64_t Controller::statSession::getUp(){
   uint64_t retVal = wipedUp;
   if (oldConns.size()){
     for (std::deque<statStorage>::iterator it = oldConns.begin(); it != oldConns.end(); ++it){
-      if (it->log.size()){retVal += it->log.rbegin()->second.up;}
+      if (it->log.size()){retVal += it->log.last().up;}
     }
   }
   if (curConns.size()){
     for (std::map<uint64_t, statStorage>::iterator it = curConns.begin(); it != curConns.end(); ++it){
-      if (it->second.log.size()){retVal += it->second.log.rbegin()->second.up;}
+      if (it->second.log.size()){retVal += it->second.log.last().up;}
     }
   }
   return retVal;
@@ -1099,12 +1113,12 @@ uint64_t Controller::statSession::getPktCount(){
   uint64_t retVal = wipedPktCount;
   if (oldConns.size()){
     for (std::deque<statStorage>::iterator it = oldConns.begin(); it != oldConns.end(); ++it){
-      if (it->log.size()){retVal += it->log.rbegin()->second.pktCount;}
+      if (it->log.size()){retVal += it->log.last().pktCount;}
     }
   }
   if (curConns.size()){
     for (std::map<uint64_t, statStorage>::iterator it = curConns.begin(); it != curConns.end(); ++it){
-      if (it->second.log.size()){retVal += it->second.log.rbegin()->second.pktCount;}
+      if (it->second.log.size()){retVal += it->second.log.last().pktCount;}
     }
   }
   return retVal;
@@ -1129,12 +1143,12 @@ uint64_t Controller::statSession::getPktLost(){
   uint64_t retVal = wipedPktLost;
   if (oldConns.size()){
     for (std::deque<statStorage>::iterator it = oldConns.begin(); it != oldConns.end(); ++it){
-      if (it->log.size()){retVal += it->log.rbegin()->second.pktLost;}
+      if (it->log.size()){retVal += it->log.last().pktLost;}
     }
   }
   if (curConns.size()){
     for (std::map<uint64_t, statStorage>::iterator it = curConns.begin(); it != curConns.end(); ++it){
-      if (it->second.log.size()){retVal += it->second.log.rbegin()->second.pktLost;}
+      if (it->second.log.size()){retVal += it->second.log.last().pktLost;}
     }
   }
   return retVal;
@@ -1159,12 +1173,12 @@ uint64_t Controller::statSession::getPktRetransmit(){
   uint64_t retVal = wipedPktRetransmit;
   if (oldConns.size()){
     for (std::deque<statStorage>::iterator it = oldConns.begin(); it != oldConns.end(); ++it){
-      if (it->log.size()){retVal += it->log.rbegin()->second.pktRetransmit;}
+      if (it->log.size()){retVal += it->log.last().pktRetransmit;}
     }
   }
   if (curConns.size()){
     for (std::map<uint64_t, statStorage>::iterator it = curConns.begin(); it != curConns.end(); ++it){
-      if (it->second.log.size()){retVal += it->second.log.rbegin()->second.pktRetransmit;}
+      if (it->second.log.size()){retVal += it->second.log.last().pktRetransmit;}
     }
   }
   return retVal;
@@ -1193,11 +1207,11 @@ uint64_t Controller::statSession::getBpsUp(uint64_t t){
 /// Returns true if there is data available for timestamp t.
 bool Controller::statStorage::hasDataFor(unsigned long long t){
   if (!log.size()){return false;}
-  return (t >= log.begin()->first);
+  return (t >= log.firstTime());
 }
 
 /// Returns a reference to the most current data available at timestamp t.
-Controller::statLog &Controller::statStorage::getDataFor(unsigned long long t){
+const Controller::statLog &Controller::statStorage::getDataFor(unsigned long long t){
   static statLog empty;
   if (!log.size()){
     empty.time = 0;
@@ -1209,9 +1223,7 @@ Controller::statLog &Controller::statStorage::getDataFor(unsigned long long t){
     empty.pktRetransmit = 0;
     return empty;
   }
-  std::map<unsigned long long, statLog>::iterator it = log.upper_bound(t);
-  if (it != log.begin()){it--;}
-  return it->second;
+  return log.getAt(t);
 }
 
 /// This function is called by parseStatistics.
@@ -1225,10 +1237,9 @@ void Controller::statStorage::update(Comms::Statistics &statComm, size_t index){
   tmp.pktCount = statComm.getPacketCount(index);
   tmp.pktLost = statComm.getPacketLostCount(index);
   tmp.pktRetransmit = statComm.getPacketRetransmitCount(index);
-  log[statComm.getNow(index)] = tmp;
-  // wipe data older than approx. STAT_CUTOFF seconds
+  // Keeps at most STAT_CUTOFF entries, dropping the oldest
   /// \todo Remove least interesting data first.
-  if (log.size() > STAT_CUTOFF){log.erase(log.begin());}
+  log.set(statComm.getNow(index), tmp);
 }
 
 void Controller::statLeadIn(){
@@ -1319,7 +1330,6 @@ bool Controller::hasViewers(std::string streamName){
 /// ~~~~~~~~~~~~~~~
 /// In case of the second method, the response is an array in the same order as the requests.
 void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
-  tthread::lock_guard<tthread::mutex> guard(statsMutex);
   // first, figure out the timestamp wanted
   int64_t reqTime = 0;
   uint64_t epoch = Util::epoch();
@@ -1382,10 +1392,14 @@ void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
   if (fields & STAT_CLI_PKTCOUNT){rep["fields"].append("pktcount");}
   if (fields & STAT_CLI_PKTLOST){rep["fields"].append("pktlost");}
   if (fields & STAT_CLI_PKTRETRANSMIT){rep["fields"].append("pktretransmit");}
-  // output the data itself
-  rep["data"].null();
-  // loop over all sessions
-  if (sessions.size()){
+  // Copy the wanted data while holding the lock, and build the (much larger) response after
+  // releasing it, so big client lists do not hold up the statistics handling.
+  std::vector<sessIndex> rowIdx;
+  std::vector<uint64_t> rowVals; // CLIENT_ROW_VALS values per row, in output order
+  {
+    tthread::lock_guard<tthread::mutex> guard(statsMutex);
+    rowIdx.reserve(sessions.size());
+    rowVals.reserve(sessions.size() * CLIENT_ROW_VALS);
     for (std::map<sessIndex, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
       unsigned long long time = reqTime;
       if (now && reqTime - it->second.getEnd() < 5){time = it->second.getEnd();}
@@ -1394,26 +1408,44 @@ void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
           (!streams.size() || streams.count(it->first.streamName)) &&
           (!protos.size() || protos.count(it->first.connector))){
         if (it->second.hasDataFor(time)){
-          JSON::Value d;
-          if (fields & STAT_CLI_HOST){d.append(it->first.host);}
-          if (fields & STAT_CLI_STREAM){d.append(it->first.streamName);}
-          if (fields & STAT_CLI_PROTO){d.append(it->first.connector);}
-          if (fields & STAT_CLI_CONNTIME){d.append(it->second.getConnTime(time));}
-          if (fields & STAT_CLI_POSITION){d.append(it->second.getLastSecond(time));}
-          if (fields & STAT_CLI_DOWN){d.append(it->second.getDown(time));}
-          if (fields & STAT_CLI_UP){d.append(it->second.getUp(time));}
-          if (fields & STAT_CLI_BPS_DOWN){d.append(it->second.getBpsDown(time));}
-          if (fields & STAT_CLI_BPS_UP){d.append(it->second.getBpsUp(time));}
-          if (fields & STAT_CLI_CRC){d.append(it->first.crc);}
-          if (fields & STAT_CLI_SESSID){d.append(it->first.ID);}
-          if (fields & STAT_CLI_PKTCOUNT){d.append(it->second.getPktCount(time));}
-          if (fields & STAT_CLI_PKTLOST){d.append(it->second.getPktLost(time));}
-          if (fields & STAT_CLI_PKTRETRANSMIT){d.append(it->second.getPktRetransmit(time));}
-          rep["data"].append(d);
+          rowIdx.push_back(it->first);
+          uint64_t v[CLIENT_ROW_VALS] ={0, 0, 0, 0, 0, 0, 0, 0, 0};
+          if (fields & STAT_CLI_CONNTIME){v[0] = it->second.getConnTime(time);}
+          if (fields & STAT_CLI_POSITION){v[1] = it->second.getLastSecond(time);}
+          if (fields & STAT_CLI_DOWN){v[2] = it->second.getDown(time);}
+          if (fields & STAT_CLI_UP){v[3] = it->second.getUp(time);}
+          if (fields & STAT_CLI_BPS_DOWN){v[4] = it->second.getBpsDown(time);}
+          if (fields & STAT_CLI_BPS_UP){v[5] = it->second.getBpsUp(time);}
+          if (fields & STAT_CLI_PKTCOUNT){v[6] = it->second.getPktCount(time);}
+          if (fields & STAT_CLI_PKTLOST){v[7] = it->second.getPktLost(time);}
+          if (fields & STAT_CLI_PKTRETRANSMIT){v[8] = it->second.getPktRetransmit(time);}
+          rowVals.insert(rowVals.end(), v, v + CLIENT_ROW_VALS);
         }
       }
     }
   }
+  // output the data itself
+  JSON::Value &data = rep["data"];
+  data.null();
+  for (size_t i = 0; i < rowIdx.size(); ++i){
+    const sessIndex &idx = rowIdx[i];
+    const uint64_t *v = &rowVals[i * CLIENT_ROW_VALS];
+    JSON::Value &d = data.append();
+    if (fields & STAT_CLI_HOST){d.append(idx.host);}
+    if (fields & STAT_CLI_STREAM){d.append(idx.streamName);}
+    if (fields & STAT_CLI_PROTO){d.append(idx.connector);}
+    if (fields & STAT_CLI_CONNTIME){d.append(v[0]);}
+    if (fields & STAT_CLI_POSITION){d.append(v[1]);}
+    if (fields & STAT_CLI_DOWN){d.append(v[2]);}
+    if (fields & STAT_CLI_UP){d.append(v[3]);}
+    if (fields & STAT_CLI_BPS_DOWN){d.append(v[4]);}
+    if (fields & STAT_CLI_BPS_UP){d.append(v[5]);}
+    if (fields & STAT_CLI_CRC){d.append(idx.crc);}
+    if (fields & STAT_CLI_SESSID){d.append(idx.ID);}
+    if (fields & STAT_CLI_PKTCOUNT){d.append(v[6]);}
+    if (fields & STAT_CLI_PKTLOST){d.append(v[7]);}
+    if (fields & STAT_CLI_PKTRETRANSMIT){d.append(v[8]);}
+  }
   // all done! return is by reference, so no need to return anything here.
 }
 
@@ -1551,95 +1583,98 @@ void Controller::fillActive(JSON::Value &req, JSON::Value &rep){
     rep["fields"] = fields;
   }
   DTSC::Meta M;
+  // Only copy the totals while holding the lock; opening stream metadata below can be slow
+  std::map<std::string, struct streamTotals> totals;
   {
     tthread::lock_guard<tthread::mutex> guard(statsMutex);
-    for (std::map<std::string, struct streamTotals>::iterator it = streamStats.begin(); it != streamStats.end(); ++it){
-      //If specific streams were requested, match and skip non-matching
-      if (streams.size()){
-        bool match = false;
-        jsonForEachConst(streams, s){
-          if (!s->isString()){continue;}
-          if (s->asStringRef() == it->first || (*(s->asStringRef().rbegin()) == '+' && it->first.substr(0, s->asStringRef().size()) == s->asStringRef())){
-            match = true;
-            break;
-          }
+    totals = streamStats;
+  }
+  for (std::map<std::string, struct streamTotals>::iterator it = totals.begin(); it != totals.end(); ++it){
+    //If specific streams were requested, match and skip non-matching
+    if (streams.size()){
+      bool match = false;
+      jsonForEachConst(streams, s){
+        if (!s->isString()){continue;}
+        if (s->asStringRef() == it->first || (*(s->asStringRef().rbegin()) == '+' && it->first.substr(0, s->asStringRef().size()) == s->asStringRef())){
+          match = true;
+          break;
         }
-        if (!match){continue;}
-      }
-      if (!fields.size()){
-        rep.append(it->first);
-        continue;
       }
-      JSON::Value & S = (objMode && !longForm) ? (rep["data"][it->first]) : (rep[it->first]);
-      S.null();
-      jsonForEachConst(fields, j){
-        JSON::Value & F = longForm ? (S[j->asStringRef()]) : (S.append());
-        if (j->asStringRef() == "clients"){
-          F = it->second.currViews+it->second.currIns+it->second.currOuts;
-        }else if (j->asStringRef() == "viewers"){
-          F = it->second.currViews;
-        }else if (j->asStringRef() == "inputs"){
-          F = it->second.currIns;
-        }else if (j->asStringRef() == "outputs"){
-          F = it->second.currOuts;
-        }else if (j->asStringRef() == "views"){
-          F = it->second.viewers;
-        }else if (j->asStringRef() == "viewseconds"){
-          F = it->second.viewSeconds;
-        }else if (j->asStringRef() == "upbytes"){
-          F = it->second.upBytes;
-        }else if (j->asStringRef() == "downbytes"){
-          F = it->second.downBytes;
-        }else if (j->asStringRef() == "packsent"){
-          F = it->second.packSent;
-        }else if (j->asStringRef() == "packloss"){
-          F = it->second.packLoss;
-        }else if (j->asStringRef() == "packretrans"){
-          F = it->second.packRetrans;
-        }else if (j->asStringRef() == "firstms"){
-          if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
-          if (M){
-            uint64_t fms = 0;
-            std::set<size_t> validTracks = M.getValidTracks();
-            for (std::set<size_t>::iterator jt = validTracks.begin(); jt != validTracks.end(); jt++){
-              if (M.getFirstms(*jt) < fms){fms = M.getFirstms(*jt);}
-            }
-            F = fms;
-          }
-        }else if (j->asStringRef() == "lastms"){
-          if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
-          if (M){
-            uint64_t lms = 0;
-            std::set<size_t> validTracks = M.getValidTracks();
-            for (std::set<size_t>::iterator jt = validTracks.begin(); jt != validTracks.end(); jt++){
-              if (M.getLastms(*jt) > lms){lms = M.getLastms(*jt);}
-            }
-            F = lms;
-          }
-        }else if (j->asStringRef() == "zerounix"){
-          if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
-          if (M && M.getLive()){
-            F = (M.getBootMsOffset() + (Util::unixMS() - Util::bootMS())) / 1000;
-          }
-        }else if (j->asStringRef() == "health"){
-          if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
-          if (M){M.getHealthJSON(F);}
-        }else if (j->asStringRef() == "tracks"){
-          if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
-          if (M){
-            F = M.getValidTracks().size();
+      if (!match){continue;}
+    }
+    if (!fields.size()){
+      rep.append(it->first);
+      continue;
+    }
+    JSON::Value & S = (objMode && !longForm) ? (rep["data"][it->first]) : (rep[it->first]);
+    S.null();
+    jsonForEachConst(fields, j){
+      JSON::Value & F = longForm ? (S[j->asStringRef()]) : (S.append());
+      if (j->asStringRef() == "clients"){
+        F = it->second.currViews+it->second.currIns+it->second.currOuts;
+      }else if (j->asStringRef() == "viewers"){
+        F = it->second.currViews;
+      }else if (j->asStringRef() == "inputs"){
+        F = it->second.currIns;
+      }else if (j->asStringRef() == "outputs"){
+        F = it->second.currOuts;
+      }else if (j->asStringRef() == "views"){
+        F = it->second.viewers;
+      }else if (j->asStringRef() == "viewseconds"){
+        F = it->second.viewSeconds;
+      }else if (j->asStringRef() == "upbytes"){
+        F = it->second.upBytes;
+      }else if (j->asStringRef() == "downbytes"){
+        F = it->second.downBytes;
+      }else if (j->asStringRef() == "packsent"){
+        F = it->second.packSent;
+      }else if (j->asStringRef() == "packloss"){
+        F = it->second.packLoss;
+      }else if (j->asStringRef() == "packretrans"){
+        F = it->second.packRetrans;
+      }else if (j->asStringRef() == "firstms"){
+        if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
+        if (M){
+          uint64_t fms = 0;
+          std::set<size_t> validTracks = M.getValidTracks();
+          for (std::set<size_t>::iterator jt = validTracks.begin(); jt != validTracks.end(); jt++){
+            if (M.getFirstms(*jt) < fms){fms = M.getFirstms(*jt);}
           }
-        }else if (j->asStringRef() == "status"){
-          uint8_t ss = Util::getStreamStatus(it->first);
-          switch (ss){
-            case STRMSTAT_OFF: F = "Offline"; break;
-            case STRMSTAT_INIT: F = "Initializing"; break;
-            case STRMSTAT_BOOT: F = "Input booting"; break;
-            case STRMSTAT_WAIT: F = "Waiting for data"; break;
-            case STRMSTAT_READY: F = "Online"; break;
-            case STRMSTAT_SHUTDOWN: F = "Shutting down"; break;
-            default: F = "Invalid / Unknown"; break;
+          F = fms;
+        }
+      }else if (j->asStringRef() == "lastms"){
+        if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
+        if (M){
+          uint64_t lms = 0;
+          std::set<size_t> validTracks = M.getValidTracks();
+          for (std::set<size_t>::iterator jt = validTracks.begin(); jt != validTracks.end(); jt++){
+            if (M.getLastms(*jt) > lms){lms = M.getLastms(*jt);}
           }
+          F = lms;
+        }
+      }else if (j->asStringRef() == "zerounix"){
+        if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
+        if (M && M.getLive()){
+          F = (M.getBootMsOffset() + (Util::unixMS() - Util::bootMS())) / 1000;
+        }
+      }else if (j->asStringRef() == "health"){
+        if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
+        if (M){M.getHealthJSON(F);}
+      }else if (j->asStringRef() == "tracks"){
+        if (!M || M.getStreamName() != it->first){M.reInit(it->first, false);}
+        if (M){
+          F = M.getValidTrackCount();
+        }
+      }else if (j->asStringRef() == "status"){
+        uint8_t ss = Util::getStreamStatus(it->first);
+        switch (ss){
+          case STRMSTAT_OFF: F = "Offline"; break;
+          case STRMSTAT_INIT: F = "Initializing"; break;
+          case STRMSTAT_BOOT: F = "Input booting"; break;
+          case STRMSTAT_WAIT: F = "Waiting for data"; break;
+          case STRMSTAT_READY: F = "Online"; break;
+          case STRMSTAT_SHUTDOWN: F = "Shutting down"; break;
+          default: F = "Invalid / Unknown"; break;
         }
       }
     }
@@ -1882,6 +1917,8 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
     }
   }
 #endif
+  uint64_t segCache[Util::SEGCACHE_STAT_COUNT];
+  bool haveSegCache = Util::SegmentCache::getStats(segCache);
 
   if (mode == PROMETHEUS_TEXT){
     std::stringstream response;
@@ -1908,15 +1945,54 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
       response << "# HELP mist_trigger_count Total executions for the given trigger\n";
       response << "# HELP mist_trigger_time Total execution time in millis for the given trigger\n";
       response << "# HELP mist_trigger_fails Total failed executions for the given trigger\n";
+      response << "# HELP mist_trigger_cached Executions answered from the trigger response cache\n";
+      for (std::map<std::string, Controller::triggerLog>::iterator it = Controller::triggerStats.begin();
+           it != Controller::triggerStats.end(); it++){
+        response << "mist_trigger_count{trigger=\"" << it->first << "\"} " << it->second.totalCount << "\n";
+        response << "mist_trigger_time{trigger=\"" << it->first << "\"} " << it->second.ms << "\n";
+        response << "mist_trigger_fails{trigger=\"" << it->first << "\"} " << it->second.failCount << "\n";
+        response << "mist_trigger_cached{trigger=\"" << it->first << "\"} " << it->second.cacheHits << "\n";
+      }
+      response << "\n";
+      response << "# HELP mist_trigger_latency Execution time in millis for the given trigger.\n";
+      response << "# TYPE mist_trigger_latency histogram\n";
       for (std::map<std::string, Controller::triggerLog>::iterator it = Controller::triggerStats.begin();
            it != Controller::triggerStats.end(); it++){
-        response << "mist_trigger_count{trigger=\"" << it->first << "\"}" << it->second.totalCount << "\n";
-        response << "mist_trigger_time{trigger=\"" << it->first << "\"}" << it->second.ms << "\n";
-        response << "mist_trigger_fails{trigger=\"" << it->first << "\"}" << it->second.failCount << "\n";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < TRIGGER_LATENCY_BUCKETS; ++i){
+          cumulative += it->second.latency[i];
+          response << "mist_trigger_latency_bucket{trigger=\"" << it->first << "\",le=\"";
+          if (i < TRIGGER_LATENCY_BUCKETS - 1){
+            response << Controller::triggerLatencyBounds[i];
+          }else{
+            response << "+Inf";
+          }
+          response << "\"} " << cumulative << "\n";
+        }
+        response << "mist_trigger_latency_sum{trigger=\"" << it->first << "\"} " << it->second.ms << "\n";
+        response << "mist_trigger_latency_count{trigger=\"" << it->first << "\"} " << cumulative << "\n";
       }
       response << "\n";
     }
 
+    if (haveSegCache){
+      response << "# HELP mist_segcache_requests Segment requests checked against the shared segment cache, by result.\n";
+      response << "# TYPE mist_segcache_requests counter\n";
+      response << "mist_segcache_requests{result=\"hit\"} " << segCache[Util::SEGCACHE_HITS] << "\n";
+      response << "mist_segcache_requests{result=\"miss\"} " << segCache[Util::SEGCACHE_MISSES] << "\n\n";
+      response << "# HELP mist_segcache_entries Segments stored in or evicted from the shared segment cache.\n";
+      response << "# TYPE mist_segcache_entries counter\n";
+      response << "mist_segcache_entries{action=\"stored\"} " << segCache[Util::SEGCACHE_STORES] << "\n";
+      response << "mist_segcache_entries{action=\"evicted\"} " << segCache[Util::SEGCACHE_EVICTIONS] << "\n\n";
+      response << "# HELP mist_segcache_bytes Bytes served from (saved) and stored in the shared segment cache.\n";
+      response << "# TYPE mist_segcache_bytes counter\n";
+      response << "mist_segcache_bytes{type=\"saved\"} " << segCache[Util::SEGCACHE_BYTES_SAVED] << "\n";
+      response << "mist_segcache_bytes{type=\"stored\"} " << segCache[Util::SEGCACHE_BYTES_STORED] << "\n\n";
+      response << "# HELP mist_segcache_size Bytes of shared memory currently used by the segment cache.\n";
+      response << "# TYPE mist_segcache_size gauge\n";
+      response << "mist_segcache_size " << segCache[Util::SEGCACHE_BYTES_CACHED] << "\n\n";
+    }
+
     {// Scope for shortest possible blocking of statsMutex
       tthread::lock_guard<tthread::mutex> guard(statsMutex);
       // collect the data first
@@ -2033,8 +2109,31 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         tVal["count"] = it->second.totalCount;
         tVal["ms"] = it->second.ms;
         tVal["fails"] = it->second.failCount;
+        tVal["cached"] = it->second.cacheHits;
+        // Cumulative counts per upper bound in millis, as in the prometheus histogram
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < TRIGGER_LATENCY_BUCKETS; ++i){
+          cumulative += it->second.latency[i];
+          JSON::Value bucket;
+          if (i < TRIGGER_LATENCY_BUCKETS - 1){
+            bucket.append(Controller::triggerLatencyBounds[i]);
+          }else{
+            bucket.append(JSON::Value());
+          }
+          bucket.append(cumulative);
+          tVal["latency"].append(bucket);
+        }
       }
     }
+    if (haveSegCache){
+      resp["segcache"]["hits"] = segCache[Util::SEGCACHE_HITS];
+      resp["segcache"]["misses"] = segCache[Util::SEGCACHE_MISSES];
+      resp["segcache"]["stored"] = segCache[Util::SEGCACHE_STORES];
+      resp["segcache"]["evicted"] = segCache[Util::SEGCACHE_EVICTIONS];
+      resp["segcache"]["bytes_saved"] = segCache[Util::SEGCACHE_BYTES_SAVED];
+      resp["segcache"]["bytes_stored"] = segCache[Util::SEGCACHE_BYTES_STORED];
+      resp["segcache"]["size"] = segCache[Util::SEGCACHE_BYTES_CACHED];
+    }
     {// Scope for shortest possible blocking of statsMutex
       tthread::lock_guard<tthread::mutex> guard(statsMutex);
       // collect the data first
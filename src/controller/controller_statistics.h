@@ -1,4 +1,5 @@
 #pragma once
+#include "controller_statlog.h"
 #include <map>
 #include <mist/comms.h>
 #include <mist/defines.h>
@@ -10,11 +11,6 @@
 #include <mist/tinythread.h>
 #include <string>
 
-/// The STAT_CUTOFF define sets how many seconds of statistics history is kept.
-#ifndef STAT_CUTOFF
-#define STAT_CUTOFF 600
-#endif
-
 namespace Controller{
 
   extern bool killOnExit;
@@ -27,16 +23,6 @@ namespace Controller{
 
   void updateBandwidthConfig();
 
-  struct statLog{
-    uint64_t time;
-    uint64_t lastSecond;
-    uint64_t down;
-    uint64_t up;
-    uint64_t pktCount;
-    uint64_t pktLost;
-    uint64_t pktRetransmit;
-  };
-
   enum sessType{SESS_UNSET = 0, SESS_INPUT, SESS_OUTPUT, SESS_VIEWER};
 
   /// This is a comparison and storage class that keeps sessions apart from each other.
@@ -64,8 +50,8 @@ namespace Controller{
   public:
     void update(Comms::Statistics &statComm, size_t index);
     bool hasDataFor(unsigned long long);
-    statLog &getDataFor(unsigned long long);
-    std::map<unsigned long long, statLog> log;
+    const statLog &getDataFor(unsigned long long);
+    statLogRing log;
   };
 
   /// A session class that keeps track of both current and archived connections.
@@ -127,10 +113,17 @@ namespace Controller{
   extern tthread::mutex statsMutex;
   extern uint64_t statDropoff;
 
+  /// Amount of latency buckets kept per trigger, the last one being +Inf
+#define TRIGGER_LATENCY_BUCKETS 12
+  extern const uint64_t triggerLatencyBounds[TRIGGER_LATENCY_BUCKETS - 1];
+
   struct triggerLog{
     uint64_t totalCount;
     uint64_t failCount;
+    uint64_t cacheHits;
     uint64_t ms;
+    uint64_t latency[TRIGGER_LATENCY_BUCKETS]; ///< Executions per latency bucket, not cumulative
+    void addTime(uint64_t millis);
   };
 
   extern std::map<std::string, triggerLog> triggerStats;
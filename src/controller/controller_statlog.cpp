@@ -0,0 +1,97 @@
+#include "controller_statlog.h"
+
+Controller::statLogRing::statLogRing(size_t maxSize) : maxSize(maxSize){
+  start = 0;
+  count = 0;
+}
+
+/// Returns the amount of stored entries.
+size_t Controller::statLogRing::size() const{
+  return count;
+}
+
+/// Returns the time of the oldest entry. Must not be called when empty.
+uint64_t Controller::statLogRing::firstTime() const{
+  return at(0).t;
+}
+
+/// Returns the time of the newest entry. Must not be called when empty.
+uint64_t Controller::statLogRing::lastTime() const{
+  return at(count - 1).t;
+}
+
+/// Returns the oldest entry. Must not be called when empty.
+const Controller::statLog &Controller::statLogRing::first() const{
+  return at(0).data;
+}
+
+/// Returns the newest entry. Must not be called when empty.
+const Controller::statLog &Controller::statLogRing::last() const{
+  return at(count - 1).data;
+}
+
+/// Returns the newest entry at or before time t, or the oldest entry if all are newer.
+/// Must not be called when empty.
+const Controller::statLog &Controller::statLogRing::getAt(uint64_t t) const{
+  // Find the first entry newer than t, then step back one
+  size_t lo = 0, hi = count;
+  while (lo < hi){
+    size_t mid = lo + (hi - lo) / 2;
+    if (at(mid).t <= t){
+      lo = mid + 1;
+    }else{
+      hi = mid;
+    }
+  }
+  return at(lo ? lo - 1 : 0).data;
+}
+
+/// Stores the entry for time t, replacing an existing entry for the same time.
+/// Drops the oldest entry if the ring is full.
+void Controller::statLogRing::set(uint64_t t, const statLog &data){
+  // Find the position to store at; nearly always the end
+  size_t pos = count;
+  while (pos && at(pos - 1).t > t){--pos;}
+  if (pos && at(pos - 1).t == t){
+    at(pos - 1).data = data;
+    return;
+  }
+  if (count == entries.size()){
+    if (count < maxSize){
+      grow();
+    }else{
+      // Full: the oldest entry makes room, unless the new one would be the oldest itself
+      if (!pos){return;}
+      popFront();
+      --pos;
+    }
+  }
+  // Shift newer entries up to make room, if this one did not arrive in order
+  for (size_t i = count; i > pos; --i){at(i) = at(i - 1);}
+  at(pos).t = t;
+  at(pos).data = data;
+  ++count;
+}
+
+/// Removes the oldest entry. Must not be called when empty.
+void Controller::statLogRing::popFront(){
+  start = (start + 1) % entries.size();
+  --count;
+}
+
+/// Removes all entries and frees the storage.
+void Controller::statLogRing::clear(){
+  std::vector<entry>().swap(entries);
+  start = 0;
+  count = 0;
+}
+
+/// Doubles the capacity (up to maxSize), moving the entries to the start of the new storage.
+void Controller::statLogRing::grow(){
+  size_t newSize = entries.size() ? entries.size() * 2 : 4;
+  if (newSize > maxSize){newSize = maxSize;}
+  std::vector<entry> newEntries(newSize);
+  for (size_t i = 0; i < count; ++i){newEntries[i] = at(i);}
+  entries.swap(newEntries);
+  start = 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+/// The STAT_CUTOFF define sets how many seconds of statistics history is kept.
+#ifndef STAT_CUTOFF
+#define STAT_CUTOFF 600
+#endif
+
+namespace Controller{
+
+  struct statLog{
+    uint64_t time;
+    uint64_t lastSecond;
+    uint64_t down;
+    uint64_t up;
+    uint64_t pktCount;
+    uint64_t pktLost;
+    uint64_t pktRetransmit;
+  };
+
+  /// Per-second statistics of a single connection, ordered by the (boot seconds) time they were
+  /// reported at. Kept in a ring buffer that grows as needed up to maxSize entries, after which
+  /// adding a newer entry drops the oldest one. Entries are almost always added in order, so
+  /// adding is O(1) and lookups by time are a binary search.
+  class statLogRing{
+  public:
+    statLogRing(size_t maxSize = STAT_CUTOFF);
+    size_t size() const;
+    uint64_t firstTime() const;
+    uint64_t lastTime() const;
+    const statLog &first() const;
+    const statLog &last() const;
+    const statLog &getAt(uint64_t t) const;
+    void set(uint64_t t, const statLog &data);
+    void popFront();
+    void clear();
+
+  private:
+    struct entry{
+      uint64_t t;
+      statLog data;
+    };
+    std::vector<entry> entries; ///< Ring storage, its size is the current capacity
+    size_t start;               ///< Index of the oldest entry
+    size_t count;               ///< Amount of stored entries
+    size_t maxSize;             ///< Capacity the ring never grows beyond
+    entry &at(size_t i){return entries[(start + i) % entries.size()];}
+    const entry &at(size_t i) const{return entries[(start + i) % entries.size()];}
+    void grow();
+  };
+
+}// namespace Controller
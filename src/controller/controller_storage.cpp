@@ -358,9 +358,25 @@ namespace Controller{
     }
   }
 
+  /// Stream config page that can be marked as replaced, so processes keeping it open know to look
+  /// for a new one. Marks itself when destroyed, which happens when a stream is removed and when the
+  /// controller shuts down.
+  class streamConfPage : public IPC::sharedPage{
+  public:
+    ~streamConfPage(){setReload();}
+    void setReload(){
+      if (mapped && master){
+        Util::RelAccX A(mapped, false);
+        if (A.isReady()){A.setReload();}
+      }
+    }
+  };
+
   void writeStream(const std::string &sName, const JSON::Value &sConf){
     static std::map<std::string, JSON::Value> writtenStrms;
-    static std::map<std::string, IPC::sharedPage> pages;
+    static std::map<std::string, streamConfPage> pages;
+    // Changes on every write, and keeps increasing across restarts
+    static uint64_t generation = Util::unixMS();
     static std::set<std::string> skip;
     if (!skip.size()){
       skip.insert("online");
@@ -374,19 +390,20 @@ namespace Controller{
     }
     if (!writtenStrms.count(sName) || !writtenStrms[sName].compareExcept(sConf, skip)){
       writtenStrms[sName].assignFrom(sConf, skip);
-      IPC::sharedPage &P = pages[sName];
+      streamConfPage &P = pages[sName];
       std::string temp = writtenStrms[sName].toPacked();
+      P.setReload();
       P.close();
       char tmpBuf[NAME_BUFFER_SIZE];
       snprintf(tmpBuf, NAME_BUFFER_SIZE, SHM_STREAM_CONF, sName.c_str());
-      P.init(tmpBuf, temp.size() + 100, false, false);
+      P.init(tmpBuf, temp.size() + 150, false, false);
       if (P){
         Util::RelAccX tmpA(P.mapped, false);
         if (tmpA.isReady()){tmpA.setReload();}
         P.master = true;
         P.close();
       }
-      P.init(tmpBuf, temp.size() + 100, true, false);
+      P.init(tmpBuf, temp.size() + 150, true, false);
       if (!P){
         writtenStrms.erase(sName);
         pages.erase(sName);
@@ -394,8 +411,10 @@ namespace Controller{
       }
       Util::RelAccX A(P.mapped, false);
       A.addField("dtsc_data", RAX_DTSC, temp.size());
+      A.addField("generation", RAX_64UINT);
       // write config
       memcpy(A.getPointer("dtsc_data"), temp.data(), temp.size());
+      A.setInt("generation", ++generation);
       A.setRCount(1);
       A.setEndPos(1);
       A.setReady();
@@ -460,6 +479,7 @@ namespace Controller{
       writtenTrigs = Storage["config"]["triggers"];
       // for all shm pages that hold triggers
       pageForType.clear();
+      bool needCache = false;
 
       if (Storage["config"]["triggers"].size()){
         jsonForEach(Storage["config"]["triggers"], it){
@@ -478,6 +498,7 @@ namespace Controller{
           tPage.addField("streams", RAX_256RAW);
           tPage.addField("params", RAX_128STRING);
           tPage.addField("default", RAX_128STRING);
+          tPage.addField("cachettl", RAX_32UINT);
           tPage.setReady();
           uint32_t i = 0;
           uint32_t max = (32 * 1024 - tPage.getOffset()) / tPage.getRSize();
@@ -538,6 +559,13 @@ namespace Controller{
               }else{
                 tPage.setString("default", "", i);
               }
+              // Response caching only applies to blocking triggers
+              uint32_t cacheTTL = 0;
+              if (triggIt->isMember("cache_ttl") && (*triggIt)["sync"].asBool()){
+                cacheTTL = (*triggIt)["cache_ttl"].asInt();
+              }
+              tPage.setInt("cachettl", cacheTTL, i);
+              if (cacheTTL){needCache = true;}
             }
 
             ++i;
@@ -546,6 +574,23 @@ namespace Controller{
           tPage.setEndPos(std::min(i, max));
         }
       }
+
+      // Shared response cache for blocking triggers; kept once created, entries expire by themselves
+      static IPC::sharedPage cachePage;
+      if (needCache && !cachePage.mapped){
+        cachePage.init(SHM_TRIGGER_CACHE, SHM_TRIGGER_CACHE_SIZE, true, false);
+        if (cachePage.mapped){
+          Util::RelAccX cacheAccX(cachePage.mapped, false);
+          cacheAccX.addField("seq", RAX_64UINT);
+          cacheAccX.addField("hash", RAX_64UINT);
+          cacheAccX.addField("expires", RAX_64UINT);
+          cacheAccX.addField("response", RAX_256STRING);
+          uint32_t slots = (SHM_TRIGGER_CACHE_SIZE - cacheAccX.getOffset()) / cacheAccX.getRSize();
+          cacheAccX.setRCount(slots);
+          cacheAccX.setEndPos(slots);
+          cacheAccX.setReady();
+        }
+      }
     }
 
     static bool serverStartTriggered;
@@ -11,6 +11,7 @@
 #include <mist/downloader.h>
 #include <mist/encode.h>
 #include <mist/procs.h>
+#include <mist/segment_cache.h>
 #include <mist/stream.h>
 #include <mist/triggers.h>
 #include <sstream>
@@ -19,7 +20,10 @@
 namespace Mist{
   Util::Config *Input::config = NULL;
 
-  void Input::userLeadIn(){connectedUsers = 0;}
+  void Input::userLeadIn(){
+    connectedUsers = 0;
+    prefetchQueue.clear();
+  }
   void Input::userOnActive(size_t id){
     ++connectedUsers;
     size_t track = users.getTrack(id);
@@ -27,18 +31,35 @@ namespace Mist{
       WARN_MSG("Player is inside invalid track: %zu", track);
       return;
     }
-    //This is a bit tricky:
-    //We want to make sure the next page is buffered before we need it, during playback.
-    //To do so, we grab the current key's time and make sure current key and everything 120 seconds after it, is loaded.
+    if (!M.getVod()){return;}
     size_t key = users.getKeyNum(id);
-    uint64_t time = M.getTimeForKeyIndex(track, key);
-    size_t endKey = M.getKeyIndexForTime(track, time + 120000);
-    //But! What if our current key is 20+ seconds long? HAVE YOU THOUGHT OF THAT?!
-    //Exactly! I thought not! So, if the end key number == the first, we increase by one.
-    if (endKey == key){++endKey;}
-    DONTEVEN_MSG("User with ID:%zu is on key %zu->%zu (timestamp %" PRIu64 ")", id, key, endKey, time);
-    for (size_t i = key; i <= endKey; i++){bufferFrame(track, i);}
-    //Now, we can rest assured that the next ~120 seconds or so is pre-buffered in RAM.
+    const Util::RelAccX &tPages = M.pages(track);
+    uint64_t pageIdx = M.getPageIndexForKey(track, key);
+    if (pageIdx == INVALID_RECORD_INDEX){return;}
+    // The page the viewer is on right now always goes first, before any prefetching
+    uint32_t pageNum = tPages.getInt("firstkey", pageIdx);
+    std::pair<size_t, uint32_t> current(track, pageNum);
+    if (!isBuffered(track, pageNum, meta)){
+      ++prefetchMisses;
+      DONTEVEN_MSG("User with ID:%zu is on key %zu of track %zu, page %" PRIu32 " not buffered", id, key, track, pageNum);
+      bufferFrame(track, key);
+    }else{
+      if (prefetched.count(current)){
+        ++prefetchHits;
+        prefetched.erase(current);
+      }
+      pageCounter[track][pageNum] = DEFAULT_PAGE_TIMEOUT;
+    }
+    // Queue the pages after it, to be buffered before the viewer gets there
+    int64_t depth = config->getInteger("prefetch");
+    for (size_t i = 1; (int64_t)i <= depth && pageIdx + i < tPages.getEndPos(); ++i){
+      uint32_t nextPage = tPages.getInt("firstkey", pageIdx + i);
+      if (isBuffered(track, nextPage, meta)){
+        pageCounter[track][nextPage] = DEFAULT_PAGE_TIMEOUT;
+        continue;
+      }
+      prefetchQueue.insert(std::make_pair(i, std::make_pair(track, nextPage)));
+    }
   }
   void Input::userOnDisconnect(size_t id){}
   void Input::userLeadOut(){}
@@ -48,7 +69,7 @@ namespace Mist{
     meta.reInit(streamName, false);
   }
 
-  bool Input::hasMeta() const{return M && M.getStreamName() != "" && M.getValidTracks().size();}
+  bool Input::hasMeta() const{return M && M.getStreamName() != "" && M.getValidTrackCount();}
   bool Input::trackLoaded(size_t idx) const{return (M && M.trackLoaded(idx));}
 
   Input::Input(Util::Config *cfg) : InOutBase(){
@@ -178,8 +199,45 @@ namespace Mist{
     capa["optional"]["debug"]["option"] = "--debug";
     capa["optional"]["debug"]["type"] = "debug";
 
+    option.null();
+    option["long"] = "prefetch";
+    option["short"] = "F";
+    option["arg"] = "integer";
+    option["value"].append(2);
+    option["help"] = "Amount of pages to buffer ahead of each viewer of a VoD stream";
+    config->addOption("prefetch", option);
+    capa["optional"]["prefetch"]["name"] = "Prefetch depth";
+    capa["optional"]["prefetch"]["help"] = "Amount of pages to buffer ahead of each viewer of a VoD stream, while the viewer is still watching the current page.";
+    capa["optional"]["prefetch"]["option"] = "--prefetch";
+    capa["optional"]["prefetch"]["type"] = "uint";
+    capa["optional"]["prefetch"]["default"] = 2;
+
+    option.null();
+    option["long"] = "prefetch-memory";
+    option["short"] = "m";
+    option["arg"] = "integer";
+    option["value"].append(0);
+    option["help"] = "No prefetching while more than this amount of MiB is buffered (0 = no limit)";
+    config->addOption("prefetchmem", option);
+    capa["optional"]["prefetchmem"]["name"] = "Prefetch memory limit";
+    capa["optional"]["prefetchmem"]["help"] = "Pages are not buffered ahead of viewers while more than this amount of MiB is buffered for the stream. Pages viewers need right away are always buffered. (0 = no limit)";
+    capa["optional"]["prefetchmem"]["option"] = "--prefetch-memory";
+    capa["optional"]["prefetchmem"]["type"] = "uint";
+    capa["optional"]["prefetchmem"]["default"] = 0;
+    option.null();
+
     hasSrt = false;
     srtTrack = 0;
+    prefetchHits = 0;
+    prefetchMisses = 0;
+    prefetchPages = 0;
+    prefetchLogged[0] = prefetchLogged[1] = 0;
+    bufferedTotal = 0;
+    directPage = 0;
+    directTrack = INVALID_TRACK_ID;
+    directMinTime = 0;
+    directMaxTime = 0;
+    directBuffered = false;
   }
 
   void Input::checkHeaderTimes(std::string streamFile){
@@ -516,7 +574,7 @@ namespace Mist{
     if (M && M.getVod()){
       meta.removeEmptyTracks();
       parseHeader();
-      INFO_MSG("Header parsed, %zu tracks", M.getValidTracks().size());
+      INFO_MSG("Header parsed, %zu tracks", M.getValidTrackCount());
     }
 
     if (!streamName.size()){
@@ -592,12 +650,8 @@ namespace Mist{
   /// If the compiled default debug level is < INFO, instead returns false if the stream is not found.
   bool Input::isAlwaysOn(){
     bool ret = true;
-    std::string strName = streamName.substr(0, (streamName.find_first_of("+ ")));
-
-    char tmpBuf[NAME_BUFFER_SIZE];
-    snprintf(tmpBuf, NAME_BUFFER_SIZE, SHM_STREAM_CONF, strName.c_str());
-    Util::DTSCShmReader rStrmConf(tmpBuf);
-    DTSC::Scan streamCfg = rStrmConf.getScan();
+    streamConfig.update(streamName);
+    DTSC::Scan streamCfg = streamConfig.getScan();
     if (streamCfg){
       if (!streamCfg.getMember("always_on") || !streamCfg.getMember("always_on").asBool()){
         ret = false;
@@ -648,6 +702,8 @@ namespace Mist{
 
     INFO_MSG("Input started");
     activityCounter = Util::bootSecs();
+    uint64_t unusedTimer = Util::bootMS();
+    uint64_t statTimer = 0;
     // main serve loop
     while (keepRunning()){
       // load pages for connected clients on request
@@ -655,18 +711,30 @@ namespace Mist{
       COMM_LOOP(users, userOnActive(id), userOnDisconnect(id))
       userLeadOut();
 
+      // buffer a single page ahead of the viewers, then check on the viewers again
+      bool prefetching = prefetchNext();
+
       // unload pages that haven't been used for a while
-      removeUnused();
+      if (!prefetching || Util::bootMS() - unusedTimer >= INPUT_USER_INTERVAL){
+        removeUnused();
+        unusedTimer = Util::bootMS();
+      }
+
+      if (Util::bootSecs() - statTimer > 1){
+        prefetchStats(false);
+        statTimer = Util::bootSecs();
+      }
 
       if (M.getLive() && !internalOnly){
         uint64_t currLastUpdate = M.getLastUpdated();
         if (currLastUpdate > activityCounter){activityCounter = currLastUpdate;}
       }else{
-        if (connectedUsers && M.getValidTracks().size()){activityCounter = Util::bootSecs();}
+        if (connectedUsers && M.getValidTrackCount()){activityCounter = Util::bootSecs();}
       }
-      // if not shutting down, wait 1 second before looping
-      if (config->is_active){Util::wait(INPUT_USER_INTERVAL);}
+      // if not shutting down or prefetching, wait 1 second before looping
+      if (config->is_active && !prefetching){Util::wait(INPUT_USER_INTERVAL);}
     }
+    prefetchStats(true);
     if (!isThread()){
       if (streamStatus){streamStatus.mapped[0] = STRMSTAT_SHUTDOWN;}
       config->is_active = false;
@@ -829,6 +897,60 @@ namespace Mist{
     }
   }
   
+  /// Buffers the first page in prefetchQueue that is not buffered yet, unless that would exceed
+  /// the prefetch memory limit. Returns true if a page was buffered, so the caller knows there may
+  /// be more work waiting and checks on the viewers again right away.
+  bool Input::prefetchNext(){
+    while (prefetchQueue.size()){
+      size_t track = prefetchQueue.begin()->second.first;
+      uint32_t pageNum = prefetchQueue.begin()->second.second;
+      prefetchQueue.erase(prefetchQueue.begin());
+      if (!M.trackValid(track) || isBuffered(track, pageNum, meta)){continue;}
+      uint64_t memLimit = config->getInteger("prefetchmem") * 1024 * 1024;
+      if (memLimit && bufferedBytes() >= memLimit){
+        HIGH_MSG("Not prefetching track %zu page %" PRIu32 ": memory limit reached", track, pageNum);
+        prefetchQueue.clear();
+        return false;
+      }
+      HIGH_MSG("Prefetching track %zu page %" PRIu32, track, pageNum);
+      if (!bufferFrame(track, pageNum)){return false;}
+      prefetched.insert(std::make_pair(track, pageNum));
+      ++prefetchPages;
+      return true;
+    }
+    return false;
+  }
+
+  /// Returns the total size of all currently buffered pages of all tracks.
+  uint64_t Input::bufferedBytes(){
+    uint64_t total = 0;
+    std::set<size_t> validTracks = M.getValidTracks();
+    for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
+      const Util::RelAccX &tPages = M.pages(*it);
+      for (size_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
+        if (tPages.getInt("avail", i)){total += tPages.getInt("size", i);}
+      }
+    }
+    return total;
+  }
+
+  /// Logs the prefetch counters of serve mode if they changed since they were last logged, or at
+  /// info level once the input is done if anything was buffered for viewers at all.
+  void Input::prefetchStats(bool final){
+    if (!prefetchPages && !prefetchMisses){return;}
+    if (final){
+      INFO_MSG("Prefetched %" PRIu64 " pages (%" PRIu64 " bytes buffered in total); %" PRIu64
+               " viewer page changes were prefetched, %" PRIu64 " were not",
+               prefetchPages, bufferedTotal, prefetchHits, prefetchMisses);
+      return;
+    }
+    if (prefetchHits == prefetchLogged[0] && prefetchMisses == prefetchLogged[1]){return;}
+    prefetchLogged[0] = prefetchHits;
+    prefetchLogged[1] = prefetchMisses;
+    MEDIUM_MSG("Prefetched %" PRIu64 " pages; %" PRIu64 " viewer page changes were prefetched, %" PRIu64
+               " were not", prefetchPages, prefetchHits, prefetchMisses);
+  }
+
   void Input::connStats(Comms::Statistics &statComm){
     statComm.setUp(0);
     statComm.setDown(streamByteCount());
@@ -999,6 +1121,8 @@ namespace Mist{
 
   void Input::finish(){
     if (!standAlone || config->getBool("realtime")){return;}
+    // Segments muxed by outputs are useless once the stream is gone
+    Util::SegmentCache::wipe(streamName);
     for (std::map<size_t, std::map<uint32_t, size_t> >::iterator it = pageCounter.begin();
          it != pageCounter.end(); it++){
       for (std::map<uint32_t, size_t>::iterator it2 = it->second.begin(); it2 != it->second.end(); it2++){
@@ -1023,6 +1147,7 @@ namespace Mist{
           --pageCounter[*it][pageNum];
           if (!pageCounter[*it][pageNum]){
             pageCounter[*it].erase(pageNum);
+            prefetched.erase(std::make_pair(*it, (uint32_t)pageNum));
             bufferRemove(*it, pageNum);
           }
         }
@@ -1270,11 +1395,8 @@ namespace Mist{
       }
       return true;
     }
-    uint64_t pageIdx = 0;
-    for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt("firstkey", i) > keyNum) break;
-      pageIdx = i;
-    }
+    uint64_t pageIdx = M.getPageIndexForKey(idx, keyNum);
+    if (pageIdx == INVALID_RECORD_INDEX){pageIdx = 0;}
     uint32_t pageNumber = tPages.getInt("firstkey", pageIdx);
     if (isBuffered(idx, pageNumber, meta)){
       // Mark the page for removal after 15 seconds of no one watching it
@@ -1308,6 +1430,14 @@ namespace Mist{
       stopTime = keys.getTime(pageNumber + tPages.getInt("keycount", pageIdx));
     }
     HIGH_MSG("Playing from %" PRIu64 " to %" PRIu64, keyTime, stopTime);
+    // Packets that need no conversion may be written straight into the page by getNext
+    if (!isSrt && sourceIdx == idx){
+      directPage = &page;
+      directTrack = idx;
+      directMinTime = keyTime;
+      directMaxTime = stopTime;
+    }
+    directBuffered = false;
     if (isSrt){
       getNextSrt();
       // in case earlier seeking was imprecise, seek to the exact point
@@ -1341,6 +1471,9 @@ namespace Mist{
       for (size_t i = 0; i < keyNum; ++i){partNo += keys.getParts(i);}
       DTSC::Parts parts(M.parts(idx));
       while (thisPacket && thisTime < stopTime){
+        // Packets written by getNext through pageReserve are on the page already
+        bool isDirect = directBuffered;
+        directBuffered = false;
         if (thisTime >= lastBuffered){
           if (sourceIdx != idx){
             if (encryption.find(":") != std::string::npos || M.getEncryption(idx).find(":") != std::string::npos){
@@ -1366,7 +1499,7 @@ namespace Mist{
           }
           //Sanity check: are we matching the key's data size?
           if (thisPacket.getFlag("keyframe")){
-            size_t currPos = tPages.getInt("avail", pageIdx);
+            size_t currPos = tPages.getInt("avail", pageIdx) - (isDirect ? thisPacket.getDataLen() : 0);
             if (currPos){
               size_t keySize = keys.getSize(keyNum);
               if (currPos-prevPos != keySize){
@@ -1386,14 +1519,23 @@ namespace Mist{
           }
           ++partNo;
           HIGH_MSG("Buffering VoD packet (%zuB) @%" PRIu64 " ms on track %zu with offset %" PRIu64, dataLen, thisTime, idx, thisPacket.getInt("offset"));
-          bufferNext(thisTime, thisPacket.getInt("offset"), idx, data, dataLen,
-                     thisPacket.getInt("bpos"), thisPacket.getFlag("keyframe"), page);
+          if (!isDirect){
+            bufferNext(thisTime, thisPacket.getInt("offset"), idx, data, dataLen,
+                       thisPacket.getInt("bpos"), thisPacket.getFlag("keyframe"), page);
+          }
           ++packCounter;
           byteCounter += thisPacket.getDataLen();
           lastBuffered = thisTime;
+          directMinTime = lastBuffered;
         }
         getNext(sourceIdx);
       }
+      directPage = 0;
+      // Don't leave thisPacket pointing into a page that is about to be unmapped
+      if (directBuffered){
+        thisPacket.null();
+        directBuffered = false;
+      }
       //Sanity check: are we matching the key's data size?
       if (isVideo){
         size_t currPos = tPages.getInt("avail", pageIdx);
@@ -1414,9 +1556,30 @@ namespace Mist{
     INFO_MSG("  (%" PRIu32 "/%" PRIu64 " parts, %" PRIu64 " bytes)", packCounter,
              tPages.getInt("parts", pageIdx), byteCounter);
     pageCounter[idx][pageNumber] = DEFAULT_PAGE_TIMEOUT;
+    bufferedTotal += byteCounter;
     return true;
   }
 
+  /// Lets getNext write a packet straight into the page bufferFrame is filling, instead of filling
+  /// thisPacket with it first. Returns where the packDataSize bytes of payload should be written,
+  /// after which pageCommit must be called. Returns null if no page is being filled or the packet
+  /// does not belong on it; getNext should then fill thisPacket as usual.
+  char *Input::pageReserve(uint64_t packTime, int64_t packOffset, size_t packTrack, size_t packDataSize,
+                           uint64_t packBytePos, bool isKeyframe){
+    if (!directPage || packTrack != directTrack){return 0;}
+    if (packTime < directMinTime || packTime >= directMaxTime){return 0;}
+    return bufferReserve(packTime, packOffset, packTrack, packDataSize, packBytePos, isKeyframe, *directPage, meta);
+  }
+
+  /// Completes the packet reserved through pageReserve, once its payload has been written.
+  /// Sets thisPacket to the packet as stored on the page.
+  void Input::pageCommit(){
+    thisPacket.reInit(bufferCommit(*directPage, meta), 0, true);
+    thisTime = thisPacket.getTime();
+    thisIdx = directTrack;
+    directBuffered = true;
+  }
+
   bool Input::atKeyFrame(){
     static std::map<size_t, uint64_t> lastSeen;
     // not in keyTimes? We're not at a keyframe.
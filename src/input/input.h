@@ -8,6 +8,7 @@
 #include <mist/encryption.h>
 #include <mist/json.h>
 #include <mist/shared_memory.h>
+#include <mist/stream.h>
 #include <mist/timing.h>
 #include <set>
 
@@ -72,6 +73,12 @@ namespace Mist{
     virtual void connStats(Comms::Statistics & statComm);
     virtual void parseHeader();
     bool bufferFrame(size_t track, uint32_t keyNum);
+    char *pageReserve(uint64_t packTime, int64_t packOffset, size_t packTrack, size_t packDataSize,
+                      uint64_t packBytePos, bool isKeyframe);
+    void pageCommit();
+    bool prefetchNext();
+    uint64_t bufferedBytes();
+    void prefetchStats(bool final);
 
     uint64_t activityCounter;
 
@@ -86,9 +93,27 @@ namespace Mist{
     Encryption::AES aesCipher;
 
     IPC::sharedPage streamStatus;
+    Util::StreamConfigReader streamConfig; ///< Configuration of the stream, kept open between reads
 
     std::map<size_t, std::map<uint32_t, size_t> > pageCounter;
 
+    /// Pages to buffer ahead of viewers, as (distance from a viewer in pages, (track, page)).
+    /// Rebuilt every time the viewers are checked, nearest pages first.
+    std::set<std::pair<size_t, std::pair<size_t, uint32_t> > > prefetchQueue;
+    std::set<std::pair<size_t, uint32_t> > prefetched; ///< Pages buffered ahead, not yet viewed
+    uint64_t prefetchHits;      ///< Viewers that reached a page buffered ahead of them
+    uint64_t prefetchMisses;    ///< Viewers that had to wait for their page to be buffered
+    uint64_t prefetchPages;     ///< Pages buffered ahead of viewers
+    uint64_t prefetchLogged[2]; ///< prefetchHits and prefetchMisses when they were last logged
+    uint64_t bufferedTotal;     ///< Bytes buffered into pages since start
+
+    // The page bufferFrame is filling, which getNext may write packets into directly
+    IPC::sharedPage *directPage;
+    size_t directTrack;     ///< Track of directPage
+    uint64_t directMinTime; ///< Packets before this time are not buffered
+    uint64_t directMaxTime; ///< Packets at or after this time belong on the next page
+    bool directBuffered;    ///< True if thisPacket was written into directPage by getNext
+
     static Input *singleton;
 
     bool hasSrt;
@@ -291,7 +291,7 @@ namespace Mist{
   }
 
   void inputBuffer::finish(){
-    if (M.getValidTracks().size()){
+    if (M.getValidTrackCount()){
       /*LTS-START*/
       if (M.getBufferWindow()){
         if (Triggers::shouldTrigger("STREAM_BUFFER")){
@@ -321,7 +321,7 @@ namespace Mist{
     meta.reloadReplacedPagesIfNeeded();
     meta.removeTrack(tid);
     /*LTS-START*/
-    if (!M.getValidTracks().size()){
+    if (!M.getValidTrackCount()){
       if (Triggers::shouldTrigger("STREAM_BUFFER")){
         std::string payload = config->getString("streamname") + "\nEMPTY";
         Triggers::doTrigger("STREAM_BUFFER", payload, config->getString("streamname"));
@@ -439,11 +439,8 @@ namespace Mist{
       lastProcTime = Util::bootMS();
       std::string strName = config->getString("streamname");
       Util::sanitizeName(strName);
-      strName = strName.substr(0, (strName.find_first_of("+ ")));
-      char tmpBuf[NAME_BUFFER_SIZE];
-      snprintf(tmpBuf, NAME_BUFFER_SIZE, SHM_STREAM_CONF, strName.c_str());
-      Util::DTSCShmReader rStrmConf(tmpBuf);
-      DTSC::Scan streamCfg = rStrmConf.getScan();
+      streamConfig.update(strName);
+      DTSC::Scan streamCfg = streamConfig.getScan();
       if (streamCfg){
         JSON::Value configuredProcesses = streamCfg.getMember("processes").asJSON();
         checkProcesses(configuredProcesses);
@@ -530,11 +527,8 @@ namespace Mist{
     Util::Procs::kill_timeout = 5;
     std::string strName = config->getString("streamname");
     Util::sanitizeName(strName);
-    strName = strName.substr(0, (strName.find_first_of("+ ")));
-    char tmpBuf[NAME_BUFFER_SIZE];
-    snprintf(tmpBuf, NAME_BUFFER_SIZE, SHM_STREAM_CONF, strName.c_str());
-    Util::DTSCShmReader rStrmConf(tmpBuf);
-    DTSC::Scan streamCfg = rStrmConf.getScan();
+    streamConfig.update(strName);
+    DTSC::Scan streamCfg = streamConfig.getScan();
 
     //Check if bufferTime setting is correct
     uint64_t tmpNum = retrieveSetting(streamCfg, "DVR", "bufferTime");
@@ -631,7 +625,7 @@ namespace Mist{
   /// Checks if all processes are running, starts them if needed, stops them if needed
   void inputBuffer::checkProcesses(const JSON::Value &procs){
     allProcsRunning = true;
-    if (!M.getValidTracks().size()){return;}
+    if (!M.getValidTrackCount()){return;}
     std::set<std::string> newProcs;
 
     // used for building args
@@ -642,7 +636,7 @@ namespace Mist{
     jsonForEachConst(procs, it){
       JSON::Value tmp = *it;
       tmp["source"] = streamName;
-      if (!M.getValidTracks().size() &&
+      if (!M.getValidTrackCount() &&
           (!tmp.isMember("source_track") && !tmp.isMember("track_select"))){
         continue;
       }
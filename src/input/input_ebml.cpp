@@ -514,9 +514,16 @@ namespace Mist{
       }break;
       }
     }
+    thisTime = C.time;
+    // Copy straight into the data page when buffering one, skipping thisPacket
+    char *pageData = pageReserve(C.time, C.offset, thisIdx, C.dsize, C.bpos, C.key);
+    if (pageData){
+      memcpy(pageData, C.ptr, C.dsize);
+      pageCommit();
+      return;
+    }
     thisPacket.genericFill(C.time, C.offset, C.track, C.ptr, C.dsize,
                            C.bpos, C.key);
-    thisTime = C.time;
   }
 
   void InputEBML::getNext(size_t idx){
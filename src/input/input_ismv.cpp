@@ -111,7 +111,7 @@ namespace Mist{
     thisTime = thisPos.time/1000;
     thisIdx = thisPos.trackId;
 
-    if (buffered.size() < 2 * (idx == INVALID_TRACK_ID ? M.getValidTracks().size() : 1)){
+    if (buffered.size() < 2 * (idx == INVALID_TRACK_ID ? M.getValidTrackCount() : 1)){
       std::set<size_t> validTracks = M.getValidTracks();
       if (idx != INVALID_TRACK_ID){
         validTracks.clear();
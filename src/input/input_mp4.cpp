@@ -11,9 +11,16 @@
 #include <mist/h264.h>
 #include <mist/stream.h>
 #include <string>
+#include <unistd.h>
 
 #include "input_mp4.h"
 
+/// Largest run of chunks read from the file at once
+#define MP4_READ_MAX (4 * 1024 * 1024)
+/// Chunks of a track that are at most this far apart in the file are read in one go, along with
+/// the data of other tracks in between them
+#define MP4_READ_GAP (64 * 1024)
+
 namespace Mist{
 
   mp4TrackHeader::mp4TrackHeader(){
@@ -60,8 +67,8 @@ namespace Mist{
     hasCTTS = cttsBox.isType("ctts");
   }
 
-  void mp4TrackHeader::getPart(uint64_t index, uint64_t &offset, uint32_t &size,
-                               uint64_t &timestamp, int32_t &timeOffset, uint64_t &duration){
+  /// Moves the stsc loop to the entry holding the sample with the given index, and returns it.
+  MP4::STSCEntry mp4TrackHeader::findSTSCEntry(uint64_t index){
     if (index < sampleIndex){
       sampleIndex = 0;
       stscStart = 0;
@@ -87,6 +94,44 @@ namespace Mist{
     if (sampleIndex > index){
       FAIL_MSG("Could not complete seek - not in file (%" PRIu64 " > %" PRIu64 ")", sampleIndex, index);
     }
+    return stscEntry;
+  }
+
+  /// Returns the file offset right after the chunk holding the sample with the given index.
+  /// Following chunks of this track are included as long as they start at most maxGap bytes
+  /// after the previous one ends and end no later than maxEnd, so they can be read in one go.
+  /// The first chunk is cut off at maxEnd, if it ends after it.
+  uint64_t mp4TrackHeader::getRunEnd(uint64_t index, uint64_t maxGap, uint64_t maxEnd){
+    MP4::STSCEntry stscEntry = findSTSCEntry(index);
+    if (!stscEntry.samplesPerChunk){return 0;}
+    uint64_t stscCount = stscBox.getEntryCount();
+    uint64_t chunkCount = (stco64 ? co64Box.getEntryCount() : stcoBox.getEntryCount());
+    uint64_t sampleCount = stszBox.getSampleCount();
+    uint64_t entry = stscStart;
+    uint64_t chunk = (stscEntry.firstChunk - 1) + ((index - sampleIndex) / stscEntry.samplesPerChunk);
+    uint64_t sample = sampleIndex + (chunk - (stscEntry.firstChunk - 1)) * stscEntry.samplesPerChunk;
+
+    uint64_t runEnd = 0;
+    while (chunk < chunkCount && sample < sampleCount){
+      uint64_t chunkEnd = (stco64 ? co64Box.getChunkOffset(chunk) : stcoBox.getChunkOffset(chunk));
+      if (runEnd && (chunkEnd < runEnd || chunkEnd > runEnd + maxGap)){break;}
+      for (uint64_t i = 0; i < stscEntry.samplesPerChunk && sample < sampleCount; ++i){
+        chunkEnd += stszBox.getEntrySize(sample++);
+      }
+      if (chunkEnd > maxEnd){return runEnd ? runEnd : maxEnd;}
+      runEnd = chunkEnd;
+      ++chunk;
+      if (entry + 1 < stscCount && chunk + 1 >= stscBox.getSTSCEntry(entry + 1).firstChunk){
+        stscEntry = stscBox.getSTSCEntry(++entry);
+        if (!stscEntry.samplesPerChunk){break;}
+      }
+    }
+    return runEnd;
+  }
+
+  void mp4TrackHeader::getPart(uint64_t index, uint64_t &offset, uint32_t &size,
+                               uint64_t &timestamp, int32_t &timeOffset, uint64_t &duration){
+    MP4::STSCEntry stscEntry = findSTSCEntry(index);
 
     uint64_t stcoPlace = (stscEntry.firstChunk - 1) + ((index - sampleIndex) / stscEntry.samplesPerChunk);
     uint64_t stszStart = sampleIndex + (stcoPlace - (stscEntry.firstChunk - 1)) * stscEntry.samplesPerChunk;
@@ -159,8 +204,7 @@ namespace Mist{
   }
 
   inputMP4::inputMP4(Util::Config *cfg) : Input(cfg){
-    malSize = 4; // initialise data read buffer to 0;
-    data = (char *)malloc(malSize);
+    readPos = 0;
     capa["name"] = "MP4";
     capa["desc"] = "This input allows streaming of MP4 files as Video on Demand.";
     capa["source_match"] = "/*.mp4";
@@ -175,7 +219,7 @@ namespace Mist{
     capa["codecs"][0u][1u].append("MP3");
   }
 
-  inputMP4::~inputMP4(){free(data);}
+  inputMP4::~inputMP4(){}
 
   bool inputMP4::checkArguments(){
     if (config->getString("input") == "-"){
@@ -385,7 +429,7 @@ namespace Mist{
               nextFirstChunk =
                   (stscIndex + 1 < stscCount ? stscBox.getSTSCEntry(stscIndex + 1).firstChunk - 1 : stcoCount);
             }
-            BsetPart.keyframe = (meta.getType(tNumber) == "video" && stssIndex < stssCount &&
+            BsetPart.keyframe = (meta.getTypeId(tNumber) == DTSC::VIDEO && stssIndex < stssCount &&
                                  stszIndex + 1 == stssBox.getSampleNumber(stssIndex));
             if (BsetPart.keyframe){++stssIndex;}
             // in bpos set
@@ -465,7 +509,7 @@ namespace Mist{
     uint32_t nextKeyNum = nextKeyframe[curPart.trackID];
     if (nextKeyNum < keys.getEndValid()){
       // checking if this is a keyframe
-      if (meta.getType(curPart.trackID) == "video" && curPart.time == keys.getTime(nextKeyNum)){
+      if (meta.getTypeId(curPart.trackID) == DTSC::VIDEO && curPart.time == keys.getTime(nextKeyNum)){
         isKeyframe = true;
       }
       // if a keyframe has passed, we find the next keyframe
@@ -474,22 +518,13 @@ namespace Mist{
         ++nextKeyNum;
       }
     }
-    if (fseeko(inFile, curPart.bpos, SEEK_SET)){
-      FAIL_MSG("seek unsuccessful @bpos %" PRIu64 ": %s", curPart.bpos, strerror(errno));
-      thisPacket.null();
-      return;
-    }
-    if (curPart.size > malSize){
-      data = (char *)realloc(data, curPart.size);
-      malSize = curPart.size;
-    }
-    if (fread(data, curPart.size, 1, inFile) != 1){
-      FAIL_MSG("read unsuccessful at %ld", ftell(inFile));
+    const char *data = readPart(curPart);
+    if (!data){
       thisPacket.null();
       return;
     }
 
-    if (M.getCodec(curPart.trackID) == "subtitle"){
+    if (M.getCodecId(curPart.trackID) == DTSC::CODEC_SUBTITLE){
       unsigned int txtLen = Bit::btohs(data);
       if (!txtLen && false){
         curPart.index++;
@@ -506,7 +541,14 @@ namespace Mist{
       std::string tmpStr = thisPack.toNetPacked();
       thisPacket.reInit(tmpStr.data(), tmpStr.size());
     }else{
-      thisPacket.genericFill(curPart.time, curPart.offset, curPart.trackID, data, curPart.size, 0, isKeyframe);
+      // Copy straight into the data page when buffering one, skipping thisPacket
+      char *pageData = pageReserve(curPart.time, curPart.offset, curPart.trackID, curPart.size, 0, isKeyframe);
+      if (pageData){
+        memcpy(pageData, data, curPart.size);
+        pageCommit();
+      }else{
+        thisPacket.genericFill(curPart.time, curPart.offset, curPart.trackID, data, curPart.size, 0, isKeyframe);
+      }
     }
     thisTime = curPart.time;
     thisIdx = curPart.trackID;
@@ -520,6 +562,35 @@ namespace Mist{
     }
   }
 
+  /// Returns a pointer to the data of the given part, valid until the next call.
+  /// Parts are served from a buffer holding the run of chunks they are in. When a part is not in
+  /// the buffer, its chunk and the chunks of the same track close after it are read in one go,
+  /// instead of seeking and reading for every single part.
+  const char *inputMP4::readPart(const mp4PartTime &part){
+    if (part.bpos >= readPos && part.bpos + part.size <= readPos + readBuffer.size()){
+      return readBuffer + (part.bpos - readPos);
+    }
+    uint64_t readEnd = headerData(M.getID(part.trackID)).getRunEnd(part.index, MP4_READ_GAP, part.bpos + MP4_READ_MAX);
+    if (readEnd < part.bpos + part.size){readEnd = part.bpos + part.size;}
+    uint64_t readLen = readEnd - part.bpos;
+    readBuffer.size() = 0;
+    if (!readBuffer.allocate(readLen)){return 0;}
+    readPos = part.bpos;
+    while (readBuffer.size() < readLen){
+      ssize_t r = pread(fileno(inFile), (char *)readBuffer + readBuffer.size(), readLen - readBuffer.size(),
+                        readPos + readBuffer.size());
+      if (r < 0 && errno == EINTR){continue;}
+      if (r <= 0){break;}
+      readBuffer.size() += r;
+    }
+    if (readBuffer.size() < part.size){
+      FAIL_MSG("read unsuccessful @bpos %" PRIu64 ": %s", part.bpos, readBuffer.size() ? "end of file" : strerror(errno));
+      readBuffer.size() = 0;
+      return 0;
+    }
+    return readBuffer;
+  }
+
   void inputMP4::seek(uint64_t seekTime, size_t idx){// seek to a point
     nextKeyframe.clear();
     curPositions.clear();
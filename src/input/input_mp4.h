@@ -52,9 +52,11 @@ namespace Mist{
     uint64_t timeScale;
     void getPart(uint64_t index, uint64_t &offset, uint32_t &size, uint64_t &timestamp,
                  int32_t &timeOffset, uint64_t &duration);
+    uint64_t getRunEnd(uint64_t index, uint64_t maxGap, uint64_t maxEnd);
     uint64_t size();
 
   private:
+    MP4::STSCEntry findSTSCEntry(uint64_t index);
     bool initialised;
     // next variables are needed for the stsc/stco loop
     uint64_t stscStart;
@@ -88,6 +90,7 @@ namespace Mist{
     FILE *inFile;
 
     mp4TrackHeader &headerData(size_t trackID);
+    const char *readPart(const mp4PartTime &part);
 
     std::deque<mp4TrackHeader> trackHeaders;
     std::set<mp4PartTime> curPositions;
@@ -95,10 +98,9 @@ namespace Mist{
     // remember last seeked keyframe;
     std::map<size_t, uint32_t> nextKeyframe;
 
-    // these next two variables keep a buffer for reading from filepointer inFile;
-    uint64_t malSize;
-    char *data; ///\todo rename this variable to a more sensible name, it is a temporary piece of
-                /// memory to read from files
+    // Runs of chunks read from inFile in one go, that parts are served from
+    Util::ResizeablePointer readBuffer;
+    uint64_t readPos; ///< File offset of the first byte in readBuffer
   };
 }// namespace Mist
 
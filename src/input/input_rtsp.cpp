@@ -282,7 +282,7 @@ namespace Mist{
             seenSDP = true;
             sdpState.parseSDP(recH.body);
             recH.Clean();
-            INFO_MSG("SDP contained %zu tracks", M.getValidTracks().size());
+            INFO_MSG("SDP contained %zu tracks", M.getValidTrackCount());
             return true;
           }
           if (recH.hasHeader("Transport")){
@@ -11,7 +11,12 @@
 #include <mist/config.h>
 
 namespace Mist{
-  InOutBase::InOutBase() : M(meta){}
+  InOutBase::InOutBase() : M(meta){
+    reservedTrack = INVALID_TRACK_ID;
+    reservedPageIdx = 0;
+    reservedOffset = 0;
+    reservedLen = 0;
+  }
 
   /// Returns the ID of the main selected track, or 0 if no tracks are selected.
   /// The main track is the first video track, if any, and otherwise the first other track.
@@ -44,7 +49,7 @@ namespace Mist{
     if (!aMeta){aMeta.reInit(streamName);}
 #endif
 
-    if (!aMeta.getValidTracks().size()){
+    if (!aMeta.getValidTrackCount()){
       aMeta.clear();
       return false;
     }
@@ -58,16 +63,10 @@ namespace Mist{
 
     Util::RelAccX &tPages = aMeta.pages(idx);
 
-    uint32_t pageIdx = INVALID_KEY_NUM;
-    for (uint32_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt("firstkey", i) == pageNumber){
-        pageIdx = i;
-        break;
-      }
-    }
+    uint64_t pageIdx = aMeta.getPageIndex(idx, pageNumber);
 
     // If this is not a valid page number on this track, stop buffering this page.
-    if (pageIdx == INVALID_KEY_NUM){
+    if (pageIdx == INVALID_RECORD_INDEX){
       WARN_MSG("Aborting page buffer start: %" PRIu32 " is not a valid page number on track %zu.", pageNumber, idx);
       std::stringstream test;
       for (uint32_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
@@ -133,15 +132,9 @@ namespace Mist{
     }
     Util::RelAccX &tPages = meta.pages(idx);
 
-    uint32_t pageIdx = INVALID_KEY_NUM;
-    for (uint32_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt("firstkey", i) == pageNumber){
-        pageIdx = i;
-        break;
-      }
-    }
+    uint64_t pageIdx = meta.getPageIndex(idx, pageNumber);
     // If the given pagenumber is not a valid page on this track, do nothing
-    if (pageIdx == INVALID_KEY_NUM){
+    if (pageIdx == INVALID_RECORD_INDEX){
       INFO_MSG("Can't remove page %" PRIu32 " on track %zu as it is not a valid page number.", pageNumber, idx);
       return;
     }
@@ -182,16 +175,13 @@ namespace Mist{
   uint32_t InOutBase::bufferedOnPage(size_t idx, uint32_t keyNum, DTSC::Meta & aMeta){
     Util::RelAccX &tPages = aMeta.pages(idx);
 
-    for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      uint64_t pageNum = tPages.getInt("firstkey", i);
-      if (pageNum > keyNum) continue;
-      uint64_t keyCount = tPages.getInt("keycount", i);
-      if (pageNum + keyCount - 1 < keyNum) continue;
-      if (keyCount && pageNum + keyCount - 1 < keyNum) continue;
-      uint64_t avail = tPages.getInt("avail", i);
-      return avail ? pageNum : INVALID_KEY_NUM;
-    }
-    return INVALID_KEY_NUM;
+    uint64_t i = aMeta.getPageIndexForKey(idx, keyNum);
+    if (i == INVALID_RECORD_INDEX){return INVALID_KEY_NUM;}
+    uint64_t pageNum = tPages.getInt("firstkey", i);
+    uint64_t keyCount = tPages.getInt("keycount", i);
+    if (pageNum + keyCount - 1 < keyNum){return INVALID_KEY_NUM;}
+    uint64_t avail = tPages.getInt("avail", i);
+    return avail ? pageNum : INVALID_KEY_NUM;
   }
 
   /// Buffers the next packet on the currently opened page
@@ -205,6 +195,18 @@ namespace Mist{
   ///\param pack The packet to buffer
   void InOutBase::bufferNext(uint64_t packTime, int64_t packOffset, uint32_t packTrack, const char *packData,
                              size_t packDataSize, uint64_t packBytePos, bool isKeyframe, IPC::sharedPage & page, DTSC::Meta & aMeta){
+    char *data = bufferReserve(packTime, packOffset, packTrack, packDataSize, packBytePos, isKeyframe, page, aMeta);
+    if (!data){return;}
+    if (packData){memcpy(data, packData, packDataSize);}
+    bufferCommit(page, aMeta);
+  }
+
+  /// Writes everything but the payload of the next packet on the currently opened page, and
+  /// returns where the packDataSize bytes of payload should be written. Returns null if the packet
+  /// cannot be buffered. The packet is not visible to readers until bufferCommit is called, so
+  /// callers may write the payload straight into the page instead of copying it there later.
+  char *InOutBase::bufferReserve(uint64_t packTime, int64_t packOffset, uint32_t packTrack, size_t packDataSize,
+                                 uint64_t packBytePos, bool isKeyframe, IPC::sharedPage & page, DTSC::Meta & aMeta){
     size_t packDataLen =
         24 + (packOffset ? 17 : 0) + (packBytePos ? 15 : 0) + (isKeyframe ? 19 : 0) + packDataSize + 11;
 
@@ -212,7 +214,7 @@ namespace Mist{
     // Save the trackid of the track for easier access
     if (packTrack == INVALID_TRACK_ID){
       WARN_MSG("Packet with id %" PRIu32 " has an invalid track", packTrack);
-      return;
+      return 0;
     }
 
     // these checks were already done in bufferSinglePacket, but we check again just to be sure
@@ -221,25 +223,19 @@ namespace Mist{
                 "Wrong order on track %" PRIu32 " ignored: %" PRIu64 " < %" PRIu64, packTrack,
                 packTime, aMeta.getLastms(packTrack));
       multiWrong = true;
-      return;
+      return 0;
     }
     // Do nothing if no page is opened for this track
     if (!page){
       INFO_MSG("Trying to buffer a packet on track %" PRIu32 ", but no page is initialized", packTrack);
-      return;
+      return 0;
     }
     multiWrong = false;
 
     Util::RelAccX &tPages = aMeta.pages(packTrack);
-    uint32_t pageIdx = 0;
     uint32_t currPagNum = atoi(page.name.data() + page.name.rfind('_') + 1);
-    Util::RelAccXFieldData firstkey = tPages.getFieldData("firstkey");
-    for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt(firstkey, i) == currPagNum){
-        pageIdx = i;
-        break;
-      }
-    }
+    uint64_t pageIdx = aMeta.getPageIndex(packTrack, currPagNum);
+    if (pageIdx == INVALID_RECORD_INDEX){pageIdx = 0;}
     // Save the current write position
     uint64_t pageOffset = tPages.getInt("avail", pageIdx);
     uint64_t pageSize = tPages.getInt("size", pageIdx);
@@ -248,14 +244,20 @@ namespace Mist{
     if (pageSize - pageOffset < packDataLen){
       FAIL_MSG("Track %" PRIu32 "p%" PRIu32 " : Pack %" PRIu64 "ms of %zub exceeds size %" PRIu64 " @ bpos %" PRIu64,
                packTrack, currPagNum, packTime, packDataLen, pageSize, pageOffset);
-      return;
+      return 0;
     }
 
-    // First generate only the payload on the correct destination
-    // Leaves the 20 bytes inbetween empty to ensure the data is not accidentally read before it is
-    // complete
+    // Generate everything but the 'DTP2' bytes on the correct destination, so the packet is not
+    // accidentally read before it is complete
     char *data = page.mapped + pageOffset;
 
+    // 8 byte timestamp
+    Bit::htobll(data + 12, packTime);
+    // The mapped track id
+    Bit::htobl(data + 8, packTrack);
+    // Write the size
+    Bit::htobl(data + 4, packDataLen - 8);
+
     data[20] = 0xE0; // start container object
     unsigned int offset = 21;
     if (packOffset){
@@ -274,22 +276,26 @@ namespace Mist{
     }
     memcpy(data + offset, "\000\004data\002", 7);
     Bit::htobl(data + offset + 7, packDataSize);
-    memcpy(data + offset + 11, packData ? packData : 0, packDataSize);
     // finish container with 0x0000EE
     memcpy(data + offset + 11 + packDataSize, "\000\000\356", 3);
 
-    // Copy the remaining values in reverse order:
-    // 8 byte timestamp
-    Bit::htobll(page.mapped + pageOffset + 12, packTime);
-    // The mapped track id
-    Bit::htobl(page.mapped + pageOffset + 8, packTrack);
-    // Write the size
-    Bit::htobl(page.mapped + pageOffset + 4, packDataLen - 8);
+    reservedTrack = packTrack;
+    reservedPageIdx = pageIdx;
+    reservedOffset = pageOffset;
+    reservedLen = packDataLen;
+    return data + offset + 11;
+  }
+
+  /// Makes the packet reserved by the last bufferReserve call available to readers, once its
+  /// payload has been written. Returns a pointer to the complete packet on the page.
+  char *InOutBase::bufferCommit(IPC::sharedPage & page, DTSC::Meta & aMeta){
+    char *data = page.mapped + reservedOffset;
     // write the 'DTP2' bytes to conclude the packet and allow for reading it
-    memcpy(page.mapped + pageOffset, "DTP2", 4);
+    memcpy(data, "DTP2", 4);
 
-    DONTEVEN_MSG("Setting page %" PRIu32 " available to %" PRIu64, pageIdx, pageOffset + packDataLen);
-    tPages.setInt("avail", pageOffset + packDataLen, pageIdx);
+    DONTEVEN_MSG("Setting page %" PRIu64 " available to %" PRIu64, reservedPageIdx, reservedOffset + reservedLen);
+    aMeta.pages(reservedTrack).setInt("avail", reservedOffset + reservedLen, reservedPageIdx);
+    return data;
   }
 
   /// Wraps up the buffering of a shared memory data page
@@ -474,6 +480,8 @@ namespace Mist{
     DONTEVEN_MSG("Buffering live packet (%zuB) @%" PRIu64 " ms on track %" PRIu32 " with offset %" PRIu64, packDataSize, packTime, packTrack, packOffset);
     bufferNext(packTime, packOffset, packTrack, packData, packDataSize, packBytePos, isKeyframe, livePage[packTrack], aMeta);
     aMeta.update(packTime, packOffset, packTrack, packDataSize, packBytePos, isKeyframe);
+    // Wake up any outputs waiting for this data
+    aMeta.notifyData(packTrack);
   }
 
   ///Handles updating track metadata from a new keyframe, if applicable
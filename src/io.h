@@ -29,6 +29,9 @@ namespace Mist{
                     size_t packDataSize, uint64_t packBytePos, bool isKeyframe, IPC::sharedPage & page, DTSC::Meta & aMeta);
     void bufferNext(uint64_t packTime, int64_t packOffset, uint32_t packTrack, const char *packData,
                     size_t packDataSize, uint64_t packBytePos, bool isKeyframe, IPC::sharedPage & page);
+    char *bufferReserve(uint64_t packTime, int64_t packOffset, uint32_t packTrack, size_t packDataSize,
+                        uint64_t packBytePos, bool isKeyframe, IPC::sharedPage & page, DTSC::Meta & aMeta);
+    char *bufferCommit(IPC::sharedPage & page, DTSC::Meta & aMeta);
     void bufferLivePacket(uint64_t packTime, int64_t packOffset, uint32_t packTrack, const char *packData,
                           size_t packDataSize, uint64_t packBytePos, bool isKeyframe);
     void bufferLivePacket(uint64_t packTime, int64_t packOffset, uint32_t packTrack, const char *packData,
@@ -52,5 +55,11 @@ namespace Mist{
   private:
     std::map<uint32_t, IPC::sharedPage> livePage;
     std::map<uint32_t, size_t> curPageNum;
+
+    // The packet reserved by bufferReserve, for bufferCommit to complete
+    uint32_t reservedTrack;
+    uint64_t reservedPageIdx;
+    uint64_t reservedOffset;
+    size_t reservedLen;
   };
 }// namespace Mist
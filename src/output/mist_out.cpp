@@ -40,14 +40,7 @@ int main(int argc, char *argv[]){
       if (!defTrkSrt.size()){
         //defTrkSrt = Util::getGlobalConfig("default_track_sorting").asString();
       }
-      if (defTrkSrt.size()){
-        if (defTrkSrt == "bps_lth"){Util::defaultTrackSortOrder = Util::TRKSORT_BPS_LTH;}
-        if (defTrkSrt == "bps_htl"){Util::defaultTrackSortOrder = Util::TRKSORT_BPS_HTL;}
-        if (defTrkSrt == "id_lth"){Util::defaultTrackSortOrder = Util::TRKSORT_ID_LTH;}
-        if (defTrkSrt == "id_htl"){Util::defaultTrackSortOrder = Util::TRKSORT_ID_HTL;}
-        if (defTrkSrt == "res_lth"){Util::defaultTrackSortOrder = Util::TRKSORT_RES_LTH;}
-        if (defTrkSrt == "res_htl"){Util::defaultTrackSortOrder = Util::TRKSORT_RES_HTL;}
-      }
+      Util::setDefaultTrackSortOrder(defTrkSrt);
     }
     conf.activate();
     if (mistOut::listenMode()){
@@ -9,6 +9,7 @@
 
 #include "output.h"
 #include <mist/bitfields.h>
+#include <mist/checksum.h>
 #include <mist/defines.h>
 #include <mist/h264.h>
 #include <mist/http_parser.h>
@@ -26,8 +27,10 @@
 /*LTS-END*/
 
 namespace Mist{
-  JSON::Value Output::capa = JSON::Value();
-  Util::Config *Output::config = NULL;
+  OutputCapa Output::capa;
+  OutputConfig Output::config;
+  __thread JSON::Value *OutputCapa::threadCapa = 0;
+  __thread Util::Config *OutputConfig::threadConfig = 0;
 
   uint32_t getDTSCLen(char *mapped, uint64_t offset){return Bit::btohl(mapped + offset + 4);}
 
@@ -82,6 +85,13 @@ namespace Mist{
     option.append("Resolution, high to low");
     capa["optional"]["default_track_sorting"]["select"].append(option);
 
+    capa["optional"]["multiviewer"]["name"] = "Multi-viewer mode";
+    capa["optional"]["multiviewer"]["help"] = "Serve up to this many connections at once from a single process (one thread per connection) instead of forking a new process for every connection. Further connections wait until one ends. 0 forks a process per connection.";
+    capa["optional"]["multiviewer"]["option"] = "--multiviewer";
+    capa["optional"]["multiviewer"]["short"] = "O";
+    capa["optional"]["multiviewer"]["type"] = "uint";
+    capa["optional"]["multiviewer"]["default"] = 0;
+
     config = cfg;
   }
 
@@ -96,6 +106,8 @@ namespace Mist{
     parseData = false;
     wantRequest = true;
     sought = false;
+    connEnded = false;
+    handedOver = false;
     isInitialized = false;
     isBlocking = false;
     needsLookAhead = 0;
@@ -105,6 +117,10 @@ namespace Mist{
     uaDelay = 10;
     realTime = 1000;
     emptyCount = 0;
+    dataWakeups = 0;
+    dataSpurious = 0;
+    dataTimeouts = 0;
+    lastWaitWoken = false;
     seekCount = 2;
     firstData = true;
     newUA = true;
@@ -116,9 +132,19 @@ namespace Mist{
     if (myConn){
       setBlocking(true);
       //Make sure that if the socket is a non-stdio socket, we close it when forking
-      if (myConn.getSocket() > 2){
+      //In multi-viewer mode, the socket list is shared between threads and must not be touched
+      if (myConn.getSocket() > 2 && !Util::Config::is_multi){
         Util::Procs::socketList.insert(myConn.getSocket());
       }
+      //All connections share a PID in multi-viewer mode, and socket numbers get reused, so number
+      //the connections instead. For a given PID, every number gives a different checksum.
+      if (Util::Config::is_multi){
+        static volatile uint32_t connNum = 0;
+        char connId[8];
+        Bit::htobl(connId, crc);
+        Bit::htobl(connId + 4, __sync_add_and_fetch(&connNum, 1));
+        crc = checksum::crc32(0, connId, 8);
+      }
     }else{
       WARN_MSG("Warning: MistOut created with closed socket!");
     }
@@ -161,7 +187,23 @@ namespace Mist{
     return false;
   }
 
+  static int (*multiCallback)(Socket::Connection &S) = 0;
+  static Util::trackSortOrder multiSortOrder = Util::TRKSORT_DEFAULT;
+
+  /// Serves a connection in multi-viewer mode. Every connection runs on a thread of its own, which
+  /// starts out with the track sort order this process was configured with.
+  static int multiConnection(Socket::Connection &S){
+    Util::defaultTrackSortOrder = multiSortOrder;
+    return multiCallback(S);
+  }
+
   void Output::listener(Util::Config &conf, int (*callback)(Socket::Connection &S)){
+    if (conf.hasOption("multiviewer") && conf.getInteger("multiviewer") > 0){
+      multiCallback = callback;
+      multiSortOrder = Util::defaultTrackSortOrder;
+      conf.serveMultiSocket(multiConnection, conf.getInteger("multiviewer"));
+      return;
+    }
     conf.serveForkedSocket(callback);
   }
 
@@ -335,7 +377,7 @@ namespace Mist{
           return true;
         }
         HIGH_MSG("NOT READY YET (%zu tracks, main track: %zu, with %zu keys)",
-                 M.getValidTracks().size(), getMainSelectedTrack(), keys.getValidCount());
+                 M.getValidTrackCount(), getMainSelectedTrack(), keys.getValidCount());
       }else{
         HIGH_MSG("NOT READY YET (%zu tracks)", getSupportedTracks().size());
       }
@@ -372,9 +414,10 @@ namespace Mist{
     }else{
       if (!Util::startInput(streamName, "", true, isPushing())){
         // If stream is configured, use fallback stream setting, if set.
-        JSON::Value strCnf = Util::getStreamConfig(streamName);
-        if (strCnf && strCnf["fallback_stream"].asStringRef().size()){
-          std::string defStrm = strCnf["fallback_stream"].asStringRef();
+        streamConfig.update(streamName);
+        DTSC::Scan fallback = streamConfig.getMember("fallback_stream");
+        if (fallback && fallback.asString().size()){
+          std::string defStrm = fallback.asString();
           std::string newStrm = defStrm;
           Util::streamVariables(newStrm, streamName, "");
           INFO_MSG("Switching to configured fallback stream '%s' -> '%s'", defStrm.c_str(), newStrm.c_str());
@@ -552,6 +595,13 @@ namespace Mist{
     parseData = false;
   }
 
+  /// Stops serving this connection. A process serving just this connection shuts down, while in
+  /// multi-viewer mode the other connections of the process keep going.
+  void Output::endConnection(){
+    connEnded = true;
+    if (!Util::Config::is_multi){config->is_active = false;}
+  }
+
   ///Returns the timestamp of the next upcoming keyframe after thisPacket, or 0 if that cannot be determined (yet).
   uint64_t Output::nextKeyTime(){
     size_t trk = thisPacket.getTrackId();
@@ -577,26 +627,21 @@ namespace Mist{
   
   uint64_t Output::pageNumForKey(size_t trackId, size_t keyNum){
     const Util::RelAccX &tPages = M.pages(trackId);
-    for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      uint64_t pageNum = tPages.getInt("firstkey", i);
-      if (pageNum > keyNum) continue;
-      uint64_t pageKeys = tPages.getInt("keycount", i);
-      if (keyNum > pageNum + pageKeys - 1) continue;
-      uint64_t pageAvail = tPages.getInt("avail", i);
-      return pageAvail == 0 ? INVALID_KEY_NUM : pageNum;
-    }
-    return INVALID_KEY_NUM;
+    uint64_t i = M.getPageIndexForKey(trackId, keyNum);
+    if (i == INVALID_RECORD_INDEX){return INVALID_KEY_NUM;}
+    uint64_t pageNum = tPages.getInt("firstkey", i);
+    uint64_t pageKeys = tPages.getInt("keycount", i);
+    if (keyNum > pageNum + pageKeys - 1){return INVALID_KEY_NUM;}
+    uint64_t pageAvail = tPages.getInt("avail", i);
+    return pageAvail == 0 ? INVALID_KEY_NUM : pageNum;
   }
 
   /// Gets the highest page number available for the given trackId.
   uint64_t Output::pageNumMax(size_t trackId){
     const Util::RelAccX &tPages = M.pages(trackId);
-    uint64_t highest = 0;
-    for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      uint64_t pageNum = tPages.getInt("firstkey", i);
-      if (pageNum > highest){highest = pageNum;}
-    }
-    return highest;
+    // Page numbers only ever increase, so the last page has the highest one
+    if (tPages.getEndPos() <= tPages.getDeleted()){return 0;}
+    return tPages.getInt("firstkey", tPages.getEndPos() - 1);
   }
 
   /// Loads the page for the given trackId and keyNum into memory.
@@ -734,7 +779,7 @@ namespace Mist{
     thisPacket.null();
     MEDIUM_MSG("Seeking keyframes near %llums, max delta of %llu", pos, maxDelta);
     for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); it++){
-      if (!M.getValidTracks().count(it->first)){continue;}
+      if (!M.isValidTrack(it->first)){continue;}
       uint64_t time = M.getTimeForKeyIndex(it->first, M.getKeyIndexForTime(it->first, pos));
       uint64_t timeDelta = M.getTimeForKeyIndex(it->first, M.getKeyIndexForTime(it->first, pos + maxDelta));
       if (time >= (pos - maxDelta)){
@@ -1252,6 +1297,28 @@ namespace Mist{
     Util::wait(millis);
   }
 
+  /// Waits up to the given amount of millis for the input to signal new data on the given track,
+  /// returning as soon as it does. Playback timing is adjusted like playbackSleep does.
+  /// \param dataNotify The M.getDataNotify value retrieved before checking for data.
+  /// \returns The time waited in tens of milliseconds, at least one.
+  uint64_t Output::playbackWait(size_t trackIdx, uint32_t dataNotify, uint64_t millis){
+    // Woken up last time, but there still was nothing to send
+    if (lastWaitWoken){++dataSpurious;}
+    uint64_t waitStart = Util::bootMS();
+    lastWaitWoken = M.waitForData(trackIdx, dataNotify, millis);
+    uint64_t waited = Util::bootMS() - waitStart;
+    if (lastWaitWoken){
+      ++dataWakeups;
+    }else{
+      ++dataTimeouts;
+    }
+    if (realTime && M.getLive() && buffer.getSyncMode()){
+      firstTime += waited;
+      extraKeepAway += waited;
+    }
+    return waited < 10 ? 1 : waited / 10;
+  }
+
   /// Called right before sendNext(). Should return true if this is a stopping point.
   bool Output::reachedPlannedStop(){
     // If we're recording to file and reached the target position, stop
@@ -1306,7 +1373,7 @@ namespace Mist{
         return 2;
       }
       initialize();
-      if (!M.getValidTracks().size() || !userSelect.size() || !keepGoing()){
+      if (!M.getValidTrackCount() || !userSelect.size() || !keepGoing()){
         INFO_MSG("Stream not available - aborting");
         onFail("Stream not available for recording", true);
         return 3;
@@ -1443,7 +1510,11 @@ namespace Mist{
                 }
               }
             }
+            // Queue what sendNext writes, so small writes (such as single TS packets) are sent
+            // together in as few system calls as possible at the end of each packet.
+            myConn.beginSendBatch();
             sendNext();
+            myConn.endSendBatch();
           }else{
             parseData = false;
             /*LTS-START*/
@@ -1466,8 +1537,10 @@ namespace Mist{
       }
       stats();
     }
-    if (!config->is_active){Util::logExitReason("set inactive");}
+    if (!config->is_active){Util::logExitReason("%s", Util::shutdownReason[0] ? Util::shutdownReason : "set inactive");}
     if (!myConn){Util::logExitReason("connection closed");}
+    MEDIUM_MSG("Data waits: %" PRIu64 " woken by input (%" PRIu64 " spurious), %" PRIu64 " timed out", dataWakeups,
+               dataSpurious, dataTimeouts);
     if (strncmp(Util::exitReason, "connection closed", 17) == 0){
       MEDIUM_MSG("Client handler shutting down, exit reason: %s", Util::exitReason);
     }else{
@@ -1503,7 +1576,7 @@ namespace Mist{
     /*LTS-END*/
 
     disconnect();
-    myConn.close();
+    if (!handedOver){myConn.close();}
     return 0;
   }
 
@@ -1611,7 +1684,7 @@ namespace Mist{
         FAIL_MSG("Could not equalize tracks! This is very very very bad and I am now going to shut down to prevent worse.");
         Util::logExitReason("Could not equalize tracks");
         parseData = false;
-        config->is_active = false;
+        endConnection();
         return false;
       }
       // actually drop what we found.
@@ -1626,13 +1699,17 @@ namespace Mist{
 
     uint64_t nextTime;
     size_t trackTries = 0;
+    uint32_t firstNotify = 0;
     //In case we're not in sync mode, we might have to retry a few times
     for (; trackTries < buffer.size(); ++trackTries){
 
       nxt = *(buffer.begin());
+      //Retrieve the notification counter before checking for data, so no signal is missed
+      uint32_t dataNotify = M.getDataNotify(nxt.tid);
+      if (!trackTries){firstNotify = dataNotify;}
 
       if (meta.reloadReplacedPagesIfNeeded()){return false;}
-      if (!M.getValidTracks().count(nxt.tid)){
+      if (!M.isValidTrack(nxt.tid)){
         dropTrack(nxt.tid, "disappeared from metadata");
         return false;
       }
@@ -1728,18 +1805,22 @@ namespace Mist{
       }
 
       // in sync mode, after ~25 seconds, give up and drop the track.
-      if (++emptyCount >= dataWaitTimeout){
+      if (emptyCount >= dataWaitTimeout){
         dropTrack(nxt.tid, "EOP: data wait timeout");
         return false;
       }
+      //Block until the input signals new data on this track, for at most 100ms (10ms for VoD).
+      //emptyCount keeps counting in tens of milliseconds, however long the wait took.
+      uint64_t prevEmpty = emptyCount;
+      emptyCount += playbackWait(nxt.tid, dataNotify, M.getLive() ? 100 : 10);
       //every ~1 second, check if the stream is not offline
-      if (emptyCount % 100 == 0 && M.getLive() && Util::getStreamStatus(streamName) == STRMSTAT_OFF){
+      if (emptyCount / 100 != prevEmpty / 100 && M.getLive() && Util::getStreamStatus(streamName) == STRMSTAT_OFF){
         Util::logExitReason("Stream source shut down");
         thisPacket.null();
         return true;
       }
       //every ~16 seconds, reconnect to metadata
-      if (emptyCount % 1600 == 0){
+      if (emptyCount / 1600 != prevEmpty / 1600){
         INFO_MSG("Reconnecting to input; track %zu key %" PRIu32 " is on page %" PRIu32 " and we're currently serving %" PRIu32 " from %" PRIu32, nxt.tid, thisKey+1, nextKeyPage, thisKey, currentPage[nxt.tid]);
         reconnect();
         if (!meta){
@@ -1753,17 +1834,15 @@ namespace Mist{
           thisPacket.null();
           return true;
         }
-        return false;//no sleep after reconnect
+        return false;
       }
-      
-      //Fine! We didn't want a packet, anyway. Let's try again later.
-      playbackSleep(10);
       return false;
     }
 
     if (trackTries == buffer.size()){
       //Fine! We didn't want a packet, anyway. Let's try again later.
-      playbackSleep(10);
+      //All tracks were rotated through, so the first one is up again.
+      playbackWait(buffer.begin()->tid, firstNotify, 10);
       return false;
     }
 
@@ -1776,6 +1855,7 @@ namespace Mist{
       return false;
     }
     emptyCount = 0; // valid packet - reset empty counter
+    lastWaitWoken = false;
     thisIdx = nxt.tid;
     thisTime = thisPacket.getTime();
 
@@ -1878,6 +1958,11 @@ namespace Mist{
     connStats(now, statComm);
     statComm.setLastSecond(thisPacket ? thisPacket.getTime() : 0);
     statComm.setPid(getpid());
+    // Saves the buffer and controller from checking on our pid
+    statComm.keepAlive();
+    for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); it++){
+      it->second.keepAlive();
+    }
 
     /*LTS-START*/
     // Tag the session with the user agent
@@ -15,6 +15,54 @@
 
 namespace Mist{
 
+  /// Capabilities of the output class serving the current connection. They are shared by the whole
+  /// process, unless the thread serving a connection handed it to another output class linked
+  /// into the same binary (see HTTPOutput::runInProcess), which then uses its own until it is done.
+  /// Behaves like the JSON::Value it stands for.
+  class OutputCapa{
+  public:
+    JSON::Value &operator[](const std::string &i){return get()[i];}
+    JSON::Value &operator[](const char *i){return get()[i];}
+    JSON::Value &operator[](uint32_t i){return get()[i];}
+    operator JSON::Value &(){return get();}
+    OutputCapa &operator=(const JSON::Value &rhs){
+      get() = rhs;
+      return *this;
+    }
+    bool isMember(const std::string &name){return get().isMember(name);}
+    void removeMember(const std::string &name){get().removeMember(name);}
+    void null(){get().null();}
+    std::string toString(){return get().toString();}
+    JSON::Value &get(){return threadCapa ? *threadCapa : processCapa;}
+    static void setThread(JSON::Value *c){threadCapa = c;}
+
+  private:
+    JSON::Value processCapa;
+    static __thread JSON::Value *threadCapa;
+  };
+
+  /// Configuration of the output class serving the current connection, shared by the whole process
+  /// or replaced for one thread in the same way as OutputCapa. Behaves like a Util::Config pointer.
+  class OutputConfig{
+  public:
+    Util::Config *operator->() const{return get();}
+    operator Util::Config *() const{return get();}
+    OutputConfig &operator=(Util::Config *rhs){
+      if (threadConfig){
+        threadConfig = rhs;
+      }else{
+        processConfig = rhs;
+      }
+      return *this;
+    }
+    Util::Config *get() const{return threadConfig ? threadConfig : processConfig;}
+    static void setThread(Util::Config *c){threadConfig = c;}
+
+  private:
+    Util::Config *processConfig;
+    static __thread Util::Config *threadConfig;
+  };
+
   /// The output class is intended to be inherited by MistOut process classes.
   /// It contains all generic code and logic, while the child classes implement
   /// anything specific to particular protocols or containers.
@@ -27,7 +75,7 @@ namespace Mist{
     Output(Socket::Connection &conn);
     // static members for initialization and capabilities
     static void init(Util::Config *cfg);
-    static JSON::Value capa;
+    static OutputCapa capa;
     /*LTS-START*/
     std::string reqUrl;
     /*LTS-END*/
@@ -40,6 +88,7 @@ namespace Mist{
     bool seek(size_t tid, uint64_t pos, bool getNextKey);
     void seekKeyframesIn(unsigned long long pos, unsigned long long maxDelta);
     void stop();
+    void endConnection();
     uint64_t currentTime();
     uint64_t startTime();
     uint64_t endTime();
@@ -70,8 +119,9 @@ namespace Mist{
     virtual void sendHeader();
     virtual void onFail(const std::string &msg, bool critical = false);
     virtual void requestHandler();
-    static Util::Config *config;
+    static OutputConfig config;
     void playbackSleep(uint64_t millis);
+    uint64_t playbackWait(size_t trackIdx, uint32_t dataNotify, uint64_t millis);
 
     void selectAllTracks();
 
@@ -100,6 +150,10 @@ namespace Mist{
                           ///< prepareNext().
     std::string prevHost; ///< Old value for getConnectedBinHost, for caching
     size_t emptyCount;
+    uint64_t dataWakeups;  ///< Times a data wait was ended by the input signalling new data
+    uint64_t dataSpurious; ///< Times such a signal did not result in a packet to send
+    uint64_t dataTimeouts; ///< Times a data wait ended without a signal
+    bool lastWaitWoken;
     bool recursingSync;
     uint32_t seekCount;
     bool firstData;
@@ -126,9 +180,10 @@ namespace Mist{
 
     std::set<size_t> getSupportedTracks(const std::string &type = "") const;
 
-    inline virtual bool keepGoing(){return config->is_active && myConn;}
+    inline virtual bool keepGoing(){return config->is_active && !connEnded && myConn;}
 
     Comms::Statistics statComm;
+    Util::StreamConfigReader streamConfig; ///< Configuration of the stream, kept open between reads.
     bool isBlocking; ///< If true, indicates that myConn is blocking.
     uint32_t crc;    ///< Checksum, if any, for usage in the stats.
     uint64_t nextKeyTime();
@@ -141,6 +196,8 @@ namespace Mist{
 
     // Read/write status variables
     Socket::Connection &myConn; ///< Connection to the client.
+    bool connEnded;  ///< Set by endConnection, stops this output without stopping the process.
+    bool handedOver; ///< Another output class in this process serves myConn once run() returns.
 
     bool wantRequest; ///< If true, waits for a request.
     bool parseData; ///< If true, triggers initalization if not already done, sending of header, sending of packets.
@@ -2,6 +2,8 @@
 #include <mist/ts_packet.h>
 
 namespace Mist{
+  static InProcessConnector<OutAAC> inProcess("AAC");
+
   OutAAC::OutAAC(Socket::Connection &conn) : HTTPOutput(conn){}
 
   void OutAAC::init(Util::Config *cfg){
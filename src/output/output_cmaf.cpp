@@ -68,13 +68,15 @@ namespace Mist{
   bool OutCMAF::isReadyForPlay(){
     if (!isInitialized){initialize();}
     meta.reloadReplacedPagesIfNeeded();
-    if (!M.getValidTracks().size()){return false;}
+    if (!M.getValidTrackCount()){return false;}
     uint32_t mainTrack = M.mainTrack();
     if (mainTrack == INVALID_TRACK_ID){return false;}
     DTSC::Fragments fragments(M.fragments(mainTrack));
     return fragments.getValidCount() > 6;
   }
 
+  static InProcessConnector<OutCMAF> inProcess("CMAF");
+
   OutCMAF::OutCMAF(Socket::Connection &conn) : HTTPOutput(conn){
     // load from global config
     systemBoot = Util::getGlobalConfig("systemBoot").asInt();
@@ -180,6 +182,8 @@ namespace Mist{
         "significantly, but increases compatibility somewhat.";
     capa["optional"]["nonchunked"]["option"] = "--nonchunked";
 
+    addSegmentCacheOption(cfg);
+
     cfg->addOption("mergesessions",
                    JSON::fromString("{\"short\":\"M\",\"long\":\"mergesessions\",\"help\":\"Merge "
                                     "together sessions from one user into a single session.\"}"));
@@ -389,7 +393,7 @@ namespace Mist{
     if (url.find("Q(") != std::string::npos){
       idx = atoll(url.c_str() + url.find("Q(") + 2) % 100;
     }
-    if (!M.getValidTracks().count(idx)){
+    if (!M.isValidTrack(idx)){
       H.SendResponse("404", "Track not found", myConn);
       return;
     }
@@ -445,9 +449,15 @@ namespace Mist{
     char mdatHeader[] ={0x00, 0x00, 0x00, 0x00, 'm', 'd', 'a', 't'};
     Bit::htobl(mdatHeader, mdatSize);
 
+    // The fragment only depends on the track, the timing track and the requested time range
+    std::stringstream cacheKey;
+    cacheKey << "cmaf_" << idx << "_" << mTrack << "/" << startTime << "_" << targetTime;
+    if (sendCachedSegment(cacheKey.str())){return;}
+
     H.StartResponse(H, myConn, config->getBool("nonchunked"));
-    H.Chunkify(headerData.c_str(), headerData.size(), myConn);
-    H.Chunkify(mdatHeader, 8, myConn);
+    startSegmentCache(cacheKey.str(), targetTime);
+    sendSegmentData(headerData.c_str(), headerData.size());
+    sendSegmentData(mdatHeader, 8);
 
     seek(startTime);
 
@@ -464,13 +474,13 @@ namespace Mist{
       HIGH_MSG("Finished playback to %" PRIu64, targetTime);
       wantRequest = true;
       parseData = false;
-      H.Chunkify("", 0, myConn);
+      sendSegmentData("", 0);
       return;
     }
     char *data;
     size_t dataLen;
     thisPacket.getString("data", data, dataLen);
-    H.Chunkify(data, dataLen, myConn);
+    sendSegmentData(data, dataLen);
   }
 
   /***************************************************************************************************/
@@ -720,7 +730,7 @@ namespace Mist{
   /* Smooth Streaming Manifest Generation */
   /****************************************/
 
-  std::string toUTF16(const std::string &original){
+  static std::string toUTF16(const std::string &original){
     std::string result;
     result.append("\377\376", 2);
     for (std::string::const_iterator it = original.begin(); it != original.end(); it++){
@@ -230,7 +230,7 @@ namespace Mist{
         DTSC::Packet metaPack(dataPacket.data(), dataPacket.size());
         DTSC::Scan metaScan = metaPack.getScan();
         meta.reloadReplacedPagesIfNeeded();
-        size_t prevTracks = meta.getValidTracks().size();
+        size_t prevTracks = meta.getValidTrackCount();
 
         size_t tNum = metaScan.getMember("tracks").getSize();
         for (int i = 0; i < tNum; i++){
@@ -259,7 +259,7 @@ namespace Mist{
           meta.setBootMsOffset(Util::bootMS() - lastMs);
         }
         std::stringstream rep;
-        rep << "DTSC_HEAD parsed, we went from " << prevTracks << " to " << meta.getValidTracks().size() << " tracks. Bring on those data packets!";
+        rep << "DTSC_HEAD parsed, we went from " << prevTracks << " to " << meta.getValidTrackCount() << " tracks. Bring on those data packets!";
         sendOk(rep.str());
       }else if (myConn.Received().copy(4) == "DTP2"){
         if (!isPushing()){
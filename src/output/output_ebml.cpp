@@ -4,6 +4,8 @@
 #include <mist/riff.h>
 
 namespace Mist{
+  static InProcessConnector<OutEBML> inProcess("EBML");
+
   OutEBML::OutEBML(Socket::Connection &conn) : HTTPOutput(conn){
     currentClusterTime = 0;
     newClusterTime = 0;
@@ -59,7 +61,7 @@ namespace Mist{
         INFO_MSG("Outputting %s to stdout in EBML format", streamName.c_str());
         return;
       }
-      if (!M.getValidTracks().size()){
+      if (!M.getValidTrackCount()){
         INFO_MSG("Stream not available - aborting");
         conn.close();
         return;
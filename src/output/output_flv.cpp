@@ -2,7 +2,9 @@
 #include <mist/h264.h>
 
 namespace Mist{
-  OutFLV::OutFLV(Socket::Connection &conn) : HTTPOutput(conn){}
+  static InProcessConnector<OutFLV> inProcess("FLV");
+
+  OutFLV::OutFLV(Socket::Connection &conn) : HTTPOutput(conn){lastMeta = 0;}
 
   void OutFLV::init(Util::Config *cfg){
     HTTPOutput::init(cfg);
@@ -53,7 +55,6 @@ namespace Mist{
     // If there are now more selectable tracks, select the new track and do a seek to the current
     // timestamp
     if (M.getLive() && userSelect.size() < 2){
-      static uint64_t lastMeta = 0;
       if (Util::epoch() > lastMeta + 5){
         lastMeta = Util::epoch();
         std::set<size_t> validTracks = getSupportedTracks();
@@ -85,7 +86,7 @@ namespace Mist{
       }
     }
     myConn.SendNow(tag.data, tag.len);
-    if (config->getBool("keyframeonly")){config->is_active = false;}
+    if (config->getBool("keyframeonly")){endConnection();}
   }
 
   void OutFLV::sendHeader(){
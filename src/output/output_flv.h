@@ -12,6 +12,7 @@ namespace Mist{
   private:
     virtual bool inlineRestartCapable() const{return true;}
     FLV::Tag tag;
+    uint64_t lastMeta;
     bool isRecording();
     bool isFileTarget(){return isRecording();}
   };
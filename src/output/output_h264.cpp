@@ -3,6 +3,8 @@
 #include <mist/mp4_generic.h>
 
 namespace Mist{
+  static InProcessConnector<OutH264> inProcess("H264");
+
   OutH264::OutH264(Socket::Connection &conn) : HTTPOutput(conn){
     if (targetParams.count("keysonly")){keysOnly = 1;}
     if (config->getString("target").size()){
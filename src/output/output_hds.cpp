@@ -141,6 +141,8 @@ namespace Mist{
     return Result.str();
   }// BuildManifest
 
+  static InProcessConnector<OutHDS> inProcess("HDS");
+
   OutHDS::OutHDS(Socket::Connection &conn) : HTTPOutput(conn){
     uaDelay = 0;
     realTime = 0;
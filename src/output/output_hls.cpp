@@ -8,7 +8,7 @@ namespace Mist{
   bool OutHLS::isReadyForPlay(){
     if (!isInitialized){initialize();}
     meta.reloadReplacedPagesIfNeeded();
-    if (!M.getValidTracks().size()){return false;}
+    if (!M.getValidTrackCount()){return false;}
     uint32_t mainTrack = M.mainTrack();
     if (mainTrack == INVALID_TRACK_ID){return false;}
     DTSC::Fragments fragments(M.fragments(mainTrack));
@@ -161,6 +161,8 @@ namespace Mist{
     return result.str();
   }
 
+  static InProcessConnector<OutHLS> inProcess("HLS");
+
   OutHLS::OutHLS(Socket::Connection &conn) : TSOutput(conn){
     uaDelay = 0;
     realTime = 0;
@@ -224,6 +226,7 @@ namespace Mist{
         "If disabled, each view (main playlist request) is a separate session.";
     capa["optional"]["mergesessions"]["option"] = "--mergesessions";
     /*LTS-END*/
+    addSegmentCacheOption(cfg);
   }
 
   void OutHLS::onHTTP(){
@@ -330,7 +333,17 @@ namespace Mist{
         return;
       }
 
+      // The muxed segment only depends on the selected tracks and the requested time range
+      std::stringstream cacheKey;
+      cacheKey << "ts";
+      for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); ++it){
+        cacheKey << "_" << it->first;
+      }
+      cacheKey << "/" << from << "_" << until;
+      if (sendCachedSegment(cacheKey.str())){return;}
+
       H.StartResponse(H, myConn, VLCworkaround || config->getBool("nonchunked"));
+      startSegmentCache(cacheKey.str(), until);
       // we assume whole fragments - but timestamps may be altered at will
       uint32_t fragIndice = M.getFragmentIndexForTime(vidTrack, from);
       contPAT = fragIndice; // PAT continuity counter
@@ -346,7 +359,7 @@ namespace Mist{
       std::string request = H.url.substr(H.url.find("/", 5) + 1);
       H.setCORSHeaders();
       H.SetHeader("Content-Type", "application/vnd.apple.mpegurl");
-      if (!M.getValidTracks().size()){
+      if (!M.getValidTrackCount()){
         H.SendResponse("404", "Not online or found", myConn);
         return;
       }
@@ -359,7 +372,7 @@ namespace Mist{
         manifest = liveIndex();
       }else{
         size_t idx = atoi(request.substr(0, request.find("/")).c_str());
-        if (!M.getValidTracks().count(idx)){
+        if (!M.isValidTrack(idx)){
           H.SendResponse("404", "No corresponding track found", myConn);
           return;
         }
@@ -392,7 +405,7 @@ namespace Mist{
       }
 
       // Signal end of data
-      H.Chunkify("", 0, myConn);
+      sendSegmentData("", 0);
       H.Clean();
       return;
     }
@@ -400,7 +413,7 @@ namespace Mist{
     TSOutput::sendNext();
   }
 
-  void OutHLS::sendTS(const char *tsData, size_t len){H.Chunkify(tsData, len, myConn);}
+  void OutHLS::sendTS(const char *tsData, size_t len){sendSegmentData(tsData, len);}
 
   void OutHLS::onFail(const std::string &msg, bool critical){
     if (HTTP::URL(H.url).getExt().substr(0, 3) != "m3u"){
@@ -3,6 +3,7 @@
 #include <mist/encode.h>
 #include <mist/langcodes.h>
 #include <mist/stream.h>
+#include <mist/tinythread.h>
 #include <mist/util.h>
 #include <mist/url.h>
 #include <set>
@@ -13,6 +14,9 @@ namespace Mist{
     webSock = 0;
     idleInterval = 0;
     idleLast = 0;
+    segCacheUntil = 0;
+    segCacheEvict = 0;
+    segCaching = false;
     if (config->getString("ip").size()){myConn.setHost(config->getString("ip"));}
     if (config->getString("prequest").size()){
       myConn.Received().prepend(config->getString("prequest"));
@@ -54,6 +58,73 @@ namespace Mist{
     cfg->addBasicConnectorOptions(capa);
   }
 
+  /// Adds the --segment-cache option, for outputs that support the shared segment cache.
+  void HTTPOutput::addSegmentCacheOption(Util::Config *cfg){
+    cfg->addOption("segmentcache",
+                   JSON::fromString("{\"arg\":\"integer\",\"default\":0,\"short\":\"Z\",\"long\":\"segment-cache\","
+                                    "\"help\":\"Size in MiB of the shared cache of muxed segments, "
+                                    "per stream (0 = disabled).\"}"));
+    capa["optional"]["segmentcache"]["name"] = "Shared segment cache";
+    capa["optional"]["segmentcache"]["help"] =
+        "Amount of shared memory in MiB per stream used to cache muxed segments, so that each "
+        "segment is only muxed once no matter how many viewers request it. (0 = disabled)";
+    capa["optional"]["segmentcache"]["default"] = 0;
+    capa["optional"]["segmentcache"]["type"] = "uint";
+    capa["optional"]["segmentcache"]["option"] = "--segment-cache";
+    capa["optional"]["segmentcache"]["short"] = "Z";
+  }
+
+  /// Sends the segment stored in the shared segment cache under the given key as a complete
+  /// response, using the headers already set in H. Returns false if the cache is disabled or does
+  /// not contain the segment, in which case nothing is sent.
+  bool HTTPOutput::sendCachedSegment(const std::string &key){
+    segCaching = false;
+    segCacheData.clear();
+    if (config->getInteger("segmentcache") <= 0){return false;}
+    if (segCacheStream != streamName){
+      segCacheStream = streamName;
+      segCache.init(streamName, (uint64_t)config->getInteger("segmentcache") * 1024 * 1024);
+    }
+    if (!segCache.get(key)){return false;}
+    H.SetHeader("Content-Length", segCache.size());
+    H.SendResponse("200", "OK", myConn);
+    myConn.SendNow(segCache.data(), segCache.size());
+    H.Clean();
+    HIGH_MSG("Sent %" PRIu64 " bytes from segment cache for %s", segCache.size(), key.c_str());
+    return true;
+  }
+
+  /// Starts recording everything sent through sendSegmentData, to store it in the shared segment
+  /// cache once the segment is complete. until is the end time of the segment.
+  void HTTPOutput::startSegmentCache(const std::string &key, uint64_t until){
+    if (!segCache){return;}
+    segCaching = true;
+    segCacheKey = key;
+    segCacheUntil = until;
+    segCacheData.clear();
+    // Entries ending before the start of the live buffer can no longer be requested
+    segCacheEvict = M.getLive() ? M.getFirstms(getMainSelectedTrack()) : 0;
+  }
+
+  /// Sends segment data as a HTTP chunk, storing a copy if startSegmentCache was called.
+  /// A zero length ends both the response and the segment.
+  void HTTPOutput::sendSegmentData(const char *data, size_t len){
+    H.Chunkify(data, len, myConn);
+    if (!segCaching){return;}
+    if (len){
+      segCacheData.append(data, len);
+      if (segCacheData.size() > (uint64_t)config->getInteger("segmentcache") * 1024 * 1024){
+        // Will not fit anyway, stop copying
+        segCaching = false;
+        segCacheData.clear();
+      }
+      return;
+    }
+    segCaching = false;
+    if (myConn){segCache.store(segCacheKey, segCacheUntil, segCacheData, segCacheEvict);}
+    segCacheData.clear();
+  }
+
   void HTTPOutput::onFail(const std::string &msg, bool critical){
     INFO_MSG("Failing '%s': %s", H.url.c_str(), msg.c_str());
     if (!webSock && !isRecording() && !responded){
@@ -67,117 +138,75 @@ namespace Mist{
     Output::onFail(msg, critical);
   }
 
-  bool isMatch(const std::string &url, const std::string &m, std::string &streamname){
-    size_t found = m.find('$');
-    if (found != std::string::npos){
-      if (url.size() < m.size()){return false;}
-      if (m.substr(0, found) == url.substr(0, found) &&
-          m.substr(found + 1) == url.substr(url.size() - (m.size() - found) + 1)){
-        if (url.substr(found, url.size() - m.size() + 1).find('/') != std::string::npos){
-          return false;
-        }
-        streamname = url.substr(found, url.size() - m.size() + 1);
-        return true;
+  /// Adds the url_match and url_prefix patterns from the capabilities of a connector to R.
+  static void addRoutes(HTTP::Router &R, size_t handler, const JSON::Value &c){
+    if (c.isMember("url_match")){
+      const JSON::Value &m = c["url_match"];
+      if (m.isArray()){
+        jsonForEachConst(m, it){R.addMatch(handler, it->asStringRef());}
       }
+      if (m.isString()){R.addMatch(handler, m.asStringRef());}
+    }
+    if (c.isMember("url_prefix")){
+      const JSON::Value &p = c["url_prefix"];
+      if (p.isArray()){
+        jsonForEachConst(p, it){R.addPrefix(handler, it->asStringRef());}
+      }
+      if (p.isString()){R.addPrefix(handler, p.asStringRef());}
     }
-    return (url == m);
   }
 
-  bool isPrefix(const std::string &url, const std::string &m, std::string &streamname){
-    size_t found = m.find('$');
-    if (found != std::string::npos){
-      if (url.size() < m.size()){return false;}
-      size_t found_suf = url.find(m.substr(found + 1), found);
-      if (m.substr(0, found) == url.substr(0, found) && found_suf != std::string::npos){
-        if (url.substr(found, found_suf - found).find('/') != std::string::npos){return false;}
-        streamname = url.substr(found, found_suf - found);
-        return true;
-      }
-    }else{
-      return (url.substr(0, m.size()) == m);
+  /// Adds the url_match and url_prefix patterns from the capabilities of a connector to R.
+  static void addRoutes(HTTP::Router &R, size_t handler, const DTSC::Scan &c){
+    DTSC::Scan m = c.getMember("url_match");
+    if (m.getType() == DTSC_ARR){
+      for (size_t j = 0; j < m.getSize(); ++j){R.addMatch(handler, m.getIndice(j).asString());}
+    }else if (m){
+      R.addMatch(handler, m.asString());
+    }
+    DTSC::Scan p = c.getMember("url_prefix");
+    if (p.getType() == DTSC_ARR){
+      for (size_t j = 0; j < p.getSize(); ++j){R.addPrefix(handler, p.getIndice(j).asString());}
+    }else if (p){
+      R.addPrefix(handler, p.asString());
     }
-    return false;
   }
 
+  /// Returns the name of the connector that should handle the current request:
+  /// - empty string: No connector can handle the request.
+  /// - the name of the current output: This output should handle the request.
   /// - anything else: The request should be dispatched to a connector on the named socket.
   std::string HTTPOutput::getHandler(){
-    std::string url = H.getUrl();
-    // check the current output first, the most common case
-    if (capa.isMember("url_match") || capa.isMember("url_prefix")){
-      bool match = false;
-      std::string streamname;
-      // if there is a matcher, try to match
-      if (capa.isMember("url_match")){
-        if (capa["url_match"].isArray()){
-          jsonForEach(capa["url_match"], it){
-            match |= isMatch(url, it->asStringRef(), streamname);
-          }
-        }
-        if (capa["url_match"].isString()){
-          match |= isMatch(url, capa["url_match"].asStringRef(), streamname);
-        }
-      }
-      // if there is a prefix, try to match
-      if (capa.isMember("url_prefix")){
-        if (capa["url_prefix"].isArray()){
-          jsonForEach(capa["url_prefix"], it){
-            match |= isPrefix(url, it->asStringRef(), streamname);
-          }
-        }
-        if (capa["url_prefix"].isString()){
-          match |= isPrefix(url, capa["url_prefix"].asStringRef(), streamname);
-        }
-      }
-      if (match){
-        if (streamname.size()){
-          Util::sanitizeName(streamname);
-          H.SetVar("stream", streamname);
-        }
-        return capa["name"].asStringRef();
-      }
+    if (routesPage && routesAcc.isReload()){routesPage.close();}
+    bool reload = false;
+    if (!routesPage){
+      routesPage.init(SHM_CAPA, 0, false, false);
+      reload = routesPage;
     }
-
-    // loop over the connectors
-    Util::DTSCShmReader rCapa(SHM_CAPA);
-    DTSC::Scan capa = rCapa.getMember("connectors");
-    unsigned int capa_ctr = capa.getSize();
-    for (unsigned int i = 0; i < capa_ctr; ++i){
-      DTSC::Scan c = capa.getIndice(i);
-      // if it depends on HTTP and has a match or prefix...
-      if ((c.getMember("name").asString() == "HTTP" || c.getMember("deps").asString() == "HTTP") &&
-          (c.getMember("url_match") || c.getMember("url_prefix"))){
-        bool match = false;
-        std::string streamname;
-        // if there is a matcher, try to match
-        if (c.getMember("url_match")){
-          if (c.getMember("url_match").getSize()){
-            for (unsigned int j = 0; j < c.getMember("url_match").getSize(); ++j){
-              match |= isMatch(url, c.getMember("url_match").getIndice(j).asString(), streamname);
-            }
-          }else{
-            match |= isMatch(url, c.getMember("url_match").asString(), streamname);
-          }
-        }
-        // if there is a prefix, try to match
-        if (c.getMember("url_prefix")){
-          if (c.getMember("url_prefix").getSize()){
-            for (unsigned int j = 0; j < c.getMember("url_prefix").getSize(); ++j){
-              match |= isPrefix(url, c.getMember("url_prefix").getIndice(j).asString(), streamname);
-            }
-          }else{
-            match |= isPrefix(url, c.getMember("url_prefix").asString(), streamname);
-          }
-        }
-        if (match){
-          if (streamname.size()){
-            Util::sanitizeName(streamname);
-            H.SetVar("stream", streamname);
-          }
-          return capa.getIndiceName(i);
+    if (reload || routesFor != capa["name"].asStringRef()){
+      routes.clear();
+      // The current output first, the most common case
+      addRoutes(routes, routes.addHandler(capa["name"].asStringRef()), capa);
+      if (routesPage){
+        routesAcc = Util::RelAccX(routesPage.mapped);
+        DTSC::Scan conns = DTSC::Scan(routesAcc.getPointer("dtsc_data"), routesAcc.getSize("dtsc_data")).getMember("connectors");
+        for (size_t i = 0; i < conns.getSize(); ++i){
+          DTSC::Scan c = conns.getIndice(i);
+          // Only connectors that depend on HTTP
+          if (c.getMember("name").asString() != "HTTP" && c.getMember("deps").asString() != "HTTP"){continue;}
+          addRoutes(routes, routes.addHandler(conns.getIndiceName(i)), c);
         }
       }
+      routesFor = capa["name"].asStringRef();
+      HIGH_MSG("Built routing table with %zu URL patterns", routes.size());
+    }
+    std::string handler, streamname;
+    if (!routes.route(H.getUrl(), handler, streamname)){return "";}
+    if (streamname.size()){
+      Util::sanitizeName(streamname);
+      H.SetVar("stream", streamname);
     }
-    return "";
+    return handler;
   }
 
   void HTTPOutput::requestHandler(){
@@ -225,7 +254,8 @@ namespace Mist{
         userSelect.clear();
         if (statComm){statComm.setStatus(COMM_STATUS_DISCONNECT | statComm.getStatus());}
         reConnector(handler);
-        onFail("Server error - could not start connector", true);
+        // Unless another output (process) took over the connection, the connector could not start
+        if (myConn && !handedOver){onFail("Server error - could not start connector", true);}
         return;
       }
 
@@ -390,7 +420,73 @@ namespace Mist{
     }
   }
 
-  ///\brief Handles requests by starting a corresponding output process.
+  /// Returns the output classes linked into this binary that reConnector can run in-process.
+  std::map<std::string, HTTPOutput::inProcessConnector> &HTTPOutput::inProcessConnectors(){
+    static std::map<std::string, inProcessConnector> connectors;
+    return connectors;
+  }
+
+  /// Registers an output class for in-process use by reConnector, see InProcessConnector.
+  void HTTPOutput::addInProcess(const std::string &connector, void (*init)(Util::Config *cfg),
+                                int (*run)(Socket::Connection &conn)){
+    inProcessConnector &C = inProcessConnectors()[connector];
+    C.init = init;
+    C.run = run;
+  }
+
+  __thread HTTPOutput::inProcessSwitch *HTTPOutput::nextInProcess = 0;
+
+  /// Serves the rest of the connection with an output class linked into this binary, configured
+  /// from the same arguments its own binary would have been started with.
+  /// That output and any output it hands the connection to in turn (through reConnector) run one
+  /// after the other from here, so repeated protocol switches do not nest. Each of them gets
+  /// capabilities and configuration of its own for this thread only, leaving those of other
+  /// connections served by the same process alone.
+  /// Closes the connection when done, like exiting that binary would.
+  void HTTPOutput::runInProcess(const inProcessConnector &C, const std::vector<std::string> &args){
+    // getopt keeps its state in globals, so parse arguments one thread at a time
+    static tthread::mutex parseMutex;
+    Util::trackSortOrder ownSortOrder = Util::defaultTrackSortOrder;
+    inProcessSwitch next;
+    next.connector = &C;
+    next.args = args;
+    nextInProcess = &next;
+    bool failed = false;
+    while (next.connector && myConn){
+      const inProcessConnector &cur = *next.connector;
+      std::vector<std::string> curArgs;
+      curArgs.swap(next.args);
+      next.connector = 0;
+      std::vector<char *> argPtrs;
+      for (size_t i = 0; i < curArgs.size(); ++i){argPtrs.push_back((char *)curArgs[i].c_str());}
+      argPtrs.push_back(0);
+      int argc = curArgs.size();
+      char **argv = &argPtrs[0];
+      JSON::Value connCapa;
+      Util::Config conf(curArgs[0]);
+      OutputCapa::setThread(&connCapa);
+      OutputConfig::setThread(&conf);
+      {
+        tthread::lock_guard<tthread::mutex> guard(parseMutex);
+        cur.init(&conf);
+        failed = !conf.parseArgs(argc, argv);
+      }
+      if (failed){break;}
+      Util::defaultTrackSortOrder = Util::TRKSORT_DEFAULT;
+      Util::setDefaultTrackSortOrder(conf.getString("default_track_sorting"));
+      conf.activate();
+      Util::exitReason[0] = 0;
+      cur.run(myConn);
+    }
+    OutputCapa::setThread(0);
+    OutputConfig::setThread(0);
+    nextInProcess = 0;
+    Util::defaultTrackSortOrder = ownSortOrder;
+    if (!failed){myConn.close();}
+  }
+
+  ///\brief Handles requests by passing them on to the corresponding output, either in-process if
+  /// it is linked into this binary, or by starting its output process.
   ///\param connector The type of connector to be invoked.
   void HTTPOutput::reConnector(std::string &connector){
     // taken from CheckProtocols (controller_connectors.cpp)
@@ -467,7 +563,41 @@ namespace Mist{
     if (pipedCapa.isMember("required")){builPipedPart(p, argarr, argnum, pipedCapa["required"]);}
     if (pipedCapa.isMember("optional")){builPipedPart(p, argarr, argnum, pipedCapa["optional"]);}
 
+    // Serve it from this process if we can
+    std::map<std::string, inProcessConnector>::iterator C = inProcessConnectors().find(connector);
+    if (C != inProcessConnectors().end()){
+      std::vector<std::string> args(argarr, argarr + argnum);
+      if (nextInProcess){
+        // This output already runs in-process; runInProcess runs the next one once it returns
+        HIGH_MSG("Handing connection to %s in-process", connector.c_str());
+        nextInProcess->connector = &C->second;
+        nextInProcess->args = args;
+        handedOver = true;
+        connEnded = true;
+        return;
+      }
+      HIGH_MSG("Serving %s in-process", connector.c_str());
+      runInProcess(C->second, args);
+      return;
+    }
+
     /// start new/better process
+    if (Util::Config::is_multi){
+      // Other connections are still being served by this process, so hand this one to a child
+      pid_t child = fork();
+      if (child == -1){
+        FAIL_MSG("Could not fork for %s: %s", connector.c_str(), strerror(errno));
+        return;
+      }
+      if (child){
+        myConn.drop();
+        return;
+      }
+      dup2(myConn.getSocket(), STDIN_FILENO);
+      dup2(myConn.getSocket(), STDOUT_FILENO);
+      execv(argarr[0], argarr);
+      _exit(42);
+    }
     execv(argarr[0], argarr);
   }
 
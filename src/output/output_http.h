@@ -1,7 +1,11 @@
 #pragma once
 #include "output.h"
+#include <map>
+#include <vector>
 #include <mist/defines.h>
 #include <mist/http_parser.h>
+#include <mist/http_router.h>
+#include <mist/segment_cache.h>
 #include <mist/websocket.h>
 
 namespace Mist{
@@ -11,6 +15,7 @@ namespace Mist{
     HTTPOutput(Socket::Connection &conn);
     virtual ~HTTPOutput();
     static void init(Util::Config *cfg);
+    static void addSegmentCacheOption(Util::Config *cfg);
     virtual void onFail(const std::string &msg, bool critical = false);
     virtual void onHTTP();
     virtual void respondHTTP(const HTTP::Parser & req, bool headersOnly);
@@ -23,6 +28,8 @@ namespace Mist{
     static bool listenMode(){return false;}
     virtual bool doesWebsockets(){return false;}
     void reConnector(std::string &connector);
+    static void addInProcess(const std::string &connector, void (*init)(Util::Config *cfg),
+                             int (*run)(Socket::Connection &conn));
     std::string getHandler();
     bool parseRange(std::string header, uint64_t &byteStart, uint64_t &byteEnd);
 
@@ -35,5 +42,51 @@ namespace Mist{
     std::string getConnectedHost();             // LTS
     std::string getConnectedBinHost();          // LTS
     bool isTrustedProxy(const std::string &ip); // LTS
+
+    // Routing table for getHandler, built from the capabilities the controller wrote to shared
+    // memory, and built again when the controller replaces them or the output changes.
+    HTTP::Router routes;
+    IPC::sharedPage routesPage;
+    Util::RelAccX routesAcc;
+    std::string routesFor; ///< Name of the output the routing table was built for
+
+    /// An output class reConnector can hand the connection to without starting its binary
+    struct inProcessConnector{
+      void (*init)(Util::Config *cfg);
+      int (*run)(Socket::Connection &conn);
+    };
+    /// The output class runInProcess should run next on the connection, with its arguments
+    struct inProcessSwitch{
+      const inProcessConnector *connector;
+      std::vector<std::string> args;
+    };
+    static std::map<std::string, inProcessConnector> &inProcessConnectors();
+    static __thread inProcessSwitch *nextInProcess;
+    void runInProcess(const inProcessConnector &C, const std::vector<std::string> &args);
+
+    // Shared cache of muxed segments, see Util::SegmentCache
+    bool sendCachedSegment(const std::string &key);
+    void startSegmentCache(const std::string &key, uint64_t until);
+    void sendSegmentData(const char *data, size_t len);
+    Util::SegmentCache segCache;
+    std::string segCacheStream; ///< Stream segCache was initialized for
+    std::string segCacheKey;
+    std::string segCacheData;
+    uint64_t segCacheUntil;
+    uint64_t segCacheEvict;
+    bool segCaching;
+  };
+
+  /// Makes output class T available to HTTPOutput::reConnector under the given connector name.
+  /// Declared as a static object next to the output implementation, so that when the output is
+  /// linked into the same binary as the one a request arrives on (e.g. MistOutHTTP), the request
+  /// is served in-process instead of by executing MistOut<connector>.
+  template <class T> class InProcessConnector{
+  public:
+    InProcessConnector(const char *connector){HTTPOutput::addInProcess(connector, T::init, run);}
+    static int run(Socket::Connection &conn){
+      T tmp(conn);
+      return tmp.run();
+    }
   };
 }// namespace Mist
@@ -37,7 +37,9 @@ namespace Mist{
   OutHTTP::OutHTTP(Socket::Connection &conn) : HTTPOutput(conn){
     stayConnected = false;
     // If this connection is a socket and not already connected to stdio, connect it to stdio.
-    if (myConn.getPureSocket() != -1 && myConn.getSocket() != STDIN_FILENO && myConn.getSocket() != STDOUT_FILENO){
+    // In multi-viewer mode stdio is shared by all connections, so reConnector does this after forking instead.
+    if (!Util::Config::is_multi && myConn.getPureSocket() != -1 && myConn.getSocket() != STDIN_FILENO &&
+        myConn.getSocket() != STDOUT_FILENO){
       std::string host = getConnectedHost();
       dup2(myConn.getSocket(), STDIN_FILENO);
       dup2(myConn.getSocket(), STDOUT_FILENO);
@@ -437,9 +439,10 @@ namespace Mist{
       // If we haven't rewritten the stream name yet to a fallback, attempt to do so
       if (origStreamName == streamName){
         // If stream is configured, use fallback stream setting, if set.
-        JSON::Value strCnf = Util::getStreamConfig(streamName);
-        if (strCnf && strCnf["fallback_stream"].asStringRef().size()){
-          std::string defStrm = strCnf["fallback_stream"].asStringRef();
+        streamConfig.update(streamName);
+        DTSC::Scan fallback = streamConfig.getMember("fallback_stream");
+        if (fallback && fallback.asString().size()){
+          std::string defStrm = fallback.asString();
           std::string newStrm = defStrm;
           Util::streamVariables(newStrm, streamName, "");
           if (streamName != newStrm){
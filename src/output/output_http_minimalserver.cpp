@@ -2,6 +2,8 @@
 #include <fstream>
 
 namespace Mist{
+  static InProcessConnector<OutHTTPMinimalServer> inProcess("HTTPMinimalServer");
+
   OutHTTPMinimalServer::OutHTTPMinimalServer(Socket::Connection &conn) : HTTPOutput(conn){
     // resolve symlinks etc to a real path
     char *rp = realpath(config->getString("webroot").c_str(), 0);
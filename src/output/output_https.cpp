@@ -1,5 +1,6 @@
 #include "output_https.h"
 #include <mist/procs.h>
+#include <poll.h>
 
 namespace Mist{
   mbedtls_entropy_context OutHTTPS::entropy;
@@ -15,6 +16,8 @@ namespace Mist{
     capa["desc"] = "HTTPS connection handler, provides all enabled HTTP-based outputs";
     capa["provides"] = "HTTP";
     capa["protocol"] = "https://";
+    // Every connection ends up as a MistOutHTTP process of its own, so there is nothing to share
+    capa["optional"].removeMember("multiviewer");
     capa["required"]["cert"]["name"] = "Certificate";
     capa["required"]["cert"]["help"] = "(Root) certificate(s) file(s) to append to chain";
     capa["required"]["cert"]["option"] = "--cert";
@@ -75,6 +78,9 @@ namespace Mist{
       return;
     }
 
+    // Keep the session keys, so the kernel can take over encryption after the handshake
+    ktls.exportKeys(&sslConf);
+
     // Set up the SSL connection
     if ((ret = mbedtls_ssl_setup(&ssl, &sslConf)) != 0){
       FAIL_MSG("Could not set up SSL connection");
@@ -96,24 +102,34 @@ namespace Mist{
         C.close();
         return;
       }else{
-        Util::sleep(20);
+        struct pollfd pfd;
+        pfd.fd = client_fd.fd;
+        pfd.events = (ret == MBEDTLS_ERR_SSL_WANT_READ ? POLLIN : POLLOUT);
+        poll(&pfd, 1, 1000);
       }
     }
     HIGH_MSG("Started SSL connection handler");
   }
 
+  /// Hands encryption and decryption of the connection to the kernel after the handshake, so that
+  /// the socket carries plaintext from here on and MistOutHTTP can use it directly.
+  /// Returns false if the kernel or the session does not support it, leaving the connection to
+  /// mbedtls, or if the connection broke.
+  bool OutHTTPS::kernelTLS(){
+    if (!ktls.usable(&ssl)){return false;}
+    int ret = ktls.enable(client_fd.fd);
+    if (ret < 0){
+      Util::logExitReason("Kernel TLS receives but cannot send");
+      myConn.close();
+    }
+    return ret > 0;
+  }
+
   int OutHTTPS::run(){
+    if (!myConn){return 1;}
     unsigned char buf[1024 * 4]; // 4k internal buffer
     int ret;
 
-    // Start a MistOutHTTP process, connected to this SSL connection
-    int fderr = 2;
-    int fd[2];
-    if (socketpair(PF_LOCAL, SOCK_STREAM, 0, fd) != 0){
-      FAIL_MSG("Could not open anonymous socket for SSL<->HTTP connection!");
-      Util::logExitReason("Could not open anonymous socket for SSL<->HTTP connection!");
-      return 1;
-    }
     std::deque<std::string> args;
     args.push_back(Util::getMyPath() + "MistOutHTTP");
     args.push_back("--ip");
@@ -129,6 +145,32 @@ namespace Mist{
         args.push_back(jIt->asStringRef());
       }
     }
+
+    // With the kernel doing the encryption, this process becomes MistOutHTTP on the connection
+    if (kernelTLS()){
+      HIGH_MSG("Handing connection to MistOutHTTP using kernel TLS");
+      char *argarr[args.size() + 1];
+      for (size_t i = 0; i < args.size(); ++i){argarr[i] = (char *)args[i].c_str();}
+      argarr[args.size()] = 0;
+      mbedtls_net_set_block(&client_fd);
+      dup2(client_fd.fd, STDIN_FILENO);
+      dup2(client_fd.fd, STDOUT_FILENO);
+      setenv("MIST_BOUND_ADDR", myConn.getBoundAddress().c_str(), 1);
+      execv(argarr[0], argarr);
+      FAIL_MSG("Could not start MistOutHTTP for SSL connection: %s", strerror(errno));
+      Util::logExitReason("Could not start MistOutHTTP for SSL connection: %s", strerror(errno));
+      return 1;
+    }
+    if (!myConn){return 1;}
+
+    // Start a MistOutHTTP process, connected to this SSL connection
+    int fderr = 2;
+    int fd[2];
+    if (socketpair(PF_LOCAL, SOCK_STREAM, 0, fd) != 0){
+      FAIL_MSG("Could not open anonymous socket for SSL<->HTTP connection!");
+      Util::logExitReason("Could not open anonymous socket for SSL<->HTTP connection!");
+      return 1;
+    }
     args.push_back("");
     Util::Procs::socketList.insert(fd[0]);
     setenv("MIST_BOUND_ADDR", myConn.getBoundAddress().c_str(), 1);
@@ -179,13 +221,24 @@ namespace Mist{
             if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE){
               done += ret;
             }else{
-              Util::sleep(20);
+              struct pollfd pfd;
+              pfd.fd = client_fd.fd;
+              pfd.events = (ret == MBEDTLS_ERR_SSL_WANT_READ ? POLLIN : POLLOUT);
+              poll(&pfd, 1, 1000);
             }
           }
           http_buf.get().clear();
         }
       }
-      if (!activity){Util::sleep(20);}
+      if (!activity){
+        // Wait for either side to have data, instead of sleeping a fixed amount
+        struct pollfd pfd[2];
+        pfd[0].fd = client_fd.fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = fd[0];
+        pfd[1].events = POLLIN;
+        poll(pfd, 2, 1000);
+      }
     }
     // close the HTTP process (close stdio, kill its PID)
     http.close();
@@ -8,6 +8,7 @@
 #include <mbedtls/timing.h>
 #include <mbedtls/x509.h>
 #include <mist/defines.h>
+#include <mist/socket_ktls.h>
 
 namespace Mist{
 
@@ -24,6 +25,8 @@ namespace Mist{
   private:
     mbedtls_net_context client_fd;
     mbedtls_ssl_context ssl;
+    Socket::KernelTLS ktls;
+    bool kernelTLS();
     static mbedtls_entropy_context entropy;
     static mbedtls_ctr_drbg_context ctr_drbg;
     static mbedtls_ssl_config sslConf;
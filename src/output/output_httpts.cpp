@@ -11,6 +11,8 @@
 #include <unistd.h>
 
 namespace Mist{
+  static InProcessConnector<OutHTTPTS> inProcess("HTTPTS");
+
   OutHTTPTS::OutHTTPTS(Socket::Connection &conn) : TSOutput(conn){
     sendRepeatingHeaders = 500; // PAT/PMT every 500ms (DVB spec)
     removeOldPlaylistFiles = true;
@@ -71,7 +71,7 @@ namespace Mist{
       return;
     }
     // cancel if there are no keys in the main track
-    if (!M.getValidTracks().count(mainTrack) || !M.getLastms(mainTrack)){
+    if (!M.isValidTrack(mainTrack) || !M.getLastms(mainTrack)){
       WARN_MSG("Aborted vodSeek because no tracks selected");
       return;
     }
@@ -4,12 +4,15 @@
 #include <mist/triggers.h>
 
 namespace Mist{
+  static InProcessConnector<OutJSON> inProcess("JSON");
+
   OutJSON::OutJSON(Socket::Connection &conn) : HTTPOutput(conn){
     realTime = 0;
     bootMsOffset = 0;
     keepReselecting = false;
     dupcheck = false;
     noReceive = false;
+    inFinish = false;
     pushTrack = INVALID_TRACK_ID;
   }
 
@@ -94,9 +97,8 @@ namespace Mist{
   }
 
   bool OutJSON::onFinish(){
-    static bool recursive = false;
-    if (recursive){return true;}
-    recursive = true;
+    if (inFinish){return true;}
+    inFinish = true;
     if (keepReselecting && !isPushing() && !M.getVod()){
       uint64_t maxTimer = 7200;
       while (--maxTimer && keepGoing()){
@@ -112,13 +114,13 @@ namespace Mist{
         }else{
           if (isReadyForPlay()){
             INFO_MSG("Resuming playback!");
-            recursive = false;
+            inFinish = false;
             parseData = true;
             return true;
           }
         }
       }
-      recursive = false;
+      inFinish = false;
     }
     if (!webSock && !jsonp.size() && !first){myConn.SendNow("]\n", 2);}
     myConn.close();
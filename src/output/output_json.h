@@ -31,6 +31,7 @@ namespace Mist{
     std::set<std::string> nodup;
     bool first;
     bool noReceive;
+    bool inFinish;
   };
 }// namespace Mist
 
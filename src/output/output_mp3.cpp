@@ -1,6 +1,8 @@
 #include "output_mp3.h"
 
 namespace Mist{
+  static InProcessConnector<OutMP3> inProcess("MP3");
+
   OutMP3::OutMP3(Socket::Connection &conn) : HTTPOutput(conn){}
 
   void OutMP3::init(Util::Config *cfg){
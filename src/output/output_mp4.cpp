@@ -16,7 +16,7 @@ std::set<std::string> supportedAudio;
 std::set<std::string> supportedVideo;
 
 namespace Mist{
-  std::string toUTF16(const std::string &original){
+  static std::string toUTF16(const std::string &original){
     std::stringstream result;
     result << (char)0xFF << (char)0xFE;
     for (std::string::const_iterator it = original.begin(); it != original.end(); it++){
@@ -105,6 +105,8 @@ namespace Mist{
     return Encodings::Base64::encode(resGen.str());
   }
 
+  static InProcessConnector<OutMP4> inProcess("MP4");
+
   OutMP4::OutMP4(Socket::Connection &conn) : HTTPOutput(conn){
     prevVidTrack = INVALID_TRACK_ID;
     nextHeaderTime = 0xffffffffffffffffull;
@@ -735,7 +737,7 @@ namespace Mist{
         }
         dataSize += parts.getSize(temp.index);
 
-        if (M.getType(temp.trackID) == "meta"){dataSize += 2;}
+        if (M.getTypeId(temp.trackID) == DTSC::META){dataSize += 2;}
         // add next keyPart to sortSet
         if (temp.index + 1 < parts.getEndValid()){// Only create new element, when there are new
                                                     // elements to be added
@@ -778,7 +780,7 @@ namespace Mist{
       uint64_t partSize = parts.getSize(temp.index);
 
       // add 2 bytes in front of the subtitle that contains the length of the subtitle.
-      if (M.getCodec(temp.trackID) == "subtitle"){partSize += 2;}
+      if (M.getCodecId(temp.trackID) == DTSC::CODEC_SUBTITLE){partSize += 2;}
 
       // record where we are
       seekPoint = temp.time;
@@ -857,7 +859,7 @@ namespace Mist{
     tfhdBox.setTrackID(track + 1);
     tfhdBox.setDefaultSampleDuration(444);
     tfhdBox.setDefaultSampleSize(444);
-    tfhdBox.setDefaultSampleFlags((M.getType(track) == "video") ? (MP4::noIPicture | MP4::noKeySample)
+    tfhdBox.setDefaultSampleFlags((M.getTypeId(track) == DTSC::VIDEO) ? (MP4::noIPicture | MP4::noKeySample)
                                   : (MP4::isIPicture | MP4::isKeySample));
     tfhdBox.setSampleDescriptionIndex(1);
     trafBox.setContent(tfhdBox, 0);
@@ -962,10 +964,10 @@ namespace Mist{
       // Fun fact! Firefox cares about the ordering here.
       // It doesn't care about the order or track IDs in the header.
       // But - the first TRAF must be a video TRAF, if video is present.
-      if (M.getType(subIt->first) == "video"){
+      if (M.getTypeId(subIt->first) == DTSC::VIDEO){
         sortedTracks.push_front(subIt->first);
       }else{
-        if (!hasAudio && M.getType(subIt->first) == "audio"){hasAudio = true;}
+        if (!hasAudio && M.getTypeId(subIt->first) == DTSC::AUDIO){hasAudio = true;}
         sortedTracks.push_back(subIt->first);
       }
     }
@@ -1235,7 +1237,7 @@ namespace Mist{
       }
 
       // Handle nice move-over to new track ID
-      if (prevVidTrack != INVALID_TRACK_ID && thisIdx != prevVidTrack && M.getType(thisIdx) == "video"){
+      if (prevVidTrack != INVALID_TRACK_ID && thisIdx != prevVidTrack && M.getTypeId(thisIdx) == DTSC::VIDEO){
         if (!thisPacket.getFlag("keyframe")){
           // Ignore the packet if not a keyframe
           return;
@@ -1356,7 +1358,7 @@ namespace Mist{
     }
 
     // prepend subtitle text with 2 bytes datalength
-    if (M.getCodec(firstKeyPart.trackID) == "subtitle"){
+    if (M.getCodecId(firstKeyPart.trackID) == DTSC::CODEC_SUBTITLE){
       char pre[2];
       Bit::htobs(pre, len);
       subtitle.assign(pre, 2);
@@ -5,6 +5,8 @@
 #include <mist/defines.h>
 
 namespace Mist{
+  static InProcessConnector<OutOGG> inProcess("OGG");
+
   OutOGG::OutOGG(Socket::Connection &conn) : HTTPOutput(conn){realTime = 0;}
 
   OutOGG::~OutOGG(){}
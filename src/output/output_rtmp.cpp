@@ -196,6 +196,8 @@ namespace Mist{
 
   void OutRTMP::init(Util::Config *cfg){
     Output::init(cfg);
+    // RTMPStream keeps the chunking state of the connection in process globals
+    capa["optional"].removeMember("multiviewer");
     capa["name"] = "RTMP";
     capa["friendly"] = "RTMP";
     capa["desc"] = "Real time streaming over Adobe RTMP";
@@ -401,13 +403,13 @@ namespace Mist{
     size_t data_len = 0; // length of processed media data
     thisPacket.getString("data", tmpData, data_len);
 
-    std::string type = M.getType(thisIdx);
-    std::string codec = M.getCodec(thisIdx);
+    DTSC::datatype type = M.getTypeId(thisIdx);
+    DTSC::codecId codec = M.getCodecId(thisIdx);
 
     // set msg_type_id
-    if (type == "video"){
+    if (type == DTSC::VIDEO){
       rtmpheader[7] = 0x09;
-      if (codec == "H264"){
+      if (codec == DTSC::CODEC_H264){
         dheader_len += 4;
         dataheader[0] = 7;
         dataheader[1] = 1;
@@ -418,25 +420,25 @@ namespace Mist{
           dataheader[4] = offset & 0xFF;
         }
       }
-      if (codec == "H263"){dataheader[0] = 2;}
+      if (codec == DTSC::CODEC_H263){dataheader[0] = 2;}
       dataheader[0] |= (thisPacket.getFlag("keyframe") ? 0x10 : 0x20);
       if (thisPacket.getFlag("disposableframe")){dataheader[0] |= 0x30;}
     }
 
-    if (type == "audio"){
+    if (type == DTSC::AUDIO){
       uint32_t rate = M.getRate(thisIdx);
       rtmpheader[7] = 0x08;
-      if (codec == "AAC"){
+      if (codec == DTSC::CODEC_AAC){
         dataheader[0] += 0xA0;
         dheader_len += 1;
         dataheader[1] = 1; // raw AAC data, not sequence header
       }
-      if (codec == "MP3"){
+      if (codec == DTSC::CODEC_MP3){
         dataheader[0] += 0x20;
         dataheader[0] |= (rate == 8000 ? 0xE0 : 0x20);
       }
-      if (codec == "ADPCM"){dataheader[0] |= 0x10;}
-      if (codec == "PCM"){
+      if (codec == DTSC::CODEC_ADPCM){dataheader[0] |= 0x10;}
+      if (codec == DTSC::CODEC_PCM){
         if (M.getSize(thisIdx) == 16 && swappy.allocate(data_len)){
           for (uint32_t i = 0; i < data_len; i += 2){
             swappy[i] = tmpData[i + 1];
@@ -446,12 +448,12 @@ namespace Mist{
         }
         dataheader[0] |= 0x30;
       }
-      if (codec == "Nellymoser"){
+      if (codec == DTSC::CODEC_NELLYMOSER){
         dataheader[0] |= (rate == 8000 ? 0x50 : (rate == 16000 ? 0x40 : 0x60));
       }
-      if (codec == "ALAW"){dataheader[0] |= 0x70;}
-      if (codec == "ULAW"){dataheader[0] |= 0x80;}
-      if (codec == "Speex"){dataheader[0] |= 0xB0;}
+      if (codec == DTSC::CODEC_ALAW){dataheader[0] |= 0x70;}
+      if (codec == DTSC::CODEC_ULAW){dataheader[0] |= 0x80;}
+      if (codec == DTSC::CODEC_SPEEX){dataheader[0] |= 0xB0;}
 
       if (rate >= 44100){
         dataheader[0] |= 0x0C;
@@ -528,43 +530,23 @@ namespace Mist{
       rtmpheader[3] = timestamp & 0xff;
     }
 
-    // send the header
-    myConn.setBlocking(true);
-    myConn.SendNow(rtmpheader, header_len);
-    RTMPStream::snd_cnt += header_len; // update the sent data counter
-    // set the header's first byte to the "continue" type chunk, for later use
-    rtmpheader[0] = 0xC4;
+    // the header of the following chunks: the "continue" type, and the extended timestamp if any
+    char contheader[] ={(char)0xC4, 0, 0, 0, 0};
+    size_t cont_len = 1;
     if (timestamp >= 0x00ffffff){
-      rtmpheader[1] = (timestamp >> 24) & 0xff;
-      rtmpheader[2] = (timestamp >> 16) & 0xff;
-      rtmpheader[3] = (timestamp >> 8) & 0xff;
-      rtmpheader[4] = timestamp & 0xff;
+      contheader[1] = (timestamp >> 24) & 0xff;
+      contheader[2] = (timestamp >> 16) & 0xff;
+      contheader[3] = (timestamp >> 8) & 0xff;
+      contheader[4] = timestamp & 0xff;
+      cont_len = 5;
     }
 
-    // sent actual data - never send more than chunk_snd_max at a time
-    // interleave blocks of max chunk_snd_max bytes with 0xC4 bytes to indicate continue
-    size_t len_sent = 0;
-    while (len_sent < data_len){
-      size_t to_send = std::min(data_len - len_sent, RTMPStream::chunk_snd_max);
-      if (!len_sent){
-        myConn.SendNow(dataheader, dheader_len);
-        RTMPStream::snd_cnt += dheader_len; // update the sent data counter
-        to_send -= dheader_len;
-        len_sent += dheader_len;
-      }
-      myConn.SendNow(tmpData + len_sent - dheader_len, to_send);
-      len_sent += to_send;
-      if (len_sent < data_len){
-        if (timestamp >= 0x00ffffff){
-          myConn.SendNow(rtmpheader, 5);
-          RTMPStream::snd_cnt += 5; // update the sent data counter
-        }else{
-          myConn.SendNow(rtmpheader, 1);
-          RTMPStream::snd_cnt += 1; // update the sent data counter
-        }
-      }
-    }
-    myConn.setBlocking(false);
+    // send the data header and media data straight from the page, in chunks of at most
+    // chunk_snd_max bytes
+    chunks.start(rtmpheader, header_len, contheader, cont_len);
+    chunks.append(dataheader, dheader_len);
+    chunks.append(tmpData, data_len - dheader_len);
+    chunks.send(myConn);
   }
 
   void OutRTMP::sendHeader(){
@@ -1455,7 +1437,7 @@ namespace Mist{
           ltt = tagTime;
           //            bufferLivePacket(thisPacket);
           bufferLivePacket(tagTime, F.offset(), idx, F.getData(), F.getDataLen(), 0, F.isKeyframe);
-          if (!meta){config->is_active = false;}
+          if (!meta){endConnection();}
         }
         break;
       }
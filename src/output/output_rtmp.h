@@ -35,6 +35,7 @@ namespace Mist{
     void sendSilence(uint64_t currTime);
     bool hasSilence;
     uint64_t lastSilence;
+    RTMPStream::ChunkWriter chunks; ///< Chunks of the media packet being sent, reused between packets
   };
 }// namespace Mist
 
@@ -165,8 +165,10 @@ namespace Mist{
 
     uint64_t offset = thisPacket.getInt("offset");
     sdpState.tracks[thisIdx].pack.setTimestamp((timestamp + offset) * SDP::getMultiplier(&M, thisIdx));
+    if (callBack == sendUDP){sdpState.tracks[thisIdx].data.beginSendBatch();}
     sdpState.tracks[thisIdx].pack.sendData(socket, callBack, dataPointer, dataLen,
                                            sdpState.tracks[thisIdx].channel, meta.getCodec(thisIdx));
+    if (callBack == sendUDP){sdpState.tracks[thisIdx].data.endSendBatch();}
 
     static uint64_t lastAnnounce = Util::bootSecs();
     if (reqUrl.size() && lastAnnounce + 5 < Util::bootSecs()){
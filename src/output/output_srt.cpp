@@ -5,6 +5,8 @@
 #include <mist/http_parser.h>
 
 namespace Mist{
+  static InProcessConnector<OutSRT> inProcess("SRT");
+
   OutSRT::OutSRT(Socket::Connection &conn) : HTTPOutput(conn){realTime = 0;}
   OutSRT::~OutSRT(){}
 
@@ -47,7 +49,7 @@ namespace Mist{
     }
 
     if (filter_to > 0 && time > filter_to && filter_to > filter_from){
-      config->is_active = false;
+      endConnection();
       return;
     }
 
@@ -84,7 +86,7 @@ namespace Mist{
     webVTT = (H.url.find(".vtt") != std::string::npos) || (H.url.find(".webvtt") != std::string::npos);
     if (H.GetVar("track") != ""){
       size_t tid = atoll(H.GetVar("track").c_str());
-      if (M.getValidTracks().count(tid)){
+      if (M.isValidTrack(tid)){
         userSelect.clear();
         userSelect[tid].reload(streamName, tid);
       }
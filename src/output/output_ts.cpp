@@ -10,6 +10,7 @@ namespace Mist{
     sendRepeatingHeaders = 500; // PAT/PMT every 500ms (DVB spec)
     streamName = config->getString("streamname");
     pushOut = false;
+    curFilled = 0;
     std::string tracks = config->getString("tracks");
     if (config->getString("target").size()){
       HTTP::URL target(config->getString("target"));
@@ -33,7 +34,7 @@ namespace Mist{
           disconnect();
           streamName = "";
           userSelect.clear();
-          config->is_active = false;
+          endConnection();
           return;
         }
       }
@@ -57,7 +58,7 @@ namespace Mist{
         if (!newStream.size()){
           FAIL_MSG("Push from %s to URL %s rejected - PUSH_REWRITE trigger blanked the URL",
                    getConnectedHost().c_str(), reqUrl.c_str());
-          config->is_active = false;
+          endConnection();
           return;
         }else{
           streamName = newStream;
@@ -67,7 +68,7 @@ namespace Mist{
       }
       if (!allowPush("")){
         FAIL_MSG("Pushing not allowed");
-        config->is_active = false;
+        endConnection();
         return;
       }
     }
@@ -148,7 +149,6 @@ namespace Mist{
 
   void OutTS::sendTS(const char *tsData, size_t len){
     if (pushOut){
-      static size_t curFilled = 0;
       if (curFilled == udpSize){
         pushSock.SendNow(packetBuffer);
         myConn.addUp(packetBuffer.size());
@@ -15,6 +15,7 @@ namespace Mist{
 
   private:
     size_t udpSize;
+    size_t curFilled;
     bool pushOut;
     std::string packetBuffer;
     Socket::UDPConnection pushSock;
@@ -23,7 +24,7 @@ namespace Mist{
 
   protected:
     inline virtual bool keepGoing(){
-      return config->is_active && (!listenMode() || myConn);
+      return config->is_active && !connEnded && (!listenMode() || myConn);
     }
   };
 }// namespace Mist
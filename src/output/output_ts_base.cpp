@@ -62,9 +62,9 @@ namespace Mist{
 
   void TSOutput::sendNext(){
     // Get ready some data to speed up accesses
-    std::string type = M.getType(thisIdx);
-    std::string codec = M.getCodec(thisIdx);
-    bool video = (type == "video");
+    DTSC::datatype type = M.getTypeId(thisIdx);
+    DTSC::codecId codec = M.getCodecId(thisIdx);
+    bool video = (type == DTSC::VIDEO);
     size_t pkgPid = TS::getUniqTrackID(M, thisIdx);
     bool &firstPack = first[thisIdx];
     uint16_t &contPkg = contCounters[pkgPid];
@@ -79,20 +79,20 @@ namespace Mist{
     std::string bs;
     // prepare bufferstring
     if (video){
-      if (codec == "H264" || codec == "HEVC"){
+      if (codec == DTSC::CODEC_H264 || codec == DTSC::CODEC_HEVC){
         uint32_t extraSize = 0;
         // dataPointer[4] & 0x1f is used to check if this should be done later:
         // fillPacket("\000\000\000\001\011\360", 6);
-        if (codec == "H264" && (dataPointer[4] & 0x1f) != 0x09){extraSize += 6;}
+        if (codec == DTSC::CODEC_H264 && (dataPointer[4] & 0x1f) != 0x09){extraSize += 6;}
         if (keyframe){
-          if (codec == "H264"){
+          if (codec == DTSC::CODEC_H264){
             MP4::AVCC avccbox;
             avccbox.setPayload(M.getInit(thisIdx));
             bs = avccbox.asAnnexB();
             extraSize += bs.size();
           }
           /*LTS-START*/
-          if (codec == "HEVC"){
+          if (codec == DTSC::CODEC_HEVC){
             MP4::HVCC hvccbox;
             hvccbox.setPayload(M.getInit(thisIdx));
             bs = hvccbox.asAnnexB();
@@ -111,19 +111,19 @@ namespace Mist{
             (((dataLen + extraSize) > MAX_PES_SIZE) ? 0 : dataLen + extraSize),
             packTime, offset, true, M.getBps(thisIdx));
         fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
-        if (codec == "H264" && (dataPointer[4] & 0x1f) != 0x09){
+        if (codec == DTSC::CODEC_H264 && (dataPointer[4] & 0x1f) != 0x09){
           // End of previous nal unit, if not already present
           fillPacket("\000\000\000\001\011\360", 6, firstPack, video, keyframe, pkgPid, contPkg);
         }
         if (keyframe){
-          if (codec == "H264"){
+          if (codec == DTSC::CODEC_H264){
             MP4::AVCC avccbox;
             avccbox.setPayload(M.getInit(thisIdx));
             bs = avccbox.asAnnexB();
             fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
           }
           /*LTS-START*/
-          if (codec == "HEVC"){
+          if (codec == DTSC::CODEC_HEVC){
             MP4::HVCC hvccbox;
             hvccbox.setPayload(M.getInit(thisIdx));
             bs = hvccbox.asAnnexB();
@@ -150,9 +150,9 @@ namespace Mist{
 
         fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg);
       }
-    }else if (type == "audio"){
+    }else if (type == DTSC::AUDIO){
       size_t tempLen = dataLen;
-      if (codec == "AAC"){
+      if (codec == DTSC::CODEC_AAC){
         tempLen += 7;
         // Make sure TS timestamp is sample-aligned, if possible
         uint32_t freq = M.getRate(thisIdx);
@@ -165,7 +165,7 @@ namespace Mist{
           packTime = aacSamples * 90000 / freq;
         }
       }
-      if (codec == "opus"){
+      if (codec == DTSC::CODEC_OPUS){
         tempLen += 3 + (dataLen/255);
         bs = TS::Packet::getPESPS1LeadIn(tempLen, packTime, M.getBps(thisIdx));
         fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
@@ -177,13 +177,13 @@ namespace Mist{
         bs.clear();
         TS::Packet::getPESAudioLeadIn(bs, tempLen, packTime, M.getBps(thisIdx));
         fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
-        if (codec == "AAC"){
+        if (codec == DTSC::CODEC_AAC){
           bs = TS::getAudioHeader(dataLen, M.getInit(thisIdx));
           fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
         }
       }
       fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg);
-    }else if (type == "meta"){
+    }else if (type == DTSC::META){
       long unsigned int tempLen = dataLen;
       bs = TS::Packet::getPESMetaLeadIn(tempLen, packTime, M.getBps(thisIdx));
       fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
@@ -3,6 +3,8 @@
 #include <mist/util.h>
 
 namespace Mist{
+  static InProcessConnector<OutWAV> inProcess("WAV");
+
   OutWAV::OutWAV(Socket::Connection &conn) : HTTPOutput(conn){}
 
   void OutWAV::init(Util::Config *cfg){
@@ -39,7 +41,6 @@ namespace Mist{
     thisPacket.getString("data", dataPointer, len);
 
     // PCM must be converted to little-endian if > 8 bits per sample
-    static Util::ResizeablePointer swappy;
     if (M.getCodec(thisIdx) == "PCM"){
       if (M.getSize(thisIdx) > 8 && swappy.allocate(len)){
         if (M.getSize(thisIdx) == 16){
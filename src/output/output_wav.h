@@ -13,6 +13,7 @@ namespace Mist{
     virtual bool inlineRestartCapable() const{return true;}
 
   private:
+    Util::ResizeablePointer swappy;
     bool isRecording();
     bool isFileTarget(){return isRecording();}
   };
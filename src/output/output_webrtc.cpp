@@ -1188,7 +1188,7 @@ namespace Mist{
       return;
     }
     nackBuffer &nb = outBuffers[pSSRC];
-    if (!nb.isBuffered(seq)){
+    if (!nb.has(seq)){
       HIGH_MSG("Could not answer NACK for %" PRIu32 " #%" PRIu16 ": packet not buffered", pSSRC, seq);
       return;
     }
@@ -1468,7 +1468,7 @@ namespace Mist{
     RTP::Packet tmpPkt(rtpOutBuffer, protectedSize);
     uint32_t pSSRC = tmpPkt.getSSRC();
     uint16_t seq = tmpPkt.getSequence();
-    outBuffers[pSSRC].assign(seq, rtpOutBuffer, protectedSize);
+    outBuffers[pSSRC].store(seq, rtpOutBuffer, protectedSize);
     myConn.addUp(protectedSize);
     totalPkts++;
 
@@ -1609,6 +1609,9 @@ namespace Mist{
       rtcTrack.rtpPacketizer.setTimestamp(thisPacket.getTime() * mult);
     }
 
+    // A single frame becomes many RTP packets; hand them to the kernel in as few calls as possible
+    udp.beginSendBatch();
+
     bool isKeyFrame = thisPacket.getFlag("keyframe");
     didReceiveKeyFrame = isKeyFrame;
     if (M.getCodec(thisIdx) == "H264"){
@@ -1636,6 +1639,7 @@ namespace Mist{
       lastSR[thisIdx] = Util::bootMS();
       rtcTrack.rtpPacketizer.sendRTCP_SR((void *)&udp, onRTPPacketizerHasRTCPDataCallback);
     }
+    udp.endSendBatch();
   }
 
   // When the RTP::toDTSC converter collected a complete VP8
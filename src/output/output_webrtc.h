@@ -79,21 +79,10 @@ namespace Mist{
 
   /* ------------------------------------------------ */
 
-  class nackBuffer{
+  /// Keeps the last NACK_BUFFER_SIZE sent packets of a track, for retransmission.
+  class nackBuffer : public RTP::PacketRing{
   public:
-    bool isBuffered(uint16_t seq){
-      if (!bufs[seq % NACK_BUFFER_SIZE].size()){return false;}
-      RTP::Packet tmpPkt(bufs[seq % NACK_BUFFER_SIZE], bufs[seq % NACK_BUFFER_SIZE].size());
-      return (tmpPkt.getSequence() == seq);
-    }
-    const char *getData(uint16_t seq){return bufs[seq % NACK_BUFFER_SIZE];}
-    size_t getSize(uint16_t seq){return bufs[seq % NACK_BUFFER_SIZE].size();}
-    void assign(uint16_t seq, const char *p, size_t s){
-      bufs[seq % NACK_BUFFER_SIZE].assign(p, s);
-    }
-
-  private:
-    Util::ResizeablePointer bufs[NACK_BUFFER_SIZE];
+    nackBuffer() : RTP::PacketRing(NACK_BUFFER_SIZE){}
   };
 
   class WebRTCTrack{
@@ -138,7 +138,7 @@ int main(int argc, char **argv){
     std::set<pid_t> checkPids;
     for (size_t i = 0; i < cleanUsers.recordCount(); ++i){
       uint8_t status = cleanUsers.getStatus(i);
-      cleanUsers.setStatus(COMM_STATUS_INVALID, i);
+      cleanUsers.releaseRecord(i);
       if (status != COMM_STATUS_INVALID && !(status & COMM_STATUS_DISCONNECT)){
         pid_t pid = cleanUsers.getPid(i);
         if (pid > 1){
@@ -0,0 +1,96 @@
+/// \file aes.cpp
+/// Checks that the hardware AES backend of Encryption::AES gives the same output as mbedtls and the
+/// table based implementation in rijndael.cpp, then prints the throughput of all three.
+/// Pass a size in MiB as argument to change the amount of data used for the throughput test.
+
+#include "../lib/rijndael.cpp"
+#include <cassert>
+#include <iostream>
+#include <mist/bitfields.h>
+#include <mist/encryption.h>
+#include <mist/timing.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char testKey[] = "0123456789abcdef";
+
+/// Table based CTR encryption, with the counter layout used by Encryption::AES
+void tableCTR(uint64_t ivec, const char *src, char *dest, size_t len){
+  char keySchedule[256];
+  AES_set_encrypt_key(testKey, 128, keySchedule);
+  char counter[16];
+  memset(counter, 0, 16);
+  Bit::htobll(counter, ivec);
+  char ecount[16];
+  unsigned int num = 0;
+  AES_CTR128_crypt(src, dest, len, keySchedule, counter, ecount, num);
+}
+
+void printSpeed(const char *name, size_t bytes, uint64_t micros){
+  if (!micros){micros = 1;}
+  std::cout << name << ": " << ((double)bytes / micros / 1000.0) << " GB/s" << std::endl;
+}
+
+int main(int argc, char **argv){
+  Encryption::AES soft, hard;
+  soft.setAcceleration(false);
+  soft.setEncryptKey(testKey);
+  bool haveHard = hard.setAcceleration(true);
+  hard.setEncryptKey(testKey);
+  std::cout << "Hardware backend: " << (haveHard ? Encryption::AES::getAccelerationName() : "none") << std::endl;
+
+  char src[4096 + 16], a[4096 + 16], b[4096 + 16], c[4096 + 16];
+  for (size_t i = 0; i < sizeof(src); ++i){src[i] = (char)(rand() & 0xFF);}
+
+  // CTR: every length up to a few wide batches, plus a counter that wraps its low half
+  uint64_t ivecs[] ={0x0123456789abcdefull, 0xffffffffffffffffull};
+  for (size_t v = 0; v < 2; ++v){
+    for (size_t len = 0; len <= 4096 + 16; len += (len < 600 ? 1 : 97)){
+      assert(soft.encryptBlockCTR(ivecs[v], src, a, len));
+      assert(hard.encryptBlockCTR(ivecs[v], src, b, len));
+      tableCTR(ivecs[v], src, c, len);
+      assert(!memcmp(a, b, len));
+      assert(!memcmp(a, c, len));
+    }
+  }
+
+  // CBC: the ivec must be updated identically, so chained calls (as in Fairplay) keep matching
+  char ivA[16], ivB[16];
+  memset(ivA, 7, 16);
+  memset(ivB, 7, 16);
+  for (size_t len = 16; len <= 4096; len += 16){
+    assert(soft.encryptBlockCBC(ivA, src, a, len));
+    assert(hard.encryptBlockCBC(ivB, src, b, len));
+    assert(!memcmp(a, b, len));
+    assert(!memcmp(ivA, ivB, 16));
+  }
+
+  // Throughput
+  size_t benchSize = (argc > 1 ? atoi(argv[1]) : 64) * 1024 * 1024;
+  char *in = (char *)malloc(benchSize);
+  char *out = (char *)malloc(benchSize);
+  memset(in, 0x5A, benchSize);
+  uint64_t start = Util::getMicros();
+  tableCTR(1, in, out, benchSize);
+  printSpeed("CTR table", benchSize, Util::getMicros(start));
+  start = Util::getMicros();
+  soft.encryptBlockCTR(1, in, out, benchSize);
+  printSpeed("CTR mbedtls", benchSize, Util::getMicros(start));
+  if (haveHard){
+    start = Util::getMicros();
+    hard.encryptBlockCTR(1, in, out, benchSize);
+    printSpeed("CTR hardware", benchSize, Util::getMicros(start));
+  }
+  memset(ivA, 7, 16);
+  start = Util::getMicros();
+  soft.encryptBlockCBC(ivA, in, out, benchSize);
+  printSpeed("CBC mbedtls", benchSize, Util::getMicros(start));
+  if (haveHard){
+    start = Util::getMicros();
+    hard.encryptBlockCBC(ivA, in, out, benchSize);
+    printSpeed("CBC hardware", benchSize, Util::getMicros(start));
+  }
+  free(in);
+  free(out);
+  return 0;
+}
@@ -0,0 +1,127 @@
+/// \file annexb.cpp
+/// Checks the start code scanning functions of nalu against the byte-by-byte versions they
+/// replaced, for every instruction set this CPU supports, on random data with many zero bytes at
+/// all lengths and alignments. Then prints the scanning throughput of each instruction set.
+/// Pass a size in MiB as argument to change the amount of data used for the throughput run.
+
+#include <cassert>
+#include <iostream>
+#include <mist/nal.h>
+#include <mist/timing.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// The scanAnnexB scanner from before, comparing the bytes as unsigned
+const char *oldScanAnnexB(const char *data, uint32_t dataSize){
+  const unsigned char *offset = (const unsigned char *)data;
+  const unsigned char *maxData = offset + dataSize - 2;
+  while (offset < maxData){
+    if (offset[2] > 1){
+      offset += 3;
+      continue;
+    }
+    if (!offset[2]){
+      ++offset;
+      continue;
+    }
+    if (!offset[0] && !offset[1]){return (const char *)offset;}
+    offset += 3;
+  }
+  return 0;
+}
+
+/// The removeEmulationPrevention function from before
+std::string oldRemoveEmulationPrevention(const std::string &data){
+  std::string result;
+  result.resize(data.size());
+  result[0] = data[0];
+  result[1] = data[1];
+  size_t dataPtr = 2;
+  size_t dataLen = data.size();
+  size_t resPtr = 2;
+  while (dataPtr + 2 < dataLen){
+    if (!data[dataPtr] && !data[dataPtr + 1] && data[dataPtr + 2] == 3){
+      result[resPtr++] = data[dataPtr++];
+      result[resPtr++] = data[dataPtr++];
+      dataPtr++;
+    }else{
+      result[resPtr++] = data[dataPtr++];
+    }
+  }
+  while (dataPtr < dataLen){result[resPtr++] = data[dataPtr++];}
+  return result.substr(0, resPtr);
+}
+
+/// Random bytes, mostly 00, 01 and 03 so that start codes and emulation prevention are common
+void fillRandom(char *data, size_t len){
+  for (size_t i = 0; i < len; ++i){
+    int r = rand() % 8;
+    data[i] = (r < 4 ? 0 : (r == 4 ? 1 : (r == 5 ? 3 : (char)(rand() % 256))));
+  }
+}
+
+void checkLevel(){
+  char buf[320];
+  char res[320];
+  for (size_t loop = 0; loop < 20000; ++loop){
+    size_t len = rand() % 260;
+    size_t align = rand() % 32;
+    char *data = buf + align;
+    fillRandom(data, len);
+    assert(nalu::scanAnnexB(data, len) == oldScanAnnexB(data, len));
+    if (len >= 2){
+      std::string str(data, len);
+      std::string old = oldRemoveEmulationPrevention(str);
+      assert(nalu::removeEmulationPrevention(str) == old);
+      assert(nalu::removeEmulationPrevention(data, len, res) == old.size());
+      assert(!memcmp(res, old.data(), old.size()));
+    }
+  }
+  // Bytes with the high bit set are not start codes
+  const char high[] = "\000\000\200\000\000\377\000\000\001";
+  assert(nalu::scanAnnexB(high, 9) == high + 6);
+  assert(nalu::scanAnnexB(high, 8) == 0);
+}
+
+int main(int argc, char **argv){
+  srand(42);
+  std::deque<nalu::scanLevel> levels;
+  for (int l = nalu::SCAN_SCALAR; l <= nalu::SCAN_AVX2; ++l){
+    if (nalu::setScanLevel((nalu::scanLevel)l)){levels.push_back((nalu::scanLevel)l);}
+  }
+  for (size_t i = 0; i < levels.size(); ++i){
+    assert(nalu::setScanLevel(levels[i]));
+    checkLevel();
+  }
+
+  // Throughput: random data with a start code (and an emulation prevention byte) every 64KiB, as
+  // a high bitrate video elementary stream would have
+  size_t size = (argc > 1 ? atoi(argv[1]) : 64) * 1024 * 1024;
+  char *data = (char *)malloc(size);
+  char *res = (char *)malloc(size);
+  for (size_t i = 0; i < size; ++i){data[i] = rand() % 255 + 1;}
+  for (size_t i = 0; i + 4 < size; i += 65536){memcpy(data + i, "\000\000\001", 3);}
+  for (size_t i = 32768; i + 4 < size; i += 65536){memcpy(data + i, "\000\000\003", 3);}
+  size_t expected = (size - 5) / 65536 + 1;
+  for (size_t i = 0; i < levels.size(); ++i){
+    nalu::setScanLevel(levels[i]);
+    size_t found = 0;
+    uint64_t start = Util::getMicros();
+    const char *p = data;
+    while ((p = nalu::scanAnnexB(p, size - (p - data)))){
+      ++found;
+      p += 3;
+    }
+    uint64_t scanTime = Util::getMicros(start) + 1;
+    assert(found == expected);
+    start = Util::getMicros();
+    size_t resSize = nalu::removeEmulationPrevention(data, size, res);
+    uint64_t removeTime = Util::getMicros(start) + 1;
+    assert(resSize == size - ((size - 32768 - 5) / 65536 + 1));
+    std::cout << nalu::getScanLevelName(levels[i]) << ": scanAnnexB " << (double)size / scanTime / 1000
+              << " GB/s, removeEmulationPrevention " << (double)size / removeTime / 1000 << " GB/s" << std::endl;
+  }
+  free(data);
+  free(res);
+  return 0;
+}
@@ -0,0 +1,184 @@
+/// \file bufferreserve.cpp
+/// Checks InOutBase::bufferReserve and bufferCommit: the payload goes where the returned pointer
+/// says, packets only become visible once committed, they end up byte-identical to what bufferNext
+/// writes and follow each other on the page. Checks a packet that exactly fills the page fits and
+/// packets that do not fit are refused without touching the page. Then buffers a live track until
+/// it moves on to a new page, and checks the new page starts over at offset 0 while the old page
+/// keeps all of its packets.
+
+#include "../src/io.h"
+#include <cassert>
+#include <iostream>
+#include <mist/bitfields.h>
+#include <mist/defines.h>
+#include <mist/dtsc.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PAGE_SIZE_TEST 4096
+
+/// Gives access to the stream name InOutBase uses for its page names
+class TestIO : public Mist::InOutBase{
+public:
+  TestIO(const std::string &name){
+    streamName = name;
+    standAlone = true;
+  }
+};
+
+/// Size a packet takes on a page, the way bufferReserve works it out
+size_t packetLen(int64_t offset, uint64_t bpos, bool keyframe, size_t dataLen){
+  return 24 + (offset ? 17 : 0) + (bpos ? 15 : 0) + (keyframe ? 19 : 0) + dataLen + 11;
+}
+
+/// Checks the packet at the given position of the page has the given contents, returns its length
+size_t checkPacket(const char *page, uint64_t pos, size_t track, uint64_t time, int64_t offset,
+                   uint64_t bpos, bool keyframe, const std::string &data){
+  assert(!memcmp(page + pos, "DTP2", 4));
+  size_t len = 8 + Bit::btohl(page + pos + 4);
+  assert(len == packetLen(offset, bpos, keyframe, data.size()));
+  DTSC::Packet P(page + pos, len, true);
+  assert(P.getTrackId() == track && P.getTime() == time);
+  assert((int64_t)P.getInt("offset") == offset && P.getInt("bpos") == bpos && P.getFlag("keyframe") == keyframe);
+  char *payload;
+  size_t payloadLen;
+  P.getString("data", payload, payloadLen);
+  assert(std::string(payload, payloadLen) == data);
+  return len;
+}
+
+/// Adds an empty page for the given first key to the track
+void addPage(DTSC::Meta &M, size_t idx, uint64_t firstKey, uint64_t size){
+  Util::RelAccX &pages = M.pages(idx);
+  uint64_t i = pages.getEndPos();
+  pages.addRecords(1);
+  pages.setInt("firstkey", firstKey, i);
+  pages.setInt("keycount", 1, i);
+  pages.setInt("firsttime", firstKey * 1000, i);
+  pages.setInt("size", size, i);
+  pages.setInt("avail", 0, i);
+}
+
+/// Removes the data page of the given track and page number
+void removePage(const std::string &streamName, size_t idx, uint64_t pageNum, uint64_t size){
+  char pageId[NAME_BUFFER_SIZE];
+  snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), idx, (uint32_t)pageNum);
+  IPC::sharedPage P(pageId, size, false, false);
+  P.master = true;
+}
+
+int main(int argc, char **argv){
+  char name[64];
+  snprintf(name, 64, "reserve_test_%d", (int)getpid());
+  std::string streamName = name;
+  TestIO io(streamName);
+  DTSC::Meta M(streamName, true);
+  M.setVod(true);
+  size_t idx = M.addTrack(DEFAULT_FRAGMENT_COUNT, DEFAULT_KEY_COUNT, DEFAULT_PART_COUNT, 16);
+  M.setType(idx, "video");
+  addPage(M, idx, 0, PAGE_SIZE_TEST);
+  addPage(M, idx, 1, PAGE_SIZE_TEST);
+  Util::RelAccX &pages = M.pages(idx);
+
+  // Nothing to reserve on while no page is open
+  IPC::sharedPage page, copy;
+  assert(!io.bufferReserve(0, 0, idx, 10, 0, true, page, M));
+
+  assert(io.bufferStart(idx, 0, page, M) && io.bufferStart(idx, 1, copy, M));
+  struct{
+    uint64_t time;
+    int64_t offset;
+    uint64_t bpos;
+    bool keyframe;
+    size_t size;
+  }packets[] ={{0, 0, 0, true, 100}, {40, -80, 0, false, 7}, {80, 40, 123456, false, 0}, {120, 0, 99, true, 333}};
+  uint64_t pos = 0;
+  for (size_t i = 0; i < 4; ++i){
+    std::string data(packets[i].size, 'a' + i);
+    char *payload = io.bufferReserve(packets[i].time, packets[i].offset, idx, data.size(), packets[i].bpos,
+                                     packets[i].keyframe, page, M);
+    assert(payload);
+    // The payload comes right before the 3 bytes that close the packet
+    size_t len = packetLen(packets[i].offset, packets[i].bpos, packets[i].keyframe, data.size());
+    assert(payload == page.mapped + pos + len - 3 - data.size());
+    // Not visible to readers until committed
+    assert(memcmp(page.mapped + pos, "DTP2", 4) && pages.getInt("avail", 0) == pos);
+    memcpy(payload, data.data(), data.size());
+    assert(io.bufferCommit(page, M) == page.mapped + pos);
+    assert(pages.getInt("avail", 0) == pos + len);
+    assert(checkPacket(page.mapped, pos, idx, packets[i].time, packets[i].offset, packets[i].bpos,
+                       packets[i].keyframe, data) == len);
+    // bufferNext writes the very same bytes
+    io.bufferNext(packets[i].time, packets[i].offset, idx, data.data(), data.size(), packets[i].bpos,
+                  packets[i].keyframe, copy, M);
+    assert(pages.getInt("avail", 1) == pos + len);
+    pos += len;
+  }
+  assert(!memcmp(page.mapped, copy.mapped, pos));
+  // Earlier packets are untouched by later ones
+  pos = 0;
+  for (size_t i = 0; i < 4; ++i){
+    pos += checkPacket(page.mapped, pos, idx, packets[i].time, packets[i].offset, packets[i].bpos,
+                       packets[i].keyframe, std::string(packets[i].size, 'a' + i));
+  }
+
+  // A packet one byte too large for the rest of the page is refused and leaves the page alone
+  size_t left = PAGE_SIZE_TEST - pos;
+  size_t fits = left - packetLen(0, 0, false, 0);
+  assert(!io.bufferReserve(200, 0, idx, fits + 1, 0, false, page, M));
+  assert(pages.getInt("avail", 0) == pos);
+  for (size_t i = pos; i < PAGE_SIZE_TEST; ++i){assert(!page.mapped[i]);}
+  // One that exactly fills it fits
+  char *payload = io.bufferReserve(200, 0, idx, fits, 0, false, page, M);
+  assert(payload && payload + fits + 3 == page.mapped + PAGE_SIZE_TEST);
+  memset(payload, 'z', fits);
+  io.bufferCommit(page, M);
+  assert(pages.getInt("avail", 0) == PAGE_SIZE_TEST);
+  checkPacket(page.mapped, pos, idx, 200, 0, 0, false, std::string(fits, 'z'));
+  // After which not even an empty packet fits
+  assert(!io.bufferReserve(240, 0, idx, 0, 0, false, page, M));
+  assert(pages.getInt("avail", 0) == PAGE_SIZE_TEST);
+  io.bufferFinalize(idx, page);
+  io.bufferFinalize(idx, copy);
+  removePage(streamName, idx, 0, PAGE_SIZE_TEST);
+  removePage(streamName, idx, 1, PAGE_SIZE_TEST);
+  std::cout << "Reserved packets land where expected, exactly filling a page works, overflowing it does not" << std::endl;
+
+  // A live track moves on to a new page once a keyframe comes in more than FLIP_TARGET_DURATION
+  // after the start of the current page
+  size_t live = M.addTrack(DEFAULT_FRAGMENT_COUNT, DEFAULT_KEY_COUNT, DEFAULT_PART_COUNT, 16);
+  M.setVod(false);
+  M.setType(live, "video");
+  Util::RelAccX &livePages = M.pages(live);
+  uint64_t interval = 1000;
+  uint64_t keys = FLIP_TARGET_DURATION / interval + 2;
+  for (uint64_t k = 0; k < keys; ++k){
+    std::string data(500 + k, 'A' + k % 26);
+    io.bufferLivePacket(k * interval, 0, live, data.data(), data.size(), 0, true, M);
+    io.bufferLivePacket(k * interval + interval / 2, 0, live, data.data(), data.size(), 0, false, M);
+  }
+  assert(livePages.getEndPos() == 2);
+  uint64_t firstKeys = livePages.getInt("keycount", 0);
+  assert(livePages.getInt("firstkey", 1) == firstKeys && firstKeys + livePages.getInt("keycount", 1) == keys);
+  for (size_t p = 0; p < 2; ++p){
+    char pageId[NAME_BUFFER_SIZE];
+    snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), live,
+             (uint32_t)livePages.getInt("firstkey", p));
+    IPC::sharedPage P(pageId, livePages.getInt("size", p), false, false);
+    assert(P.mapped);
+    // Every packet of the page, starting at offset 0, up to exactly where it says data is available
+    uint64_t at = 0;
+    for (uint64_t k = livePages.getInt("firstkey", p); k < livePages.getInt("firstkey", p) + livePages.getInt("keycount", p); ++k){
+      std::string data(500 + k, 'A' + k % 26);
+      at += checkPacket(P.mapped, at, live, k * interval, 0, 0, true, data);
+      at += checkPacket(P.mapped, at, live, k * interval + interval / 2, 0, 0, false, data);
+    }
+    assert(at == livePages.getInt("avail", p));
+  }
+  removePage(streamName, live, 0, livePages.getInt("size", 0));
+  removePage(streamName, live, firstKeys, livePages.getInt("size", 1));
+  std::cout << "Live page " << firstKeys << " started over at offset 0 after " << firstKeys
+            << " keys on page 0" << std::endl;
+  return 0;
+}
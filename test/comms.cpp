@@ -0,0 +1,252 @@
+/// \file comms.cpp
+/// Starts many short-lived client processes that register on a Comms::Users page while this
+/// process loops over the page as its master, and checks no record is ever in use by two clients
+/// at once, clients that exit without disconnecting get cleaned up, and all records are released in
+/// the end and handed out again before any new ones. Checks a record claimed by a client that dies
+/// before activating it is released without the master ever seeing it. Checks the page grows once all its records
+/// are in use, without disturbing clients that mapped it before. Then prints the time per record claim and the time and kill() calls per COMM_LOOP pass
+/// over many live records, the way it was done before and through the free list and keepAlive.
+/// Pass a record count as argument to change the amount of live records timed.
+
+#include <cassert>
+#include <iostream>
+#include <mist/comms.h>
+#include <mist/defines.h>
+#include <mist/timing.h>
+#include <set>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static uint64_t kills = 0;
+
+// Count the pid checks, passing them on to the kernel
+extern "C" int kill(pid_t pid, int sig){
+  ++kills;
+  return syscall(SYS_kill, pid, sig);
+}
+
+/// The COMM_LOOP from before, which checks the pid of every record on every pass
+#define OLD_COMM_LOOP(comm, onActive, onDisconnect) \
+  {\
+    for (size_t id = 0; id < comm.recordCount(); id++){\
+      if (comm.getStatus(id) == COMM_STATUS_INVALID){continue;}\
+      if (!Util::Procs::isRunning(comm.getPid(id))){\
+        comm.setStatus(COMM_STATUS_DISCONNECT | comm.getStatus(id), id);\
+      }\
+      onActive;\
+      if (comm.getStatus(id) & COMM_STATUS_DISCONNECT){\
+        onDisconnect;\
+        comm.setStatus(COMM_STATUS_INVALID, id);\
+      }\
+    }\
+  }
+
+/// Gives the master access to the way records were claimed before, and through the free list
+class TestUsers : public Comms::Users{
+public:
+  /// The search Comms::reload did before
+  uint64_t oldClaim(){
+    size_t reqCount = dataAccX.getRCount();
+    for (size_t idx = 0; idx < reqCount; ++idx){
+      if (status.uint(idx) == COMM_STATUS_INVALID){
+        IPC::semGuard G(&sem);
+        if (status.uint(idx) != COMM_STATUS_INVALID){continue;}
+        fill(idx);
+        return idx;
+      }
+    }
+    return INVALID_RECORD_INDEX;
+  }
+  uint64_t claimOnly(){return claimRecord();}
+  uint64_t claim(){
+    uint64_t idx = claimRecord();
+    if (idx != INVALID_RECORD_INDEX){fill(idx);}
+    return idx;
+  }
+  void oldRelease(size_t idx){status.set(COMM_STATUS_INVALID, idx);}
+  size_t capacity() const{return dataAccX.getRCount();}
+  void fill(size_t idx){
+    pid.set(getpid(), idx);
+    alive.set(Util::bootSecs(), idx);
+    status.set(COMM_STATUS_ACTIVE, idx);
+  }
+};
+
+/// Registers and unregisters a user on the page over and over, checking nobody else uses the same
+/// record meanwhile. Exits without unregistering after the last one if crash is set.
+void client(const std::string &streamName, size_t num, size_t iterations, bool crash, int startPipe){
+  // Wait for the master to start looping
+  char c;
+  while (read(startPipe, &c, 1) > 0){}
+  srand(getpid());
+  for (size_t i = 0; i < iterations; ++i){
+    Comms::Users U;
+    U.reload(streamName, num);
+    if (!U){_exit(1);}
+    size_t token = (num << 16) + i;
+    U.setKeyNum(token);
+    U.keepAlive();
+    usleep(rand() % 20000);
+    if (U.getKeyNum() != token || U.getTrack() != num || U.getPid() != (uint32_t)getpid()){_exit(2);}
+    if (crash && i == iterations - 1){_exit(0);}
+  }
+  _exit(0);
+}
+
+int main(int argc, char **argv){
+  char streamName[64];
+  snprintf(streamName, 64, "commstest%d", (int)getpid());
+
+  {
+    TestUsers M;
+    M.reload(streamName, true);
+    assert(M);
+    // Many clients that come and go at the same time, of which some exit without unregistering
+    size_t clients = 200, iterations = 50;
+    std::set<pid_t> children;
+    int startPipe[2];
+    assert(!pipe(startPipe));
+    for (size_t i = 0; i < clients; ++i){
+      pid_t child = fork();
+      if (!child){
+        close(startPipe[1]);
+        client(streamName, i + 1, iterations, !(i % 16), startPipe[0]);
+      }
+      children.insert(child);
+    }
+    close(startPipe[0]);
+    close(startPipe[1]);
+    size_t disconnects = 0;
+    size_t maxActive = 0, active = 0;
+    uint64_t deadline = 0;
+    while (children.size() || active){
+      active = 0;
+      COMM_LOOP(M, ++active, ++disconnects);
+      if (active > maxActive){maxActive = active;}
+      int status;
+      pid_t done;
+      while ((done = waitpid(-1, &status, WNOHANG)) > 0){
+        if (!WIFEXITED(status) || WEXITSTATUS(status)){
+          std::cerr << "Client " << done << " failed with status " << status << std::endl;
+          return 1;
+        }
+        children.erase(done);
+      }
+      if (!children.size() && !deadline){deadline = Util::bootSecs() + COMM_ALIVE_TIMEOUT + 5;}
+      assert(!deadline || Util::bootSecs() < deadline);
+      Util::sleep(10);
+    }
+    for (size_t i = 0; i < M.recordCount(); ++i){assert(M.getStatus(i) == COMM_STATUS_INVALID);}
+    assert(disconnects == clients * iterations);
+    std::cout << clients * iterations << " registrations by " << clients << " clients (" << (clients + 15) / 16
+              << " exiting without unregistering): at most " << maxActive << " at once, "
+              << M.recordCount() << " records used" << std::endl;
+    // Every released record is handed out again before any record that was never used
+    size_t used = M.recordCount();
+    std::set<uint64_t> reused;
+    for (size_t i = 0; i < used; ++i){
+      uint64_t idx = M.claim();
+      assert(idx < used);
+      reused.insert(idx);
+    }
+    assert(reused.size() == used && M.recordCount() == used);
+    assert(M.claim() == used);
+    for (size_t i = 0; i <= used; ++i){M.releaseRecord(i);}
+  }
+
+  {
+    // A client that dies between claiming a record and activating it
+    TestUsers M;
+    M.reload(streamName, true);
+    pid_t child = fork();
+    if (!child){
+      TestUsers C;
+      C.reload(streamName, true);
+      C.claimOnly();
+      _exit(0);
+    }
+    assert(waitpid(child, 0, 0) == child);
+    size_t idx = 0;
+    while (idx < M.recordCount() && M.getPid(idx) != (uint32_t)child){++idx;}
+    assert(idx < M.recordCount() && M.getStatus(idx) == COMM_STATUS_CLAIMED);
+    size_t active = 0, disconnects = 0;
+    uint64_t deadline = Util::bootSecs() + COMM_ALIVE_TIMEOUT + 5;
+    while (M.getStatus(idx) != COMM_STATUS_INVALID){
+      COMM_LOOP(M, ++active, ++disconnects);
+      assert(Util::bootSecs() < deadline);
+      Util::sleep(100);
+    }
+    assert(!active && !disconnects);
+    assert(M.claim() == idx);
+    M.releaseRecord(idx);
+    std::cout << "Record claimed by a client that died before activating it was released" << std::endl;
+  }
+
+  {
+    // Filling the page makes it grow
+    std::string growName = std::string(streamName) + "grow";
+    TestUsers G, H;
+    G.reload(growName, true);
+    H.reload(growName, true);
+    size_t capacity = G.capacity();
+    // A client that mapped the page before it grew
+    Comms::Users early;
+    early.reload(growName, (size_t)1);
+    assert(early);
+    for (size_t i = 1; i <= capacity; ++i){assert(G.claim() == i);}
+    assert(G.capacity() == capacity * 2 && G.recordCount() == capacity + 1);
+    early.setKeyNum(42);
+    early.keepAlive();
+    assert(G.getKeyNum(0) == 42 && G.getTrack(0) == 1);
+    // Other processes see the new records once their COMM_LOOP maps them
+    assert(H.recordCount() == capacity);
+    H.remapIfGrown();
+    assert(H.recordCount() == capacity + 1 && H.getStatus(capacity) == COMM_STATUS_ACTIVE);
+    for (size_t i = 0; i <= capacity; ++i){G.releaseRecord(i);}
+    std::cout << "Page grew from " << capacity << " to " << G.capacity() << " records" << std::endl;
+  }
+
+  // Claiming and looping over many live records
+  size_t records = (argc > 1 ? atoi(argv[1]) : 20000);
+  TestUsers T;
+  T.reload(streamName, true);
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < records; ++i){assert(T.claim() != INVALID_RECORD_INDEX);}
+  uint64_t newClaim = Util::getMicros(start);
+  assert(T.recordCount() == records);
+
+  size_t passes = 20, active = 0, disconnects = 0;
+  uint64_t startKills = kills;
+  start = Util::getMicros();
+  for (size_t i = 0; i < passes; ++i){OLD_COMM_LOOP(T, ++active, ++disconnects);}
+  uint64_t oldLoop = Util::getMicros(start);
+  uint64_t oldKills = kills - startKills;
+  startKills = kills;
+  start = Util::getMicros();
+  for (size_t i = 0; i < passes; ++i){COMM_LOOP(T, --active, ++disconnects);}
+  uint64_t newLoop = Util::getMicros(start);
+  uint64_t newKills = kills - startKills;
+  assert(!active && !disconnects);
+  for (size_t i = 0; i < records; ++i){T.releaseRecord(i);}
+
+  // The same amount of claims on a page grown to the same size, searching for a free record
+  TestUsers O;
+  O.reload(std::string(streamName) + "old", true);
+  for (size_t i = 0; i < records; ++i){O.claim();}
+  for (size_t i = 0; i < records; ++i){O.releaseRecord(i);}
+  start = Util::getMicros();
+  for (size_t i = 0; i < records; ++i){assert(O.oldClaim() != INVALID_RECORD_INDEX);}
+  uint64_t oldClaim = Util::getMicros(start);
+  for (size_t i = 0; i < records; ++i){O.oldRelease(i);}
+
+  std::cout << "Claiming " << records << " records: searching " << oldClaim * 1000 / records
+            << "ns, free list " << newClaim * 1000 / records << "ns per claim" << std::endl;
+  std::cout << "Looping over " << records << " live records: pid checks " << oldLoop / passes << "us and "
+            << oldKills / passes << " kill() calls, keepAlive " << newLoop / passes << "us and "
+            << newKills / passes << " kill() calls per pass" << std::endl;
+  return 0;
+}
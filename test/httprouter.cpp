@@ -0,0 +1,198 @@
+/// \file httprouter.cpp
+/// Checks HTTP::Router against the pattern by pattern matching HTTPOutput::getHandler used to do,
+/// using the URL patterns of all HTTP based connectors and a mix of requests for them, requests no
+/// connector handles, and random variations of both. Then prints the time per lookup of both.
+/// Pass a lookup count as argument to change the amount of lookups timed.
+
+#include <cassert>
+#include <deque>
+#include <iostream>
+#include <mist/http_router.h>
+#include <mist/json.h>
+#include <mist/timing.h>
+#include <stdlib.h>
+
+/// The url_match matcher getHandler used before
+bool isMatch(const std::string &url, const std::string &m, std::string &streamname){
+  size_t found = m.find('$');
+  if (found != std::string::npos){
+    if (url.size() < m.size()){return false;}
+    if (m.substr(0, found) == url.substr(0, found) &&
+        m.substr(found + 1) == url.substr(url.size() - (m.size() - found) + 1)){
+      if (url.substr(found, url.size() - m.size() + 1).find('/') != std::string::npos){
+        return false;
+      }
+      streamname = url.substr(found, url.size() - m.size() + 1);
+      return true;
+    }
+  }
+  return (url == m);
+}
+
+/// The url_prefix matcher getHandler used before
+bool isPrefix(const std::string &url, const std::string &m, std::string &streamname){
+  size_t found = m.find('$');
+  if (found != std::string::npos){
+    if (url.size() < m.size()){return false;}
+    size_t found_suf = url.find(m.substr(found + 1), found);
+    if (m.substr(0, found) == url.substr(0, found) && found_suf != std::string::npos){
+      if (url.substr(found, found_suf - found).find('/') != std::string::npos){return false;}
+      streamname = url.substr(found, found_suf - found);
+      return true;
+    }
+  }else{
+    return (url.substr(0, m.size()) == m);
+  }
+  return false;
+}
+
+/// The url_match or url_prefix patterns of a connector, which may be a string or an array
+std::deque<std::string> patterns(const JSON::Value &c, const char *type){
+  std::deque<std::string> res;
+  if (!c.isMember(type)){return res;}
+  if (c[type].isString()){res.push_back(c[type].asStringRef());}
+  jsonForEachConst(c[type], it){res.push_back(it->asStringRef());}
+  return res;
+}
+
+/// The connector loop of getHandler from before
+bool oldRoute(const JSON::Value &conns, const std::string &url, std::string &handler, std::string &streamname){
+  jsonForEachConst(conns, c){
+    bool match = false;
+    std::string name;
+    if (c->isMember("url_match")){
+      const JSON::Value &m = (*c)["url_match"];
+      if (m.isArray()){
+        jsonForEachConst(m, it){match |= isMatch(url, it->asStringRef(), name);}
+      }
+      if (m.isString()){match |= isMatch(url, m.asStringRef(), name);}
+    }
+    if (c->isMember("url_prefix")){
+      const JSON::Value &p = (*c)["url_prefix"];
+      if (p.isArray()){
+        jsonForEachConst(p, it){match |= isPrefix(url, it->asStringRef(), name);}
+      }
+      if (p.isString()){match |= isPrefix(url, p.asStringRef(), name);}
+    }
+    if (match){
+      handler = c.key();
+      streamname = name;
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char **argv){
+  // The URL patterns of the HTTP based connectors, in the (alphabetical) order of the capabilities
+  JSON::Value conns;
+  conns["AAC"]["url_match"] = "/$.aac";
+  conns["CMAF"]["url_prefix"] = "/cmaf/$/";
+  conns["EBML"]["url_match"].append("/$.mkv");
+  conns["EBML"]["url_match"].append("/$.webm");
+  conns["FLV"]["url_match"] = "/$.flv";
+  conns["H264"]["url_match"] = "/$.h264";
+  conns["HDS"]["url_prefix"] = "/dynamic/$/";
+  conns["HLS"]["url_prefix"] = "/hls/$/";
+  const char *internal[] ={"/crossdomain.xml", "/clientaccesspolicy.xml", "/$.html", "/favicon.ico",
+                            "/$.smil", "/info_$.js", "/json_$.js", "/player.js", "/videojs.js",
+                            "/dashjs.js", "/webrtc.js", "/flv.js", "/hlsjs.js", "/skins/default.css",
+                            "/skins/dev.css", "/skins/videojs.css", "/embed_$.js", "/flashplayer.swf",
+                            "/oldflashplayer.swf", 0};
+  for (size_t i = 0; internal[i]; ++i){conns["HTTP"]["url_match"].append(internal[i]);}
+  conns["HTTP"]["url_prefix"] = "/.well-known/";
+  conns["HTTPMinimalServer"]["url_prefix"] = "/static/";
+  conns["HTTPTS"]["url_match"] = "/$.ts";
+  conns["JPG"]["url_match"] = "/$.jpg";
+  conns["JSON"]["url_match"] = "/$.json";
+  conns["MP3"]["url_match"] = "/$.mp3";
+  conns["MP4"]["url_match"].append("/$.mp4");
+  conns["MP4"]["url_match"].append("/$.3gp");
+  conns["MP4"]["url_match"].append("/$.fmp4");
+  conns["OGG"]["url_match"] = "/$.ogg";
+  conns["SRT"]["url_match"].append("/$.srt");
+  conns["SRT"]["url_match"].append("/$.vtt");
+  conns["SRT"]["url_match"].append("/$.webvtt");
+  conns["WAV"]["url_match"] = "/$.wav";
+  conns["WebRTC"]["url_match"] = "/webrtc/$";
+  // Overlapping patterns, to check which one wins
+  conns["ZZ"]["url_match"].append("/$.mp4");
+  conns["ZZ"]["url_prefix"].append("/hls/$");
+  conns["ZZ"]["url_prefix"].append("/hls/$/index");
+  conns["ZZ"]["url_prefix"].append("/z$");
+
+  HTTP::Router R;
+  jsonForEachConst(conns, c){
+    size_t h = R.addHandler(c.key());
+    std::deque<std::string> m = patterns(*c, "url_match");
+    for (size_t i = 0; i < m.size(); ++i){R.addMatch(h, m[i]);}
+    std::deque<std::string> p = patterns(*c, "url_prefix");
+    for (size_t i = 0; i < p.size(); ++i){R.addPrefix(h, p[i]);}
+  }
+
+  // Requests for every pattern with a few stream names, and random variations of them
+  std::vector<std::string> urls;
+  const char *names[] ={"live", "live+abc", "a/b", "", "$", "x.mp4", 0};
+  const char *extra[] ={"", "index.m3u8", "1080p/chunk_123.ts", "/", ".mp4", "?x=1", 0};
+  jsonForEachConst(conns, c){
+    std::deque<std::string> pats = patterns(*c, "url_match");
+    std::deque<std::string> prefixes = patterns(*c, "url_prefix");
+    pats.insert(pats.end(), prefixes.begin(), prefixes.end());
+    for (size_t p = 0; p < pats.size(); ++p){
+      for (size_t n = 0; names[n]; ++n){
+        for (size_t e = 0; extra[e]; ++e){
+          std::string u = pats[p];
+          size_t d = u.find('$');
+          if (d != std::string::npos){u.replace(d, 1, names[n]);}
+          urls.push_back(u + extra[e]);
+        }
+      }
+    }
+  }
+  srand(42);
+  size_t base = urls.size();
+  for (size_t i = 0; i < base * 4; ++i){
+    std::string u = urls[rand() % base];
+    switch (rand() % 3){
+    case 0: u.erase(rand() % (u.size() + 1), 1 + rand() % 3); break;
+    case 1: u.insert(rand() % (u.size() + 1), 1, "/$.xhz"[rand() % 6]); break;
+    default: u = u.substr(0, rand() % (u.size() + 1)); break;
+    }
+    urls.push_back(u);
+  }
+  size_t matched = 0;
+  for (size_t i = 0; i < urls.size(); ++i){
+    std::string oldHandler, oldName, newHandler, newName;
+    bool oldFound = oldRoute(conns, urls[i], oldHandler, oldName);
+    bool newFound = R.route(urls[i], newHandler, newName);
+    if (oldFound != newFound || oldHandler != newHandler || oldName != newName){
+      std::cerr << urls[i] << ": " << oldHandler << "(" << oldName << ") != " << newHandler << "("
+                << newName << ")" << std::endl;
+      return 1;
+    }
+    if (oldFound){++matched;}
+  }
+
+  size_t loops = (argc > 1 ? atoi(argv[1]) : 200000);
+  size_t sum = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    std::string handler, name;
+    oldRoute(conns, urls[i % urls.size()], handler, name);
+    sum += handler.size() + name.size();
+  }
+  uint64_t oldTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    std::string handler, name;
+    R.route(urls[i % urls.size()], handler, name);
+    sum -= handler.size() + name.size();
+  }
+  uint64_t newTime = Util::getMicros(start);
+  assert(!sum);
+  std::cout << R.size() << " patterns of " << conns.size() << " connectors, " << urls.size()
+            << " URLs of which " << matched << " match" << std::endl;
+  std::cout << "Pattern by pattern: " << oldTime * 1000 / loops << "ns, trie: " << newTime * 1000 / loops
+            << "ns per lookup" << std::endl;
+  return 0;
+}
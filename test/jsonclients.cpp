@@ -0,0 +1,137 @@
+/// \file jsonclients.cpp
+/// Builds a "clients" API response for a large amount of sessions the way the controller used to
+/// (the whole tree built while holding the statistics lock) and the way it does now (only copying
+/// the session data under the lock), checks both serialise identically, and prints the time spent
+/// under the lock, the time to serialise and the peak RSS.
+/// Pass a session count as argument to change the amount of sessions used.
+
+#include <cassert>
+#include <iostream>
+#include <mist/json.h>
+#include <mist/timing.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <vector>
+
+/// The subset of a session the clients response is built from
+struct session{
+  std::string host;
+  std::string streamName;
+  std::string connector;
+  std::string ID;
+  uint32_t crc;
+  uint64_t vals[9];
+};
+
+/// Returns the peak resident set size so far, in KiB
+uint64_t peakRSS(){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/// Builds a row the way fillClients used to, into a temporary that is then copied
+void oldRows(const std::vector<session> &S, JSON::Value &rep){
+  rep["data"].null();
+  for (size_t i = 0; i < S.size(); ++i){
+    JSON::Value d;
+    d.append(S[i].host);
+    d.append(S[i].streamName);
+    d.append(S[i].connector);
+    for (size_t j = 0; j < 6; ++j){d.append(S[i].vals[j]);}
+    d.append(S[i].crc);
+    d.append(S[i].ID);
+    for (size_t j = 6; j < 9; ++j){d.append(S[i].vals[j]);}
+    rep["data"].append(d);
+  }
+}
+
+/// Copies the sessions the way fillClients does now while holding the lock
+void copyRows(const std::vector<session> &S, std::vector<session> &rows){
+  rows.reserve(S.size());
+  for (size_t i = 0; i < S.size(); ++i){rows.push_back(S[i]);}
+}
+
+/// Builds the response from the copied rows, without holding the lock
+void newRows(const std::vector<session> &rows, JSON::Value &rep){
+  JSON::Value &data = rep["data"];
+  data.null();
+  for (size_t i = 0; i < rows.size(); ++i){
+    JSON::Value &d = data.append();
+    d.append(rows[i].host);
+    d.append(rows[i].streamName);
+    d.append(rows[i].connector);
+    for (size_t j = 0; j < 6; ++j){d.append(rows[i].vals[j]);}
+    d.append(rows[i].crc);
+    d.append(rows[i].ID);
+    for (size_t j = 6; j < 9; ++j){d.append(rows[i].vals[j]);}
+  }
+}
+
+int main(int argc, char **argv){
+  // Serialisation of the basic types
+  JSON::Value J;
+  J["int"] = (int64_t)-1234567890123ll;
+  J["dbl"] = 1.5;
+  J["str"] = "a\"b\\c\n\x01\xc3\xa9";
+  J["arr"].append(true);
+  J["arr"].append(JSON::Value());
+  J["arr"].prepend("x");
+  J["obj"]["e"].null();
+  assert(J.toString() == "{\"arr\":[\"x\",true,null],\"dbl\":1.5000000000,\"int\":-1234567890123,"
+                         "\"obj\":{\"e\":null},\"str\":\"a\\\"b\\\\c\\n\\u0001\\u00E9\"}");
+  J["arr"].shrink(1);
+  assert(J["arr"].toString() == "[null]");
+
+  size_t count = (argc > 1 ? atoi(argv[1]) : 50000);
+  std::vector<session> S(count);
+  char buf[64];
+  for (size_t i = 0; i < count; ++i){
+    snprintf(buf, sizeof(buf), "10.%d.%d.%d", (int)(i >> 16) & 255, (int)(i >> 8) & 255, (int)i & 255);
+    S[i].host = buf;
+    snprintf(buf, sizeof(buf), "stream%d", (int)(i % 100));
+    S[i].streamName = buf;
+    S[i].connector = (i % 3) ? "HLS" : "WebRTC";
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)i * 2654435761ull);
+    S[i].ID = buf;
+    S[i].crc = i * 2654435761u;
+    for (size_t j = 0; j < 9; ++j){S[i].vals[j] = i * (j + 1) * 1000;}
+  }
+
+  uint64_t baseRSS = peakRSS();
+  std::string oldStr, newStr;
+  uint64_t oldLock, oldSerialise, newLock, newBuild, newSerialise;
+  {
+    JSON::Value rep;
+    uint64_t start = Util::getMicros();
+    oldRows(S, rep);
+    oldLock = Util::getMicros(start);
+    start = Util::getMicros();
+    oldStr = rep.toString();
+    oldSerialise = Util::getMicros(start);
+  }
+  uint64_t oldRSS = peakRSS();
+  {
+    JSON::Value rep;
+    std::vector<session> rows;
+    uint64_t start = Util::getMicros();
+    copyRows(S, rows);
+    newLock = Util::getMicros(start);
+    start = Util::getMicros();
+    newRows(rows, rep);
+    newBuild = Util::getMicros(start);
+    start = Util::getMicros();
+    newStr = rep.toString();
+    newSerialise = Util::getMicros(start);
+  }
+  assert(oldStr == newStr);
+  std::cout << count << " sessions, " << newStr.size() << " bytes of JSON" << std::endl;
+  std::cout << "Tree built under lock: " << oldLock / 1000 << "ms under lock, " << oldSerialise / 1000
+            << "ms to serialise" << std::endl;
+  std::cout << "Rows copied under lock: " << newLock / 1000 << "ms under lock, " << newBuild / 1000
+            << "ms to build, " << newSerialise / 1000 << "ms to serialise" << std::endl;
+  // The second run reuses memory freed by the first, so only the first raises the peak
+  std::cout << "Peak RSS growth: " << (oldRSS - baseRSS) / 1024 << " MiB" << std::endl;
+  return 0;
+}
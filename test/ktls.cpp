@@ -0,0 +1,355 @@
+/// \file ktls.cpp
+/// Sets up TLS 1.2 AES-GCM sessions between an mbedtls server using Socket::KernelTLS and an
+/// mbedtls client over loopback TCP, and checks the exported keys, IVs and sequence numbers are
+/// the ones the kernel needs: records built by hand from the server keys starting at
+/// KernelTLS::firstSequence must decrypt on the client, and records the client sends must decrypt
+/// with the client keys. If the kernel supports TLS, also checks a session handed to the kernel
+/// keeps working both ways, and otherwise that the session keeps working through mbedtls after
+/// the kernel refused it. Then prints the throughput per core of CPU time of sending through
+/// mbedtls the way MistOutHTTPS proxies MistOutHTTP, and of sending plaintext with kernel TLS.
+/// Usage: ktls [MiB to send]
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <mbedtls/certs.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/gcm.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#include <mist/socket_ktls.h>
+#include <mist/tinythread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CHUNK (16 * 1024)
+
+// ECDHE-RSA with AES-128-GCM, with AES-256-GCM, and either
+static const int gcmSuites[3][3] ={{0xC02F, 0}, {0xC030, 0}, {0xC02F, 0xC030, 0}};
+
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context rng;
+static mbedtls_x509_crt cert;
+static mbedtls_pk_context key;
+
+int sendAll(int sock, const unsigned char *buf, size_t len){
+  size_t done = 0;
+  while (done < len){
+    ssize_t r = send(sock, buf + done, len - done, MSG_NOSIGNAL);
+    if (r <= 0){return -1;}
+    done += r;
+  }
+  return 0;
+}
+
+int recvAll(int sock, unsigned char *buf, size_t len){
+  size_t done = 0;
+  while (done < len){
+    ssize_t r = recv(sock, buf + done, len - done, 0);
+    if (r <= 0){return -1;}
+    done += r;
+  }
+  return 0;
+}
+
+int bioSend(void *ctx, const unsigned char *buf, size_t len){
+  ssize_t r = send(*(int *)ctx, buf, len, MSG_NOSIGNAL);
+  return r < 0 ? -0x4E : (int)r; // MBEDTLS_ERR_NET_SEND_FAILED
+}
+
+int bioRecv(void *ctx, unsigned char *buf, size_t len){
+  ssize_t r = recv(*(int *)ctx, buf, len, 0);
+  return r < 0 ? -0x4C : (int)r; // MBEDTLS_ERR_NET_RECV_FAILED
+}
+
+/// One side of a session over a TCP socket, using the suites at the given index of gcmSuites
+struct side{
+  int sock;
+  mbedtls_ssl_config conf;
+  mbedtls_ssl_context ssl;
+  Socket::KernelTLS ktls;
+  int handshake;
+  side(bool server, int suite){
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_init(&ssl);
+    assert(!mbedtls_ssl_config_defaults(&conf, server ? MBEDTLS_SSL_IS_SERVER : MBEDTLS_SSL_IS_CLIENT,
+                                        MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT));
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &rng);
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_ciphersuites(&conf, gcmSuites[suite]);
+    if (server){
+      assert(!mbedtls_ssl_conf_own_cert(&conf, &cert, &key));
+      ktls.exportKeys(&conf);
+    }
+    assert(!mbedtls_ssl_setup(&ssl, &conf));
+    mbedtls_ssl_set_bio(&ssl, &sock, bioSend, bioRecv, 0);
+  }
+  ~side(){
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_config_free(&conf);
+    close(sock);
+  }
+};
+
+void serverHandshake(void *s){
+  side *S = (side *)s;
+  S->handshake = mbedtls_ssl_handshake(&S->ssl);
+}
+
+/// Connects a client and a server over loopback and completes the handshake
+void connectPair(side &server, side &client){
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(sa);
+  assert(!bind(listener, (sockaddr *)&sa, sizeof(sa)) && !listen(listener, 1));
+  assert(!getsockname(listener, (sockaddr *)&sa, &len));
+  client.sock = socket(AF_INET, SOCK_STREAM, 0);
+  assert(!connect(client.sock, (sockaddr *)&sa, sizeof(sa)));
+  server.sock = accept(listener, 0, 0);
+  assert(server.sock >= 0);
+  close(listener);
+  tthread::thread T(serverHandshake, &server);
+  int ret = mbedtls_ssl_handshake(&client.ssl);
+  T.join();
+  assert(!ret && !server.handshake);
+}
+
+/// Puts the sequence number in the first 8 bytes of buf, big-endian
+void putSeq(unsigned char *buf, uint64_t seq){
+  for (size_t i = 0; i < 8; ++i){buf[i] = (seq >> (56 - 8 * i)) & 0xFF;}
+}
+
+/// Sets up AES-GCM with a key exported by KernelTLS
+void gcmKey(mbedtls_gcm_context &gcm, const std::string &k){
+  mbedtls_gcm_init(&gcm);
+  assert(!mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, (const unsigned char *)k.data(), k.size() * 8));
+}
+
+/// Sends an application data record encrypted the way the kernel does: the implicit IV followed
+/// by the sequence number as nonce, the sequence number as explicit nonce in the record
+void sendRecord(side &S, uint64_t seq, const std::string &data){
+  mbedtls_gcm_context gcm;
+  gcmKey(gcm, S.ktls.serverKey);
+  unsigned char rec[5 + 8 + CHUNK + 16], nonce[12], aad[13];
+  memcpy(nonce, S.ktls.serverIV.data(), 4);
+  putSeq(nonce + 4, seq);
+  putSeq(aad, seq);
+  aad[8] = 23;
+  aad[9] = 3;
+  aad[10] = 3;
+  aad[11] = data.size() >> 8;
+  aad[12] = data.size() & 0xFF;
+  size_t len = 8 + data.size() + 16;
+  memcpy(rec, aad + 8, 3);
+  rec[3] = len >> 8;
+  rec[4] = len & 0xFF;
+  putSeq(rec + 5, seq);
+  assert(!mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, data.size(), nonce, 12, aad, 13,
+                                    (const unsigned char *)data.data(), rec + 13, 16, rec + 13 + data.size()));
+  mbedtls_gcm_free(&gcm);
+  assert(!sendAll(S.sock, rec, 5 + len));
+}
+
+/// Receives an application data record and decrypts it the way the kernel does
+std::string recvRecord(side &S, uint64_t seq){
+  unsigned char hdr[5], rec[8 + CHUNK + 16], nonce[12], aad[13], out[CHUNK];
+  assert(!recvAll(S.sock, hdr, 5));
+  assert(hdr[0] == 23 && hdr[1] == 3 && hdr[2] == 3);
+  size_t len = (hdr[3] << 8) | hdr[4];
+  assert(len >= 24 && len <= sizeof(rec));
+  assert(!recvAll(S.sock, rec, len));
+  // mbedtls uses the sequence number as explicit nonce too, as the kernel expects
+  putSeq(aad, seq);
+  assert(!memcmp(rec, aad, 8));
+  size_t dataLen = len - 24;
+  memcpy(nonce, S.ktls.clientIV.data(), 4);
+  memcpy(nonce + 4, rec, 8);
+  memcpy(aad + 8, hdr, 3);
+  aad[11] = dataLen >> 8;
+  aad[12] = dataLen & 0xFF;
+  mbedtls_gcm_context gcm;
+  gcmKey(gcm, S.ktls.clientKey);
+  assert(!mbedtls_gcm_auth_decrypt(&gcm, dataLen, nonce, 12, aad, 13, rec + 8 + dataLen, 16, rec + 8, out));
+  mbedtls_gcm_free(&gcm);
+  return std::string((char *)out, dataLen);
+}
+
+/// Reads exactly len bytes of application data from the client session
+std::string clientRead(side &C, size_t len){
+  std::string data;
+  unsigned char buf[CHUNK];
+  while (data.size() < len){
+    int r = mbedtls_ssl_read(&C.ssl, buf, std::min(sizeof(buf), len - data.size()));
+    assert(r > 0);
+    data.append((char *)buf, r);
+  }
+  return data;
+}
+
+/// Checks the keys exported for a session using the given suite by doing the record layer by hand
+void checkExport(int suite, size_t keyLen){
+  side server(true, suite), client(false, suite);
+  connectPair(server, client);
+  assert(server.ktls.serverKey.size() == keyLen && server.ktls.clientKey.size() == keyLen);
+  assert(server.ktls.serverIV.size() == 4 && server.ktls.clientIV.size() == 4);
+  uint64_t seq = Socket::KernelTLS::firstSequence;
+  for (size_t i = 0; i < 3; ++i){
+    std::string msg = std::string("server record ") + (char)('0' + i);
+    sendRecord(server, seq + i, msg);
+    assert(clientRead(client, msg.size()) == msg);
+    msg = std::string("client record ") + (char)('0' + i);
+    assert(mbedtls_ssl_write(&client.ssl, (const unsigned char *)msg.data(), msg.size()) == (int)msg.size());
+    assert(recvRecord(server, seq + i) == msg);
+  }
+  std::cout << mbedtls_ssl_get_ciphersuite(&server.ssl) << ": exported keys, IVs and sequence numbers check out" << std::endl;
+}
+
+/// Returns the CPU time (user and system) of the calling thread so far, in us
+uint64_t threadCPU(){
+  struct rusage ru;
+  getrusage(RUSAGE_THREAD, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+struct bench{
+  side *server;
+  int in;       ///< Socket the proxy reads plaintext from
+  int out;      ///< Socket plaintext is written to: the proxy, or the connection with kernel TLS
+  size_t bytes; ///< Amount of data to send
+  uint64_t cpu; ///< CPU time used by the sending threads together, in us
+};
+
+/// Writes the plaintext, like MistOutHTTP does, either to the proxy or straight to the socket
+void produce(void *b){
+  bench &B = *(bench *)b;
+  uint64_t start = threadCPU();
+  unsigned char buf[CHUNK];
+  memset(buf, 'M', sizeof(buf));
+  for (size_t done = 0; done < B.bytes; done += sizeof(buf)){assert(!sendAll(B.out, buf, sizeof(buf)));}
+  if (B.out != B.server->sock){shutdown(B.out, SHUT_WR);}
+  __sync_fetch_and_add(&B.cpu, threadCPU() - start);
+}
+
+/// Passes the plaintext on through mbedtls, like MistOutHTTPS does
+void proxy(void *b){
+  bench &B = *(bench *)b;
+  uint64_t start = threadCPU();
+  unsigned char buf[4 * 1024];
+  ssize_t r;
+  while ((r = recv(B.in, buf, sizeof(buf), 0)) > 0){
+    for (ssize_t done = 0; done < r;){
+      int ret = mbedtls_ssl_write(&B.server->ssl, buf + done, r - done);
+      assert(ret > 0);
+      done += ret;
+    }
+  }
+  __sync_fetch_and_add(&B.cpu, threadCPU() - start);
+}
+
+/// Sends bytes of data to the client, through the kernel or an mbedtls proxy, and returns the
+/// throughput in Mbit/s per core of CPU time used by the sending side
+uint64_t measure(side &server, side &client, bool kernel, size_t bytes){
+  bench B;
+  B.server = &server;
+  B.bytes = bytes;
+  B.cpu = 0;
+  B.in = -1;
+  B.out = server.sock;
+  if (!kernel){
+    int pair[2];
+    assert(!socketpair(PF_LOCAL, SOCK_STREAM, 0, pair));
+    B.in = pair[0];
+    B.out = pair[1];
+  }
+  tthread::thread *P = kernel ? 0 : new tthread::thread(proxy, &B);
+  tthread::thread T(produce, &B);
+  unsigned char buf[CHUNK];
+  for (size_t got = 0; got < bytes;){
+    int r = mbedtls_ssl_read(&client.ssl, buf, sizeof(buf));
+    assert(r > 0 && buf[0] == 'M');
+    got += r;
+  }
+  T.join();
+  if (P){
+    P->join();
+    delete P;
+    close(B.in);
+    close(B.out);
+  }
+  return B.cpu ? (uint64_t)bytes * 8 / B.cpu : 0;
+}
+
+int main(int argc, char **argv){
+  size_t bytes = (argc > 1 ? atoi(argv[1]) : 64) * 1024 * 1024;
+  mbedtls_entropy_init(&entropy);
+  mbedtls_ctr_drbg_init(&rng);
+  assert(!mbedtls_ctr_drbg_seed(&rng, mbedtls_entropy_func, &entropy, 0, 0));
+  mbedtls_x509_crt_init(&cert);
+  mbedtls_pk_init(&key);
+  assert(!mbedtls_x509_crt_parse(&cert, (const unsigned char *)mbedtls_test_srv_crt, mbedtls_test_srv_crt_len));
+  assert(!mbedtls_pk_parse_key(&key, (const unsigned char *)mbedtls_test_srv_key, mbedtls_test_srv_key_len, 0, 0));
+
+  checkExport(0, 16);
+  checkExport(1, 32);
+
+  // Through the kernel, if it can
+  bool kernel = false;
+  {
+    side server(true, 2), client(false, 2);
+    connectPair(server, client);
+    int ret = server.ktls.usable(&server.ssl) ? server.ktls.enable(server.sock) : 0;
+    assert(ret >= 0);
+    kernel = ret;
+    if (kernel){
+      std::string msg = "kernel to mbedtls";
+      assert(!sendAll(server.sock, (const unsigned char *)msg.data(), msg.size()));
+      assert(clientRead(client, msg.size()) == msg);
+      msg = "mbedtls to kernel";
+      assert(mbedtls_ssl_write(&client.ssl, (const unsigned char *)msg.data(), msg.size()) == (int)msg.size());
+      unsigned char buf[64];
+      assert(!recvAll(server.sock, buf, msg.size()) && !memcmp(buf, msg.data(), msg.size()));
+      std::cout << "Kernel TLS sends and receives" << std::endl;
+    }else{
+      // The session is left to mbedtls, which must keep working after the attempt
+      std::string msg = "mbedtls after refusal";
+      assert(mbedtls_ssl_write(&server.ssl, (const unsigned char *)msg.data(), msg.size()) == (int)msg.size());
+      assert(clientRead(client, msg.size()) == msg);
+      assert(mbedtls_ssl_write(&client.ssl, (const unsigned char *)msg.data(), msg.size()) == (int)msg.size());
+      unsigned char buf[64];
+      assert(mbedtls_ssl_read(&server.ssl, buf, sizeof(buf)) == (int)msg.size() && !memcmp(buf, msg.data(), msg.size()));
+      std::cout << "Kernel TLS not available, the session stays with mbedtls" << std::endl;
+    }
+  }
+
+  std::cout << "Sending " << bytes / 1024 / 1024 << " MiB with "
+            << "TLS-ECDHE-RSA-WITH-AES-128-GCM-SHA256" << std::endl;
+  {
+    side server(true, 0), client(false, 0);
+    connectPair(server, client);
+    uint64_t rate = measure(server, client, false, bytes);
+    std::cout << "Proxied through mbedtls: " << rate / 1000 << "." << rate / 100 % 10 << " Gbit/s per core" << std::endl;
+  }
+  if (kernel){
+    side server(true, 0), client(false, 0);
+    connectPair(server, client);
+    assert(server.ktls.enable(server.sock) == 1);
+    uint64_t rate = measure(server, client, true, bytes);
+    std::cout << "Kernel TLS: " << rate / 1000 << "." << rate / 100 % 10 << " Gbit/s per core" << std::endl;
+  }
+
+  mbedtls_x509_crt_free(&cert);
+  mbedtls_pk_free(&key);
+  mbedtls_ctr_drbg_free(&rng);
+  mbedtls_entropy_free(&entropy);
+  return 0;
+}
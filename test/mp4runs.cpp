@@ -0,0 +1,283 @@
+/// \file mp4runs.cpp
+/// Checks mp4TrackHeader::getRunEnd against a walk over a plain list of chunks, for random chunk
+/// layouts with several stsc entries, gaps between chunks of all sizes and chunks that go back in
+/// the file, looking up samples both in order and at random. Then writes a file laid out like an
+/// MP4 with interleaved video and audio chunks, reads every sample of it in time order once with a
+/// seek and read per sample the way MistInMP4 did before, and once through runs of chunks the way
+/// it does now. Checks both read the right data, and prints the read system calls and time taken.
+/// Usage: mp4runs [MiB of samples in the file]
+
+#include "../src/input/input_mp4.h"
+#include <cassert>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <mist/timing.h>
+#include <mist/util.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#define READ_MAX (4 * 1024 * 1024)
+#define READ_GAP (64 * 1024)
+
+/// Chunk of a track: where it starts in the file and which samples it holds
+struct chunk{
+  uint64_t offset;
+  uint64_t firstSample;
+  uint64_t samples;
+};
+
+/// A track as plain lists of chunks and sample sizes, along with the boxes describing it
+struct track{
+  std::vector<chunk> chunks;
+  std::vector<uint32_t> sizes;
+  Mist::mp4TrackHeader hdr;
+  uint64_t chunkEnd(size_t c){
+    uint64_t end = chunks[c].offset;
+    for (uint64_t s = 0; s < chunks[c].samples; ++s){end += sizes[chunks[c].firstSample + s];}
+    return end;
+  }
+  size_t chunkOf(uint64_t index){
+    size_t c = 0;
+    while (index >= chunks[c].firstSample + chunks[c].samples){++c;}
+    return c;
+  }
+  uint64_t sampleOffset(uint64_t index){
+    size_t c = chunkOf(index);
+    uint64_t pos = chunks[c].offset;
+    for (uint64_t s = chunks[c].firstSample; s < index; ++s){pos += sizes[s];}
+    return pos;
+  }
+  /// Fills the boxes of hdr from chunks and sizes, with a new stsc entry every time the amount of
+  /// samples per chunk changes, and samples the given amount of milliseconds apart
+  void makeBoxes(uint32_t sampleMs){
+    MP4::STSC stsc;
+    MP4::STCO stco;
+    MP4::STSZ stsz;
+    MP4::STTS stts;
+    stsz.setSampleSize(0);
+    size_t entries = 0;
+    for (size_t c = 0; c < chunks.size(); ++c){
+      if (!c || chunks[c].samples != chunks[c - 1].samples){
+        stsc.setSTSCEntry(MP4::STSCEntry(c + 1, chunks[c].samples, 1), entries++);
+      }
+      stco.setChunkOffset(chunks[c].offset, c);
+    }
+    for (size_t s = 0; s < sizes.size(); ++s){stsz.setEntrySize(sizes[s], s);}
+    MP4::STTSEntry delta;
+    delta.sampleCount = sizes.size();
+    delta.sampleDelta = sampleMs;
+    stts.setSTTSEntry(delta, 0);
+    hdr.stscBox.copyFrom(stsc);
+    hdr.stcoBox.copyFrom(stco);
+    hdr.stszBox.copyFrom(stsz);
+    hdr.sttsBox.copyFrom(stts);
+    hdr.timeScale = 1000;
+  }
+  /// What getRunEnd should return, found by walking the chunk list
+  uint64_t runEnd(uint64_t index, uint64_t maxGap, uint64_t maxEnd){
+    size_t c = chunkOf(index);
+    uint64_t end = chunkEnd(c);
+    if (end > maxEnd){return maxEnd;}
+    for (++c; c < chunks.size(); ++c){
+      if (chunks[c].offset < end || chunks[c].offset > end + maxGap){break;}
+      if (chunkEnd(c) > maxEnd){break;}
+      end = chunkEnd(c);
+    }
+    return end;
+  }
+};
+
+/// Lays out a track of random chunks at random distances, now and then going back in the file
+void randomTrack(track &T, size_t chunkCount){
+  uint64_t pos = 100000;
+  uint64_t perChunk = 1 + rand() % 8;
+  for (size_t c = 0; c < chunkCount; ++c){
+    if (!(rand() % 4)){perChunk = 1 + rand() % 8;}
+    chunk C;
+    C.firstSample = T.sizes.size();
+    C.samples = perChunk;
+    for (uint64_t s = 0; s < perChunk; ++s){T.sizes.push_back(1 + rand() % 5000);}
+    switch (rand() % 4){
+    case 0: C.offset = pos; break;
+    case 1: C.offset = pos + rand() % 1000; break;
+    case 2: C.offset = pos + rand() % 100000; break;
+    default: C.offset = (rand() % 3) ? pos + 70000 : pos - 50000; break;
+    }
+    T.chunks.push_back(C);
+    pos = T.chunkEnd(c);
+  }
+  T.makeBoxes(40);
+}
+
+/// Returns the amount of read system calls made by this process so far
+uint64_t readSyscalls(){
+  int fd = open("/proc/self/io", O_RDONLY);
+  if (fd == -1){return 0;}
+  char buf[512];
+  ssize_t len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0){return 0;}
+  buf[len] = 0;
+  const char *syscr = strstr(buf, "syscr: ");
+  return syscr ? strtoull(syscr + 7, 0, 10) : 0;
+}
+
+/// The byte at the given offset of the benchmark file
+char fileByte(uint64_t pos){return (char)(pos * 7 + (pos >> 12));}
+
+/// A sample to read from the benchmark file
+struct sampleRef{
+  track *T;
+  uint64_t index;
+  uint64_t bpos;
+  uint32_t size;
+};
+
+/// Checks a sample read from the benchmark file holds what was written there
+void checkSample(const char *data, uint64_t pos, uint32_t size){
+  assert(data);
+  assert(data[0] == fileByte(pos) && data[size / 2] == fileByte(pos + size / 2) &&
+         data[size - 1] == fileByte(pos + size - 1));
+}
+
+/// Reads samples from the benchmark file through runs of chunks, like inputMP4::readPart
+struct runReader{
+  int fd;
+  Util::ResizeablePointer readBuffer;
+  uint64_t readPos;
+  const char *read(track &T, uint64_t index, uint64_t bpos, uint32_t size){
+    if (bpos >= readPos && bpos + size <= readPos + readBuffer.size()){
+      return readBuffer + (bpos - readPos);
+    }
+    uint64_t readEnd = T.hdr.getRunEnd(index, READ_GAP, bpos + READ_MAX);
+    if (readEnd < bpos + size){readEnd = bpos + size;}
+    uint64_t readLen = readEnd - bpos;
+    readBuffer.size() = 0;
+    if (!readBuffer.allocate(readLen)){return 0;}
+    readPos = bpos;
+    while (readBuffer.size() < readLen){
+      ssize_t r = pread(fd, (char *)readBuffer + readBuffer.size(), readLen - readBuffer.size(),
+                        readPos + readBuffer.size());
+      if (r <= 0){break;}
+      readBuffer.size() += r;
+    }
+    return readBuffer.size() >= size ? (const char *)readBuffer : 0;
+  }
+};
+
+int main(int argc, char **argv){
+  srand(1234);
+  // getRunEnd against the chunk list, for all kinds of limits
+  for (size_t layout = 0; layout < 200; ++layout){
+    track T;
+    randomTrack(T, 1 + rand() % 60);
+    for (size_t i = 0; i < 300; ++i){
+      uint64_t index = (i < T.sizes.size()) ? i : rand() % T.sizes.size();
+      uint64_t maxGap = (rand() % 3) ? READ_GAP : rand() % 2000;
+      uint64_t maxEnd = (uint64_t)-1;
+      if (rand() % 2){
+        uint64_t start = T.sampleOffset(index);
+        maxEnd = start + 1 + rand() % (T.runEnd(index, maxGap, maxEnd) - start);
+      }
+      uint64_t expect = T.runEnd(index, maxGap, maxEnd);
+      uint64_t got = T.hdr.getRunEnd(index, maxGap, maxEnd);
+      if (got != expect){
+        std::cerr << "Layout " << layout << ", sample " << index << ": run ends at " << got
+                  << " instead of " << expect << std::endl;
+        return 1;
+      }
+    }
+  }
+  std::cout << "getRunEnd matches the chunk list for 200 random layouts" << std::endl;
+
+  // Video at 25fps in chunks of half a second, with interleaved chunks of 48kHz AAC audio
+  uint64_t fileSize = (argc > 1 ? atoi(argv[1]) : 64) * 1024 * 1024;
+  track V, A;
+  uint64_t pos = 4096;
+  while (pos < fileSize){
+    chunk C;
+    C.offset = pos;
+    C.firstSample = V.sizes.size();
+    C.samples = 12;
+    for (size_t s = 0; s < C.samples; ++s){
+      V.sizes.push_back((V.sizes.size() % 50) ? 20000 + rand() % 40000 : 150000);
+    }
+    V.chunks.push_back(C);
+    pos = V.chunkEnd(V.chunks.size() - 1);
+    C.offset = pos;
+    C.firstSample = A.sizes.size();
+    C.samples = 23;
+    for (size_t s = 0; s < C.samples; ++s){A.sizes.push_back(300 + rand() % 300);}
+    A.chunks.push_back(C);
+    pos = A.chunkEnd(A.chunks.size() - 1);
+  }
+  V.makeBoxes(40);
+  A.makeBoxes(21);
+
+  char fileName[] = "/tmp/mp4runsXXXXXX";
+  int fd = mkstemp(fileName);
+  assert(fd != -1);
+  unlink(fileName);
+  {
+    std::string block(1024 * 1024, 0);
+    for (uint64_t at = 0; at < pos; at += block.size()){
+      for (size_t i = 0; i < block.size(); ++i){block[i] = fileByte(at + i);}
+      assert(write(fd, block.data(), block.size()) == (ssize_t)block.size());
+    }
+  }
+
+  // All samples in time order, the way getNext goes through them
+  std::multimap<uint64_t, sampleRef> order;
+  track *tracks[2] ={&V, &A};
+  for (size_t t = 0; t < 2; ++t){
+    for (uint64_t i = 0; i < tracks[t]->sizes.size(); ++i){
+      uint64_t bpos, time, duration;
+      uint32_t size;
+      int32_t offset;
+      tracks[t]->hdr.getPart(i, bpos, size, time, offset, duration);
+      assert(bpos == tracks[t]->sampleOffset(i) && size == tracks[t]->sizes[i]);
+      sampleRef S ={tracks[t], i, bpos, size};
+      order.insert(std::make_pair(time, S));
+    }
+  }
+
+  // A seek and read for every sample
+  FILE *F = fdopen(dup(fd), "r");
+  assert(F);
+  std::string sample;
+  uint64_t reads = readSyscalls();
+  uint64_t start = Util::getMicros();
+  for (std::multimap<uint64_t, sampleRef>::iterator it = order.begin(); it != order.end(); ++it){
+    sampleRef &S = it->second;
+    sample.resize(S.size);
+    assert(!fseeko(F, S.bpos, SEEK_SET) && fread((char *)sample.data(), S.size, 1, F) == 1);
+    checkSample(sample.data(), S.bpos, S.size);
+  }
+  uint64_t oldTime = Util::getMicros(start);
+  uint64_t oldReads = readSyscalls() - reads - 1;
+  fclose(F);
+
+  // Runs of chunks
+  runReader R;
+  R.fd = fd;
+  R.readPos = 0;
+  reads = readSyscalls();
+  start = Util::getMicros();
+  for (std::multimap<uint64_t, sampleRef>::iterator it = order.begin(); it != order.end(); ++it){
+    sampleRef &S = it->second;
+    checkSample(R.read(*S.T, S.index, S.bpos, S.size), S.bpos, S.size);
+  }
+  uint64_t newTime = Util::getMicros(start);
+  uint64_t newReads = readSyscalls() - reads - 1;
+  close(fd);
+
+  std::cout << "Reading " << order.size() << " samples (" << pos / 1024 / 1024 << " MiB) in time order:" << std::endl;
+  std::cout << "  Seek and read per sample: " << oldReads << " reads, " << oldTime / 1000 << "ms" << std::endl;
+  std::cout << "  Runs of chunks: " << newReads << " reads, " << newTime / 1000 << "ms" << std::endl;
+  assert(newReads < oldReads);
+  return 0;
+}
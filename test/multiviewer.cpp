@@ -0,0 +1,260 @@
+/// \file multiviewer.cpp
+/// Serves the same viewers once with a process per connection (forkServer) and once from a single
+/// process (multiServer), and checks both serve every viewer the same data. Every connection maps a
+/// shared page standing in for the stream metadata and data pages, sends part of it and then stays
+/// connected, like a viewer of a live stream does. For both modes prints the memory use of all
+/// serving processes while every viewer is connected, the CPU time per viewer and the accept
+/// latency. RSS counts a shared page once for every mapping of it, PSS shows what it actually costs.
+/// Also checks a single process limited to fewer connections than there are viewers only serves the
+/// next viewer once an earlier one leaves.
+/// Pass a viewer count as argument to change the amount of concurrent viewers.
+
+#include <algorithm>
+#include <cassert>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <mist/config.h>
+#include <mist/shared_memory.h>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#define PAGE_SIZE_BENCH (4 * 1024 * 1024)
+#define SEND_SIZE (64 * 1024)
+
+static std::string pageName;
+static pid_t serverPid = 0;
+
+/// Maps the page like an output maps its stream, sends the start of it and waits for the viewer
+/// to go away.
+int viewer(Socket::Connection &S){
+  IPC::sharedPage P(pageName, PAGE_SIZE_BENCH, false, false);
+  if (!P.mapped){return 1;}
+  // Read all of it once, the way an output reads the metadata it needs
+  uint64_t sum = 0;
+  for (size_t i = 0; i < PAGE_SIZE_BENCH; i += 4096){sum += P.mapped[i];}
+  if (sum != PAGE_SIZE_BENCH / 4096 * 'M'){return 1;}
+  S.SendNow(P.mapped, SEND_SIZE);
+  while (S && Util::Config::is_active){
+    if (!S.spool()){Util::sleep(20);}
+  }
+  return 0;
+}
+
+/// Returns the pid of the server followed by those of its child processes
+std::vector<pid_t> serverPids(){
+  std::vector<pid_t> pids;
+  pids.push_back(serverPid);
+  DIR *D = opendir("/proc");
+  if (!D){return pids;}
+  struct dirent *E;
+  while ((E = readdir(D))){
+    char path[64];
+    snprintf(path, 64, "/proc/%s/stat", E->d_name);
+    std::ifstream F(path);
+    std::string stat;
+    if (!std::getline(F, stat) || stat.rfind(')') == std::string::npos){continue;}
+    // The parent pid comes after the process name and state
+    if (atoi(stat.c_str() + stat.rfind(')') + 4) == serverPid){pids.push_back(atoi(E->d_name));}
+  }
+  closedir(D);
+  return pids;
+}
+
+/// Sums a field (in kB) of a /proc status-like file over the server and all its child processes
+uint64_t procSum(const std::string &file, const std::string &field){
+  std::vector<pid_t> pids = serverPids();
+  uint64_t total = 0;
+  for (size_t i = 0; i < pids.size(); ++i){
+    char path[64];
+    snprintf(path, 64, "/proc/%d/%s", (int)pids[i], file.c_str());
+    std::ifstream F(path);
+    std::string line;
+    while (std::getline(F, line)){
+      if (line.compare(0, field.size(), field)){continue;}
+      total += strtoull(line.c_str() + field.size(), 0, 10);
+    }
+  }
+  return total;
+}
+
+struct result{
+  uint64_t rss;     ///< Resident memory of all serving processes together, in kB
+  uint64_t pss;     ///< Proportional memory of all serving processes together, in kB
+  uint64_t cpu;     ///< User and system CPU time of all serving processes together, in us
+  uint64_t median;  ///< Median time from connect() to the first data, in us
+  uint64_t p90;     ///< 90th percentile time from connect() to the first data, in us
+  size_t processes; ///< Amount of serving processes
+};
+
+/// Connects to the server on the given port of localhost
+int connectViewer(uint32_t port){
+  sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  assert(s >= 0);
+  assert(!connect(s, (sockaddr *)&sa, sizeof(sa)));
+  return s;
+}
+
+/// Receives the data a viewer gets sent, returns the time from start until the first of it arrived
+/// in us
+uint64_t receiveViewer(int s, uint64_t start){
+  uint64_t latency = 0;
+  char buf[SEND_SIZE];
+  size_t got = 0;
+  while (got < SEND_SIZE){
+    ssize_t r = recv(s, buf + got, SEND_SIZE - got, 0);
+    assert(r > 0);
+    if (!got){latency = Util::getMicros(start);}
+    got += r;
+  }
+  assert(buf[0] == 'M' && buf[SEND_SIZE - 1] == 'M');
+  return latency;
+}
+
+/// Opens a listening socket on a free port of localhost
+Socket::Server listenLocal(uint32_t &port){
+  Socket::Server server(0, std::string("127.0.0.1"));
+  assert(server.connected());
+  std::string host;
+  assert(Socket::getSocketName(server.getSocket(), host, port) && port);
+  return server;
+}
+
+/// Serves viewers count connections through forked or multi-viewer mode, reports the result
+result serve(bool multi, size_t viewers){
+  uint32_t port = 0;
+  Socket::Server server = listenLocal(port);
+  int usage[2];
+  assert(!pipe(usage));
+  serverPid = fork();
+  if (!serverPid){
+    close(usage[0]);
+    pid_t self = getpid();
+    Util::Config conf("multiviewertest");
+    conf.activate();
+    if (multi){
+      conf.multiServer(server, viewer, viewers);
+    }else{
+      int r = conf.forkServer(server, viewer);
+      if (getpid() != self){_exit(r);}
+    }
+    while (waitpid(-1, 0, 0) > 0){}
+    struct rusage self_ru, child_ru;
+    getrusage(RUSAGE_SELF, &self_ru);
+    getrusage(RUSAGE_CHILDREN, &child_ru);
+    uint64_t cpu = (self_ru.ru_utime.tv_sec + self_ru.ru_stime.tv_sec + child_ru.ru_utime.tv_sec +
+                    child_ru.ru_stime.tv_sec) *
+                       1000000 +
+                   self_ru.ru_utime.tv_usec + self_ru.ru_stime.tv_usec + child_ru.ru_utime.tv_usec +
+                   child_ru.ru_stime.tv_usec;
+    if (write(usage[1], &cpu, sizeof(cpu)) != sizeof(cpu)){_exit(1);}
+    _exit(0);
+  }
+  close(usage[1]);
+  server.drop();
+
+  std::vector<int> socks;
+  std::vector<uint64_t> latency;
+  for (size_t i = 0; i < viewers; ++i){
+    uint64_t start = Util::getMicros();
+    int s = connectViewer(port);
+    latency.push_back(receiveViewer(s, start));
+    socks.push_back(s);
+  }
+  // Give the last viewers time to settle into their waiting loop
+  Util::sleep(500);
+  result R;
+  R.rss = procSum("status", "VmRSS:");
+  R.pss = procSum("smaps_rollup", "Pss:");
+  R.processes = serverPids().size();
+  for (size_t i = 0; i < socks.size(); ++i){close(socks[i]);}
+  Util::sleep(200);
+  kill(serverPid, SIGTERM);
+  uint64_t cpu = 0;
+  assert(read(usage[0], &cpu, sizeof(cpu)) == sizeof(cpu));
+  close(usage[0]);
+  int status;
+  assert(waitpid(serverPid, &status, 0) == serverPid && WIFEXITED(status) && !WEXITSTATUS(status));
+  R.cpu = cpu;
+  std::sort(latency.begin(), latency.end());
+  R.median = latency[latency.size() / 2];
+  R.p90 = latency[latency.size() * 9 / 10];
+  return R;
+}
+
+/// Serves more viewers than a single process is limited to, and checks the one past the limit is
+/// only served once an earlier viewer leaves
+void checkLimit(size_t limit){
+  uint32_t port = 0;
+  Socket::Server server = listenLocal(port);
+  pid_t child = fork();
+  if (!child){
+    Util::Config conf("multiviewertest");
+    conf.activate();
+    _exit(conf.multiServer(server, viewer, limit));
+  }
+  server.drop();
+  std::vector<int> socks;
+  for (size_t i = 0; i < limit; ++i){
+    socks.push_back(connectViewer(port));
+    receiveViewer(socks.back(), Util::getMicros());
+  }
+  // The connection is made, but nothing serves it yet
+  int waiting = connectViewer(port);
+  struct pollfd pfd;
+  pfd.fd = waiting;
+  pfd.events = POLLIN;
+  assert(poll(&pfd, 1, 500) == 0);
+  uint64_t start = Util::getMicros();
+  close(socks[0]);
+  uint64_t latency = receiveViewer(waiting, start);
+  close(waiting);
+  for (size_t i = 1; i < socks.size(); ++i){close(socks[i]);}
+  Util::sleep(200);
+  kill(child, SIGTERM);
+  int status;
+  assert(waitpid(child, &status, 0) == child && WIFEXITED(status) && !WEXITSTATUS(status));
+  std::cout << "Limited to " << limit << " connections: the next viewer was served " << latency / 1000
+            << "ms after an earlier one left" << std::endl;
+}
+
+void print(const char *mode, const result &R, size_t viewers){
+  std::cout << mode << ": " << R.processes << " processes, RSS " << R.rss / 1024 << " MiB ("
+            << R.rss / viewers << " kB per viewer), PSS " << R.pss / 1024 << " MiB (" << R.pss / viewers
+            << " kB per viewer), CPU " << R.cpu / viewers << "us per viewer, accept latency median "
+            << R.median << "us p90 " << R.p90 << "us" << std::endl;
+}
+
+int main(int argc, char **argv){
+  size_t viewers = (argc > 1 ? atoi(argv[1]) : 200);
+  char name[64];
+  snprintf(name, 64, "MstMultiTest%d", (int)getpid());
+  pageName = name;
+  IPC::sharedPage P(pageName, PAGE_SIZE_BENCH, true, false);
+  assert(P.mapped);
+  memset(P.mapped, 'M', PAGE_SIZE_BENCH);
+
+  checkLimit(4);
+  result forked = serve(false, viewers);
+  result multi = serve(true, viewers);
+  std::cout << viewers << " concurrent viewers" << std::endl;
+  print("Forked", forked, viewers);
+  print("Multi-viewer", multi, viewers);
+  assert(forked.processes == viewers + 1);
+  assert(multi.processes == 1);
+  return 0;
+}
@@ -0,0 +1,147 @@
+/// \file packetfields.cpp
+/// Checks that the DTSC::Packet accessors find the same members as a DTSC::Scan of the packet does,
+/// for generated packets with all combinations of members, a packet from JSON with extra members,
+/// and packets changed after creation. Then prints the time per packet of the accessors a few
+/// outputs call for every packet, through a Scan of the packet and through the accessors.
+/// Pass a packet count as argument to change the amount of packets timed.
+
+#include <cassert>
+#include <deque>
+#include <iostream>
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *names[] ={"data", "offset", "keyframe", "bpos", "time", "trackid", "disposableframe", "nope", "d", 0};
+
+/// Asserts all accessors of P agree with a Scan of P
+void checkPacket(const DTSC::Packet &P){
+  DTSC::Scan S = P.getScan();
+  for (size_t n = 0; names[n]; ++n){
+    DTSC::Scan M = S.getMember(names[n]);
+    char *str, *oldStr;
+    size_t len, oldLen;
+    P.getString(names[n], str, len);
+    M.getString(oldStr, oldLen);
+    assert(str == oldStr && len == oldLen);
+    std::string s;
+    P.getString(names[n], s);
+    assert(s == M.asString());
+    assert(P.getInt(names[n]) == (uint64_t)M.asInt());
+    assert(P.getFlag(names[n]) == (bool)M.asInt());
+    assert(P.hasMember(names[n]) == (M.getType() > 0));
+  }
+}
+
+/// The members an output or input asks for, per packet
+struct output{
+  const char *name;
+  const char *fields[7]; ///< Members read as string first, then as int, as often as they are read
+  size_t strings;        ///< How many of fields are strings
+};
+
+int main(int argc, char **argv){
+  srand(42);
+  // Generated packets with every combination of members
+  for (size_t i = 0; i < 64; ++i){
+    std::string payload(1 + rand() % 300, 'x');
+    DTSC::Packet P;
+    P.genericFill(rand(), (i & 1) ? rand() - RAND_MAX / 2 : 0, i, payload.data(), payload.size(),
+                  (i & 2) ? rand() : 0, i & 4);
+    checkPacket(P);
+    DTSC::Packet R(P.getData(), P.getDataLen(), true);
+    checkPacket(R);
+    DTSC::Packet C(P);
+    checkPacket(C);
+    // Changes after the members were looked up
+    if (i & 4){P.setKeyFrame(false);}
+    checkPacket(P);
+    P.appendData("abc", 3);
+    checkPacket(P);
+    P.appendNal("defg", 4);
+    checkPacket(P);
+    P.upgradeNal("hi", 2);
+    checkPacket(P);
+    P.nullMember("offset");
+    checkPacket(P);
+    P.nullMember("data");
+    checkPacket(P);
+    P.null();
+    checkPacket(P);
+    P.reInit(R.getData(), R.getDataLen());
+    checkPacket(P);
+  }
+  // Packets from JSON, with other members and the members in a different order
+  JSON::Value J;
+  J["time"] = 1234;
+  J["trackid"] = 2;
+  J["keyframe"] = 1;
+  J["disposableframe"] = 1;
+  J["offset"] = 42;
+  J["bpos"] = 99;
+  J["data"] = "payload";
+  std::string packed = J.toNetPacked();
+  DTSC::Packet J2(packed.data(), packed.size());
+  checkPacket(J2);
+  assert(J2.getTime() == 1234 && J2.getTrackId() == 2 && J2.getInt("offset") == 42);
+  assert(J2.getFlag("keyframe") && J2.getInt("bpos") == 99);
+
+  // The accessors outputs use for every packet, on packets of a live H264+AAC stream
+  output outputs[] ={{"TS", {"data", "keyframe", "offset"}, 1},
+                     {"MP4", {"data", "offset", "offset", "keyframe", "keyframe"}, 1},
+                     {"RTMP", {"data", "offset", "keyframe", "disposableframe"}, 1},
+                     {"Input", {"data", "keyframe", "offset", "offset", "bpos", "keyframe"}, 1}};
+  std::deque<std::string> packets;
+  for (size_t i = 0; i < 64; ++i){
+    std::string payload(i % 2 ? 400 : 20000, 'x');
+    DTSC::Packet P;
+    P.genericFill(i * 20, (i % 2) ? 0 : 40, 1 + i % 2, payload.data(), payload.size(), i * 1000, !(i % 32));
+    packets.push_back(std::string(P.getData(), P.getDataLen()));
+  }
+  size_t loops = (argc > 1 ? atoi(argv[1]) : 1000000);
+  for (size_t o = 0; o < sizeof(outputs) / sizeof(output); ++o){
+    const output &O = outputs[o];
+    size_t fieldCount = 0;
+    while (fieldCount < 7 && O.fields[fieldCount]){++fieldCount;}
+    DTSC::Packet P;
+    uint64_t sum = 0;
+    uint64_t start = Util::getMicros();
+    for (size_t i = 0; i < loops; ++i){
+      const std::string &pkt = packets[i % packets.size()];
+      P.reInit(pkt.data(), pkt.size(), true);
+      DTSC::Scan S = P.getScan();
+      for (size_t f = 0; f < fieldCount; ++f){
+        if (f < O.strings){
+          char *str;
+          size_t len;
+          S.getMember(O.fields[f]).getString(str, len);
+          sum += len;
+        }else{
+          sum += S.getMember(O.fields[f]).asInt();
+        }
+      }
+    }
+    uint64_t oldTime = Util::getMicros(start);
+    start = Util::getMicros();
+    for (size_t i = 0; i < loops; ++i){
+      const std::string &pkt = packets[i % packets.size()];
+      P.reInit(pkt.data(), pkt.size(), true);
+      for (size_t f = 0; f < fieldCount; ++f){
+        if (f < O.strings){
+          char *str;
+          size_t len;
+          P.getString(O.fields[f], str, len);
+          sum -= len;
+        }else{
+          sum -= P.getInt(O.fields[f]);
+        }
+      }
+    }
+    uint64_t newTime = Util::getMicros(start);
+    assert(!sum);
+    std::cout << O.name << " (" << fieldCount << " lookups): scanning " << oldTime * 1000 / loops
+              << "ns, indexed " << newTime * 1000 / loops << "ns per packet" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,149 @@
+/// \file packetsorter.cpp
+/// Tests Util::packetSorter against a plain std::set, and benchmarks both with 1 to 128 tracks.
+/// Checks duplicates that come in through insert and through replaceFirst are only played once.
+
+#include <cassert>
+#include <iostream>
+#include <mist/stream.h>
+#include <mist/timing.h>
+#include <set>
+#include <stdlib.h>
+
+Util::sortedPageInfo makeInfo(size_t tid, uint64_t time){
+  Util::sortedPageInfo ret;
+  ret.tid = tid;
+  ret.time = time;
+  ret.offset = time * 3;
+  ret.partIndex = time / 2;
+  return ret;
+}
+
+/// Runs random inserts, replaces and drops on both the sorter and a reference set.
+void checkAgainstSet(size_t trackCount){
+  Util::packetSorter sorter;
+  std::set<Util::sortedPageInfo> ref;
+  uint64_t times[128];
+  for (size_t i = 0; i < trackCount; ++i){
+    times[i] = rand() % 1000;
+    sorter.insert(makeInfo(i, times[i]));
+    ref.insert(makeInfo(i, times[i]));
+  }
+  for (size_t n = 0; n < 20000; ++n){
+    assert(sorter.size() == ref.size());
+    if (!ref.size()){break;}
+    const Util::sortedPageInfo *first = sorter.begin();
+    assert(first->tid == ref.begin()->tid && first->time == ref.begin()->time);
+    assert(first->offset == ref.begin()->offset);
+    size_t tid = first->tid;
+    if (rand() % 50 == 0){
+      // Drop a random track that is still present
+      size_t drop = rand() % trackCount;
+      if (!sorter.hasEntry(drop)){continue;}
+      sorter.dropTrack(drop);
+      for (std::set<Util::sortedPageInfo>::iterator it = ref.begin(); it != ref.end(); ++it){
+        if (it->tid == drop){
+          ref.erase(it);
+          break;
+        }
+      }
+      assert(!sorter.hasEntry(drop));
+      continue;
+    }
+    times[tid] += rand() % 40;
+    sorter.replaceFirst(makeInfo(tid, times[tid]));
+    ref.erase(ref.begin());
+    ref.insert(makeInfo(tid, times[tid]));
+  }
+  std::set<size_t> tids;
+  sorter.getTrackList(tids);
+  assert(tids.size() == ref.size());
+
+  // Switching to async (deque) mode must keep playback order
+  sorter.setSyncMode(false);
+  for (std::set<Util::sortedPageInfo>::iterator it = ref.begin(); it != ref.end(); ++it){
+    assert(sorter.begin()->tid == it->tid);
+    sorter.moveFirstToEnd();
+  }
+}
+
+/// Checks the first packet of the sorter matches the reference, then removes it from both.
+void popFirst(Util::packetSorter &sorter, std::set<Util::sortedPageInfo> &ref){
+  assert(ref.size() && sorter.size());
+  assert(sorter.begin()->tid == ref.begin()->tid && sorter.begin()->time == ref.begin()->time);
+  sorter.dropTrack(sorter.begin()->tid);
+  ref.erase(ref.begin());
+}
+
+/// Feeds the sorter duplicates through both insert and replaceFirst, and checks every packet
+/// comes out once, in the order of a set, in sync mode as well as after switching to async mode.
+void checkDuplicates(bool switchMode){
+  Util::packetSorter sorter;
+  std::set<Util::sortedPageInfo> ref;
+  for (size_t i = 0; i < 6; ++i){
+    sorter.insert(makeInfo(i, 10 * (i + 1)));
+    ref.insert(makeInfo(i, 10 * (i + 1)));
+  }
+  // The same packet again, through insert: twice for a later packet, once for the first one
+  sorter.insert(makeInfo(2, 30));
+  sorter.insert(makeInfo(2, 30));
+  sorter.insert(makeInfo(0, 10));
+  assert(sorter.begin()->tid == 0 && sorter.begin()->time == 10);
+  // The first packet replaced by one that is already waiting further on
+  sorter.replaceFirst(makeInfo(3, 40));
+  ref.erase(ref.begin());
+  // And by one that becomes the new first packet while a copy of it is in the sorter
+  sorter.insert(makeInfo(4, 25));
+  ref.insert(makeInfo(4, 25));
+  sorter.replaceFirst(makeInfo(4, 25));
+  ref.erase(ref.begin());
+  assert(sorter.begin()->tid == 4 && sorter.begin()->time == 25);
+  if (switchMode){
+    sorter.setSyncMode(false);
+    assert(sorter.size() == ref.size());
+    for (std::set<Util::sortedPageInfo>::iterator it = ref.begin(); it != ref.end(); ++it){
+      assert(sorter.begin()->tid == it->tid && sorter.begin()->time == it->time);
+      sorter.moveFirstToEnd();
+    }
+    return;
+  }
+  while (ref.size()){popFirst(sorter, ref);}
+  assert(!sorter.size());
+}
+
+void benchmark(size_t trackCount){
+  size_t loops = 200000;
+  Util::packetSorter sorter;
+  std::set<Util::sortedPageInfo> ref;
+  for (size_t i = 0; i < trackCount; ++i){
+    sorter.insert(makeInfo(i, i));
+    ref.insert(makeInfo(i, i));
+  }
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    Util::sortedPageInfo nxt = *ref.begin();
+    nxt.time += 33 + nxt.tid % 7;
+    ref.erase(ref.begin());
+    ref.insert(nxt);
+  }
+  uint64_t setTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    Util::sortedPageInfo nxt = *sorter.begin();
+    nxt.time += 33 + nxt.tid % 7;
+    sorter.replaceFirst(nxt);
+  }
+  uint64_t heapTime = Util::getMicros(start);
+  assert(sorter.begin()->tid == ref.begin()->tid && sorter.begin()->time == ref.begin()->time);
+  std::cout << trackCount << " tracks: std::set " << (setTime * 1000 / loops) << "ns, packetSorter "
+            << (heapTime * 1000 / loops) << "ns per replaceFirst" << std::endl;
+}
+
+int main(int argc, char **argv){
+  srand(1234);
+  size_t counts[] ={1, 2, 3, 8, 17, 64, 128};
+  for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i){checkAgainstSet(counts[i]);}
+  checkDuplicates(false);
+  checkDuplicates(true);
+  for (size_t i = 1; i <= 128; i *= 2){benchmark(i);}
+  return 0;
+}
@@ -0,0 +1,126 @@
+/// \file pages.cpp
+/// Checks the binary search page lookups of DTSC::Meta against the linear scans they replaced, on a
+/// track with 10k pages of which only some are available, before and after deleting pages from the
+/// front. Then prints the seek latency of both.
+/// Pass a page count as argument to change the amount of pages used.
+
+#include <cassert>
+#include <iostream>
+#include <mist/defines.h>
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/// The linear scan Meta::getPageNumberForTime used before
+size_t linearPageForTime(const DTSC::Meta &M, size_t idx, uint64_t time){
+  const Util::RelAccX &pages = M.pages(idx);
+  uint64_t res = pages.getDeleted();
+  for (uint64_t i = res; i < pages.getEndPos(); ++i){
+    if (pages.getInt("avail", i) == 0){continue;}
+    if (pages.getInt("firsttime", i) > time){break;}
+    res = i;
+  }
+  return pages.getInt("firstkey", res);
+}
+
+/// The linear scan Meta::getPageNumberForKey used before
+size_t linearPageForKey(const DTSC::Meta &M, size_t idx, uint64_t keyNum){
+  const Util::RelAccX &pages = M.pages(idx);
+  uint64_t res = pages.getDeleted();
+  for (uint64_t i = res; i < pages.getEndPos(); ++i){
+    if (pages.getInt("avail", i) == 0){continue;}
+    if (pages.getInt("firstkey", i) > keyNum){break;}
+    res = i;
+  }
+  return pages.getInt("firstkey", res);
+}
+
+/// The linear scan used by bufferFrame and friends to find the page a key is on
+uint64_t linearIndexForKey(const DTSC::Meta &M, size_t idx, uint64_t keyNum){
+  const Util::RelAccX &pages = M.pages(idx);
+  uint64_t res = INVALID_RECORD_INDEX;
+  for (uint64_t i = pages.getDeleted(); i < pages.getEndPos(); ++i){
+    if (pages.getInt("firstkey", i) > keyNum){break;}
+    res = i;
+  }
+  return res;
+}
+
+/// Compares all lookups for the first and last keys and a spread of keys and times in between,
+/// including ones outside the track
+void checkAll(const DTSC::Meta &M, size_t idx, uint64_t lastKey, uint64_t lastTime){
+  const Util::RelAccX &pages = M.pages(idx);
+  for (uint64_t key = 0; key <= lastKey + 2; key += (key < 200 || key + 200 > lastKey ? 1 : 1 + rand() % 50)){
+    assert(M.getPageNumberForKey(idx, key) == linearPageForKey(M, idx, key));
+    uint64_t i = linearIndexForKey(M, idx, key);
+    assert(M.getPageIndexForKey(idx, key) == i);
+    if (i != INVALID_RECORD_INDEX && pages.getInt("firstkey", i) == key){
+      assert(M.getPageIndex(idx, key) == i);
+    }else{
+      assert(M.getPageIndex(idx, key) == INVALID_RECORD_INDEX);
+    }
+  }
+  for (uint64_t time = 0; time <= lastTime + 5000; time += 1000 + rand() % 100000){
+    assert(M.getPageNumberForTime(idx, time) == linearPageForTime(M, idx, time));
+  }
+}
+
+int main(int argc, char **argv){
+  size_t pageCount = (argc > 1 ? atoi(argv[1]) : 10000);
+  char streamName[64];
+  snprintf(streamName, 64, "pages_test_%d", (int)getpid());
+  DTSC::Meta M(streamName, true);
+  size_t idx = M.addTrack(DEFAULT_FRAGMENT_COUNT, DEFAULT_KEY_COUNT, DEFAULT_PART_COUNT, pageCount);
+  M.setType(idx, "video");
+
+  // Pages of 1 to 5 keys of 2 seconds each, starting at key 10 and time 5000, with every third
+  // page (and a run of pages near the start) not available
+  Util::RelAccX &pages = M.pages(idx);
+  srand(42);
+  uint64_t key = 10;
+  for (size_t i = 0; i < pageCount; ++i){
+    uint64_t keys = 1 + rand() % 5;
+    pages.addRecords(1);
+    pages.setInt("firstkey", key, i);
+    pages.setInt("keycount", keys, i);
+    pages.setInt("firsttime", 5000 + key * 2000, i);
+    pages.setInt("lastkeytime", 5000 + (key + keys - 1) * 2000, i);
+    pages.setInt("avail", (i % 3 && (i < 5 || i > 20)) ? 1 : 0, i);
+    key += keys;
+  }
+  uint64_t lastKey = key - 1;
+  uint64_t lastTime = 5000 + lastKey * 2000;
+  checkAll(M, idx, lastKey, lastTime);
+
+  // Live streams delete pages from the front
+  pages.deleteRecords(pageCount / 10);
+  checkAll(M, idx, lastKey, lastTime);
+
+  // Seek latency: random keys and times, as viewers seeking around would
+  size_t loops = 1000;
+  std::vector<uint64_t> seekKeys, seekTimes;
+  for (size_t i = 0; i < loops; ++i){
+    seekKeys.push_back(rand() % (lastKey + 1));
+    seekTimes.push_back(rand() % (lastTime + 1));
+  }
+  uint64_t sum = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    sum += linearPageForKey(M, idx, seekKeys[i]) + linearPageForTime(M, idx, seekTimes[i]);
+  }
+  uint64_t linearTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    sum -= M.getPageNumberForKey(idx, seekKeys[i]) + M.getPageNumberForTime(idx, seekTimes[i]);
+  }
+  uint64_t indexedTime = Util::getMicros(start);
+  assert(!sum);
+  std::cout << pageCount << " pages: linear scan " << (linearTime * 1000 / (loops * 2))
+            << "ns, binary search " << (indexedTime * 1000 / (loops * 2)) << "ns per seek" << std::endl;
+  // There are no actual data pages to remove along with the track
+  for (uint64_t i = pages.getDeleted(); i < pages.getEndPos(); ++i){pages.setInt("avail", 0, i);}
+  M.clear();
+  return 0;
+}
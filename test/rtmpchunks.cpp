@@ -0,0 +1,282 @@
+/// \file rtmpchunks.cpp
+/// Checks that RTMPStream::ChunkWriter writes the exact same bytes as RTMPStream::Chunk::Pack and
+/// as the chunking OutRTMP::sendNext did before, for messages of all sizes around the chunk size,
+/// with and without extended timestamps, with and without send batching. Then prints the system
+/// calls per MB and the throughput per core of sending media messages over a TCP connection both
+/// ways, for a few chunk and frame sizes.
+/// Pass an amount of MiB as argument to change the amount of data sent per run.
+
+#include <cassert>
+#include <iostream>
+#include <mist/rtmpchunks.h>
+#include <mist/timing.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static uint64_t syscalls = 0;
+
+// Count the system calls that sending makes, passing them on to the kernel
+extern "C"{
+  ssize_t send(int fd, const void *buf, size_t len, int flags){
+    ++syscalls;
+    return syscall(SYS_sendto, fd, buf, len, flags, 0, 0);
+  }
+  ssize_t sendmsg(int fd, const struct msghdr *msg, int flags){
+    ++syscalls;
+    return syscall(SYS_sendmsg, fd, msg, flags);
+  }
+  ssize_t writev(int fd, const struct iovec *iov, int cnt){
+    ++syscalls;
+    return syscall(SYS_writev, fd, iov, cnt);
+  }
+}
+
+/// Returns the user plus system CPU time used by this process so far, in microseconds.
+uint64_t cpuMicros(){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec +
+         usage.ru_stime.tv_usec;
+}
+
+/// FNV-1a over everything sent or received
+uint64_t hashData(uint64_t h, const char *data, size_t len){
+  for (size_t i = 0; i < len; ++i){h = (h ^ (unsigned char)data[i]) * 1099511628211ull;}
+  return h;
+}
+
+/// The chunking of OutRTMP::sendNext from before: the header, then the data header and media data
+/// interleaved with continuation headers, all through separate SendNow calls
+void oldSend(Socket::Connection &C, char *rtmpheader, size_t header_len, uint64_t timestamp,
+             const char *dataheader, size_t dheader_len, const char *tmpData, size_t data_len){
+  C.SendNow(rtmpheader, header_len);
+  rtmpheader[0] = 0xC4;
+  if (timestamp >= 0x00ffffff){
+    rtmpheader[1] = (timestamp >> 24) & 0xff;
+    rtmpheader[2] = (timestamp >> 16) & 0xff;
+    rtmpheader[3] = (timestamp >> 8) & 0xff;
+    rtmpheader[4] = timestamp & 0xff;
+  }
+  size_t len_sent = 0;
+  while (len_sent < data_len){
+    size_t to_send = std::min(data_len - len_sent, RTMPStream::chunk_snd_max);
+    if (!len_sent){
+      C.SendNow(dataheader, dheader_len);
+      to_send -= dheader_len;
+      len_sent += dheader_len;
+    }
+    C.SendNow(tmpData + len_sent - dheader_len, to_send);
+    len_sent += to_send;
+    if (len_sent < data_len){C.SendNow(rtmpheader, (timestamp >= 0x00ffffff) ? 5 : 1);}
+  }
+}
+
+/// The same message through a ChunkWriter
+void newSend(Socket::Connection &C, const char *rtmpheader, size_t header_len, uint64_t timestamp,
+             const char *dataheader, size_t dheader_len, const char *tmpData, size_t data_len){
+  char contheader[] ={(char)0xC4, 0, 0, 0, 0};
+  if (timestamp >= 0x00ffffff){
+    contheader[1] = (timestamp >> 24) & 0xff;
+    contheader[2] = (timestamp >> 16) & 0xff;
+    contheader[3] = (timestamp >> 8) & 0xff;
+    contheader[4] = timestamp & 0xff;
+  }
+  static RTMPStream::ChunkWriter chunks;
+  chunks.start(rtmpheader, header_len, contheader, (timestamp >= 0x00ffffff) ? 5 : 1);
+  chunks.append(dataheader, dheader_len);
+  chunks.append(tmpData, data_len - dheader_len);
+  chunks.send(C);
+}
+
+/// Writes the header of a full (type 0) chunk on chunk stream 4 into rtmpheader, returns its length
+size_t makeHeader(char *rtmpheader, uint64_t timestamp, size_t data_len, char msg_type_id){
+  size_t header_len = 12;
+  rtmpheader[0] = 4;
+  rtmpheader[4] = (data_len >> 16) & 0xff;
+  rtmpheader[5] = (data_len >> 8) & 0xff;
+  rtmpheader[6] = data_len & 0xff;
+  rtmpheader[7] = msg_type_id;
+  rtmpheader[8] = 1;
+  rtmpheader[9] = rtmpheader[10] = rtmpheader[11] = 0;
+  if (timestamp >= 0x00ffffff){
+    rtmpheader[1] = rtmpheader[2] = rtmpheader[3] = 0xff;
+    rtmpheader[header_len++] = (timestamp >> 24) & 0xff;
+    rtmpheader[header_len++] = (timestamp >> 16) & 0xff;
+    rtmpheader[header_len++] = (timestamp >> 8) & 0xff;
+    rtmpheader[header_len++] = timestamp & 0xff;
+  }else{
+    rtmpheader[1] = (timestamp >> 16) & 0xff;
+    rtmpheader[2] = (timestamp >> 8) & 0xff;
+    rtmpheader[3] = timestamp & 0xff;
+  }
+  return header_len;
+}
+
+/// Returns everything written to a Connection on the file fd, and empties the file
+std::string written(Socket::Connection &C, int fd){
+  C.flushSendBatch();
+  std::string res((size_t)lseek(fd, 0, SEEK_CUR), 0);
+  if (res.size()){assert(pread(fd, &res[0], res.size(), 0) == (ssize_t)res.size());}
+  lseek(fd, 0, SEEK_SET);
+  assert(!ftruncate(fd, 0));
+  return res;
+}
+
+/// Sends bytes of media in frames of frameSize bytes to a reading child process and checks what
+/// arrives. If report is set, prints the system calls per MB and the throughput per core.
+void run(size_t chunkSize, size_t bytes, size_t frameSize, bool writer, bool report){
+  int lsock = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(!bind(lsock, (struct sockaddr *)&addr, sizeof(addr)));
+  socklen_t addrLen = sizeof(addr);
+  assert(!getsockname(lsock, (struct sockaddr *)&addr, &addrLen));
+  assert(!listen(lsock, 1));
+  int hashPipe[2];
+  assert(!pipe(hashPipe));
+  pid_t child = fork();
+  if (!child){
+    // Reader: hash everything until the connection closes, then report hash and size
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    assert(!connect(s, (struct sockaddr *)&addr, sizeof(addr)));
+    uint64_t res[2] ={14695981039346656037ull, 0};
+    char buf[65536];
+    ssize_t r;
+    while ((r = read(s, buf, sizeof(buf))) > 0){
+      res[0] = hashData(res[0], buf, r);
+      res[1] += r;
+    }
+    assert(write(hashPipe[1], res, sizeof(res)) == sizeof(res));
+    _exit(0);
+  }
+  int s = accept(lsock, 0, 0);
+  ::close(lsock);
+  Socket::Connection C(s);
+  C.setBlocking(false);
+  RTMPStream::chunk_snd_max = chunkSize;
+  std::string frameData(frameSize, 0);
+  for (size_t i = 0; i < frameSize; ++i){frameData[i] = rand();}
+  const char dataheader[] ={0x17, 1, 0, 0, 0};
+  uint64_t startCalls = syscalls;
+  uint64_t startCpu = cpuMicros();
+  for (size_t sent = 0, ts = 0; sent < bytes; sent += frameSize, ts += 40){
+    // Sends every packet in a send batch, like Output does around sendNext
+    C.beginSendBatch();
+    char rtmpheader[16];
+    size_t header_len = makeHeader(rtmpheader, ts, frameSize + 5, 9);
+    if (writer){
+      newSend(C, rtmpheader, header_len, ts, dataheader, 5, frameData.data(), frameSize + 5);
+    }else{
+      oldSend(C, rtmpheader, header_len, ts, dataheader, 5, frameData.data(), frameSize + 5);
+    }
+    C.endSendBatch();
+  }
+  uint64_t cpu = cpuMicros() - startCpu + 1;
+  // What should have arrived: headers, data header and payload, with continuation headers
+  uint64_t h = 14695981039346656037ull;
+  for (size_t sent = 0, ts = 0; sent < bytes; sent += frameSize, ts += 40){
+    char rtmpheader[16];
+    h = hashData(h, rtmpheader, makeHeader(rtmpheader, ts, frameSize + 5, 9));
+    h = hashData(h, dataheader, 5);
+    for (size_t i = 0; i < frameSize; ++i){
+      if (i + 5 >= chunkSize && !((i + 5) % chunkSize)){h = hashData(h, "\304", 1);}
+      h = hashData(h, frameData.data() + i, 1);
+    }
+  }
+  uint64_t calls = syscalls - startCalls;
+  uint64_t total = C.dataUp();
+  C.close();
+  uint64_t res[2];
+  assert(read(hashPipe[0], res, sizeof(res)) == sizeof(res));
+  waitpid(child, 0, 0);
+  ::close(hashPipe[0]);
+  ::close(hashPipe[1]);
+  assert(res[1] == total);
+  assert(res[0] == h);
+  if (report){
+    std::cout << "Chunks of " << chunkSize << ", frames of " << frameSize
+              << (writer ? " bytes, ChunkWriter: " : " bytes, SendNow per piece: ")
+              << (double)calls * 1048576 / total << " system calls per MB, " << (double)total / cpu
+              << " MB/s per core" << std::endl;
+  }
+}
+
+int main(int argc, char **argv){
+  srand(42);
+  FILE *f = tmpfile();
+  int fd = fileno(f);
+  Socket::Connection C(fd, fd);
+  size_t chunkSizes[] ={128, 1000, 4096, 65536};
+  size_t msgSizes[] ={1, 2, 5, 6, 7, 8, 127, 128, 129, 255, 256, 257, 4095, 4096, 4097, 65535, 65536, 65537, 200000};
+  uint64_t stamps[] ={0, 1000, 0xfffffe, 0xffffff, 0x1000000, 0xffffffffull};
+  std::string payload(200000, 0);
+  for (size_t i = 0; i < payload.size(); ++i){payload[i] = rand();}
+  size_t checked = 0;
+  for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(size_t); ++c){
+    RTMPStream::chunk_snd_max = chunkSizes[c];
+    for (size_t m = 0; m < sizeof(msgSizes) / sizeof(size_t); ++m){
+      size_t len = msgSizes[m];
+      for (size_t t = 0; t < sizeof(stamps) / sizeof(uint64_t); ++t){
+        uint64_t ts = stamps[t];
+        // Against Chunk::Pack, for the first message on chunk stream 4
+        RTMPStream::lastsend.clear();
+        RTMPStream::Chunk ch;
+        ch.cs_id = 4;
+        ch.timestamp = ts;
+        ch.len = len;
+        ch.real_len = len;
+        ch.len_left = 0;
+        ch.msg_type_id = 9;
+        ch.msg_stream_id = 1;
+        ch.data = payload.substr(0, len);
+        std::string packed = ch.Pack();
+        char rtmpheader[16];
+        size_t header_len = makeHeader(rtmpheader, ts, len, 9);
+        assert(!memcmp(packed.data(), rtmpheader, header_len));
+        size_t dheader_len = std::min(len, (size_t)(1 + m % 5));
+        newSend(C, rtmpheader, header_len, ts, payload.data(), dheader_len, payload.data() + dheader_len, len);
+        assert(written(C, fd) == packed);
+
+        // Against the chunking of sendNext from before, with and without a send batch
+        for (int batch = 0; batch < 2; ++batch){
+          if (batch){C.beginSendBatch(1000);}
+          header_len = makeHeader(rtmpheader, ts, len, 9);
+          oldSend(C, rtmpheader, header_len, ts, payload.data(), dheader_len, payload.data() + dheader_len, len);
+          if (batch){C.endSendBatch();}
+          std::string oldOut = written(C, fd);
+          if (batch){C.beginSendBatch(1000);}
+          header_len = makeHeader(rtmpheader, ts, len, 9);
+          newSend(C, rtmpheader, header_len, ts, payload.data(), dheader_len, payload.data() + dheader_len, len);
+          if (batch){C.endSendBatch();}
+          assert(written(C, fd) == oldOut);
+          ++checked;
+        }
+      }
+    }
+  }
+  std::cout << checked << " messages written identically" << std::endl;
+  C.drop();
+  fclose(f);
+
+  size_t bytes = (argc > 1 ? atoi(argv[1]) : 64) * 1048576;
+  // Throughput with frames of a 6 Mbps stream at 25 frames per second, and of key frames, with
+  // the chunk size MistOutRTMP uses and a smaller one as used by other servers
+  size_t runs[][2] ={{65536, 30000}, {65536, 200000}, {4096, 30000}};
+  for (size_t r = 0; r < 3; ++r){
+    run(runs[r][0], 4 * 1048576, runs[r][1], false, false);
+    run(runs[r][0], 4 * 1048576, runs[r][1], true, false);
+    run(runs[r][0], bytes, runs[r][1], false, true);
+    run(runs[r][0], bytes, runs[r][1], true, true);
+  }
+  return 0;
+}
@@ -0,0 +1,204 @@
+/// \file rtpsorter.cpp
+/// Replays a generated RTP stream with loss and reordering through RTP::Sorter and through a copy
+/// of the original std::map based sorter, checks both output the same packets and statistics,
+/// and prints the time taken by each. Also checks RTP::PacketRing on its own.
+/// Usage: rtpsorter [packets] [loss percentage] [reorder percentage]
+
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <mist/bitfields.h>
+#include <mist/rtp.h>
+#include <mist/timing.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// The std::map based sorter RTP::Sorter used before it kept its buffer in a PacketRing.
+/// Statistics that are not compared are left out.
+class MapSorter{
+public:
+  MapSorter(){
+    rtpSeq = 0;
+    rtpWSeq = 0;
+    lostTotal = 0;
+    packTotal = 0;
+    first = true;
+    preBuffer = true;
+  }
+  virtual ~MapSorter(){}
+  virtual void outPacket(const RTP::Packet &p) = 0;
+  void addPacket(const RTP::Packet &pack){
+    uint16_t pSNo = pack.getSequence();
+    if (first){
+      rtpWSeq = pSNo;
+      rtpSeq = pSNo - 5;
+      first = false;
+    }
+    if (preBuffer){
+      if (packBuffer.size() >= 5){
+        preBuffer = false;
+        rtpSeq = packBuffer.begin()->first;
+        rtpWSeq = rtpSeq;
+      }
+    }else{
+      while ((int16_t)(rtpSeq - pSNo) < -(int)RTP::PACKET_DROP_TIMEOUT){
+        // The original left packets given up on in the map, to be output after the next wraparound
+        packBuffer.erase(rtpSeq);
+        ++rtpSeq;
+        ++lostTotal;
+        ++packTotal;
+      }
+    }
+    if ((int16_t)(rtpWSeq - rtpSeq) < 0){rtpWSeq = rtpSeq;}
+    while ((int16_t)(rtpWSeq - pSNo) < -(int)RTP::PACKET_REORDER_WAIT){
+      if (!packBuffer.count(rtpWSeq)){wantedSeqs.insert(rtpWSeq);}
+      ++rtpWSeq;
+    }
+    while (packBuffer.count(rtpSeq)){
+      outPacket(packBuffer[rtpSeq]);
+      packBuffer.erase(rtpSeq);
+      ++rtpSeq;
+      ++packTotal;
+    }
+    if ((int16_t)(rtpSeq - pSNo) < 0){packBuffer[pack.getSequence()] = pack;}
+    if (rtpSeq == pSNo){
+      outPacket(pack);
+      ++rtpSeq;
+      ++packTotal;
+    }
+    if ((int16_t)(rtpWSeq - rtpSeq) < 0){rtpWSeq = rtpSeq;}
+  }
+  uint16_t rtpSeq, rtpWSeq;
+  bool first, preBuffer;
+  int32_t lostTotal;
+  uint32_t packTotal;
+  std::set<uint16_t> wantedSeqs;
+  std::map<uint16_t, RTP::Packet> packBuffer;
+};
+
+/// Collects a checksum over all output packets, in output order.
+uint64_t checksum(uint64_t sum, const RTP::Packet &p){
+  const char *d = p.ptr();
+  sum = sum * 31 + p.getSequence();
+  for (size_t i = 0; i < p.getSize(); i += 97){sum = sum * 31 + (uint8_t)d[i];}
+  return sum * 31 + p.getSize();
+}
+
+class RingCheck : public RTP::Sorter{
+public:
+  RingCheck(){
+    sum = 0;
+    count = 0;
+  }
+  void outPacket(const uint64_t track, const RTP::Packet &p){
+    sum = checksum(sum, p);
+    ++count;
+  }
+  uint64_t sum;
+  size_t count;
+};
+
+class MapCheck : public MapSorter{
+public:
+  MapCheck(){
+    sum = 0;
+    count = 0;
+  }
+  void outPacket(const RTP::Packet &p){
+    sum = checksum(sum, p);
+    ++count;
+  }
+  uint64_t sum;
+  size_t count;
+};
+
+/// A generated RTP stream: packets in arrival order, with their offsets in one buffer.
+struct Capture{
+  std::string data;
+  std::vector<size_t> offsets;
+  std::vector<size_t> sizes;
+};
+
+/// Generates count RTP packets starting at sequence number firstSeq, dropping loss percent of
+/// them and swapping reorder percent of them with a packet up to 8 positions further.
+void generate(Capture &C, size_t count, uint16_t firstSeq, size_t loss, size_t reorder){
+  std::vector<uint16_t> order;
+  for (size_t i = 0; i < count; ++i){
+    if ((size_t)(rand() % 100) < loss){continue;}
+    order.push_back(firstSeq + i);
+  }
+  for (size_t i = 0; i + 8 < order.size(); ++i){
+    if ((size_t)(rand() % 100) < reorder){std::swap(order[i], order[i + 1 + rand() % 8]);}
+  }
+  char pkt[1500];
+  for (size_t i = 0; i < order.size(); ++i){
+    size_t size = 200 + rand() % 1200;
+    memset(pkt, order[i] & 0xFF, size);
+    pkt[0] = 0x80;
+    pkt[1] = 96;
+    Bit::htobs(pkt + 2, order[i]);
+    Bit::htobl(pkt + 4, order[i] * 3000);
+    Bit::htobl(pkt + 8, 0x12345678);
+    C.offsets.push_back(C.data.size());
+    C.sizes.push_back(size);
+    C.data.append(pkt, size);
+  }
+}
+
+void checkRing(){
+  RTP::PacketRing R(16);
+  assert(R.capacity() == 16 && !R.size());
+  char buf[3000];
+  memset(buf, 0, sizeof(buf));
+  R.store(65530, buf, 100);
+  R.store(4, buf, 100);
+  assert(R.has(65530) && R.has(4) && !R.has(5) && R.size() == 2);
+  assert(R.earliest(65500) == 65530 && R.earliest(0) == 4);
+  // Sequence numbers a multiple of the capacity apart share a slot
+  R.store(20, buf, 50);
+  assert(!R.has(4) && R.has(20) && R.getSize(20) == 50 && R.size() == 2);
+  // Larger packets and a larger capacity keep all stored packets
+  buf[2999] = 42;
+  R.store(21, buf, 3000);
+  R.reserve(100);
+  assert(R.capacity() == 128 && R.size() == 3);
+  assert(R.has(65530) && R.has(20) && R.has(21) && R.getData(21)[2999] == 42);
+  R.remove(20);
+  assert(!R.has(20) && R.size() == 2 && !R.getData(20));
+}
+
+int main(int argc, char **argv){
+  size_t count = (argc > 1 ? atoi(argv[1]) : 500000);
+  size_t loss = (argc > 2 ? atoi(argv[2]) : 1);
+  size_t reorder = (argc > 3 ? atoi(argv[3]) : 5);
+  srand(42);
+  checkRing();
+
+  Capture C;
+  // Start close to the wraparound point, so it is always crossed
+  generate(C, count, 65000, loss, reorder);
+
+  RingCheck ring;
+  MapCheck map;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < C.offsets.size(); ++i){
+    map.addPacket(RTP::Packet(C.data.data() + C.offsets[i], C.sizes[i]));
+  }
+  uint64_t mapTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < C.offsets.size(); ++i){
+    ring.addPacket(RTP::Packet(C.data.data() + C.offsets[i], C.sizes[i]));
+  }
+  uint64_t ringTime = Util::getMicros(start);
+
+  assert(ring.count == map.count);
+  assert(ring.sum == map.sum);
+  assert(ring.lostTotal == map.lostTotal);
+  assert(ring.packTotal == map.packTotal);
+  assert(ring.wantedSeqs == map.wantedSeqs);
+  std::cout << C.offsets.size() << " packets (" << loss << "% loss, " << reorder << "% reordered), "
+            << ring.count << " sorted, " << ring.lostTotal << " lost" << std::endl;
+  std::cout << "std::map: " << (mapTime * 1000 / C.offsets.size()) << "ns per packet" << std::endl;
+  std::cout << "PacketRing: " << (ringTime * 1000 / C.offsets.size()) << "ns per packet" << std::endl;
+  return 0;
+}
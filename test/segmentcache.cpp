@@ -0,0 +1,111 @@
+/// \file segmentcache.cpp
+/// Checks Util::SegmentCache: misses for unknown keys, hits with the exact stored bytes, refusing
+/// duplicate and oversized entries, evicting entries that left the DVR window, evicting the
+/// entries ending first once the cache is full, and the server-wide counters of all of these.
+
+#include <cassert>
+#include <iostream>
+#include <mist/segment_cache.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint64_t before[Util::SEGCACHE_STAT_COUNT];
+
+/// Returns how much the given counter changed since the test started
+uint64_t statDiff(Util::segmentCacheStat stat){
+  uint64_t now[Util::SEGCACHE_STAT_COUNT];
+  assert(Util::SegmentCache::getStats(now));
+  return now[stat] - before[stat];
+}
+
+/// Returns a segment of len bytes that differs per seed
+std::string segment(size_t len, char seed){
+  std::string res(len, seed);
+  for (size_t i = 0; i < len; i += 7){res[i] = (char)(i + seed);}
+  return res;
+}
+
+/// Checks key is a hit that returns exactly data
+void checkHit(Util::SegmentCache &C, const std::string &key, const std::string &data){
+  assert(C.get(key));
+  assert(C.size() == data.size());
+  assert(!memcmp(C.data(), data.data(), data.size()));
+}
+
+int main(){
+  char streamName[64];
+  snprintf(streamName, 64, "segcachetest%d", (int)getpid());
+  // Every entry takes 16 bytes of header plus its key plus its data
+  const size_t entry = 16 + 4 + 1000;
+
+  Util::SegmentCache disabled;
+  disabled.init(streamName, 0);
+  assert(!disabled);
+  assert(!disabled.store("seg0", 1000, segment(1000, 0)));
+
+  Util::SegmentCache C;
+  C.init(streamName, entry * 4);
+  assert(C);
+  // Make sure the counters page exists before taking the starting values
+  C.get("none");
+  assert(Util::SegmentCache::getStats(before));
+
+  assert(!C.get("seg1"));
+  assert(statDiff(Util::SEGCACHE_MISSES) == 1);
+  assert(C.store("seg1", 1000, segment(1000, 1)));
+  checkHit(C, "seg1", segment(1000, 1));
+  // Storing the same key again is refused, the first copy stays
+  assert(!C.store("seg1", 1000, segment(1000, 9)));
+  checkHit(C, "seg1", segment(1000, 1));
+  // Entries that can never fit are refused
+  assert(!C.store("huge", 1000, segment(entry * 4, 2)));
+  assert(!C.get("huge"));
+
+  // A second cache object on the same stream, as another viewer would have, sees the same entries
+  Util::SegmentCache other;
+  other.init(streamName, entry * 4);
+  checkHit(other, "seg1", segment(1000, 1));
+
+  // Fill the cache, then store one more: the entry ending first goes
+  assert(C.store("seg3", 3000, segment(1000, 3)));
+  assert(C.store("seg2", 2000, segment(1000, 2)));
+  assert(C.store("seg4", 4000, segment(1000, 4)));
+  assert(statDiff(Util::SEGCACHE_BYTES_CACHED) == entry * 4);
+  assert(!statDiff(Util::SEGCACHE_EVICTIONS));
+  assert(C.store("seg5", 5000, segment(1000, 5)));
+  assert(statDiff(Util::SEGCACHE_EVICTIONS) == 1);
+  assert(!C.get("seg1"));
+  checkHit(C, "seg2", segment(1000, 2));
+  // Data of a hit stays valid after its entry gets evicted, until the next get
+  assert(other.get("seg2"));
+  assert(C.store("seg6", 6000, segment(1000, 6)));
+  assert(!C.get("seg2"));
+  assert(other.size() == 1000 && !memcmp(other.data(), segment(1000, 2).data(), 1000));
+  checkHit(C, "seg3", segment(1000, 3));
+  checkHit(C, "seg4", segment(1000, 4));
+  checkHit(C, "seg5", segment(1000, 5));
+  checkHit(C, "seg6", segment(1000, 6));
+
+  // Everything ending before the start of the DVR window goes, not just what is needed for room
+  assert(C.store("seg7", 7000, segment(500, 7), 5500));
+  assert(!C.get("seg3") && !C.get("seg4") && !C.get("seg5"));
+  checkHit(C, "seg6", segment(1000, 6));
+  checkHit(C, "seg7", segment(500, 7));
+  assert(statDiff(Util::SEGCACHE_EVICTIONS) == 5);
+  assert(statDiff(Util::SEGCACHE_STORES) == 7);
+  assert(statDiff(Util::SEGCACHE_BYTES_STORED) == 6500);
+  assert(statDiff(Util::SEGCACHE_BYTES_CACHED) == entry + 16 + 4 + 500);
+  assert(statDiff(Util::SEGCACHE_HITS) == 11);
+  assert(statDiff(Util::SEGCACHE_MISSES) == 7);
+
+  // Wiping removes all entries and the cache itself
+  Util::SegmentCache::wipe(streamName);
+  assert(!statDiff(Util::SEGCACHE_BYTES_CACHED));
+  Util::SegmentCache after;
+  after.init(streamName, entry * 4);
+  assert(!after.get("seg6") && !after.get("seg7"));
+  Util::SegmentCache::wipe(streamName);
+  std::cout << "Segment cache hits, misses and evictions check out" << std::endl;
+  return 0;
+}
@@ -0,0 +1,238 @@
+/// \file sendbatch.cpp
+/// Sends data over a loopback TCP connection through Socket::Connection::SendNow in the write
+/// patterns of the HLS, HTTP-TS and RTMP outputs, and checks it all arrives intact and in order,
+/// both with and without send batching. Then prints the system calls per MB and the throughput
+/// per core of the sending side for each pattern, both ways. Also checks the kernel does not hold
+/// back the end of a batch that was sent with more data announced.
+/// Pass an amount of MiB as argument to change the amount of data sent per run.
+
+#include <cassert>
+#include <iostream>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+static uint64_t syscalls = 0;
+
+// Count the system calls that sending makes, passing them on to the kernel
+extern "C"{
+  ssize_t send(int fd, const void *buf, size_t len, int flags){
+    ++syscalls;
+    return syscall(SYS_sendto, fd, buf, len, flags, 0, 0);
+  }
+  ssize_t sendmsg(int fd, const struct msghdr *msg, int flags){
+    ++syscalls;
+    return syscall(SYS_sendmsg, fd, msg, flags);
+  }
+  ssize_t writev(int fd, const struct iovec *iov, int cnt){
+    ++syscalls;
+    return syscall(SYS_writev, fd, iov, cnt);
+  }
+  int fcntl(int fd, int cmd, ...){
+    ++syscalls;
+    va_list ap;
+    va_start(ap, cmd);
+    long arg = va_arg(ap, long);
+    va_end(ap);
+    return syscall(SYS_fcntl, fd, cmd, arg);
+  }
+}
+
+/// Returns the user plus system CPU time used by this process so far, in microseconds.
+uint64_t cpuMicros(){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec +
+         usage.ru_stime.tv_usec;
+}
+
+/// FNV-1a over everything sent or received
+uint64_t hashData(uint64_t h, const char *data, size_t len){
+  for (size_t i = 0; i < len; ++i){h = (h ^ (unsigned char)data[i]) * 1099511628211ull;}
+  return h;
+}
+
+enum pattern{HLS, HTTPTS, RTMP};
+const char *patternNames[] ={"HLS", "HTTP-TS", "RTMP"};
+
+/// Sends bytes of media in frames of frameSize bytes, the way the given output writes them.
+/// Returns the hash of all data handed to SendNow.
+uint64_t sendMedia(Socket::Connection &C, pattern p, size_t bytes, size_t frameSize, bool batched){
+  std::string frameData(frameSize, 0);
+  char *frame = &frameData[0];
+  for (size_t i = 0; i < frameSize; ++i){frame[i] = rand();}
+  uint64_t h = 14695981039346656037ull;
+  size_t sent = 0;
+  while (sent < bytes){
+    if (batched){C.beginSendBatch();}
+    if (p == RTMP){
+      // A header, then the frame in chunks of 4096 bytes each preceded by a one byte header
+      char header[12];
+      memset(header, sent & 0xFF, 12);
+      C.SendNow(header, 12);
+      h = hashData(h, header, 12);
+      for (size_t i = 0; i < frameSize; i += 4096){
+        size_t len = std::min((size_t)4096, frameSize - i);
+        if (i){
+          C.SendNow("\304", 1);
+          h = hashData(h, "\304", 1);
+        }
+        C.SendNow(frame + i, len);
+        h = hashData(h, frame + i, len);
+      }
+    }else{
+      // The frame in TS packets of 188 bytes, chunked for HLS over HTTP/1.1
+      for (size_t i = 0; i + 188 <= frameSize; i += 188){
+        frame[i] = 0x47;
+        if (p == HLS){
+          C.SendNow("bc\r\n", 4);
+          h = hashData(h, "bc\r\n", 4);
+        }
+        C.SendNow(frame + i, 188);
+        h = hashData(h, frame + i, 188);
+        if (p == HLS){
+          C.SendNow("\r\n", 2);
+          h = hashData(h, "\r\n", 2);
+        }
+      }
+    }
+    if (batched){C.endSendBatch();}
+    sent += frameSize;
+  }
+  return h;
+}
+
+/// Sends bytes in the given pattern to a reading child process and checks what arrives.
+/// If report is set, prints the system calls per MB and the throughput per core of the sending side.
+void run(pattern p, size_t bytes, size_t frameSize, bool batched, bool nonblock, bool report = false){
+  int lsock = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(!bind(lsock, (struct sockaddr *)&addr, sizeof(addr)));
+  socklen_t addrLen = sizeof(addr);
+  assert(!getsockname(lsock, (struct sockaddr *)&addr, &addrLen));
+  assert(!listen(lsock, 1));
+  int hashPipe[2];
+  assert(!pipe(hashPipe));
+  pid_t child = fork();
+  if (!child){
+    // Reader: hash everything until the connection closes, then report hash and size
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    assert(!connect(s, (struct sockaddr *)&addr, sizeof(addr)));
+    uint64_t res[2] ={14695981039346656037ull, 0};
+    char buf[65536];
+    ssize_t r;
+    while ((r = read(s, buf, sizeof(buf))) > 0){
+      res[0] = hashData(res[0], buf, r);
+      res[1] += r;
+    }
+    assert(write(hashPipe[1], res, sizeof(res)) == sizeof(res));
+    _exit(0);
+  }
+  int s = accept(lsock, 0, 0);
+  ::close(lsock);
+  Socket::Connection C(s);
+  if (nonblock){C.setBlocking(false);}
+  uint64_t startCalls = syscalls;
+  uint64_t startCpu = cpuMicros();
+  uint64_t start = Util::getMicros();
+  uint64_t h = sendMedia(C, p, bytes, frameSize, batched);
+  uint64_t cpu = cpuMicros() - startCpu + 1;
+  uint64_t wall = Util::getMicros(start) + 1;
+  uint64_t calls = syscalls - startCalls;
+  uint64_t total = C.dataUp();
+  C.close();
+  uint64_t res[2];
+  assert(read(hashPipe[0], res, sizeof(res)) == sizeof(res));
+  waitpid(child, 0, 0);
+  ::close(hashPipe[0]);
+  ::close(hashPipe[1]);
+  assert(res[1] == total);
+  assert(res[0] == h);
+  if (report){
+    std::cout << patternNames[p] << (batched ? " batched: " : ": ") << (double)calls * 1048576 / total
+              << " system calls per MB, " << (double)total / cpu << " MB/s per core, "
+              << (double)total / wall << " MB/s" << std::endl;
+  }
+}
+
+/// Ends a send batch after a gathering send or a send too big to queue, the ways a frame can end,
+/// and checks the whole frame arrives without sending anything after it.
+void checkFrameEnd(bool gather){
+  int lsock = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(!bind(lsock, (struct sockaddr *)&addr, sizeof(addr)));
+  socklen_t addrLen = sizeof(addr);
+  assert(!getsockname(lsock, (struct sockaddr *)&addr, &addrLen));
+  assert(!listen(lsock, 1));
+  int r = socket(AF_INET, SOCK_STREAM, 0);
+  assert(!connect(r, (struct sockaddr *)&addr, sizeof(addr)));
+  Socket::Connection C(accept(lsock, 0, 0));
+  ::close(lsock);
+  C.setBlocking(false);
+  // Less than a segment on loopback, which the kernel holds back for up to 200ms when told more
+  // follows. Too big to queue with a high-water mark of 4096 bytes.
+  std::string frame(6001, 'F');
+  C.beginSendBatch(4096);
+  C.SendNow("header", 6);
+  if (gather){
+    struct iovec pieces[2];
+    pieces[0].iov_base = (void *)frame.data();
+    pieces[0].iov_len = 3000;
+    pieces[1].iov_base = (void *)(frame.data() + 3000);
+    pieces[1].iov_len = frame.size() - 3000;
+    C.SendNow(pieces, 2);
+  }else{
+    C.SendNow(frame.data(), frame.size());
+  }
+  C.endSendBatch();
+  size_t expect = 6 + frame.size(), got = 0;
+  uint64_t deadline = Util::bootMS() + 100;
+  char buf[65536];
+  while (got < expect && Util::bootMS() < deadline){
+    struct pollfd pfd;
+    pfd.fd = r;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 50) < 1){continue;}
+    ssize_t n = read(r, buf, sizeof(buf));
+    if (n > 0){got += n;}
+  }
+  assert(got == expect);
+  C.close();
+  ::close(r);
+}
+
+int main(int argc, char **argv){
+  srand(42);
+  // Nothing of a frame is held back by the kernel once its batch ends
+  checkFrameEnd(true);
+  checkFrameEnd(false);
+  size_t bytes = (argc > 1 ? atoi(argv[1]) : 64) * 1048576;
+  // Correctness on blocking and nonblocking sockets, with frames that cross the high-water mark
+  for (int p = HLS; p <= RTMP; ++p){
+    run((pattern)p, 4 * 1048576, 100000, false, true);
+    run((pattern)p, 4 * 1048576, 100000, true, true);
+    run((pattern)p, 4 * 1048576, 1000, true, false);
+  }
+  // Throughput with frames of a 6 Mbps stream at 25 frames per second, on a nonblocking socket
+  // like the outputs use
+  for (int p = HLS; p <= RTMP; ++p){
+    run((pattern)p, bytes, 30000, false, true, true);
+    run((pattern)p, bytes, 30000, true, true, true);
+  }
+  return 0;
+}
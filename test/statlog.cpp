@@ -0,0 +1,139 @@
+/// \file statlog.cpp
+/// Checks Controller::statLogRing against the std::map based log the controller used to keep per
+/// connection, including out of order and repeated reports and dropping entries when full. Then
+/// simulates reports for 100k connections in both, with periodic wiping of old entries as
+/// statSession::wipeOld does, and prints the time and memory used by each.
+/// Usage: statlog [connections] [seconds]
+
+#include "../src/controller/controller_statlog.cpp"
+#include <cassert>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <mist/timing.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef std::map<unsigned long long, Controller::statLog> mapLog;
+
+/// Adds an entry to a map log the way statStorage::update used to
+void mapSet(mapLog &log, uint64_t t, const Controller::statLog &data, size_t maxSize){
+  log[t] = data;
+  if (log.size() > maxSize){log.erase(log.begin());}
+}
+
+/// Looks up an entry in a map log the way statStorage::getDataFor used to
+const Controller::statLog &mapGet(mapLog &log, uint64_t t){
+  mapLog::iterator it = log.upper_bound(t);
+  if (it != log.begin()){it--;}
+  return it->second;
+}
+
+Controller::statLog makeLog(uint64_t t, uint64_t v){
+  Controller::statLog l;
+  l.time = t;
+  l.lastSecond = v;
+  l.down = v * 1000;
+  l.up = v * 10;
+  l.pktCount = v;
+  l.pktLost = v / 10;
+  l.pktRetransmit = v / 20;
+  return l;
+}
+
+void checkSame(Controller::statLogRing &R, mapLog &M){
+  assert(R.size() == M.size());
+  if (!M.size()){return;}
+  assert(R.firstTime() == M.begin()->first && R.lastTime() == M.rbegin()->first);
+  assert(R.first().down == M.begin()->second.down && R.last().down == M.rbegin()->second.down);
+  for (uint64_t t = M.begin()->first - 2; t <= M.rbegin()->first + 2; ++t){
+    assert(R.getAt(t).down == mapGet(M, t).down);
+  }
+}
+
+/// Current resident set size in KiB
+uint64_t currentRSS(){
+  FILE *f = fopen("/proc/self/statm", "r");
+  unsigned long size = 0, rss = 0;
+  if (f){
+    if (fscanf(f, "%lu %lu", &size, &rss) != 2){rss = 0;}
+    fclose(f);
+  }
+  return rss * 4;
+}
+
+int main(int argc, char **argv){
+  // Random reports, mostly in order, some repeated or late, into a small ring that fills up
+  srand(42);
+  Controller::statLogRing R(16);
+  mapLog M;
+  uint64_t now = 1000;
+  for (size_t i = 0; i < 5000; ++i){
+    uint64_t t = now;
+    int r = rand() % 10;
+    if (r == 0){t = now - rand() % 20;}
+    if (r < 8){++now;}
+    Controller::statLog l = makeLog(t, i);
+    R.set(t, l);
+    mapSet(M, t, l, 16);
+    checkSame(R, M);
+    // Wipe as statSession::wipeOld does for current connections
+    if (i % 37 == 0){
+      while (R.size() > 1 && R.firstTime() < now - 10){R.popFront();}
+      while (M.size() > 1 && M.begin()->first < now - 10){M.erase(M.begin());}
+      checkSame(R, M);
+    }
+  }
+  R.clear();
+  assert(!R.size());
+  R.set(5, makeLog(5, 5));
+  assert(R.size() == 1 && R.getAt(0).down == 5000 && R.getAt(100).down == 5000);
+
+  // Load: every connection reports every second, and entries older than the cutoff are wiped
+  // every 10 seconds, keeping at most STAT_CUTOFF entries per connection
+  size_t conns = (argc > 1 ? atoi(argv[1]) : 100000);
+  size_t seconds = (argc > 2 ? atoi(argv[2]) : 60);
+  uint64_t cutoff = 30;
+  uint64_t baseRSS = currentRSS();
+  uint64_t ringTime, ringRSS, mapTime, mapRSS;
+  uint64_t sum = 0;
+  {
+    std::vector<Controller::statLogRing> logs(conns);
+    uint64_t start = Util::getMicros();
+    for (uint64_t t = 1; t <= seconds; ++t){
+      for (size_t c = 0; c < conns; ++c){logs[c].set(t, makeLog(t, c + t));}
+      if (t % 10 == 0 && t > cutoff){
+        for (size_t c = 0; c < conns; ++c){
+          while (logs[c].size() > 1 && logs[c].firstTime() < t - cutoff){logs[c].popFront();}
+        }
+      }
+      for (size_t c = 0; c < conns; c += 100){sum += logs[c].getAt(t - 5).down;}
+    }
+    ringTime = Util::getMicros(start);
+    ringRSS = currentRSS() - baseRSS;
+  }
+  malloc_trim(0);
+  baseRSS = currentRSS();
+  {
+    std::vector<mapLog> logs(conns);
+    uint64_t start = Util::getMicros();
+    for (uint64_t t = 1; t <= seconds; ++t){
+      for (size_t c = 0; c < conns; ++c){mapSet(logs[c], t, makeLog(t, c + t), STAT_CUTOFF);}
+      if (t % 10 == 0 && t > cutoff){
+        for (size_t c = 0; c < conns; ++c){
+          while (logs[c].size() > 1 && logs[c].begin()->first < t - cutoff){logs[c].erase(logs[c].begin());}
+        }
+      }
+      for (size_t c = 0; c < conns; c += 100){sum -= mapGet(logs[c], t - 5).down;}
+    }
+    mapTime = Util::getMicros(start);
+    mapRSS = currentRSS() - baseRSS;
+  }
+  assert(!sum);
+  std::cout << conns << " connections, " << seconds << "s of reports" << std::endl;
+  std::cout << "std::map: " << mapTime / seconds / 1000 << "ms per second of reports, " << mapRSS / 1024
+            << " MiB" << std::endl;
+  std::cout << "statLogRing: " << ringTime / seconds / 1000 << "ms per second of reports, "
+            << ringRSS / 1024 << " MiB" << std::endl;
+  return 0;
+}
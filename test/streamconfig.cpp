@@ -0,0 +1,141 @@
+/// \file streamconfig.cpp
+/// Writes a stream configuration page the way the controller does, and checks that a
+/// Util::StreamConfigReader sees it, keeps it open while it is unchanged, and notices when it is
+/// replaced or removed. Then prints the time and heap allocations per connection of reading a few
+/// settings the way outputs used to (opening the page and converting it to JSON every time) and
+/// through a StreamConfigReader kept open.
+/// Pass a connection count as argument to change the amount of connections simulated.
+
+#include <cassert>
+#include <iostream>
+#include <mist/defines.h>
+#include <mist/stream.h>
+#include <mist/timing.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint64_t allocs = 0;
+
+void *operator new(size_t size) throw(std::bad_alloc){
+  ++allocs;
+  void *p = malloc(size ? size : 1);
+  if (!p){throw std::bad_alloc();}
+  return p;
+}
+
+void operator delete(void *p) throw(){
+  free(p);
+}
+
+/// Replaces the configuration page of a stream the way Controller::writeStream does
+void writeConfig(IPC::sharedPage &P, const char *pageName, const JSON::Value &conf, uint64_t generation){
+  std::string temp = conf.toPacked();
+  if (P){Util::RelAccX(P.mapped, false).setReload();}
+  P.close();
+  P.init(pageName, temp.size() + 150, false, false);
+  if (P){
+    Util::RelAccX tmpA(P.mapped, false);
+    if (tmpA.isReady()){tmpA.setReload();}
+    P.master = true;
+    P.close();
+  }
+  P.init(pageName, temp.size() + 150, true, false);
+  assert(P);
+  Util::RelAccX A(P.mapped, false);
+  A.addField("dtsc_data", RAX_DTSC, temp.size());
+  if (generation){A.addField("generation", RAX_64UINT);}
+  memcpy(A.getPointer("dtsc_data"), temp.data(), temp.size());
+  if (generation){A.setInt("generation", generation);}
+  A.setRCount(1);
+  A.setEndPos(1);
+  A.setReady();
+}
+
+int main(int argc, char **argv){
+  char streamName[64];
+  snprintf(streamName, 64, "streamconfig_test_%d", (int)getpid());
+  char pageName[NAME_BUFFER_SIZE];
+  snprintf(pageName, NAME_BUFFER_SIZE, SHM_STREAM_CONF, streamName);
+  std::string wildcardName = std::string(streamName) + "+abc";
+
+  JSON::Value conf;
+  conf["name"] = streamName;
+  conf["source"] = "/media/video.mp4";
+  conf["fallback_stream"] = "fallback";
+  conf["DVR"] = 50000;
+  conf["processes"][0u]["process"] = "AV";
+  conf["processes"][0u]["codec"] = "opus";
+  IPC::sharedPage P;
+  writeConfig(P, pageName, conf, 7);
+
+  Util::StreamConfigReader R;
+  assert(!R && !R.getScan() && !R.getGeneration());
+  assert(R.update(wildcardName));
+  assert(R && R.getGeneration() == 7);
+  assert(R.getMember("source").asString() == "/media/video.mp4");
+  assert(R.getMember("DVR").asInt() == 50000);
+  assert(!R.getMember("cut"));
+  assert(R.getScan().asJSON().toString() == conf.toString());
+  assert(Util::getStreamConfig(wildcardName).toString() == conf.toString());
+  // Unchanged: nothing to do, for both the base and the wildcard name
+  assert(!R.update(streamName));
+  assert(!R.update(wildcardName));
+
+  // Replaced by the controller
+  conf["DVR"] = 60000;
+  writeConfig(P, pageName, conf, 8);
+  assert(R.update(streamName));
+  assert(R.getGeneration() == 8 && R.getMember("DVR").asInt() == 60000);
+  assert(!R.update(streamName));
+
+  // Written by a controller that does not set a generation: always counts as a change
+  writeConfig(P, pageName, conf, 0);
+  assert(R.update(streamName));
+  assert(!R.getGeneration() && R.getMember("DVR").asInt() == 60000);
+  writeConfig(P, pageName, conf, 9);
+  assert(R.update(streamName));
+
+  // Removed by the controller
+  Util::RelAccX(P.mapped, false).setReload();
+  P.master = true;
+  P.close();
+  assert(R.update(streamName));
+  assert(!R && !R.getMember("source"));
+  assert(!R.update(streamName));
+  writeConfig(P, pageName, conf, 10);
+  assert(R.update(streamName));
+  assert(R.getGeneration() == 10);
+
+  // Every connection reads the source and the fallback stream setting
+  size_t conns = (argc > 1 ? atoi(argv[1]) : 100000);
+  uint64_t sum = 0;
+  uint64_t oldAllocs = allocs;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < conns; ++i){
+    Util::DTSCShmReader rStrmConf(pageName);
+    JSON::Value strCnf = rStrmConf.getScan().asJSON();
+    sum += strCnf["source"].asStringRef().size() + strCnf["fallback_stream"].asStringRef().size();
+  }
+  uint64_t oldTime = Util::getMicros(start);
+  oldAllocs = allocs - oldAllocs;
+  uint64_t newAllocs = allocs;
+  start = Util::getMicros();
+  for (size_t i = 0; i < conns; ++i){
+    R.update(streamName);
+    sum -= R.getMember("source").asString().size() + R.getMember("fallback_stream").asString().size();
+  }
+  uint64_t newTime = Util::getMicros(start);
+  newAllocs = allocs - newAllocs;
+  assert(!sum);
+  std::cout << conns << " connections" << std::endl;
+  std::cout << "Open and convert to JSON: " << oldTime * 1000 / conns << "ns and "
+            << (double)oldAllocs / conns << " allocations per connection" << std::endl;
+  std::cout << "StreamConfigReader: " << newTime * 1000 / conns << "ns and " << (double)newAllocs / conns
+            << " allocations per connection" << std::endl;
+  P.master = true;
+  P.close();
+  return 0;
+}
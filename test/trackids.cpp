@@ -0,0 +1,132 @@
+/// \file trackids.cpp
+/// Checks that DTSC::Meta::getTypeId and getCodecId agree with getType and getCodec, also after
+/// the type or codec of a track is changed, in the process that changes it and in a reader of the
+/// same shared metadata. Then prints the time and heap allocations per 1000 packets of the type
+/// and codec checks TSOutput::sendNext does, through the strings and through the interned ids.
+/// Pass a packet count as argument to change the amount of packets simulated.
+
+#include <cassert>
+#include <iostream>
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static uint64_t allocs = 0;
+
+void *operator new(size_t size) throw(std::bad_alloc){
+  ++allocs;
+  void *p = malloc(size ? size : 1);
+  if (!p){throw std::bad_alloc();}
+  return p;
+}
+
+void operator delete(void *p) throw(){
+  free(p);
+}
+
+/// Asserts the interned ids of all given tracks match their type and codec strings
+void checkMatches(const DTSC::Meta &M, const std::set<size_t> &tracks){
+  for (std::set<size_t>::const_iterator it = tracks.begin(); it != tracks.end(); ++it){
+    assert(M.getTypeId(*it) == DTSC::internType(M.getType(*it).c_str()));
+    assert(M.getCodecId(*it) == DTSC::internCodec(M.getCodec(*it).c_str()));
+  }
+}
+
+int main(int argc, char **argv){
+  const char *codecs[] ={"H264", "HEVC",  "H263",  "AV1",   "VP8",   "VP9",  "MPEG2",
+                         "JPEG", "theora", "AAC",  "MP3",   "MP2",   "AC3",  "DTS",
+                         "opus", "vorbis", "PCM",  "PCMLE", "FLOAT", "ALAW", "ULAW",
+                         "ADPCM", "Nellymoser", "Speex", "subtitle", "JSON", "ID3", 0};
+  size_t c = 0;
+  for (; codecs[c]; ++c){assert(DTSC::internCodec(codecs[c]) == DTSC::CODEC_H264 + c);}
+  assert(DTSC::CODEC_H264 + c - 1 == DTSC::CODEC_ID3);
+  assert(DTSC::internCodec("h264") == DTSC::CODEC_OTHER);
+  assert(DTSC::internCodec("") == DTSC::CODEC_OTHER);
+  assert(DTSC::internType("video") == DTSC::VIDEO && DTSC::internType("audio") == DTSC::AUDIO);
+  assert(DTSC::internType("meta") == DTSC::META && DTSC::internType("") == DTSC::INVALID);
+
+  char streamName[64];
+  snprintf(streamName, 64, "trackids_%d", (int)getpid());
+  DTSC::Meta M(streamName, true);
+  size_t v = M.addTrack();
+  M.setType(v, "video");
+  M.setCodec(v, "H264");
+  size_t a = M.addTrack();
+  M.setType(a, "audio");
+  M.setCodec(a, "AAC");
+  size_t s = M.addTrack();
+  assert(M.getTypeId(s) == DTSC::INVALID && M.getCodecId(s) == DTSC::CODEC_OTHER);
+  M.setType(s, "meta");
+  M.setCodec(s, "subtitle");
+  DTSC::Meta R(streamName, false);
+  checkMatches(M, M.getValidTracks());
+  checkMatches(R, R.getValidTracks());
+  assert(R.getTypeId(v) == DTSC::VIDEO && R.getCodecId(v) == DTSC::CODEC_H264);
+  assert(R.getTypeId(s) == DTSC::META && R.getCodecId(s) == DTSC::CODEC_SUBTITLE);
+
+  // Changes made by the master must be picked up, by the master and by the reader
+  M.setCodec(a, "opus");
+  M.setCodec(v, "SomeNewCodec");
+  checkMatches(M, M.getValidTracks());
+  checkMatches(R, R.getValidTracks());
+  assert(R.getCodecId(a) == DTSC::CODEC_OPUS && R.getCodecId(v) == DTSC::CODEC_OTHER);
+
+  // A removed track index that gets reused must not keep the old ids
+  M.removeTrack(a);
+  size_t b = M.addTrack();
+  M.setType(b, "video");
+  M.setCodec(b, "HEVC");
+  R.reloadReplacedPagesIfNeeded();
+  R.refresh();
+  checkMatches(M, M.getValidTracks());
+  checkMatches(R, R.getValidTracks());
+  assert(M.getTypeId(b) == DTSC::VIDEO && M.getCodecId(b) == DTSC::CODEC_HEVC);
+
+  // The checks TSOutput::sendNext does for every packet, on a video and an audio track
+  M.setCodec(v, "H264");
+  std::set<size_t> tracks = M.getValidTracks();
+  size_t packets = (argc > 1 ? atoi(argv[1]) : 1000000);
+  size_t sum = 0;
+  uint64_t oldAllocs = allocs;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < packets; ++i){
+    size_t idx = (i % 2) ? v : b;
+    std::string type = M.getType(idx);
+    std::string codec = M.getCodec(idx);
+    if (type == "video"){
+      if (codec == "H264" || codec == "HEVC"){sum += (codec == "H264" ? 1 : 2);}
+    }else if (type == "audio"){
+      if (codec == "AAC" || codec == "opus"){sum += 3;}
+    }
+  }
+  uint64_t oldTime = Util::getMicros(start);
+  oldAllocs = allocs - oldAllocs;
+  uint64_t newAllocs = allocs;
+  start = Util::getMicros();
+  for (size_t i = 0; i < packets; ++i){
+    size_t idx = (i % 2) ? v : b;
+    DTSC::datatype type = M.getTypeId(idx);
+    DTSC::codecId codec = M.getCodecId(idx);
+    if (type == DTSC::VIDEO){
+      if (codec == DTSC::CODEC_H264 || codec == DTSC::CODEC_HEVC){
+        sum -= (codec == DTSC::CODEC_H264 ? 1 : 2);
+      }
+    }else if (type == DTSC::AUDIO){
+      if (codec == DTSC::CODEC_AAC || codec == DTSC::CODEC_OPUS){sum -= 3;}
+    }
+  }
+  uint64_t newTime = Util::getMicros(start);
+  newAllocs = allocs - newAllocs;
+  assert(!sum);
+  std::cout << packets << " packets on " << tracks.size() << " tracks" << std::endl;
+  std::cout << "getType/getCodec: " << oldTime * 1000 / packets << "ns and " << oldAllocs * 1000.0 / packets
+            << " allocations per 1000 packets" << std::endl;
+  std::cout << "getTypeId/getCodecId: " << newTime * 1000 / packets << "ns and "
+            << newAllocs * 1000.0 / packets << " allocations per 1000 packets" << std::endl;
+  R.clear();
+  M.clear();
+  return 0;
+}
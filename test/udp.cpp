@@ -0,0 +1,136 @@
+/// \file udp.cpp
+/// Sends datagrams over loopback through Socket::UDPConnection and checks they all arrive intact,
+/// in order and with the right sender, both with and without send batching. Then compares the
+/// packets/sec and CPU time of plain sendto/recvfrom against the (batched) UDPConnection calls.
+/// Pass a packet count as argument to change the amount of packets used for the benchmark.
+
+#include <cassert>
+#include <iostream>
+#include <mist/bitfields.h>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define PACKET_SIZE 1200
+#define BURST 64
+
+/// Returns the user plus system CPU time used by this process so far, in microseconds.
+uint64_t cpuMicros(){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec +
+         usage.ru_stime.tv_usec;
+}
+
+/// Reads the sequence number fillPacket wrote, from unsigned bytes so it is never sign-extended
+uint32_t packetSeq(const char *buf){
+  const uint8_t *p = (const uint8_t *)buf;
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void fillPacket(char *buf, uint32_t seq){
+  memset(buf, seq & 0xFF, PACKET_SIZE);
+  Bit::htobl(buf, seq);
+}
+
+/// Sends count packets from sender to receiver in bursts, receiving each burst before the next
+/// one is sent so the receive buffer never overflows. Returns the amount of packets received.
+size_t transfer(Socket::UDPConnection &sender, Socket::UDPConnection &receiver, uint16_t senderPort,
+                size_t count, bool batched, bool verify){
+  char buf[PACKET_SIZE];
+  size_t received = 0;
+  for (size_t sent = 0; sent < count;){
+    if (batched){sender.beginSendBatch();}
+    size_t burstEnd = sent + BURST;
+    for (; sent < count && sent < burstEnd; ++sent){
+      fillPacket(buf, sent);
+      sender.SendNow(buf, PACKET_SIZE);
+    }
+    if (batched){sender.endSendBatch();}
+    uint64_t waitStart = Util::getMS();
+    while (received < sent && Util::getMS() - waitStart < 1000){
+      if (!receiver.Receive()){continue;}
+      if (verify){
+        assert(receiver.data.size() == PACKET_SIZE);
+        assert(packetSeq(receiver.data) == received);
+        assert((uint8_t)receiver.data[PACKET_SIZE - 1] == (received & 0xFF));
+        assert(receiver.getDestPort() == senderPort);
+      }
+      ++received;
+    }
+  }
+  return received;
+}
+
+/// Same as transfer, but with plain sendto/recvfrom calls on the same sockets.
+size_t transferPlain(Socket::UDPConnection &sender, Socket::UDPConnection &receiver, size_t count){
+  char buf[PACKET_SIZE];
+  char rbuf[2048];
+  size_t received = 0;
+  for (size_t sent = 0; sent < count;){
+    size_t burstEnd = sent + BURST;
+    for (; sent < count && sent < burstEnd; ++sent){
+      fillPacket(buf, sent);
+      sendto(sender.getSock(), buf, PACKET_SIZE, 0, (const sockaddr *)sender.getDestAddr(), sender.getDestAddrLen());
+    }
+    uint64_t waitStart = Util::getMS();
+    while (received < sent && Util::getMS() - waitStart < 1000){
+      struct sockaddr_storage from;
+      socklen_t fromLen = sizeof(from);
+      if (recvfrom(receiver.getSock(), rbuf, sizeof(rbuf), MSG_TRUNC | MSG_DONTWAIT, (sockaddr *)&from, &fromLen) > 0){
+        ++received;
+      }
+    }
+  }
+  return received;
+}
+
+void printSpeed(const char *name, size_t packets, uint64_t micros, uint64_t cpu){
+  if (!micros){micros = 1;}
+  std::cout << name << ": " << (packets * 1000000 / micros) << " packets/s, " << (cpu * 1000 / packets)
+            << "ns CPU per packet" << std::endl;
+}
+
+int main(int argc, char **argv){
+  Util::redirectLogsIfNeeded();
+  Socket::UDPConnection receiver(true), sender(true);
+  uint16_t recvPort = receiver.bind(0, "127.0.0.1");
+  uint16_t sendPort = sender.bind(0, "127.0.0.1");
+  assert(recvPort && sendPort);
+  sender.SetDestination("127.0.0.1", recvPort);
+  // Replies go back to the sender; Receive must overwrite this with the real sender every time
+  receiver.SetDestination("127.0.0.1", 9);
+
+  assert(transfer(sender, receiver, sendPort, 1000, false, true) == 1000);
+  assert(transfer(sender, receiver, sendPort, 1000, true, true) == 1000);
+  assert(!receiver.Receive());
+
+  // Datagrams larger than the receive buffer come in truncated and grow it, later ones arrive intact
+  std::string big(5000, 'x');
+  for (size_t i = 0; i < 3; ++i){
+    sender.SendNow(big);
+    Util::sleep(10);
+    assert(receiver.Receive());
+    assert(receiver.data.size() && receiver.data.size() <= big.size());
+    assert(!memcmp(receiver.data, big.data(), receiver.data.size()));
+  }
+  assert(receiver.data.size() == big.size() && !memcmp(receiver.data, big.data(), big.size()));
+
+  size_t count = (argc > 1 ? atoi(argv[1]) : 200000);
+  uint64_t start = Util::getMicros();
+  uint64_t cpu = cpuMicros();
+  size_t got = transferPlain(sender, receiver, count);
+  printSpeed("sendto/recvfrom", got, Util::getMicros(start), cpuMicros() - cpu);
+  start = Util::getMicros();
+  cpu = cpuMicros();
+  got = transfer(sender, receiver, sendPort, count, false, false);
+  printSpeed("SendNow/Receive", got, Util::getMicros(start), cpuMicros() - cpu);
+  start = Util::getMicros();
+  cpu = cpuMicros();
+  got = transfer(sender, receiver, sendPort, count, true, false);
+  printSpeed("batched SendNow/Receive", got, Util::getMicros(start), cpuMicros() - cpu);
+  return 0;
+}
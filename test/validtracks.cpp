@@ -0,0 +1,97 @@
+/// \file validtracks.cpp
+/// Tests that the cached valid track bitmap follows getValidTracks(), both in the process that
+/// changes the tracks and in a reader of the same shared metadata. Also checks a track that is not
+/// ready while the bitmap is built, like one being resized, turns valid once it is ready.
+
+#include <cassert>
+#include <iostream>
+#include <mist/defines.h>
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/// Asserts isValidTrack() and getValidTrackCount() agree with getValidTracks()
+void checkMatches(const DTSC::Meta &M, size_t maxIdx){
+  std::set<size_t> valid = M.getValidTracks();
+  assert(M.getValidTrackCount() == valid.size());
+  for (size_t i = 0; i < maxIdx; ++i){assert(M.isValidTrack(i) == (bool)valid.count(i));}
+}
+
+/// Times both ways of checking a track for validity, with the given amount of tracks
+void benchmark(size_t trackCount){
+  char streamName[64];
+  snprintf(streamName, 64, "validtracks_bench_%d_%zu", (int)getpid(), trackCount);
+  DTSC::Meta M(streamName, true);
+  for (size_t i = 0; i < trackCount; ++i){M.setType(M.addTrack(), "video");}
+  checkMatches(M, trackCount + 2);
+
+  size_t loops = 100000;
+  size_t hits = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){hits += M.getValidTracks().count(i % trackCount);}
+  uint64_t setTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){hits += M.isValidTrack(i % trackCount);}
+  uint64_t cacheTime = Util::getMicros(start);
+  assert(hits == loops * 2);
+  std::cout << trackCount << " tracks: getValidTracks().count() " << (setTime * 1000 / loops)
+            << "ns, isValidTrack() " << (cacheTime * 1000 / loops) << "ns per check" << std::endl;
+  M.clear();
+}
+
+int main(int argc, char **argv){
+  char streamName[64];
+  snprintf(streamName, 64, "validtracks_%d", (int)getpid());
+  DTSC::Meta M(streamName, true);
+  size_t a = M.addTrack();
+  M.setType(a, "video");
+  size_t b = M.addTrack();
+  M.setType(b, "audio");
+  checkMatches(M, 4);
+  assert(M.isValidTrack(a) && M.isValidTrack(b));
+  assert(!M.isValidTrack(b + 1));
+
+  DTSC::Meta R(streamName, false);
+  checkMatches(R, 4);
+  assert(R.getValidTrackCount() == 2);
+
+  // Changes made by the master must be picked up by the reader
+  M.removeTrack(a);
+  checkMatches(M, 4);
+  assert(!M.isValidTrack(a) && M.getValidTrackCount() == 1);
+  checkMatches(R, 4);
+  assert(!R.isValidTrack(a));
+
+  size_t c = M.addTrack();
+  M.setType(c, "video");
+  R.reloadReplacedPagesIfNeeded();
+  R.refresh();
+  checkMatches(M, 4);
+  checkMatches(R, 4);
+  assert(R.isValidTrack(c));
+
+  // A track that is not ready while the bitmap is built
+  size_t d = M.addTrack();
+  M.setType(d, "audio");
+  char pageName[NAME_BUFFER_SIZE];
+  snprintf(pageName, NAME_BUFFER_SIZE, SHM_STREAM_TM, streamName, (uint32_t)getpid(), d);
+  IPC::sharedPage trackPage(pageName, 0, false, false);
+  assert(trackPage.mapped);
+  trackPage.mapped[0] &= ~1;
+  M.refresh();
+  checkMatches(M, 5);
+  assert(!M.isValidTrack(d));
+  // Becoming ready changes nothing else, but must still be picked up
+  trackPage.mapped[0] |= 1;
+  assert(M.isValidTrack(d));
+  checkMatches(M, 5);
+
+  R.clear();
+  M.clear();
+
+  benchmark(2);
+  benchmark(8);
+  benchmark(64);
+  return 0;
+}